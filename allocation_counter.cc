@@ -0,0 +1,159 @@
+//
+// Copyright (C) 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+
+#include "dhcp_client/allocation_counter.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+
+namespace {
+thread_local size_t g_allocation_count = 0;
+
+void* Allocate(size_t size) {
+  g_allocation_count++;
+  // malloc(0) may return null, operator new may not.
+  return malloc(size == 0 ? 1 : size);
+}
+
+#if defined(__cpp_aligned_new)
+void* AllocateAligned(size_t size, std::align_val_t alignment) {
+  g_allocation_count++;
+  void* pointer = nullptr;
+  // posix_memalign wants at least the alignment of a pointer.
+  size_t alignment_bytes =
+      std::max(static_cast<size_t>(alignment), sizeof(void*));
+  if (posix_memalign(&pointer, alignment_bytes, size == 0 ? 1 : size) != 0) {
+    return nullptr;
+  }
+  return pointer;
+}
+#endif  // __cpp_aligned_new
+}  // namespace
+
+void* operator new(size_t size) {
+  void* pointer = Allocate(size);
+  if (pointer == nullptr) {
+    // Builds without exceptions can not throw std::bad_alloc, fail the
+    // way their allocator does.
+    abort();
+  }
+  return pointer;
+}
+
+void* operator new[](size_t size) {
+  return operator new(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+  return Allocate(size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+  return Allocate(size);
+}
+
+void operator delete(void* pointer) noexcept {
+  free(pointer);
+}
+
+void operator delete[](void* pointer) noexcept {
+  free(pointer);
+}
+
+void operator delete(void* pointer, size_t size) noexcept {
+  free(pointer);
+}
+
+void operator delete[](void* pointer, size_t size) noexcept {
+  free(pointer);
+}
+
+void operator delete(void* pointer, const std::nothrow_t&) noexcept {
+  free(pointer);
+}
+
+void operator delete[](void* pointer, const std::nothrow_t&) noexcept {
+  free(pointer);
+}
+
+// The over-aligned allocations of C++17, counted the same way.
+#if defined(__cpp_aligned_new)
+void* operator new(size_t size, std::align_val_t alignment) {
+  void* pointer = AllocateAligned(size, alignment);
+  if (pointer == nullptr) {
+    abort();
+  }
+  return pointer;
+}
+
+void* operator new[](size_t size, std::align_val_t alignment) {
+  return operator new(size, alignment);
+}
+
+void* operator new(size_t size,
+                   std::align_val_t alignment,
+                   const std::nothrow_t&) noexcept {
+  return AllocateAligned(size, alignment);
+}
+
+void* operator new[](size_t size,
+                     std::align_val_t alignment,
+                     const std::nothrow_t&) noexcept {
+  return AllocateAligned(size, alignment);
+}
+
+void operator delete(void* pointer, std::align_val_t alignment) noexcept {
+  free(pointer);
+}
+
+void operator delete[](void* pointer, std::align_val_t alignment) noexcept {
+  free(pointer);
+}
+
+void operator delete(void* pointer,
+                     size_t size,
+                     std::align_val_t alignment) noexcept {
+  free(pointer);
+}
+
+void operator delete[](void* pointer,
+                       size_t size,
+                       std::align_val_t alignment) noexcept {
+  free(pointer);
+}
+
+void operator delete(void* pointer,
+                     std::align_val_t alignment,
+                     const std::nothrow_t&) noexcept {
+  free(pointer);
+}
+
+void operator delete[](void* pointer,
+                       std::align_val_t alignment,
+                       const std::nothrow_t&) noexcept {
+  free(pointer);
+}
+#endif  // __cpp_aligned_new
+
+namespace dhcp_client {
+
+size_t GetThreadAllocationCount() {
+  return g_allocation_count;
+}
+
+}  // namespace dhcp_client
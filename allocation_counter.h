@@ -0,0 +1,48 @@
+//
+// Copyright (C) 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+
+#ifndef DHCP_CLIENT_ALLOCATION_COUNTER_H_
+#define DHCP_CLIENT_ALLOCATION_COUNTER_H_
+
+#include <cstddef>
+
+#include <gtest/gtest.h>
+
+namespace dhcp_client {
+
+// Heap allocations made by the calling thread so far. Counted by the
+// global operator new of allocation_counter.cc, which replaces the
+// default one in the binaries it is linked in.
+size_t GetThreadAllocationCount();
+
+// Test fixture checking the allocations of a piece of code against
+// a budget. Only the test thread is counted, so the threads of the
+// code under test do not make the counts flaky.
+class AllocationBudgetTest : public testing::Test {
+ protected:
+  // Returns the number of allocations made while running |function|.
+  template <typename Function>
+  static size_t CountAllocations(Function function) {
+    size_t start = GetThreadAllocationCount();
+    function();
+    return GetThreadAllocationCount() - start;
+  }
+};
+
+}  // namespace dhcp_client
+
+#endif  // DHCP_CLIENT_ALLOCATION_COUNTER_H_
@@ -0,0 +1,262 @@
+//
+// Copyright (C) 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "dhcp_client/batched_socket.h"
+
+#include <linux/if_packet.h>
+#include <sys/uio.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include <base/bind.h>
+#include <base/logging.h>
+
+using base::Bind;
+using shill::ByteString;
+
+namespace dhcp_client {
+
+namespace {
+// Large enough for any DHCP message on an Ethernet link.
+const size_t kMaxFrameLength = 1 << 12;
+// Bound the work done per wakeup.
+const size_t kMaxBatchesPerWakeup = 4;
+// Bound the memory used by frames waiting to be sent.
+const size_t kMaxQueuedFrames = 1024;
+
+// Room for the PACKET_AUXDATA control message of a frame.
+union ControlBuffer {
+  struct cmsghdr header;
+  uint8_t data[CMSG_SPACE(sizeof(struct tpacket_auxdata))];
+};
+
+// Returns the tp_status reported in the PACKET_AUXDATA control message
+// of |message|, 0 if there is none.
+uint32_t GetPacketStatus(struct msghdr* message) {
+  for (struct cmsghdr* control = CMSG_FIRSTHDR(message);
+       control != nullptr;
+       control = CMSG_NXTHDR(message, control)) {
+    if (control->cmsg_level == SOL_PACKET &&
+        control->cmsg_type == PACKET_AUXDATA &&
+        control->cmsg_len >= CMSG_LEN(sizeof(struct tpacket_auxdata))) {
+      struct tpacket_auxdata auxdata;
+      memcpy(&auxdata, CMSG_DATA(control), sizeof(auxdata));
+      return auxdata.tp_status;
+    }
+  }
+  return 0;
+}
+}  // namespace
+
+bool BatchedSocket::EnablePacketStatus(Sockets* sockets, int fd) {
+  int enable = 1;
+  if (sockets->SetSockOpt(fd, SOL_PACKET, PACKET_AUXDATA,
+                          &enable, sizeof(enable)) != 0) {
+    PLOG(WARNING) << "Failed to enable PACKET_AUXDATA";
+    return false;
+  }
+  return true;
+}
+
+const size_t BatchedSocket::kBatchSize;
+const size_t BatchedSocket::kMaxSegments;
+
+BatchedSocket::Stats::Stats()
+    : receive_batch_sizes(kBatchSize + 1, 0),
+      send_batch_sizes(kBatchSize + 1, 0),
+      frames_received(0),
+      frames_sent(0),
+      receive_errors(0),
+      send_errors(0) {
+}
+
+BatchedSocket::BatchedSocket(Sockets* sockets,
+                             int fd,
+                             EventDispatcherInterface* event_dispatcher,
+                             size_t receive_batch_size)
+    : sockets_(sockets),
+      fd_(fd),
+      event_dispatcher_(event_dispatcher),
+      receive_batch_size_(std::max<size_t>(
+          1, std::min(receive_batch_size, kBatchSize))),
+      flush_posted_(false),
+      flush_count_(0),
+      weak_ptr_factory_(this) {
+}
+
+BatchedSocket::~BatchedSocket() {}
+
+size_t BatchedSocket::Receive(const ReceiveCallback& callback) {
+  // The callback may destroy this object.
+  base::WeakPtr<BatchedSocket> self = weak_ptr_factory_.GetWeakPtr();
+  if (receive_buffer_.empty()) {
+    receive_buffer_.resize(receive_batch_size_ * kMaxFrameLength);
+  }
+  size_t frame_count = 0;
+  for (size_t batch = 0; batch < kMaxBatchesPerWakeup; batch++) {
+    struct mmsghdr messages[kBatchSize];
+    struct iovec iovecs[kBatchSize];
+    struct sockaddr_storage addresses[kBatchSize];
+    ControlBuffer controls[kBatchSize];
+    memset(messages, 0, sizeof(messages));
+    for (size_t i = 0; i < receive_batch_size_; i++) {
+      messages[i].msg_hdr.msg_control = &controls[i];
+      messages[i].msg_hdr.msg_controllen = sizeof(controls[i]);
+      iovecs[i].iov_base = &receive_buffer_[i * kMaxFrameLength];
+      iovecs[i].iov_len = kMaxFrameLength;
+      messages[i].msg_hdr.msg_iov = &iovecs[i];
+      messages[i].msg_hdr.msg_iovlen = 1;
+      messages[i].msg_hdr.msg_name = &addresses[i];
+      messages[i].msg_hdr.msg_namelen = sizeof(addresses[i]);
+    }
+    int count = sockets_->RecvMmsg(fd_, messages, receive_batch_size_,
+                                   MSG_DONTWAIT);
+    if (count < 0) {
+      if (errno != EAGAIN && errno != EWOULDBLOCK) {
+        PLOG(ERROR) << "Failed to receive frames";
+      }
+      break;
+    }
+    stats_.receive_batch_sizes[count]++;
+    for (int i = 0; i < count; i++) {
+      if (messages[i].msg_hdr.msg_flags & MSG_TRUNC) {
+        LOG(ERROR) << "Dropping oversized frame";
+        stats_.receive_errors++;
+        continue;
+      }
+      stats_.frames_received++;
+      frame_count++;
+      callback.Run(static_cast<unsigned char*>(iovecs[i].iov_base),
+                   messages[i].msg_len,
+                   reinterpret_cast<struct sockaddr*>(&addresses[i]),
+                   GetPacketStatus(&messages[i].msg_hdr));
+      if (!self) {
+        return frame_count;
+      }
+    }
+    if (static_cast<size_t>(count) < receive_batch_size_) {
+      // The socket is drained.
+      break;
+    }
+  }
+  return frame_count;
+}
+
+bool BatchedSocket::Send(const ByteString& frame,
+                         const struct sockaddr* address,
+                         socklen_t address_length) {
+  PendingFrame* pending = Enqueue(address, address_length);
+  if (pending == nullptr) {
+    return false;
+  }
+  pending->frame = frame;
+  pending->segment_count = 0;
+  ScheduleFlush();
+  return true;
+}
+
+bool BatchedSocket::Send(const struct iovec* segments,
+                         size_t segment_count,
+                         const struct sockaddr* address,
+                         socklen_t address_length) {
+  if (segment_count == 0 || segment_count > kMaxSegments) {
+    LOG(ERROR) << "Invalid number of segments: " << segment_count;
+    stats_.send_errors++;
+    return false;
+  }
+  PendingFrame* pending = Enqueue(address, address_length);
+  if (pending == nullptr) {
+    return false;
+  }
+  pending->frame.Clear();
+  memcpy(pending->segments, segments, segment_count * sizeof(*segments));
+  pending->segment_count = segment_count;
+  ScheduleFlush();
+  return true;
+}
+
+BatchedSocket::PendingFrame* BatchedSocket::Enqueue(
+    const struct sockaddr* address,
+    socklen_t address_length) {
+  if (send_queue_.size() >= kMaxQueuedFrames ||
+      address_length > sizeof(struct sockaddr_storage)) {
+    LOG(ERROR) << "Unable to queue frame";
+    stats_.send_errors++;
+    return nullptr;
+  }
+  send_queue_.push_back(PendingFrame());
+  PendingFrame* pending = &send_queue_.back();
+  memset(&pending->address, 0, sizeof(pending->address));
+  if (address != nullptr) {
+    memcpy(&pending->address, address, address_length);
+  }
+  pending->address_length = address != nullptr ? address_length : 0;
+  return pending;
+}
+
+void BatchedSocket::ScheduleFlush() {
+  if (flush_posted_) {
+    return;
+  }
+  flush_posted_ = event_dispatcher_->PostTask(
+      Bind(&BatchedSocket::Flush, weak_ptr_factory_.GetWeakPtr()));
+  if (!flush_posted_) {
+    // Without an event loop the frame has to go out right away.
+    Flush();
+  }
+}
+
+void BatchedSocket::Flush() {
+  flush_posted_ = false;
+  flush_count_++;
+  size_t next = 0;
+  while (next < send_queue_.size()) {
+    size_t count = std::min(kBatchSize, send_queue_.size() - next);
+    struct mmsghdr messages[kBatchSize];
+    memset(messages, 0, sizeof(messages));
+    for (size_t i = 0; i < count; i++) {
+      PendingFrame* pending = &send_queue_[next + i];
+      if (pending->segment_count == 0) {
+        pending->segments[0].iov_base = pending->frame.GetData();
+        pending->segments[0].iov_len = pending->frame.GetLength();
+        pending->segment_count = 1;
+      }
+      messages[i].msg_hdr.msg_iov = pending->segments;
+      messages[i].msg_hdr.msg_iovlen = pending->segment_count;
+      if (pending->address_length != 0) {
+        messages[i].msg_hdr.msg_name = &pending->address;
+        messages[i].msg_hdr.msg_namelen = pending->address_length;
+      }
+    }
+    int sent = sockets_->SendMmsg(fd_, messages, count, 0);
+    if (sent <= 0) {
+      // sendmmsg stops at the first frame that fails, drop it and go on
+      // with the rest.
+      PLOG(ERROR) << "Failed to send frame";
+      stats_.send_errors++;
+      next++;
+      continue;
+    }
+    stats_.send_batch_sizes[sent]++;
+    stats_.frames_sent += sent;
+    next += sent;
+  }
+  send_queue_.clear();
+}
+
+}  // namespace dhcp_client
@@ -0,0 +1,148 @@
+//
+// Copyright (C) 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef DHCP_CLIENT_BATCHED_SOCKET_H_
+#define DHCP_CLIENT_BATCHED_SOCKET_H_
+
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <base/callback.h>
+#include <base/macros.h>
+#include <base/memory/weak_ptr.h>
+#include <shill/net/byte_string.h>
+
+#include "dhcp_client/event_dispatcher_interface.h"
+#include "dhcp_client/sockets.h"
+
+namespace dhcp_client {
+
+// Batched I/O on a datagram socket.
+// Receiving drains the socket with recvmmsg, and the frames queued for
+// sending during one event loop iteration go out with a single sendmmsg
+// from a task posted on the dispatcher.
+class BatchedSocket {
+ public:
+  // Maximum number of frames per recvmmsg/sendmmsg call.
+  static const size_t kBatchSize = 16;
+  // Maximum number of segments of a frame sent in place.
+  static const size_t kMaxSegments = 2;
+
+  // Called for every received frame. |buffer| and |address| are only
+  // valid during the call. |status| holds the TP_STATUS_* bits reported
+  // for a packet socket frame, see EnablePacketStatus(), 0 otherwise.
+  typedef base::Callback<void(const unsigned char* buffer,
+                              size_t len,
+                              const struct sockaddr* address,
+                              uint32_t status)>
+      ReceiveCallback;
+
+  struct Stats {
+    Stats();
+    // |receive_batch_sizes[n]| is the number of recvmmsg calls that
+    // returned n frames, the same goes for |send_batch_sizes|.
+    std::vector<uint64_t> receive_batch_sizes;
+    std::vector<uint64_t> send_batch_sizes;
+    uint64_t frames_received;
+    uint64_t frames_sent;
+    // Frames dropped because they did not fit the receive buffer,
+    // or failed to send.
+    uint64_t receive_errors;
+    uint64_t send_errors;
+  };
+
+  // |sockets| and |fd| are not owned. A recvmmsg call reads up to
+  // |receive_batch_size| frames, at most kBatchSize. Every frame of a
+  // batch gets its own 4 KB receive slot, allocated on the first
+  // Receive(): a socket serving a single client needs one slot, the
+  // shared socket of a PacketDemuxer a full batch.
+  BatchedSocket(Sockets* sockets,
+                int fd,
+                EventDispatcherInterface* event_dispatcher,
+                size_t receive_batch_size);
+  ~BatchedSocket();
+
+  // Have the kernel report the status of every frame received on the
+  // packet socket |fd| with PACKET_AUXDATA, in particular whether its
+  // checksum was verified already.
+  static bool EnablePacketStatus(Sockets* sockets, int fd);
+
+  // Read the frames pending on the socket and pass them to |callback|.
+  // Reads at most a few batches so a busy socket cannot starve the
+  // event loop. Returns the number of frames read.
+  size_t Receive(const ReceiveCallback& callback);
+
+  // Queue |frame| for |address|, it is sent once the current event loop
+  // iteration is done. Returns false if the queue is full.
+  bool Send(const shill::ByteString& frame,
+            const struct sockaddr* address,
+            socklen_t address_length);
+  // Same, but the frame made of the |segment_count| |segments| is not
+  // copied: sendmmsg gathers it from where it is. The segments must be
+  // left untouched until the next Flush(), see flush_count().
+  bool Send(const struct iovec* segments,
+            size_t segment_count,
+            const struct sockaddr* address,
+            socklen_t address_length);
+  // Send the queued frames now.
+  void Flush();
+
+  // Number of Flush() calls so far. A frame queued in place is sent once
+  // this changes.
+  uint64_t flush_count() const { return flush_count_; }
+  const Stats& stats() const { return stats_; }
+
+ private:
+  struct PendingFrame {
+    // Copy of the frame, unless it is sent in place from |segments|.
+    shill::ByteString frame;
+    struct iovec segments[kMaxSegments];
+    size_t segment_count;
+    struct sockaddr_storage address;
+    socklen_t address_length;
+  };
+
+  // Add an entry for a frame to |address| to the send queue, and make
+  // sure it is flushed. Returns null if the queue is full.
+  PendingFrame* Enqueue(const struct sockaddr* address,
+                        socklen_t address_length);
+  // Flush the queue at the end of this event loop iteration.
+  void ScheduleFlush();
+
+  Sockets* sockets_;
+  int fd_;
+  EventDispatcherInterface* event_dispatcher_;
+  size_t receive_batch_size_;
+  // Receive slots, one per frame of a batch. Empty until the first
+  // Receive().
+  std::vector<unsigned char> receive_buffer_;
+  std::vector<PendingFrame> send_queue_;
+  bool flush_posted_;
+  uint64_t flush_count_;
+  Stats stats_;
+
+  base::WeakPtrFactory<BatchedSocket> weak_ptr_factory_;
+
+  DISALLOW_COPY_AND_ASSIGN(BatchedSocket);
+};
+
+}  // namespace dhcp_client
+
+#endif  // DHCP_CLIENT_BATCHED_SOCKET_H_
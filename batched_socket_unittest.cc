@@ -0,0 +1,304 @@
+//
+// Copyright (C) 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "dhcp_client/batched_socket.h"
+
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <vector>
+
+#include <base/bind.h>
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include <shill/net/byte_string.h>
+
+#include "dhcp_client/mock_event_dispatcher.h"
+#include "dhcp_client/mock_sockets.h"
+#include "dhcp_client/simulated_event_dispatcher.h"
+
+using base::Bind;
+using base::Unretained;
+using shill::ByteString;
+using ::testing::_;
+using ::testing::Invoke;
+using ::testing::NiceMock;
+using ::testing::Return;
+
+namespace dhcp_client {
+
+namespace {
+const int kFakeFd = 99;
+const size_t kFakeFrameLength = 300;
+
+ByteString MakeFrame(unsigned char value) {
+  std::vector<unsigned char> frame(kFakeFrameLength, value);
+  return ByteString(frame.data(), frame.size());
+}
+}  // namespace
+
+class BatchedSocketTest : public testing::Test {
+ public:
+  BatchedSocketTest() : frame_count_(0) {}
+
+  void SetUp() {
+    ON_CALL(sockets_, SendMmsg(kFakeFd, _, _, _))
+        .WillByDefault(Invoke(this, &BatchedSocketTest::SendMessages));
+    ON_CALL(sockets_, RecvMmsg(kFakeFd, _, _, _))
+        .WillByDefault(Invoke(this, &BatchedSocketTest::ReceiveMessages));
+    batched_socket_.reset(new BatchedSocket(&sockets_, kFakeFd, &dispatcher_,
+                                            BatchedSocket::kBatchSize));
+  }
+
+  void OnFrame(const unsigned char* buffer,
+               size_t len,
+               const struct sockaddr* address,
+               uint32_t status) {
+    EXPECT_EQ(kFakeFrameLength, len);
+    // Only packet sockets report a status.
+    EXPECT_EQ(0u, status);
+    EXPECT_EQ(frame_count_, buffer[0]);
+    frame_count_++;
+  }
+
+  // sendmmsg: gathers the frames of the batch into |sent_frames_|.
+  int SendMessages(int fd,
+                   struct mmsghdr* messages,
+                   unsigned int vlen,
+                   int flags) {
+    send_batch_sizes_.push_back(vlen);
+    for (unsigned int i = 0; i < vlen; i++) {
+      const struct msghdr& header = messages[i].msg_hdr;
+      ByteString frame;
+      for (size_t j = 0; j < header.msg_iovlen; j++) {
+        frame.Append(ByteString(
+            static_cast<unsigned char*>(header.msg_iov[j].iov_base),
+            header.msg_iov[j].iov_len));
+      }
+      sent_frames_.push_back(frame);
+    }
+    return static_cast<int>(vlen);
+  }
+
+  // recvmmsg on a non blocking socket: fills the batch from
+  // |pending_frames_|, and fails with EAGAIN once they run out.
+  int ReceiveMessages(int fd,
+                      struct mmsghdr* messages,
+                      unsigned int vlen,
+                      int flags) {
+    EXPECT_TRUE(flags & MSG_DONTWAIT);
+    if (pending_frames_.empty()) {
+      errno = EAGAIN;
+      return -1;
+    }
+    size_t count = std::min<size_t>(vlen, pending_frames_.size());
+    for (size_t i = 0; i < count; i++) {
+      const ByteString& frame = pending_frames_.front();
+      struct msghdr* header = &messages[i].msg_hdr;
+      EXPECT_GE(header->msg_iov[0].iov_len, frame.GetLength());
+      memcpy(header->msg_iov[0].iov_base, frame.GetConstData(),
+             frame.GetLength());
+      messages[i].msg_len = frame.GetLength();
+      header->msg_controllen = 0;
+      pending_frames_.pop_front();
+    }
+    receive_batch_sizes_.push_back(count);
+    return static_cast<int>(count);
+  }
+
+ protected:
+  // Checks that the frames sent are the ones made by MakeFrame(i).
+  void ExpectSentFrames(size_t count) {
+    ASSERT_EQ(count, sent_frames_.size());
+    for (size_t i = 0; i < count; i++) {
+      EXPECT_TRUE(sent_frames_[i].Equals(MakeFrame(i)));
+    }
+  }
+
+  NiceMock<MockSockets> sockets_;
+  SimulatedEventDispatcher dispatcher_;
+  std::unique_ptr<BatchedSocket> batched_socket_;
+  size_t frame_count_;
+  std::vector<ByteString> sent_frames_;
+  std::vector<size_t> send_batch_sizes_;
+  std::deque<ByteString> pending_frames_;
+  std::vector<size_t> receive_batch_sizes_;
+};
+
+TEST_F(BatchedSocketTest, SendCoalescesFramesOfOneIteration) {
+  const size_t kFrames = 5;
+  for (size_t i = 0; i < kFrames; i++) {
+    EXPECT_TRUE(batched_socket_->Send(MakeFrame(i), nullptr, 0));
+  }
+  // Nothing goes out before the event loop runs the flush task.
+  EXPECT_EQ(1u, dispatcher_.pending_task_count());
+  EXPECT_TRUE(sent_frames_.empty());
+
+  dispatcher_.RunFor(0);
+  ExpectSentFrames(kFrames);
+  EXPECT_EQ(std::vector<size_t>({kFrames}), send_batch_sizes_);
+  const BatchedSocket::Stats& stats = batched_socket_->stats();
+  EXPECT_EQ(1u, stats.send_batch_sizes[kFrames]);
+  EXPECT_EQ(kFrames, stats.frames_sent);
+  EXPECT_EQ(0u, stats.send_errors);
+}
+
+TEST_F(BatchedSocketTest, SendSplitsLargeQueue) {
+  const size_t kFrames = BatchedSocket::kBatchSize + 3;
+  for (size_t i = 0; i < kFrames; i++) {
+    EXPECT_TRUE(batched_socket_->Send(MakeFrame(i), nullptr, 0));
+  }
+  dispatcher_.RunFor(0);
+  ExpectSentFrames(kFrames);
+  EXPECT_EQ(std::vector<size_t>({BatchedSocket::kBatchSize, 3}),
+            send_batch_sizes_);
+  const BatchedSocket::Stats& stats = batched_socket_->stats();
+  EXPECT_EQ(1u, stats.send_batch_sizes[BatchedSocket::kBatchSize]);
+  EXPECT_EQ(1u, stats.send_batch_sizes[3]);
+}
+
+TEST_F(BatchedSocketTest, SendWithoutEventLoop) {
+  NiceMock<MockEventDispatcher> dispatcher;
+  EXPECT_CALL(dispatcher, PostTask(_)).WillOnce(Return(false));
+  batched_socket_.reset(new BatchedSocket(&sockets_, kFakeFd, &dispatcher,
+                                          BatchedSocket::kBatchSize));
+  EXPECT_TRUE(batched_socket_->Send(MakeFrame(0), nullptr, 0));
+  ExpectSentFrames(1);
+  EXPECT_EQ(std::vector<size_t>({1}), send_batch_sizes_);
+  EXPECT_EQ(1u, batched_socket_->stats().send_batch_sizes[1]);
+}
+
+TEST_F(BatchedSocketTest, SendDropsFailedFrame) {
+  const size_t kFrames = 3;
+  for (size_t i = 0; i < kFrames; i++) {
+    EXPECT_TRUE(batched_socket_->Send(MakeFrame(i), nullptr, 0));
+  }
+  // The first frame fails, the others go out in the next call.
+  EXPECT_CALL(sockets_, SendMmsg(kFakeFd, _, kFrames, _))
+      .WillOnce(Return(-1));
+  EXPECT_CALL(sockets_, SendMmsg(kFakeFd, _, kFrames - 1, _))
+      .WillOnce(Invoke(this, &BatchedSocketTest::SendMessages));
+  dispatcher_.RunFor(0);
+  ASSERT_EQ(kFrames - 1, sent_frames_.size());
+  EXPECT_TRUE(sent_frames_[0].Equals(MakeFrame(1)));
+  const BatchedSocket::Stats& stats = batched_socket_->stats();
+  EXPECT_EQ(kFrames - 1, stats.frames_sent);
+  EXPECT_EQ(1u, stats.send_errors);
+}
+
+TEST_F(BatchedSocketTest, SendSegmentsInPlace) {
+  unsigned char header[28];
+  unsigned char payload[kFakeFrameLength - sizeof(header)];
+  memset(header, 0, sizeof(header));
+  memset(payload, 7, sizeof(payload));
+  struct iovec segments[BatchedSocket::kMaxSegments];
+  segments[0].iov_base = header;
+  segments[0].iov_len = sizeof(header);
+  segments[1].iov_base = payload;
+  segments[1].iov_len = sizeof(payload);
+  uint64_t flush_count = batched_socket_->flush_count();
+  EXPECT_TRUE(batched_socket_->Send(segments, 2, nullptr, 0));
+  // The segments are referenced, not copied: a change made before the
+  // flush goes out.
+  payload[sizeof(payload) - 1] = 9;
+  EXPECT_EQ(flush_count, batched_socket_->flush_count());
+  dispatcher_.RunFor(0);
+  EXPECT_NE(flush_count, batched_socket_->flush_count());
+
+  ASSERT_EQ(1u, sent_frames_.size());
+  const ByteString& frame = sent_frames_[0];
+  ASSERT_EQ(kFakeFrameLength, frame.GetLength());
+  EXPECT_EQ(0, memcmp(header, frame.GetConstData(), sizeof(header)));
+  EXPECT_EQ(0, memcmp(payload, frame.GetConstData() + sizeof(header),
+                      sizeof(payload)));
+}
+
+TEST_F(BatchedSocketTest, SendRejectsTooManySegments) {
+  struct iovec segments[BatchedSocket::kMaxSegments + 1];
+  memset(segments, 0, sizeof(segments));
+  EXPECT_FALSE(batched_socket_->Send(segments, arraysize(segments),
+                                     nullptr, 0));
+  EXPECT_EQ(0u, dispatcher_.pending_task_count());
+  EXPECT_EQ(1u, batched_socket_->stats().send_errors);
+}
+
+TEST_F(BatchedSocketTest, FlushTaskIgnoredAfterDestruction) {
+  EXPECT_TRUE(batched_socket_->Send(MakeFrame(0), nullptr, 0));
+  EXPECT_CALL(sockets_, SendMmsg(_, _, _, _)).Times(0);
+  batched_socket_.reset();
+  dispatcher_.RunFor(0);
+}
+
+TEST_F(BatchedSocketTest, ReceiveInBatches) {
+  const size_t kFrames = BatchedSocket::kBatchSize + 4;
+  for (size_t i = 0; i < kFrames; i++) {
+    pending_frames_.push_back(MakeFrame(i));
+  }
+  EXPECT_EQ(kFrames, batched_socket_->Receive(
+      Bind(&BatchedSocketTest::OnFrame, Unretained(this))));
+  EXPECT_EQ(kFrames, frame_count_);
+  // A short batch means the socket is drained.
+  EXPECT_EQ(std::vector<size_t>({BatchedSocket::kBatchSize, 4}),
+            receive_batch_sizes_);
+  const BatchedSocket::Stats& stats = batched_socket_->stats();
+  EXPECT_EQ(kFrames, stats.frames_received);
+  EXPECT_EQ(1u, stats.receive_batch_sizes[BatchedSocket::kBatchSize]);
+  EXPECT_EQ(1u, stats.receive_batch_sizes[4]);
+}
+
+TEST_F(BatchedSocketTest, ReceiveOneFramePerCall) {
+  batched_socket_.reset(new BatchedSocket(&sockets_, kFakeFd, &dispatcher_,
+                                          1));
+  const size_t kFrames = 3;
+  for (size_t i = 0; i < kFrames; i++) {
+    pending_frames_.push_back(MakeFrame(i));
+  }
+  EXPECT_EQ(kFrames, batched_socket_->Receive(
+      Bind(&BatchedSocketTest::OnFrame, Unretained(this))));
+  EXPECT_EQ(kFrames, frame_count_);
+  EXPECT_EQ(std::vector<size_t>({1, 1, 1}), receive_batch_sizes_);
+}
+
+TEST_F(BatchedSocketTest, ReceiveDropsTruncatedFrame) {
+  pending_frames_.push_back(MakeFrame(0));
+  EXPECT_CALL(sockets_, RecvMmsg(kFakeFd, _, _, _))
+      .WillOnce(Invoke([this](int fd,
+                              struct mmsghdr* messages,
+                              unsigned int vlen,
+                              int flags) {
+        int count = ReceiveMessages(fd, messages, vlen, flags);
+        messages[0].msg_hdr.msg_flags |= MSG_TRUNC;
+        return count;
+      }));
+  EXPECT_EQ(0u, batched_socket_->Receive(
+      Bind(&BatchedSocketTest::OnFrame, Unretained(this))));
+  EXPECT_EQ(0u, frame_count_);
+  EXPECT_EQ(1u, batched_socket_->stats().receive_errors);
+}
+
+TEST_F(BatchedSocketTest, ReceiveOnEmptySocket) {
+  EXPECT_EQ(0u, batched_socket_->Receive(
+      Bind(&BatchedSocketTest::OnFrame, Unretained(this))));
+  EXPECT_EQ(0u, frame_count_);
+  EXPECT_TRUE(receive_batch_sizes_.empty());
+}
+
+}  // namespace dhcp_client
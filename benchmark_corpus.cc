@@ -0,0 +1,229 @@
+//
+// Copyright (C) 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+
+#include "dhcp_client/benchmark_corpus.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/ip.h>
+#include <netinet/udp.h>
+
+#include <cstring>
+
+#include "dhcp_client/checksum.h"
+#include "dhcp_client/dhcp_message.h"
+#include "dhcp_client/dhcp_options.h"
+
+namespace dhcp_client {
+
+namespace {
+const uint16_t kDHCPServerPort = 67;
+const uint16_t kDHCPClientPort = 68;
+// Offset of the options field in a DHCP message.
+const size_t kOptionsOffset = 240;
+// RFC 1542 section 3.4: BOOTP relays and some servers pad the message
+// to the BOOTP minimum of 300 bytes.
+const size_t kBOOTPMinimumLength = 300;
+const uint8_t kHardwareAddress[] = {0x00, 0x1a, 0x11, 0xc3, 0x02, 0x5e};
+
+// The fixed fields of a reply to |transaction_id| for |your_ip_address|.
+std::vector<uint8_t> MakeReply(uint32_t transaction_id,
+                               uint32_t your_ip_address) {
+  std::vector<uint8_t> message(kOptionsOffset, 0);
+  message[0] = 2;  // op: reply
+  message[1] = 1;  // htype: ethernet
+  message[2] = sizeof(kHardwareAddress);
+  uint32_t value = htonl(transaction_id);
+  memcpy(&message[4], &value, sizeof(value));
+  value = htonl(your_ip_address);
+  memcpy(&message[16], &value, sizeof(value));
+  memcpy(&message[28], kHardwareAddress, sizeof(kHardwareAddress));
+  message[236] = 0x63;  // magic cookie
+  message[237] = 0x82;
+  message[238] = 0x53;
+  message[239] = 0x63;
+  return message;
+}
+
+void AppendOptions(const std::vector<uint8_t>& options,
+                   std::vector<uint8_t>* message) {
+  message->insert(message->end(), options.begin(), options.end());
+}
+
+// Wrap |message| in the IP and UDP headers a server would send it with.
+shill::ByteString MakeFrame(const std::vector<uint8_t>& message,
+                            uint32_t source,
+                            uint32_t destination) {
+  const size_t header_len = sizeof(struct iphdr) + sizeof(struct udphdr);
+  shill::ByteString frame(header_len + message.size());
+  uint8_t* buffer = frame.GetData();
+  memcpy(buffer + header_len, message.data(), message.size());
+  struct iphdr* ip = reinterpret_cast<struct iphdr*>(buffer);
+  struct udphdr* udp = reinterpret_cast<struct udphdr*>(buffer + sizeof(*ip));
+  udp->uh_sport = htons(kDHCPServerPort);
+  udp->uh_dport = htons(kDHCPClientPort);
+  udp->uh_ulen = htons(static_cast<uint16_t>(sizeof(*udp) + message.size()));
+  udp->uh_sum = htons(ComputeUDPChecksum(
+      source, destination, reinterpret_cast<const uint8_t*>(udp),
+      sizeof(*udp) + message.size()));
+  if (udp->uh_sum == 0) {
+    udp->uh_sum = 0xffff;
+  }
+  ip->version = IPVERSION;
+  ip->ihl = sizeof(*ip) >> 2;
+  ip->ttl = IPDEFTTL;
+  ip->protocol = IPPROTO_UDP;
+  ip->saddr = htonl(source);
+  ip->daddr = htonl(destination);
+  ip->tot_len = htons(static_cast<uint16_t>(header_len + message.size()));
+  ip->check = htons(ComputeInternetChecksum(
+      reinterpret_cast<const uint8_t*>(ip), sizeof(*ip)));
+  return frame;
+}
+
+std::vector<CorpusMessage> BuildReplyCorpus() {
+  std::vector<CorpusMessage> corpus;
+  CorpusMessage entry;
+
+  // Home router Ack, the same set of options most consumer routers send.
+  entry.name = "home_router_ack";
+  entry.message = MakeReply(0x0f22a350, 0xc0a80117);
+  AppendOptions({
+      kDHCPOptionMessageType, 1, kDHCPMessageTypeAck,
+      kDHCPOptionServerIdentifier, 4, 192, 168, 1, 1,
+      kDHCPOptionLeaseTime, 4, 0x00, 0x01, 0x51, 0x80,
+      kDHCPOptionRenewalTime, 4, 0x00, 0x00, 0xa8, 0xc0,
+      kDHCPOptionRebindingTime, 4, 0x00, 0x01, 0x27, 0x50,
+      kDHCPOptionSubnetMask, 4, 255, 255, 255, 0,
+      kDHCPOptionRouter, 4, 192, 168, 1, 1,
+      kDHCPOptionDNSServer, 8, 192, 168, 1, 1, 8, 8, 8, 8,
+      kDHCPOptionDomainName, 8, 'l', 'a', 'n', '.', 'h', 'o', 'm', 'e',
+      kDHCPOptionEnd}, &entry.message);
+  entry.frame = MakeFrame(entry.message, 0xc0a80101, 0xffffffff);
+  corpus.push_back(entry);
+
+  // Home router Offer, padded to the BOOTP minimum length.
+  entry.name = "home_router_offer_padded";
+  entry.message = MakeReply(0x0f22a350, 0xc0a80117);
+  AppendOptions({
+      kDHCPOptionMessageType, 1, kDHCPMessageTypeOffer,
+      kDHCPOptionServerIdentifier, 4, 192, 168, 1, 1,
+      kDHCPOptionLeaseTime, 4, 0x00, 0x01, 0x51, 0x80,
+      kDHCPOptionSubnetMask, 4, 255, 255, 255, 0,
+      kDHCPOptionRouter, 4, 192, 168, 1, 1,
+      kDHCPOptionDNSServer, 4, 192, 168, 1, 1,
+      kDHCPOptionEnd}, &entry.message);
+  entry.message.resize(kBOOTPMinimumLength, kDHCPOptionPad);
+  entry.frame = MakeFrame(entry.message, 0xc0a80101, 0xffffffff);
+  corpus.push_back(entry);
+
+  // Phone hotspot Ack, the minimum a server sends.
+  entry.name = "hotspot_ack";
+  entry.message = MakeReply(0x7a01c4e2, 0xc0a82b8c);
+  AppendOptions({
+      kDHCPOptionMessageType, 1, kDHCPMessageTypeAck,
+      kDHCPOptionServerIdentifier, 4, 192, 168, 43, 1,
+      kDHCPOptionLeaseTime, 4, 0x00, 0x00, 0x0e, 0x10,
+      kDHCPOptionSubnetMask, 4, 255, 255, 255, 0,
+      kDHCPOptionRouter, 4, 192, 168, 43, 1,
+      kDHCPOptionDNSServer, 4, 192, 168, 43, 1,
+      kDHCPOptionEnd}, &entry.message);
+  entry.frame = MakeFrame(entry.message, 0xc0a82b01, 0xc0a82b8c);
+  corpus.push_back(entry);
+
+  // Enterprise Offer, with redundant routers and name servers, a long
+  // domain name and vendor specific information.
+  entry.name = "enterprise_offer";
+  entry.message = MakeReply(0x5d3b9e01, 0x0a1e0442);
+  AppendOptions({
+      kDHCPOptionMessageType, 1, kDHCPMessageTypeOffer,
+      kDHCPOptionServerIdentifier, 4, 10, 30, 0, 5,
+      kDHCPOptionLeaseTime, 4, 0x00, 0x00, 0x70, 0x80,
+      kDHCPOptionRenewalTime, 4, 0x00, 0x00, 0x38, 0x40,
+      kDHCPOptionRebindingTime, 4, 0x00, 0x00, 0x62, 0x70,
+      kDHCPOptionSubnetMask, 4, 255, 255, 252, 0,
+      kDHCPOptionRouter, 8, 10, 30, 4, 1, 10, 30, 4, 2,
+      kDHCPOptionDNSServer, 12, 10, 0, 0, 53, 10, 0, 1, 53, 10, 0, 2, 53,
+      kDHCPOptionDomainName, 22, 'b', 'u', 'i', 'l', 'd', 'i', 'n', 'g',
+      '4', '.', 'c', 'o', 'r', 'p', '.', 'e', 'x', 'a', 'm', 'p', 'l', 'e',
+      kDHCPOptionVendorSpecificInformation, 16,
+      0x01, 0x04, 0x0a, 0x1e, 0x00, 0x07, 0x02, 0x08,
+      'A', 'N', 'D', 'R', 'O', 'I', 'D', 0x00,
+      kDHCPOptionEnd}, &entry.message);
+  entry.frame = MakeFrame(entry.message, 0x0a1e0005, 0xffffffff);
+  corpus.push_back(entry);
+
+  // Enterprise Ack to a renewal, unicast to the leased address.
+  entry.name = "enterprise_renew_ack";
+  entry.message = MakeReply(0x5d3b9e77, 0x0a1e0442);
+  AppendOptions({
+      kDHCPOptionMessageType, 1, kDHCPMessageTypeAck,
+      kDHCPOptionServerIdentifier, 4, 10, 30, 0, 5,
+      kDHCPOptionLeaseTime, 4, 0x00, 0x00, 0x70, 0x80,
+      kDHCPOptionRenewalTime, 4, 0x00, 0x00, 0x38, 0x40,
+      kDHCPOptionRebindingTime, 4, 0x00, 0x00, 0x62, 0x70,
+      kDHCPOptionSubnetMask, 4, 255, 255, 252, 0,
+      kDHCPOptionRouter, 8, 10, 30, 4, 1, 10, 30, 4, 2,
+      kDHCPOptionDNSServer, 12, 10, 0, 0, 53, 10, 0, 1, 53, 10, 0, 2, 53,
+      kDHCPOptionEnd}, &entry.message);
+  entry.frame = MakeFrame(entry.message, 0x0a1e0005, 0x0a1e0442);
+  corpus.push_back(entry);
+
+  // Enterprise Ack with RFC 3442 classless static routes to the other
+  // sites, next to the default route. Servers keep sending the router
+  // option for the clients that ignore option 121.
+  entry.name = "classless_routes_ack";
+  entry.message = MakeReply(0x5d3b9e02, 0x0a1e0442);
+  AppendOptions({
+      kDHCPOptionMessageType, 1, kDHCPMessageTypeAck,
+      kDHCPOptionServerIdentifier, 4, 10, 30, 0, 5,
+      kDHCPOptionLeaseTime, 4, 0x00, 0x00, 0x70, 0x80,
+      kDHCPOptionSubnetMask, 4, 255, 255, 252, 0,
+      kDHCPOptionRouter, 4, 10, 30, 4, 1,
+      kDHCPOptionDNSServer, 8, 10, 0, 0, 53, 10, 0, 1, 53,
+      kDHCPOptionClasslessStaticRoute, 26,
+      8, 10, 10, 30, 4, 1,
+      12, 172, 16, 10, 30, 4, 1,
+      24, 192, 168, 100, 10, 30, 4, 2,
+      0, 10, 30, 4, 1,
+      kDHCPOptionEnd}, &entry.message);
+  entry.frame = MakeFrame(entry.message, 0x0a1e0005, 0xffffffff);
+  corpus.push_back(entry);
+
+  // Nak to an INIT-REBOOT request for an address from another network.
+  entry.name = "nak";
+  entry.message = MakeReply(0x19e4d2c0, 0);
+  AppendOptions({
+      kDHCPOptionMessageType, 1, kDHCPMessageTypeNak,
+      kDHCPOptionServerIdentifier, 4, 10, 30, 0, 5,
+      kDHCPOptionMessage, 19, 'r', 'e', 'q', 'u', 'e', 's', 't', 'e', 'd',
+      ' ', 'a', 'd', 'd', 'r', 'e', 's', 's', ' ', '?',
+      kDHCPOptionEnd}, &entry.message);
+  entry.frame = MakeFrame(entry.message, 0x0a1e0005, 0xffffffff);
+  corpus.push_back(entry);
+
+  return corpus;
+}
+}  // namespace
+
+const std::vector<CorpusMessage>& GetReplyCorpus() {
+  static const std::vector<CorpusMessage>* corpus =
+      new std::vector<CorpusMessage>(BuildReplyCorpus());
+  return *corpus;
+}
+
+}  // namespace dhcp_client
@@ -0,0 +1,53 @@
+//
+// Copyright (C) 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+
+#ifndef DHCP_CLIENT_BENCHMARK_CORPUS_H_
+#define DHCP_CLIENT_BENCHMARK_CORPUS_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <shill/net/byte_string.h>
+
+namespace dhcp_client {
+
+// A server reply, as received by the client.
+struct CorpusMessage {
+  std::string name;
+  // The DHCP message, starting at op.
+  std::vector<uint8_t> message;
+  // The same message in its IP/UDP frame, with valid checksums.
+  shill::ByteString frame;
+};
+
+// Offers, Acks and Naks modeled on the replies of common servers, from
+// a bare hotspot Ack to an enterprise Offer carrying vendor options.
+// Built once, the benchmarks index it with their argument.
+const std::vector<CorpusMessage>& GetReplyCorpus();
+
+// Register |benchmark| once per corpus message.
+template <typename Benchmark>
+void ApplyReplyCorpus(Benchmark* benchmark) {
+  for (size_t i = 0; i < GetReplyCorpus().size(); i++) {
+    benchmark->Arg(static_cast<int>(i));
+  }
+}
+
+}  // namespace dhcp_client
+
+#endif  // DHCP_CLIENT_BENCHMARK_CORPUS_H_
@@ -0,0 +1,45 @@
+//
+// Copyright (C) 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include <string>
+#include <vector>
+
+#include <base/at_exit.h>
+#include <base/command_line.h>
+#include <base/logging.h>
+#include <benchmark/benchmark.h>
+
+namespace {
+// Results are printed as JSON, the format regression tracking reads.
+// Flags given on the command line come later and take precedence, e.g.
+// --benchmark_format=console for reading the results by hand.
+const char kDefaultOutputFormat[] = "--benchmark_format=json";
+}  // namespace
+
+int main(int argc, char** argv) {
+  base::AtExitManager exit_manager;
+  base::CommandLine::Init(argc, argv);
+  // Error paths exercised by the benchmarks would otherwise flood
+  // the output and skew the measurements.
+  logging::SetMinLogLevel(logging::LOG_FATAL);
+  std::string default_output_format(kDefaultOutputFormat);
+  std::vector<char*> args(argv, argv + argc);
+  args.insert(args.begin() + 1, &default_output_format[0]);
+  int args_count = static_cast<int>(args.size());
+  ::benchmark::Initialize(&args_count, args.data());
+  ::benchmark::RunSpecifiedBenchmarks();
+  return 0;
+}
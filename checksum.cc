@@ -0,0 +1,249 @@
+//
+// Copyright (C) 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "dhcp_client/checksum.h"
+
+#include <netinet/in.h>
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define DHCP_CLIENT_X86_CHECKSUM 1
+#endif
+
+namespace dhcp_client {
+
+namespace {
+// The wide implementations sum native 16 bit words: the one's complement
+// sum is byte order independent (RFC 1071 section 2.B), so the result only
+// needs to be swapped to big endian at the end.
+
+// Number of vector blocks summed before the 32 bit lanes are flushed.
+// Each lane takes two 16 bit words per block, 2 * 0xffff * 16384 < 2^32.
+const size_t kMaxBlocksPerFlush = 16384;
+
+uint16_t FoldBigEndian(uint64_t sum) {
+  while (sum >> 16) {
+    sum = (sum >> 16) + (sum & 0xffff);
+  }
+  return static_cast<uint16_t>(sum);
+}
+
+// Folds a sum of native words and converts it to host order.
+uint16_t FoldNative(uint64_t sum) {
+  return ntohs(FoldBigEndian(sum));
+}
+
+// Adds |value| to |sum| with an end around carry.
+uint64_t AddWithCarry(uint64_t sum, uint64_t value) {
+  sum += value;
+  return sum + (sum < value);
+}
+
+// Adds the native words of |data| to |sum|.
+// |data| must start at an even offset of the checksummed buffer.
+uint64_t SumNativeWords(const uint8_t* data, size_t len, uint64_t sum) {
+  while (len >= sizeof(uint64_t)) {
+    uint64_t word;
+    memcpy(&word, data, sizeof(word));
+    sum = AddWithCarry(sum, word);
+    data += sizeof(word);
+    len -= sizeof(word);
+  }
+  if (len > 0) {
+    // Zero padding keeps an odd trailing byte in the high half of its word.
+    uint64_t word = 0;
+    memcpy(&word, data, len);
+    sum = AddWithCarry(sum, word);
+  }
+  return sum;
+}
+
+// The reference implementation, one big endian word at a time.
+uint16_t SumScalar(const uint8_t* data, size_t len) {
+  uint64_t sum = 0;
+  while (len > 1) {
+    sum += static_cast<uint32_t>(data[0]) << 8 | static_cast<uint32_t>(data[1]);
+    data += 2;
+    len -= 2;
+  }
+  if (len == 1) {
+    sum += static_cast<uint32_t>(*data) << 8;
+  }
+  return FoldBigEndian(sum);
+}
+
+uint16_t SumPortable64(const uint8_t* data, size_t len) {
+  return FoldNative(SumNativeWords(data, len, 0));
+}
+
+#if defined(DHCP_CLIENT_X86_CHECKSUM)
+__attribute__((target("sse2")))
+uint16_t SumSSE2(const uint8_t* data, size_t len) {
+  const __m128i zero = _mm_setzero_si128();
+  uint64_t sum = 0;
+  while (len >= sizeof(__m128i)) {
+    size_t blocks = std::min(len / sizeof(__m128i), kMaxBlocksPerFlush);
+    __m128i accumulator = zero;
+    for (size_t i = 0; i < blocks; i++) {
+      __m128i block =
+          _mm_loadu_si128(reinterpret_cast<const __m128i*>(data));
+      accumulator = _mm_add_epi32(accumulator,
+                                  _mm_unpacklo_epi16(block, zero));
+      accumulator = _mm_add_epi32(accumulator,
+                                  _mm_unpackhi_epi16(block, zero));
+      data += sizeof(__m128i);
+    }
+    len -= blocks * sizeof(__m128i);
+    uint32_t lanes[4];
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), accumulator);
+    for (uint32_t lane : lanes) {
+      sum += lane;
+    }
+  }
+  return FoldNative(SumNativeWords(data, len, sum));
+}
+
+__attribute__((target("avx2")))
+uint16_t SumAVX2(const uint8_t* data, size_t len) {
+  const __m256i zero = _mm256_setzero_si256();
+  uint64_t sum = 0;
+  while (len >= sizeof(__m256i)) {
+    size_t blocks = std::min(len / sizeof(__m256i), kMaxBlocksPerFlush);
+    __m256i accumulator = zero;
+    for (size_t i = 0; i < blocks; i++) {
+      __m256i block =
+          _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data));
+      accumulator = _mm256_add_epi32(accumulator,
+                                     _mm256_unpacklo_epi16(block, zero));
+      accumulator = _mm256_add_epi32(accumulator,
+                                     _mm256_unpackhi_epi16(block, zero));
+      data += sizeof(__m256i);
+    }
+    len -= blocks * sizeof(__m256i);
+    uint32_t lanes[8];
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes), accumulator);
+    for (uint32_t lane : lanes) {
+      sum += lane;
+    }
+  }
+  return FoldNative(SumNativeWords(data, len, sum));
+}
+#endif  // DHCP_CLIENT_X86_CHECKSUM
+
+const ChecksumKernel kScalarKernel = {"scalar", SumScalar};
+const ChecksumKernel kPortable64Kernel = {"portable64", SumPortable64};
+#if defined(DHCP_CLIENT_X86_CHECKSUM)
+const ChecksumKernel kSSE2Kernel = {"sse2", SumSSE2};
+const ChecksumKernel kAVX2Kernel = {"avx2", SumAVX2};
+#endif
+
+ChecksumKernel SelectKernel() {
+#if defined(DHCP_CLIENT_X86_CHECKSUM)
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    return kAVX2Kernel;
+  }
+  if (__builtin_cpu_supports("sse2")) {
+    return kSSE2Kernel;
+  }
+#endif
+  return kPortable64Kernel;
+}
+
+}  // namespace
+
+uint16_t ChecksumSum(const uint8_t* data, size_t len) {
+  static const ChecksumKernel kernel = SelectKernel();
+  return kernel.sum(data, len);
+}
+
+uint16_t ChecksumAdd(uint16_t a, uint16_t b) {
+  return FoldBigEndian(static_cast<uint32_t>(a) + b);
+}
+
+uint16_t ComputeInternetChecksum(const uint8_t* data, size_t len) {
+  return static_cast<uint16_t>(~ChecksumSum(data, len));
+}
+
+uint16_t ChecksumSumSegments(const struct iovec* segments, size_t count) {
+  uint16_t sum = 0;
+  bool odd_offset = false;
+  for (size_t i = 0; i < count; i++) {
+    uint16_t segment_sum = ChecksumSum(
+        static_cast<const uint8_t*>(segments[i].iov_base),
+        segments[i].iov_len);
+    // A segment starting at an odd offset has its bytes in the other
+    // halves of the 16 bit words (RFC 1071 section 2.B).
+    if (odd_offset) {
+      segment_sum = static_cast<uint16_t>(segment_sum << 8 | segment_sum >> 8);
+    }
+    sum = ChecksumAdd(sum, segment_sum);
+    odd_offset ^= (segments[i].iov_len & 1) != 0;
+  }
+  return sum;
+}
+
+uint16_t ComputeUDPChecksum(uint32_t source,
+                            uint32_t destination,
+                            const uint8_t* datagram,
+                            size_t len) {
+  struct iovec segment;
+  segment.iov_base = const_cast<uint8_t*>(datagram);
+  segment.iov_len = len;
+  return ComputeUDPChecksum(source, destination, &segment, 1);
+}
+
+uint16_t ComputeUDPChecksum(uint32_t source,
+                            uint32_t destination,
+                            const struct iovec* segments,
+                            size_t count) {
+  size_t len = 0;
+  for (size_t i = 0; i < count; i++) {
+    len += segments[i].iov_len;
+  }
+  // IPv4 pseudo header: source, destination, zero, protocol, UDP length.
+  uint8_t pseudo_header[12];
+  uint32_t address = htonl(source);
+  memcpy(pseudo_header, &address, sizeof(address));
+  address = htonl(destination);
+  memcpy(pseudo_header + 4, &address, sizeof(address));
+  pseudo_header[8] = 0;
+  pseudo_header[9] = IPPROTO_UDP;
+  pseudo_header[10] = static_cast<uint8_t>(len >> 8);
+  pseudo_header[11] = static_cast<uint8_t>(len);
+  uint16_t sum = ChecksumAdd(ChecksumSum(pseudo_header, sizeof(pseudo_header)),
+                             ChecksumSumSegments(segments, count));
+  return static_cast<uint16_t>(~sum);
+}
+
+std::vector<ChecksumKernel> GetSupportedChecksumKernels() {
+  std::vector<ChecksumKernel> kernels = {kScalarKernel, kPortable64Kernel};
+#if defined(DHCP_CLIENT_X86_CHECKSUM)
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("sse2")) {
+    kernels.push_back(kSSE2Kernel);
+  }
+  if (__builtin_cpu_supports("avx2")) {
+    kernels.push_back(kAVX2Kernel);
+  }
+#endif
+  return kernels;
+}
+
+}  // namespace dhcp_client
@@ -0,0 +1,73 @@
+//
+// Copyright (C) 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef DHCP_CLIENT_CHECKSUM_H_
+#define DHCP_CLIENT_CHECKSUM_H_
+
+#include <sys/uio.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace dhcp_client {
+
+// Internet checksum (RFC 1071) helpers.
+// All sums are 16 bit one's complement sums of |data| read as big endian
+// 16 bit words, with an odd trailing byte padded with zero. They are
+// returned in host byte order and are not complemented.
+
+// Returns the one's complement sum of |data|.
+// The implementation is picked once based on the features of the CPU.
+uint16_t ChecksumSum(const uint8_t* data, size_t len);
+
+// Returns the one's complement sum of |a| and |b|.
+uint16_t ChecksumAdd(uint16_t a, uint16_t b);
+
+// Returns the one's complement sum of the |count| |segments| taken as one
+// buffer. Each segment is summed on its own, any of them may have an odd
+// length.
+uint16_t ChecksumSumSegments(const struct iovec* segments, size_t count);
+
+// Returns the internet checksum of |data|, in host byte order.
+uint16_t ComputeInternetChecksum(const uint8_t* data, size_t len);
+
+// Returns the UDP checksum of |datagram| with the IPv4 pseudo header
+// built from |source| and |destination|, in host byte order.
+// For a received datagram carrying a valid checksum this returns 0.
+uint16_t ComputeUDPChecksum(uint32_t source,
+                            uint32_t destination,
+                            const uint8_t* datagram,
+                            size_t len);
+// Same for a datagram made of the |count| |segments|.
+uint16_t ComputeUDPChecksum(uint32_t source,
+                            uint32_t destination,
+                            const struct iovec* segments,
+                            size_t count);
+
+// A checksum implementation, exposed for tests and benchmarks.
+struct ChecksumKernel {
+  const char* name;
+  uint16_t (*sum)(const uint8_t* data, size_t len);
+};
+
+// Returns the implementations this CPU can run.
+// The first one is the plain 16 bit reference implementation.
+std::vector<ChecksumKernel> GetSupportedChecksumKernels();
+
+}  // namespace dhcp_client
+
+#endif  // DHCP_CLIENT_CHECKSUM_H_
@@ -0,0 +1,86 @@
+//
+// Copyright (C) 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "dhcp_client/checksum.h"
+
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "dhcp_client/benchmark_corpus.h"
+#include "dhcp_client/dhcp_message.h"
+
+namespace dhcp_client {
+namespace {
+
+// Run |kernel_index| of GetSupportedChecksumKernels() over range(1) bytes.
+// Kernels the CPU does not support are skipped.
+void BM_ChecksumKernel(benchmark::State& state) {
+  std::vector<ChecksumKernel> kernels = GetSupportedChecksumKernels();
+  size_t kernel_index = static_cast<size_t>(state.range(0));
+  if (kernel_index >= kernels.size()) {
+    state.SkipWithError("Kernel not supported on this CPU");
+    return;
+  }
+  const ChecksumKernel& kernel = kernels[kernel_index];
+  std::vector<uint8_t> buffer(static_cast<size_t>(state.range(1)));
+  for (size_t i = 0; i < buffer.size(); i++) {
+    buffer[i] = static_cast<uint8_t>(i * 31 + 7);
+  }
+  while (state.KeepRunning()) {
+    benchmark::DoNotOptimize(kernel.sum(buffer.data(), buffer.size()));
+  }
+  state.SetLabel(kernel.name);
+  state.SetBytesProcessed(
+      static_cast<int64_t>(state.iterations()) * state.range(1));
+}
+
+void ChecksumKernelArguments(benchmark::internal::Benchmark* benchmark) {
+  // IP header, DHCP Discover datagram, minimum IP MTU, Ethernet MTU.
+  const int kLengths[] = {20, 308, 576, 1500};
+  for (int kernel_index = 0; kernel_index < 4; kernel_index++) {
+    for (int length : kLengths) {
+      benchmark->Args({kernel_index, length});
+    }
+  }
+}
+BENCHMARK(BM_ChecksumKernel)->Apply(ChecksumKernelArguments);
+
+void BM_ComputeUDPChecksum(benchmark::State& state) {
+  std::vector<uint8_t> datagram(308, 0x5a);
+  while (state.KeepRunning()) {
+    benchmark::DoNotOptimize(ComputeUDPChecksum(
+        0xc0a80101, 0xffffffff, datagram.data(), datagram.size()));
+  }
+}
+BENCHMARK(BM_ComputeUDPChecksum);
+
+// The entry point the frame building code uses, over each reply of the
+// corpus.
+void BM_DHCPMessageComputeChecksum(benchmark::State& state) {
+  const CorpusMessage& reply = GetReplyCorpus()[state.range(0)];
+  while (state.KeepRunning()) {
+    benchmark::DoNotOptimize(DHCPMessage::ComputeChecksum(
+        reply.frame.GetConstData(), reply.frame.GetLength()));
+  }
+  state.SetLabel(reply.name);
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) *
+                          reply.frame.GetLength());
+}
+BENCHMARK(BM_DHCPMessageComputeChecksum)->Apply(ApplyReplyCorpus);
+
+}  // namespace
+}  // namespace dhcp_client
@@ -0,0 +1,201 @@
+//
+// Copyright (C) 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "dhcp_client/checksum.h"
+
+#include <netinet/in.h>
+#include <sys/uio.h>
+
+#include <random>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace dhcp_client {
+
+namespace {
+// Longest buffer used for the length/alignment sweep.
+const size_t kMaxSweepLength = 1600;
+// Alignments cover every offset within an AVX2 vector.
+const size_t kMaxAlignment = 32;
+// Long enough for the vector lanes to be flushed more than once.
+const size_t kLongBufferLength = 1 << 20;
+
+// A UDP datagram from 192.168.1.1:67 to 255.255.255.255:68
+// with a valid checksum.
+const uint32_t kFakeSourceAddress = 0xc0a80101;
+const uint32_t kFakeDestinationAddress = 0xffffffff;
+}  // namespace
+
+class ChecksumTest : public testing::Test {
+ protected:
+  ChecksumTest()
+      : kernels_(GetSupportedChecksumKernels()),
+        random_engine_(0x5eed) {}
+
+  std::vector<uint8_t> RandomBuffer(size_t len) {
+    std::uniform_int_distribution<unsigned int> distribution(0, 0xff);
+    std::vector<uint8_t> buffer(len);
+    for (size_t i = 0; i < len; i++) {
+      buffer[i] = static_cast<uint8_t>(distribution(random_engine_));
+    }
+    return buffer;
+  }
+
+  // Checks that every kernel agrees with the reference on |data|.
+  void ExpectKernelsMatch(const uint8_t* data, size_t len) {
+    uint16_t expected = kernels_[0].sum(data, len);
+    for (const auto& kernel : kernels_) {
+      EXPECT_EQ(expected, kernel.sum(data, len))
+          << kernel.name << " length " << len;
+    }
+  }
+
+  std::vector<ChecksumKernel> kernels_;
+  std::mt19937 random_engine_;
+};
+
+TEST_F(ChecksumTest, ReferenceKernelFirst) {
+  ASSERT_GE(kernels_.size(), 2u);
+  EXPECT_STREQ("scalar", kernels_[0].name);
+}
+
+TEST_F(ChecksumTest, KnownValue) {
+  // RFC 1071 section 3 example.
+  const uint8_t kData[] = {0x00, 0x01, 0xf2, 0x03, 0xf4, 0xf5, 0xf6, 0xf7};
+  for (const auto& kernel : kernels_) {
+    EXPECT_EQ(0xddf2, kernel.sum(kData, sizeof(kData))) << kernel.name;
+  }
+  EXPECT_EQ(0x220d, ComputeInternetChecksum(kData, sizeof(kData)));
+}
+
+TEST_F(ChecksumTest, EmptyBuffer) {
+  for (const auto& kernel : kernels_) {
+    EXPECT_EQ(0, kernel.sum(nullptr, 0)) << kernel.name;
+  }
+}
+
+TEST_F(ChecksumTest, AllWordValues) {
+  // Every 16 bit word, alone and trailed by an odd byte.
+  uint8_t data[3];
+  for (uint32_t word = 0; word <= 0xffff; word++) {
+    data[0] = static_cast<uint8_t>(word >> 8);
+    data[1] = static_cast<uint8_t>(word);
+    data[2] = static_cast<uint8_t>(word * 7);
+    ExpectKernelsMatch(data, 2);
+    ExpectKernelsMatch(data, 3);
+  }
+}
+
+TEST_F(ChecksumTest, AllLengthsAndAlignments) {
+  std::vector<uint8_t> buffer = RandomBuffer(kMaxSweepLength + kMaxAlignment);
+  for (size_t alignment = 0; alignment < kMaxAlignment; alignment++) {
+    for (size_t len = 0; len <= kMaxSweepLength; len++) {
+      ExpectKernelsMatch(buffer.data() + alignment, len);
+    }
+  }
+}
+
+TEST_F(ChecksumTest, AllOnesCarries) {
+  // Maximal words stress the carries and the lane flushes.
+  std::vector<uint8_t> buffer(kLongBufferLength + 1, 0xff);
+  ExpectKernelsMatch(buffer.data(), buffer.size());
+  ExpectKernelsMatch(buffer.data(), buffer.size() - 1);
+  EXPECT_EQ(0xffff, ChecksumSum(buffer.data(), buffer.size() - 1));
+}
+
+TEST_F(ChecksumTest, LongRandomBuffer) {
+  std::vector<uint8_t> buffer = RandomBuffer(kLongBufferLength + 7);
+  for (size_t alignment = 0; alignment < 8; alignment++) {
+    ExpectKernelsMatch(buffer.data() + alignment,
+                       buffer.size() - alignment);
+  }
+}
+
+TEST_F(ChecksumTest, ChecksumAdd) {
+  EXPECT_EQ(0x0001, ChecksumAdd(0xffff, 0x0001));
+  EXPECT_EQ(0xffff, ChecksumAdd(0xffff, 0x0000));
+  std::vector<uint8_t> buffer = RandomBuffer(200);
+  EXPECT_EQ(ChecksumSum(buffer.data(), buffer.size()),
+            ChecksumAdd(ChecksumSum(buffer.data(), 64),
+                        ChecksumSum(buffer.data() + 64, 136)));
+}
+
+TEST_F(ChecksumTest, UDPChecksum) {
+  std::vector<uint8_t> datagram = RandomBuffer(301);
+  datagram[0] = 0;
+  datagram[1] = 67;
+  datagram[2] = 0;
+  datagram[3] = 68;
+  datagram[4] = static_cast<uint8_t>(datagram.size() >> 8);
+  datagram[5] = static_cast<uint8_t>(datagram.size());
+  datagram[6] = 0;
+  datagram[7] = 0;
+  uint16_t checksum = ComputeUDPChecksum(kFakeSourceAddress,
+                                         kFakeDestinationAddress,
+                                         datagram.data(),
+                                         datagram.size());
+  datagram[6] = static_cast<uint8_t>(checksum >> 8);
+  datagram[7] = static_cast<uint8_t>(checksum);
+  EXPECT_EQ(0, ComputeUDPChecksum(kFakeSourceAddress,
+                                  kFakeDestinationAddress,
+                                  datagram.data(),
+                                  datagram.size()));
+  // A corrupted datagram no longer verifies.
+  datagram[100] ^= 0x10;
+  EXPECT_NE(0, ComputeUDPChecksum(kFakeSourceAddress,
+                                  kFakeDestinationAddress,
+                                  datagram.data(),
+                                  datagram.size()));
+}
+
+TEST_F(ChecksumTest, SumSegments) {
+  std::vector<uint8_t> buffer = RandomBuffer(301);
+  uint16_t expected = ChecksumSum(buffer.data(), buffer.size());
+  // Every split into three segments, odd and even lengths alike.
+  for (size_t first = 0; first <= 20; first++) {
+    for (size_t second = 0; second <= 20; second++) {
+      struct iovec segments[3];
+      segments[0].iov_base = buffer.data();
+      segments[0].iov_len = first;
+      segments[1].iov_base = buffer.data() + first;
+      segments[1].iov_len = second;
+      segments[2].iov_base = buffer.data() + first + second;
+      segments[2].iov_len = buffer.size() - first - second;
+      EXPECT_EQ(expected, ChecksumSumSegments(segments, 3))
+          << first << " " << second;
+    }
+  }
+}
+
+TEST_F(ChecksumTest, UDPChecksumOfSegments) {
+  std::vector<uint8_t> datagram = RandomBuffer(301);
+  struct iovec segments[2];
+  segments[0].iov_base = datagram.data();
+  segments[0].iov_len = 8;
+  segments[1].iov_base = datagram.data() + 8;
+  segments[1].iov_len = datagram.size() - 8;
+  EXPECT_EQ(ComputeUDPChecksum(kFakeSourceAddress,
+                               kFakeDestinationAddress,
+                               datagram.data(),
+                               datagram.size()),
+            ComputeUDPChecksum(kFakeSourceAddress,
+                               kFakeDestinationAddress,
+                               segments,
+                               2));
+}
+
+}  // namespace dhcp_client
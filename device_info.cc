@@ -16,18 +16,30 @@
 
 #include "dhcp_client/device_info.h"
 
+#include <linux/rtnetlink.h>
 #include <net/if.h>
 #include <netinet/in.h>
+#include <sched.h>
 #include <sys/ioctl.h>
+#include <sys/socket.h>
 
+#include <cerrno>
+#include <cstring>
 #include <memory>
 #include <string>
+#include <unordered_set>
+#include <vector>
 
+#include <base/bind.h>
 #include <base/logging.h>
 
+using base::Bind;
+using base::Unretained;
 using shill::ByteString;
-using shill::Sockets;
 using shill::RTNLHandler;
+using shill::RTNLListener;
+using shill::RTNLMessage;
+using shill::Sockets;
 using std::unique_ptr;
 
 namespace {
@@ -35,13 +47,38 @@ namespace {
 base::LazyInstance<dhcp_client::DeviceInfo> g_dhcp_device_info
     = LAZY_INSTANCE_INITIALIZER;
 
+const uint64_t kSlotEmpty = 0;
+const uint64_t kSlotUsed = 1;
+const uint64_t kSlotDeleted = 2;
+const uint64_t kSlotStateMask = 3;
+const int kSlotIndexShift = 32;
+// A reader that keeps racing with the writer gives up after this many
+// attempts, and the caller looks the interface up in the kernel.
+const int kMaxTableReadAttempts = 100;
+// A link message with its statistics takes about a kilobyte, the kernel
+// fills each read of the dump with as many as fit.
+const size_t kDumpBufferSize = 32768;
+
 }  // namespace
 
 namespace dhcp_client {
 
+const size_t DeviceInfo::kTableSize;
+
 DeviceInfo::DeviceInfo()
     : sockets_(new Sockets()),
-      rtnl_handler_(RTNLHandler::GetInstance()) {
+      rtnl_handler_(RTNLHandler::GetInstance()),
+      sequence_(0),
+      slots_(new Slot[kTableSize]),
+      used_slots_(0),
+      deleted_slots_(0),
+      dump_sequence_(1) {
+  for (size_t i = 0; i < kTableSize; i++) {
+    slots_[i].name[0].store(0, std::memory_order_relaxed);
+    slots_[i].name[1].store(0, std::memory_order_relaxed);
+    slots_[i].state_and_index.store(kSlotEmpty, std::memory_order_relaxed);
+    slots_[i].hardware_address.store(0, std::memory_order_relaxed);
+  }
 }
 
 DeviceInfo::~DeviceInfo() {}
@@ -50,15 +87,181 @@ DeviceInfo* DeviceInfo::GetInstance() {
   return g_dhcp_device_info.Pointer();
 }
 
+void DeviceInfo::Start() {
+  if (link_listener_) {
+    return;
+  }
+  link_listener_.reset(
+      new RTNLListener(RTNLHandler::kRequestLink,
+                       Bind(&DeviceInfo::LinkMsgHandler, Unretained(this)),
+                       rtnl_handler_));
+  rtnl_handler_->Start(RTMGRP_LINK);
+  // Subscribed first, so that no change made during the dump is missed.
+  if (!DumpLinks()) {
+    LOG(ERROR) << "Links are looked up in the kernel until their next "
+               << "notification";
+    rtnl_handler_->RequestDump(RTNLHandler::kRequestLink);
+  }
+}
+
+void DeviceInfo::Stop() {
+  link_listener_.reset();
+  links_.clear();
+  RebuildTable();
+}
+
+bool DeviceInfo::DumpLinks() {
+  int fd = sockets_->Socket(PF_NETLINK, SOCK_RAW | SOCK_CLOEXEC,
+                            NETLINK_ROUTE);
+  if (fd == -1) {
+    PLOG(ERROR) << "Failed to create rtnetlink socket";
+    return false;
+  }
+  shill::ScopedSocketCloser socket_closer(sockets_.get(), fd);
+
+  struct {
+    struct nlmsghdr header;
+    struct ifinfomsg body;
+  } request;
+  memset(&request, 0, sizeof(request));
+  request.header.nlmsg_len = sizeof(request);
+  request.header.nlmsg_type = RTM_GETLINK;
+  request.header.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+  request.header.nlmsg_seq = dump_sequence_++;
+  request.body.ifi_family = AF_UNSPEC;
+  if (sockets_->Send(fd, &request, sizeof(request), 0) !=
+      static_cast<ssize_t>(sizeof(request))) {
+    PLOG(ERROR) << "Failed to send the link dump request";
+    return false;
+  }
+
+  dump_buffer_.resize(kDumpBufferSize);
+  std::unordered_set<int> dumped_links;
+  for (;;) {
+    ssize_t received = sockets_->RecvFrom(fd,
+                                          dump_buffer_.data(),
+                                          dump_buffer_.size(),
+                                          0,
+                                          nullptr,
+                                          nullptr);
+    if (received < 0 && errno == EINTR) {
+      continue;
+    }
+    if (received <= 0) {
+      PLOG(ERROR) << "Failed to receive the link dump";
+      return false;
+    }
+    int remaining = static_cast<int>(received);
+    for (const struct nlmsghdr* message =
+             reinterpret_cast<const struct nlmsghdr*>(dump_buffer_.data());
+         NLMSG_OK(message, remaining);
+         message = NLMSG_NEXT(message, remaining)) {
+      if (message->nlmsg_seq != request.header.nlmsg_seq) {
+        continue;
+      }
+      if (message->nlmsg_type == NLMSG_DONE) {
+        RemoveLinksNotIn(dumped_links);
+        return true;
+      }
+      if (message->nlmsg_type == NLMSG_ERROR) {
+        LOG(ERROR) << "The link dump failed";
+        return false;
+      }
+      if (message->nlmsg_type == RTM_NEWLINK) {
+        AddDumpedLink(message, &dumped_links);
+      }
+    }
+  }
+}
+
 bool DeviceInfo::GetDeviceInfo(const std::string& interface_name,
                                ByteString* mac_address,
-                               unsigned int* interface_index ) {
-  struct ifreq ifr;
-  size_t if_name_len = interface_name.size();
-  if (if_name_len > IFNAMSIZ) {
+                               unsigned int* interface_index) {
+  if (interface_name.size() >= IFNAMSIZ) {
     LOG(ERROR) << "Interface name is too long.";
     return false;
   }
+  if (GetDeviceInfoFromTable(interface_name, mac_address, interface_index)) {
+    return true;
+  }
+  return GetDeviceInfoFromKernel(interface_name, mac_address, interface_index);
+}
+
+bool DeviceInfo::MakeKey(const std::string& interface_name, uint64_t key[2]) {
+  char name[sizeof(uint64_t) * 2];
+  if (interface_name.size() >= sizeof(name)) {
+    return false;
+  }
+  memset(name, 0, sizeof(name));
+  memcpy(name, interface_name.data(), interface_name.size());
+  memcpy(key, name, sizeof(name));
+  return true;
+}
+
+size_t DeviceInfo::HashKey(const uint64_t key[2]) {
+  uint64_t hash = (key[0] ^ (key[1] * 0x9e3779b97f4a7c15ULL)) *
+      0xff51afd7ed558ccdULL;
+  return static_cast<size_t>(hash ^ (hash >> 29));
+}
+
+bool DeviceInfo::GetDeviceInfoFromTable(const std::string& interface_name,
+                                        ByteString* mac_address,
+                                        unsigned int* interface_index) {
+  uint64_t key[2];
+  if (!MakeKey(interface_name, key)) {
+    return false;
+  }
+  size_t start = HashKey(key);
+  for (int attempt = 0; attempt < kMaxTableReadAttempts; attempt++) {
+    uint32_t sequence = sequence_.load(std::memory_order_acquire);
+    if (sequence & 1) {
+      // The table is being updated, let the writer run.
+      sched_yield();
+      continue;
+    }
+    bool found = false;
+    uint64_t state_and_index = 0;
+    uint64_t hardware_address = 0;
+    for (size_t i = 0; i < kTableSize; i++) {
+      const Slot& slot = slots_[(start + i) & (kTableSize - 1)];
+      state_and_index = slot.state_and_index.load(std::memory_order_relaxed);
+      uint64_t state = state_and_index & kSlotStateMask;
+      if (state == kSlotEmpty) {
+        break;
+      }
+      if (state == kSlotUsed &&
+          slot.name[0].load(std::memory_order_relaxed) == key[0] &&
+          slot.name[1].load(std::memory_order_relaxed) == key[1]) {
+        hardware_address =
+            slot.hardware_address.load(std::memory_order_relaxed);
+        found = true;
+        break;
+      }
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (sequence_.load(std::memory_order_relaxed) != sequence) {
+      // Raced with an update, the copy may be inconsistent.
+      continue;
+    }
+    if (!found) {
+      return false;
+    }
+    uint8_t address[sizeof(hardware_address)];
+    memcpy(address, &hardware_address, sizeof(hardware_address));
+    *mac_address = ByteString(address, IFHWADDRLEN);
+    *interface_index =
+        static_cast<unsigned int>(state_and_index >> kSlotIndexShift);
+    return true;
+  }
+  LOG(WARNING) << "Link table busy, " << interface_name << " not found";
+  return false;
+}
+
+bool DeviceInfo::GetDeviceInfoFromKernel(const std::string& interface_name,
+                                         ByteString* mac_address,
+                                         unsigned int* interface_index) {
+  struct ifreq ifr;
+  size_t if_name_len = interface_name.size();
   memcpy(ifr.ifr_name, interface_name.c_str(), if_name_len);
   ifr.ifr_name[if_name_len] = 0;
   int fd = sockets_->Socket(AF_INET, SOCK_DGRAM, 0);
@@ -84,5 +287,211 @@ bool DeviceInfo::GetDeviceInfo(const std::string& interface_name,
   return true;
 }
 
-}  // namespace dhcp_client
+void DeviceInfo::LinkMsgHandler(const RTNLMessage& msg) {
+  if (msg.type() != RTNLMessage::kTypeLink) {
+    return;
+  }
+  int interface_index = msg.interface_index();
+  if (msg.mode() == RTNLMessage::kModeDelete) {
+    RemoveLink(interface_index);
+    return;
+  }
+  if (msg.mode() != RTNLMessage::kModeAdd ||
+      !msg.HasAttribute(IFLA_IFNAME) ||
+      !msg.HasAttribute(IFLA_ADDRESS)) {
+    return;
+  }
+  ByteString name_bytes = msg.GetAttribute(IFLA_IFNAME);
+  std::string interface_name(
+      reinterpret_cast<const char*>(name_bytes.GetConstData()),
+      strnlen(reinterpret_cast<const char*>(name_bytes.GetConstData()),
+              name_bytes.GetLength()));
+  AddLink(interface_index, interface_name, msg.GetAttribute(IFLA_ADDRESS));
+}
+
+void DeviceInfo::AddDumpedLink(const struct nlmsghdr* message,
+                               std::unordered_set<int>* dumped_links) {
+  if (message->nlmsg_len < NLMSG_LENGTH(sizeof(struct ifinfomsg))) {
+    return;
+  }
+  const struct ifinfomsg* info =
+      static_cast<const struct ifinfomsg*>(NLMSG_DATA(message));
+  std::string interface_name;
+  ByteString hardware_address;
+  bool has_name = false;
+  bool has_address = false;
+  int remaining = IFLA_PAYLOAD(message);
+  for (const struct rtattr* attribute = IFLA_RTA(info);
+       RTA_OK(attribute, remaining);
+       attribute = RTA_NEXT(attribute, remaining)) {
+    const char* data = static_cast<const char*>(RTA_DATA(attribute));
+    size_t length = RTA_PAYLOAD(attribute);
+    if (attribute->rta_type == IFLA_IFNAME) {
+      interface_name.assign(data, strnlen(data, length));
+      has_name = true;
+    } else if (attribute->rta_type == IFLA_ADDRESS) {
+      hardware_address =
+          ByteString(reinterpret_cast<const unsigned char*>(data), length);
+      has_address = true;
+    }
+  }
+  dumped_links->insert(info->ifi_index);
+  if (has_name && has_address) {
+    AddLink(info->ifi_index, interface_name, hardware_address);
+  }
+}
+
+void DeviceInfo::RemoveLinksNotIn(const std::unordered_set<int>& links) {
+  std::vector<int> removed_links;
+  for (const auto& index_and_link : links_) {
+    if (links.count(index_and_link.first) == 0) {
+      removed_links.push_back(index_and_link.first);
+    }
+  }
+  for (int interface_index : removed_links) {
+    RemoveLink(interface_index);
+  }
+}
+
+void DeviceInfo::AddLink(int interface_index,
+                         const std::string& interface_name,
+                         const ByteString& hardware_address) {
+  uint64_t key[2];
+  if (interface_index <= 0 || !MakeKey(interface_name, key)) {
+    return;
+  }
+  // Only Ethernet-like addresses fit in a slot, the other links are
+  // looked up in the kernel.
+  if (hardware_address.GetLength() != IFHWADDRLEN) {
+    RemoveLink(interface_index);
+    return;
+  }
+  auto it = links_.find(interface_index);
+  if (it != links_.end() &&
+      it->second.name == interface_name &&
+      it->second.hardware_address.Equals(hardware_address)) {
+    return;
+  }
+  BeginUpdate();
+  if (it != links_.end()) {
+    // The interface was renamed or changed its address.
+    EraseSlot(it->second.name);
+  }
+  // The name may still be held by a link whose removal is not known yet,
+  // e.g. when the interface was recreated. Only the latest link keeps it.
+  int previous_index = EraseSlot(interface_name);
+  if (previous_index != 0 && previous_index != interface_index) {
+    links_.erase(previous_index);
+  }
+  Link& link = links_[interface_index];
+  link.name = interface_name;
+  link.hardware_address = hardware_address;
+  if ((used_slots_ + deleted_slots_ + 1) * 4 > kTableSize * 3) {
+    // Too many deleted slots, lookups of missing names get long.
+    RebuildTable();
+  } else {
+    InsertSlot(interface_index, link);
+  }
+  EndUpdate();
+}
 
+void DeviceInfo::RemoveLink(int interface_index) {
+  auto it = links_.find(interface_index);
+  if (it == links_.end()) {
+    return;
+  }
+  BeginUpdate();
+  EraseSlot(it->second.name);
+  EndUpdate();
+  links_.erase(it);
+}
+
+void DeviceInfo::BeginUpdate() {
+  uint32_t sequence = sequence_.load(std::memory_order_relaxed);
+  sequence_.store(sequence + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+}
+
+void DeviceInfo::EndUpdate() {
+  uint32_t sequence = sequence_.load(std::memory_order_relaxed);
+  sequence_.store(sequence + 1, std::memory_order_release);
+}
+
+void DeviceInfo::InsertSlot(int interface_index, const Link& link) {
+  if ((used_slots_ + 1) * 2 > kTableSize) {
+    LOG(WARNING) << "Too many interfaces, " << link.name
+                 << " is not cached.";
+    return;
+  }
+  uint64_t key[2];
+  MakeKey(link.name, key);
+  size_t start = HashKey(key);
+  for (size_t i = 0; i < kTableSize; i++) {
+    Slot& slot = slots_[(start + i) & (kTableSize - 1)];
+    uint64_t state =
+        slot.state_and_index.load(std::memory_order_relaxed) & kSlotStateMask;
+    if (state == kSlotUsed) {
+      continue;
+    }
+    if (state == kSlotDeleted) {
+      deleted_slots_--;
+    }
+    uint64_t hardware_address = 0;
+    memcpy(&hardware_address, link.hardware_address.GetConstData(),
+           IFHWADDRLEN);
+    slot.name[0].store(key[0], std::memory_order_relaxed);
+    slot.name[1].store(key[1], std::memory_order_relaxed);
+    slot.hardware_address.store(hardware_address, std::memory_order_relaxed);
+    slot.state_and_index.store(
+        kSlotUsed |
+            (static_cast<uint64_t>(interface_index) << kSlotIndexShift),
+        std::memory_order_relaxed);
+    used_slots_++;
+    return;
+  }
+}
+
+int DeviceInfo::EraseSlot(const std::string& interface_name) {
+  uint64_t key[2];
+  MakeKey(interface_name, key);
+  size_t start = HashKey(key);
+  for (size_t i = 0; i < kTableSize; i++) {
+    Slot& slot = slots_[(start + i) & (kTableSize - 1)];
+    uint64_t state =
+        slot.state_and_index.load(std::memory_order_relaxed) & kSlotStateMask;
+    if (state == kSlotEmpty) {
+      return 0;
+    }
+    if (state == kSlotUsed &&
+        slot.name[0].load(std::memory_order_relaxed) == key[0] &&
+        slot.name[1].load(std::memory_order_relaxed) == key[1]) {
+      uint64_t state_and_index =
+          slot.state_and_index.load(std::memory_order_relaxed);
+      slot.state_and_index.store(kSlotDeleted, std::memory_order_relaxed);
+      used_slots_--;
+      deleted_slots_++;
+      return static_cast<int>(state_and_index >> kSlotIndexShift);
+    }
+  }
+  return 0;
+}
+
+void DeviceInfo::RebuildTable() {
+  bool updating = sequence_.load(std::memory_order_relaxed) & 1;
+  if (!updating) {
+    BeginUpdate();
+  }
+  for (size_t i = 0; i < kTableSize; i++) {
+    slots_[i].state_and_index.store(kSlotEmpty, std::memory_order_relaxed);
+  }
+  used_slots_ = 0;
+  deleted_slots_ = 0;
+  for (const auto& index_and_link : links_) {
+    InsertSlot(index_and_link.first, index_and_link.second);
+  }
+  if (!updating) {
+    EndUpdate();
+  }
+}
+
+}  // namespace dhcp_client
@@ -17,34 +17,137 @@
 #ifndef DHCP_CLIENT_DEVICE_INFO_H_
 #define DHCP_CLIENT_DEVICE_INFO_H_
 
+#include <linux/netlink.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
 #include <memory>
 #include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
 
 #include <base/lazy_instance.h>
 #include <base/macros.h>
 
 #include "shill/net/byte_string.h"
 #include "shill/net/rtnl_handler.h"
+#include "shill/net/rtnl_listener.h"
+#include "shill/net/rtnl_message.h"
 #include "shill/net/sockets.h"
 
 namespace dhcp_client {
 
+// Interface name to hardware address and index lookups.
+// Once started, the links are kept in a table filled by a RTM_GETLINK
+// dump and updated from the RTNL link notifications, so that lookups do
+// not need any system call. The table is written on the thread of the
+// RTNL handler only, and read from any thread without locking under a
+// sequence lock. Interfaces missing from the table are looked up in the
+// kernel.
 class DeviceInfo {
  public:
   virtual ~DeviceInfo();
   static DeviceInfo* GetInstance();
+
+  // Subscribe to the link notifications and fill the table from a dump
+  // of the links, which is complete when this returns.
+  // Must be called on the thread of the RTNL handler.
+  void Start();
+  void Stop();
+
+  // Bring the table up to date with a RTM_GETLINK dump on a netlink
+  // socket of its own, blocking until the kernel has sent all the links.
+  // The links missing from the dump are removed.
+  // Returns false if the dump failed, the table is then only updated by
+  // the notifications. Must be called on the thread of the RTNL handler.
+  bool DumpLinks();
+
+  // Can be called from any thread.
   bool GetDeviceInfo(const std::string& interface_name,
                      shill::ByteString* mac_address,
                      unsigned int* interface_index);
+  // Same as GetDeviceInfo() without the lookup in the kernel, for the
+  // callers that just made the table current with DumpLinks(). Also
+  // fails if the table keeps changing during the lookup.
+  bool GetDeviceInfoFromTable(const std::string& interface_name,
+                              shill::ByteString* mac_address,
+                              unsigned int* interface_index);
+
  protected:
   DeviceInfo();
 
  private:
   friend class DeviceInfoTest;
+  friend class ManagerTest;
+  friend struct base::DefaultLazyInstanceTraits<DeviceInfo>;
+
+  // Number of slots of the table, half of them can be used.
+  static const size_t kTableSize = 1 << 14;
+
+  // A table slot is made of atomic words so that a reader can copy it
+  // while the writer updates it, the sequence lock tells if the copy is
+  // consistent.
+  struct Slot {
+    // Interface name, NUL padded.
+    std::atomic<uint64_t> name[2];
+    // Slot state in the low bits, interface index in the high ones.
+    std::atomic<uint64_t> state_and_index;
+    std::atomic<uint64_t> hardware_address;
+  };
+
+  struct Link {
+    std::string name;
+    shill::ByteString hardware_address;
+  };
+
+  // Returns false if the name does not fit in a slot.
+  static bool MakeKey(const std::string& interface_name, uint64_t key[2]);
+  static size_t HashKey(const uint64_t key[2]);
+
+  bool GetDeviceInfoFromKernel(const std::string& interface_name,
+                               shill::ByteString* mac_address,
+                               unsigned int* interface_index);
+
+  void LinkMsgHandler(const shill::RTNLMessage& msg);
+  // Add the link of a RTM_NEWLINK message of the dump, and its index to
+  // |dumped_links|.
+  void AddDumpedLink(const struct nlmsghdr* message,
+                     std::unordered_set<int>* dumped_links);
+  void AddLink(int interface_index,
+               const std::string& interface_name,
+               const shill::ByteString& hardware_address);
+  void RemoveLink(int interface_index);
+  // Remove the links whose index is not in |links|, which a complete
+  // dump shows are gone even if their notification is still queued.
+  void RemoveLinksNotIn(const std::unordered_set<int>& links);
+
+  // Writer side of the table, must be called between BeginUpdate() and
+  // EndUpdate().
+  void BeginUpdate();
+  void EndUpdate();
+  void InsertSlot(int interface_index, const Link& link);
+  // Returns the interface index of the erased slot, 0 if there is none.
+  int EraseSlot(const std::string& interface_name);
+  // Drop the deleted slots by filling the table again from |links_|.
+  void RebuildTable();
 
   std::unique_ptr<shill::Sockets> sockets_;
   shill::RTNLHandler* rtnl_handler_;
-  friend struct base::DefaultLazyInstanceTraits<DeviceInfo>;
+  std::unique_ptr<shill::RTNLListener> link_listener_;
+
+  // Sequence lock of |slots_|, odd while the table is being updated.
+  std::atomic<uint32_t> sequence_;
+  std::unique_ptr<Slot[]> slots_;
+  size_t used_slots_;
+  size_t deleted_slots_;
+  // Known links by interface index, only used by the writer.
+  std::unordered_map<int, Link> links_;
+  // Sequence number of the next dump request.
+  uint32_t dump_sequence_;
+  // Kept between dumps to reuse its storage.
+  std::vector<uint8_t> dump_buffer_;
 
   DISALLOW_COPY_AND_ASSIGN(DeviceInfo);
 };
@@ -16,22 +16,32 @@
 
 #include <dhcp_client/device_info.h>
 
+#include <linux/rtnetlink.h>
 #include <net/if.h>
 #include <sys/ioctl.h>
 
+#include <cstring>
+#include <vector>
+
+#include <base/strings/stringprintf.h>
+
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
 
 #include <shill/net/byte_string.h>
 #include <shill/net/mock_sockets.h>
 #include <shill/net/mock_rtnl_handler.h>
+#include <shill/net/rtnl_message.h>
 
 using shill::ByteString;
 using shill::MockRTNLHandler;
 using shill::MockSockets;
+using shill::RTNLHandler;
+using shill::RTNLMessage;
 using ::testing::_;
 using ::testing::DoAll;
 using ::testing::ElementsAreArray;
+using ::testing::Invoke;
 using ::testing::Return;
 
 namespace {
@@ -41,6 +51,9 @@ const unsigned int kFakeInterfaceIndex = 1;
 const std::string kFakeDeviceName = "eth0";
 const std::string kFakeLongDeviceName = "a_long_device_name";
 const uint8_t kFakeMacAddress[] = {0x00, 0x01, 0x02, 0xaa, 0xbb, 0xcc};
+const std::string kFakeOtherDeviceName = "eth1";
+const int kFakeNetlinkFd = 98;
+const unsigned int kFakeOtherInterfaceIndex = 2;
 
 }
 
@@ -55,9 +68,98 @@ class DeviceInfoTest : public testing::Test {
     sockets_ = new MockSockets();
     device_info_->sockets_.reset(sockets_);
     device_info_->rtnl_handler_ = &rtnl_handler_;
+    // The instance is shared by the tests, start with an empty table.
+    device_info_->Stop();
   }
 
  protected:
+  void SendLinkMessage(RTNLMessage::Mode mode,
+                       int interface_index,
+                       const std::string& interface_name) {
+    RTNLMessage msg(RTNLMessage::kTypeLink, mode, 0, 0, 0, interface_index,
+                    AF_UNSPEC);
+    msg.SetAttribute(IFLA_IFNAME,
+                     ByteString(interface_name, true /* copy_terminator */));
+    msg.SetAttribute(IFLA_ADDRESS,
+                     ByteString(kFakeMacAddress, sizeof(kFakeMacAddress)));
+    device_info_->LinkMsgHandler(msg);
+  }
+
+  // Append a message of the link dump answering the request |sequence|
+  // to |dump|, a link if |interface_name| is not empty.
+  static void AddDumpMessage(uint16_t type,
+                             uint32_t sequence,
+                             int interface_index,
+                             const std::string& interface_name,
+                             std::vector<uint8_t>* dump) {
+    size_t offset = dump->size();
+    dump->resize(offset + NLMSG_SPACE(sizeof(struct ifinfomsg)), 0);
+    struct ifinfomsg info;
+    memset(&info, 0, sizeof(info));
+    info.ifi_index = interface_index;
+    memcpy(&(*dump)[offset + NLMSG_HDRLEN], &info, sizeof(info));
+    if (!interface_name.empty()) {
+      AddAttribute(IFLA_IFNAME, interface_name.c_str(),
+                   interface_name.size() + 1, dump);
+      AddAttribute(IFLA_ADDRESS, kFakeMacAddress, sizeof(kFakeMacAddress),
+                   dump);
+    }
+    struct nlmsghdr header;
+    memset(&header, 0, sizeof(header));
+    header.nlmsg_len = dump->size() - offset;
+    header.nlmsg_type = type;
+    header.nlmsg_flags = NLM_F_MULTI;
+    header.nlmsg_seq = sequence;
+    memcpy(&(*dump)[offset], &header, sizeof(header));
+  }
+
+  static void AddAttribute(uint16_t type,
+                           const void* data,
+                           size_t length,
+                           std::vector<uint8_t>* dump) {
+    size_t offset = dump->size();
+    dump->resize(offset + RTA_SPACE(length), 0);
+    struct rtattr attribute;
+    attribute.rta_len = RTA_LENGTH(length);
+    attribute.rta_type = type;
+    memcpy(&(*dump)[offset], &attribute, sizeof(attribute));
+    memcpy(&(*dump)[offset + RTA_LENGTH(0)], data, length);
+  }
+
+  uint32_t NextDumpSequence() const { return device_info_->dump_sequence_; }
+
+  // The dump socket reads |dump|, one element at a time.
+  void ExpectLinkDump(const std::vector<std::vector<uint8_t>>& dump) {
+    EXPECT_CALL(*sockets_, Socket(PF_NETLINK, _, NETLINK_ROUTE))
+        .WillOnce(Return(kFakeNetlinkFd));
+    EXPECT_CALL(*sockets_, Send(kFakeNetlinkFd, _, _, 0))
+        .WillOnce(Invoke([](int fd, const void* buf, size_t len,
+                            int flags) {
+          const struct nlmsghdr* header =
+              static_cast<const struct nlmsghdr*>(buf);
+          EXPECT_EQ(RTM_GETLINK, header->nlmsg_type);
+          EXPECT_TRUE(header->nlmsg_flags & NLM_F_DUMP);
+          return static_cast<ssize_t>(len);
+        }));
+    auto& recv = EXPECT_CALL(*sockets_,
+                             RecvFrom(kFakeNetlinkFd, _, _, _, _, _));
+    for (const std::vector<uint8_t>& read : dump) {
+      recv.WillOnce(Invoke([read](int fd, void* buf, size_t len, int flags,
+                                  struct sockaddr* src_addr,
+                                  socklen_t* addrlen) {
+        EXPECT_GE(len, read.size());
+        memcpy(buf, read.data(), read.size());
+        return static_cast<ssize_t>(read.size());
+      }));
+    }
+    EXPECT_CALL(*sockets_, Close(kFakeNetlinkFd)).WillOnce(Return(0));
+  }
+
+  // Lookups that miss the table fail with this.
+  void FailKernelLookups() {
+    EXPECT_CALL(*sockets_, Socket(_, _, _)).WillRepeatedly(Return(-1));
+  }
+
   DeviceInfo* device_info_;
   MockRTNLHandler rtnl_handler_;
   MockSockets* sockets_;  // Owned by device_info_.
@@ -137,4 +239,190 @@ TEST_F(DeviceInfoTest, GetDeviceInfoFailedToGetInterfaceIndex) {
                                            &interface_index));
 }
 
+TEST_F(DeviceInfoTest, StartFillsLinkTable) {
+  // The dump of the request being sent next comes in two reads.
+  uint32_t sequence = NextDumpSequence();
+  std::vector<std::vector<uint8_t>> dump(2);
+  AddDumpMessage(RTM_NEWLINK, sequence, kFakeInterfaceIndex,
+                 kFakeDeviceName, &dump[0]);
+  AddDumpMessage(RTM_NEWLINK, sequence, kFakeOtherInterfaceIndex,
+                 kFakeOtherDeviceName, &dump[1]);
+  AddDumpMessage(NLMSG_DONE, sequence, 0, "", &dump[1]);
+  ExpectLinkDump(dump);
+  EXPECT_CALL(rtnl_handler_, Start(RTMGRP_LINK));
+  EXPECT_CALL(rtnl_handler_, RequestDump(_)).Times(0);
+  device_info_->Start();
+
+  // Both links are known as soon as Start() returns.
+  EXPECT_CALL(*sockets_, Socket(_, _, _)).Times(0);
+  ByteString mac_address;
+  unsigned int interface_index;
+  EXPECT_TRUE(device_info_->GetDeviceInfo(kFakeDeviceName,
+                                          &mac_address,
+                                          &interface_index));
+  EXPECT_EQ(kFakeInterfaceIndex, interface_index);
+  EXPECT_TRUE(device_info_->GetDeviceInfo(kFakeOtherDeviceName,
+                                          &mac_address,
+                                          &interface_index));
+  EXPECT_EQ(kFakeOtherInterfaceIndex, interface_index);
+  EXPECT_THAT(kFakeMacAddress,
+              ElementsAreArray(mac_address.GetConstData(),
+                               sizeof(kFakeMacAddress)));
+  device_info_->Stop();
+}
+
+TEST_F(DeviceInfoTest, DumpSkipsOtherRequests) {
+  uint32_t sequence = NextDumpSequence();
+  std::vector<std::vector<uint8_t>> dump(1);
+  AddDumpMessage(RTM_NEWLINK, sequence - 1, kFakeOtherInterfaceIndex,
+                 kFakeOtherDeviceName, &dump[0]);
+  AddDumpMessage(RTM_NEWLINK, sequence, kFakeInterfaceIndex,
+                 kFakeDeviceName, &dump[0]);
+  AddDumpMessage(NLMSG_DONE, sequence, 0, "", &dump[0]);
+  ExpectLinkDump(dump);
+  EXPECT_TRUE(device_info_->DumpLinks());
+  FailKernelLookups();
+  ByteString mac_address;
+  unsigned int interface_index;
+  EXPECT_TRUE(device_info_->GetDeviceInfo(kFakeDeviceName,
+                                          &mac_address,
+                                          &interface_index));
+  EXPECT_FALSE(device_info_->GetDeviceInfo(kFakeOtherDeviceName,
+                                           &mac_address,
+                                           &interface_index));
+}
+
+TEST_F(DeviceInfoTest, DumpRemovesMissingLinks) {
+  SendLinkMessage(RTNLMessage::kModeAdd, kFakeOtherInterfaceIndex,
+                  kFakeOtherDeviceName);
+  uint32_t sequence = NextDumpSequence();
+  std::vector<std::vector<uint8_t>> dump(1);
+  AddDumpMessage(RTM_NEWLINK, sequence, kFakeInterfaceIndex,
+                 kFakeDeviceName, &dump[0]);
+  AddDumpMessage(NLMSG_DONE, sequence, 0, "", &dump[0]);
+  ExpectLinkDump(dump);
+  EXPECT_TRUE(device_info_->DumpLinks());
+  FailKernelLookups();
+  ByteString mac_address;
+  unsigned int interface_index;
+  EXPECT_TRUE(device_info_->GetDeviceInfo(kFakeDeviceName,
+                                          &mac_address,
+                                          &interface_index));
+  EXPECT_FALSE(device_info_->GetDeviceInfo(kFakeOtherDeviceName,
+                                           &mac_address,
+                                           &interface_index));
+}
+
+TEST_F(DeviceInfoTest, StartRequestsDumpIfDumpFails) {
+  EXPECT_CALL(*sockets_, Socket(PF_NETLINK, _, NETLINK_ROUTE))
+      .WillOnce(Return(-1));
+  EXPECT_CALL(rtnl_handler_, Start(RTMGRP_LINK));
+  EXPECT_CALL(rtnl_handler_, RequestDump(RTNLHandler::kRequestLink));
+  device_info_->Start();
+  device_info_->Stop();
+}
+
+TEST_F(DeviceInfoTest, DumpFailsOnError) {
+  uint32_t sequence = NextDumpSequence();
+  std::vector<std::vector<uint8_t>> dump(1);
+  AddDumpMessage(NLMSG_ERROR, sequence, 0, "", &dump[0]);
+  ExpectLinkDump(dump);
+  EXPECT_FALSE(device_info_->DumpLinks());
+}
+
+TEST_F(DeviceInfoTest, GetDeviceInfoFromLinkTable) {
+  SendLinkMessage(RTNLMessage::kModeAdd, kFakeInterfaceIndex, kFakeDeviceName);
+  EXPECT_CALL(*sockets_, Socket(_, _, _)).Times(0);
+  EXPECT_CALL(rtnl_handler_, GetInterfaceIndex(_)).Times(0);
+  ByteString mac_address;
+  unsigned int interface_index;
+  EXPECT_TRUE(device_info_->GetDeviceInfo(kFakeDeviceName,
+                                          &mac_address,
+                                          &interface_index));
+  EXPECT_EQ(kFakeInterfaceIndex, interface_index);
+  EXPECT_THAT(kFakeMacAddress,
+              ElementsAreArray(mac_address.GetConstData(),
+                               sizeof(kFakeMacAddress)));
+}
+
+TEST_F(DeviceInfoTest, LinkRemoved) {
+  SendLinkMessage(RTNLMessage::kModeAdd, kFakeInterfaceIndex, kFakeDeviceName);
+  SendLinkMessage(RTNLMessage::kModeDelete, kFakeInterfaceIndex,
+                  kFakeDeviceName);
+  FailKernelLookups();
+  ByteString mac_address;
+  unsigned int interface_index;
+  EXPECT_FALSE(device_info_->GetDeviceInfo(kFakeDeviceName,
+                                           &mac_address,
+                                           &interface_index));
+}
+
+TEST_F(DeviceInfoTest, LinkRenamed) {
+  SendLinkMessage(RTNLMessage::kModeAdd, kFakeInterfaceIndex, kFakeDeviceName);
+  SendLinkMessage(RTNLMessage::kModeAdd, kFakeInterfaceIndex,
+                  kFakeOtherDeviceName);
+  FailKernelLookups();
+  ByteString mac_address;
+  unsigned int interface_index;
+  EXPECT_FALSE(device_info_->GetDeviceInfo(kFakeDeviceName,
+                                           &mac_address,
+                                           &interface_index));
+  EXPECT_TRUE(device_info_->GetDeviceInfo(kFakeOtherDeviceName,
+                                          &mac_address,
+                                          &interface_index));
+  EXPECT_EQ(kFakeInterfaceIndex, interface_index);
+}
+
+TEST_F(DeviceInfoTest, LinkRecreated) {
+  // The new link shows up before the removal of the old one.
+  SendLinkMessage(RTNLMessage::kModeAdd, kFakeInterfaceIndex, kFakeDeviceName);
+  SendLinkMessage(RTNLMessage::kModeAdd, kFakeInterfaceIndex + 1,
+                  kFakeDeviceName);
+  FailKernelLookups();
+  ByteString mac_address;
+  unsigned int interface_index;
+  EXPECT_TRUE(device_info_->GetDeviceInfo(kFakeDeviceName,
+                                          &mac_address,
+                                          &interface_index));
+  EXPECT_EQ(kFakeInterfaceIndex + 1, interface_index);
+  // The late removal of the old link leaves the new one alone.
+  SendLinkMessage(RTNLMessage::kModeDelete, kFakeInterfaceIndex,
+                  kFakeDeviceName);
+  EXPECT_TRUE(device_info_->GetDeviceInfo(kFakeDeviceName,
+                                          &mac_address,
+                                          &interface_index));
+  EXPECT_EQ(kFakeInterfaceIndex + 1, interface_index);
+}
+
+TEST_F(DeviceInfoTest, LinkChurn) {
+  // Enough links come and go to fill the table with deleted slots.
+  const int kLinks = 64;
+  const int kRounds = 1000;
+  for (int round = 0; round < kRounds; round++) {
+    for (int i = 0; i < kLinks; i++) {
+      int index = round * kLinks + i + 1;
+      SendLinkMessage(RTNLMessage::kModeAdd, index,
+                      base::StringPrintf("veth%d", index));
+    }
+    if (round == kRounds - 1) {
+      break;
+    }
+    for (int i = 0; i < kLinks; i++) {
+      int index = round * kLinks + i + 1;
+      SendLinkMessage(RTNLMessage::kModeDelete, index,
+                      base::StringPrintf("veth%d", index));
+    }
+  }
+  EXPECT_CALL(*sockets_, Socket(_, _, _)).Times(0);
+  for (int i = 0; i < kLinks; i++) {
+    int index = (kRounds - 1) * kLinks + i + 1;
+    ByteString mac_address;
+    unsigned int interface_index;
+    EXPECT_TRUE(device_info_->GetDeviceInfo(base::StringPrintf("veth%d", index),
+                                            &mac_address,
+                                            &interface_index));
+    EXPECT_EQ(static_cast<unsigned int>(index), interface_index);
+  }
+}
+
 }  // namespace dhcp_client
@@ -56,15 +56,27 @@
         },
       },
       'sources': [
+        'batched_socket.cc',
+        'checksum.cc',
         'daemon.cc',
         'device_info.cc',
         'dhcp_message.cc',
         'dhcp_options_parser.cc',
         'dhcp_options_writer.cc',
         'dhcpv4.cc',
+        'frame_template.cc',
+        'frame_writer.cc',
+        'lease_log.cc',
         'message_loop_event_dispatcher.cc',
         'manager.cc',
+        'manager_shard.cc',
+        'packet_demuxer.cc',
+        'packet_ring.cc',
+        'rtnl_lease_applier.cc',
         'service.cc',
+        'socket_filter.cc',
+        'sockets.cc',
+        'timer_wheel_event_dispatcher.cc',
       ],
     },
     {
@@ -79,17 +91,74 @@
   'conditions': [
     ['USE_test == 1', {
       'targets': [
+        {
+          'target_name': 'libdhcp_client_simulation',
+          'type': 'static_library',
+          'dependencies': ['libdhcp_client'],
+          'sources': [
+            'simulated_event_dispatcher.cc',
+            'simulated_network.cc',
+            'simulated_server.cc',
+            'simulation.cc',
+          ],
+        },
+        {
+          'target_name': 'dhcp_client_simulator',
+          'type': 'executable',
+          'dependencies': ['libdhcp_client_simulation'],
+          'sources': [
+            'simulator_main.cc',
+          ],
+        },
         {
           'target_name': 'dhcp_client_testrunner',
           'type': 'executable',
-          'dependencies': ['libdhcp_client'],
+          'dependencies': [
+            'libdhcp_client',
+            'libdhcp_client_simulation',
+          ],
           'includes': ['../../../../platform2/common-mk/common_test.gypi'],
           'sources': [
+            'allocation_counter.cc',
+            'batched_socket_unittest.cc',
+            'checksum_unittest.cc',
             'device_info_unittest.cc',
+            'dhcpv4_unittest.cc',
             'dhcp_message_unittest.cc',
             'dhcp_options_parser_unittest.cc',
             'dhcp_options_writer_unittest.cc',
+            'frame_template_unittest.cc',
+            'frame_writer_unittest.cc',
+            'lease_log_unittest.cc',
+            'manager_unittest.cc',
+            'mpsc_queue_unittest.cc',
+            'packet_demuxer_unittest.cc',
+            'packet_ring_unittest.cc',
+            'rtnl_lease_applier_unittest.cc',
+            'service_unittest.cc',
+            'simulated_event_dispatcher_unittest.cc',
+            'simulation_unittest.cc',
+            'socket_filter_unittest.cc',
             'testrunner.cc',
+            'timer_wheel_event_dispatcher_unittest.cc',
+          ],
+        },
+        {
+          'target_name': 'dhcp_client_benchmark',
+          'type': 'executable',
+          'dependencies': ['libdhcp_client'],
+          'link_settings': {
+            'libraries': [
+              '-lbenchmark',
+            ],
+          },
+          'sources': [
+            'benchmark_corpus.cc',
+            'benchmarkrunner.cc',
+            'checksum_benchmark.cc',
+            'dhcp_message_benchmark.cc',
+            'dhcp_options_benchmark.cc',
+            'dhcpv4_benchmark.cc',
           ],
         },
       ],
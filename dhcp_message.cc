@@ -20,16 +20,17 @@
 #include <net/if_arp.h>
 #include <netinet/in.h>
 
-#include <memory>
-#include <set>
+#include <array>
+#include <cstddef>
 #include <string>
 #include <utility>
 #include <vector>
 
 #include <base/logging.h>
 
+#include "dhcp_client/checksum.h"
 #include "dhcp_client/dhcp_options.h"
-#include "dhcp_client/dhcp_options_writer.h"
+#include "dhcp_client/frame_writer.h"
 
 using shill::ByteString;
 
@@ -41,7 +42,6 @@ const int kServerNameLength = 64;
 const int kBootFileLength = 128;
 const uint32_t kMagicCookie = 0x63825363;
 const size_t kDHCPMessageMaxLength = 548;
-const size_t kDHCPMessageMinLength = 236;
 const uint8_t kDHCPMessageBootRequest = 1;
 const uint8_t kDHCPMessageBootReply = 2;
 
@@ -64,6 +64,130 @@ struct __attribute__((__packed__)) RawDHCPMessage {
   uint32_t cookie;
   uint8_t options[kDHCPOptionLength];
 };
+
+typedef bool (*OptionDecoder)(const uint8_t* buffer,
+                              uint8_t length,
+                              DHCPMessage* message);
+
+// Decodes an option into |field| of the message. The parser type is known
+// at compile time, so GetOption() is called directly rather than through
+// the vtable, and no parser object is allocated.
+template <typename Parser, typename T, T DHCPMessage::*field>
+struct FieldDecoder {
+  static bool Decode(const uint8_t* buffer,
+                     uint8_t length,
+                     DHCPMessage* message) {
+    Parser parser;
+    return parser.Parser::GetOption(buffer, length, &(message->*field));
+  }
+};
+
+template <size_t... indexes> struct IndexSequence {};
+template <size_t count, size_t... indexes>
+struct MakeIndexSequence
+    : MakeIndexSequence<count - 1, count - 1, indexes...> {};
+template <size_t... indexes>
+struct MakeIndexSequence<0, indexes...> {
+  typedef IndexSequence<indexes...> Type;
+};
+}  // namespace
+
+// Options without a specialization are ignored by the parser.
+template <uint8_t option_code>
+struct DHCPOptionTraits {
+  static constexpr OptionDecoder kDecoder = nullptr;
+};
+
+template <>
+struct DHCPOptionTraits<kDHCPOptionSubnetMask> {
+  static constexpr OptionDecoder kDecoder =
+      &FieldDecoder<UInt32Parser, uint32_t, &DHCPMessage::subnet_mask_>::Decode;
+};
+
+template <>
+struct DHCPOptionTraits<kDHCPOptionRouter> {
+  static constexpr OptionDecoder kDecoder =
+      &FieldDecoder<UInt32ListParser, std::vector<uint32_t>,
+                    &DHCPMessage::router_>::Decode;
+};
+
+template <>
+struct DHCPOptionTraits<kDHCPOptionDNSServer> {
+  static constexpr OptionDecoder kDecoder =
+      &FieldDecoder<UInt32ListParser, std::vector<uint32_t>,
+                    &DHCPMessage::dns_server_>::Decode;
+};
+
+template <>
+struct DHCPOptionTraits<kDHCPOptionDomainName> {
+  static constexpr OptionDecoder kDecoder =
+      &FieldDecoder<StringParser, std::string,
+                    &DHCPMessage::domain_name_>::Decode;
+};
+
+template <>
+struct DHCPOptionTraits<kDHCPOptionVendorSpecificInformation> {
+  static constexpr OptionDecoder kDecoder =
+      &FieldDecoder<ByteArrayParser, ByteString,
+                    &DHCPMessage::vendor_specific_info_>::Decode;
+};
+
+template <>
+struct DHCPOptionTraits<kDHCPOptionLeaseTime> {
+  static constexpr OptionDecoder kDecoder =
+      &FieldDecoder<UInt32Parser, uint32_t, &DHCPMessage::lease_time_>::Decode;
+};
+
+template <>
+struct DHCPOptionTraits<kDHCPOptionMessageType> {
+  static constexpr OptionDecoder kDecoder =
+      &FieldDecoder<UInt8Parser, uint8_t, &DHCPMessage::message_type_>::Decode;
+};
+
+template <>
+struct DHCPOptionTraits<kDHCPOptionServerIdentifier> {
+  static constexpr OptionDecoder kDecoder =
+      &FieldDecoder<UInt32Parser, uint32_t,
+                    &DHCPMessage::server_identifier_>::Decode;
+};
+
+template <>
+struct DHCPOptionTraits<kDHCPOptionMessage> {
+  static constexpr OptionDecoder kDecoder =
+      &FieldDecoder<StringParser, std::string,
+                    &DHCPMessage::error_message_>::Decode;
+};
+
+template <>
+struct DHCPOptionTraits<kDHCPOptionRenewalTime> {
+  static constexpr OptionDecoder kDecoder =
+      &FieldDecoder<UInt32Parser, uint32_t,
+                    &DHCPMessage::renewal_time_>::Decode;
+};
+
+template <>
+struct DHCPOptionTraits<kDHCPOptionRebindingTime> {
+  static constexpr OptionDecoder kDecoder =
+      &FieldDecoder<UInt32Parser, uint32_t,
+                    &DHCPMessage::rebinding_time_>::Decode;
+};
+
+template <>
+struct DHCPOptionTraits<kDHCPOptionRapidCommit> {
+  static constexpr OptionDecoder kDecoder =
+      &FieldDecoder<FlagParser, bool, &DHCPMessage::rapid_commit_>::Decode;
+};
+
+namespace {
+template <size_t... option_codes>
+constexpr std::array<OptionDecoder, sizeof...(option_codes)>
+MakeOptionDecoderTable(IndexSequence<option_codes...>) {
+  return {{DHCPOptionTraits<option_codes>::kDecoder...}};
+}
+
+// Decoder for every option code, indexed by the code itself.
+constexpr std::array<OptionDecoder, 256> kOptionDecoders =
+    MakeOptionDecoderTable(MakeIndexSequence<256>::Type());
 }  // namespace
 
 DHCPMessage::DHCPMessage()
@@ -72,90 +196,123 @@ DHCPMessage::DHCPMessage()
       message_type_(0),
       server_identifier_(0),
       renewal_time_(0),
-      rebinding_time_(0) {
-  options_map_.insert(std::make_pair(kDHCPOptionMessageType,
-      ParserContext(new UInt8Parser(), &message_type_)));
-  options_map_.insert(std::make_pair(kDHCPOptionLeaseTime,
-      ParserContext(new UInt32Parser(), &lease_time_)));
-  options_map_.insert(std::make_pair(kDHCPOptionMessage,
-      ParserContext(new StringParser(), &error_message_)));
-  options_map_.insert(std::make_pair(kDHCPOptionSubnetMask,
-      ParserContext(new UInt32Parser(), &subnet_mask_)));
-  options_map_.insert(std::make_pair(kDHCPOptionServerIdentifier,
-      ParserContext(new UInt32Parser(), &server_identifier_)));
-  options_map_.insert(std::make_pair(kDHCPOptionRenewalTime,
-      ParserContext(new UInt32Parser(), &renewal_time_)));
-  options_map_.insert(std::make_pair(kDHCPOptionRebindingTime,
-      ParserContext(new UInt32Parser(), &rebinding_time_)));
-  options_map_.insert(std::make_pair(kDHCPOptionDNSServer,
-      ParserContext(new UInt32ListParser(), &dns_server_)));
-  options_map_.insert(std::make_pair(kDHCPOptionRouter,
-      ParserContext(new UInt32ListParser(), &router_)));
-  options_map_.insert(std::make_pair(kDHCPOptionDomainName,
-      ParserContext(new StringParser(), &domain_name_)));
-  options_map_.insert(std::make_pair(kDHCPOptionVendorSpecificInformation,
-      ParserContext(new ByteArrayParser(), &vendor_specific_info_)));
+      rebinding_time_(0),
+      rapid_commit_(false) {
 }
 
 DHCPMessage::~DHCPMessage() {}
 
-bool DHCPMessage::InitFromBuffer(const unsigned char* buffer,
-                                 size_t length,
-                                 DHCPMessage* message) {
-  if (buffer == NULL) {
+DHCPMessageView::DHCPMessageView()
+    : buffer_(nullptr),
+      length_(0),
+      message_type_(0) {
+  memset(option_offsets_, 0, sizeof(option_offsets_));
+}
+
+DHCPMessageView::~DHCPMessageView() {}
+
+bool DHCPMessageView::Init(const unsigned char* buffer,
+                           size_t length,
+                           DHCPMessageView* view) {
+  if (buffer == nullptr) {
     LOG(ERROR) << "Invalid buffer address";
     return false;
   }
-  if (length < kDHCPMessageMinLength || length > kDHCPMessageMaxLength) {
+  // IsValid() reads the fixed fields up to the magic cookie.
+  if (length < offsetof(RawDHCPMessage, options) ||
+      length > kDHCPMessageMaxLength) {
     LOG(ERROR) << "Invalid DHCP message length";
     return false;
   }
-  const RawDHCPMessage* raw_message
-      = reinterpret_cast<const RawDHCPMessage*>(buffer);
-  size_t options_length = reinterpret_cast<const unsigned char*>(raw_message) +
-      length - reinterpret_cast<const unsigned char*>(raw_message->options) + 1;
-  message->opcode_ = raw_message->op;
-  message->hardware_address_type_ = raw_message->htype;
-  message->hardware_address_length_ = raw_message->hlen;
-  if (message->hardware_address_length_ > kClientHardwareAddressLength) {
-    LOG(ERROR) << "Invalid hardware address length";
-    return false;
-  }
-  message->relay_hops_ = raw_message->hops;
-  message->transaction_id_ = ntohl(raw_message->xid);
-  message->seconds_ = ntohs(raw_message->secs);
-  message->flags_ = ntohs(raw_message->flags);
-  message->client_ip_address_ = ntohl(raw_message->ciaddr);
-  message->your_ip_address_ = ntohl(raw_message->yiaddr);
-  message->next_server_ip_address_ = ntohl(raw_message->siaddr);
-  message->agent_ip_address_ = ntohl(raw_message->giaddr);
-  message->cookie_ = ntohl(raw_message->cookie);
-  message->client_hardware_address_ = ByteString(
-      reinterpret_cast<const char*>(raw_message->chaddr),
-      message->hardware_address_length_);
-  message->servername_.assign(reinterpret_cast<const char*>(raw_message->sname),
-                              kServerNameLength);
-  message->bootfile_.assign(reinterpret_cast<const char*>(raw_message->file),
-                            kBootFileLength);
+  view->buffer_ = buffer;
+  view->length_ = length;
+  view->message_type_ = 0;
+  memset(view->option_offsets_, 0, sizeof(view->option_offsets_));
   // Validate the DHCP Message
-  if (!message->IsValid()) {
+  if (!view->IsValid()) {
     return false;
   }
-  if (!message->ParseDHCPOptions(raw_message->options, options_length)) {
+  if (!view->IndexDHCPOptions()) {
     LOG(ERROR) << "Failed to parse DHCP options";
     return false;
   }
   return true;
 }
 
-bool DHCPMessage::ParseDHCPOptions(const uint8_t* options,
-                                   size_t options_length) {
+bool DHCPMessageView::IsReplyTo(const unsigned char* buffer,
+                                size_t length,
+                                uint32_t transaction_id,
+                                const ByteString& hardware_address) {
+  // Runs for every packet on the segment: only fixed offsets are read,
+  // and nothing is logged.
+  if (buffer == nullptr || length < offsetof(RawDHCPMessage, options)) {
+    return false;
+  }
+  const RawDHCPMessage* raw_message =
+      reinterpret_cast<const RawDHCPMessage*>(buffer);
+  size_t hardware_address_length = hardware_address.GetLength();
+  return raw_message->op == kDHCPMessageBootReply &&
+         ntohl(raw_message->xid) == transaction_id &&
+         ntohl(raw_message->cookie) == kMagicCookie &&
+         raw_message->hlen == hardware_address_length &&
+         hardware_address_length <= kClientHardwareAddressLength &&
+         memcmp(raw_message->chaddr,
+                hardware_address.GetConstData(),
+                hardware_address_length) == 0;
+}
+
+bool DHCPMessageView::IsValid() const {
+  const RawDHCPMessage* raw_message =
+      reinterpret_cast<const RawDHCPMessage*>(buffer_);
+  if (raw_message->op != kDHCPMessageBootReply) {
+    LOG(ERROR) << "Invalid DHCP message op code";
+    return false;
+  }
+  if (raw_message->htype != ARPHRD_ETHER) {
+    LOG(ERROR) << "DHCP message device family id does not match";
+    return false;
+  }
+  if (raw_message->hlen != IFHWADDRLEN) {
+    LOG(ERROR) <<
+        "DHCP message device hardware address length does not match";
+    return false;
+  }
+  // We have nothing to do with the 'hops' field.
+
+  // The reply message from server should have the same xid we cached in client.
+  // DHCP state machine will take charge of this checking.
+
+  // According to RFC 2131, all secs field in reply messages should be 0.
+  if (raw_message->secs) {
+    LOG(ERROR) << "Invalid DHCP message secs";
+    return false;
+  }
+
+  // Check broadcast flags.
+  // It should be 0 because we do not request broadcast reply.
+  if (raw_message->flags) {
+    LOG(ERROR) << "Invalid DHCP message flags";
+    return false;
+  }
+
+  // We need to ensure the message contains the correct client hardware address.
+  // DHCP state machine will take charge of this checking.
+
+  // We do not use the bootfile field.
+  if (ntohl(raw_message->cookie) != kMagicCookie) {
+    LOG(ERROR) << "DHCP message cookie does not match";
+    return false;
+  }
+  return true;
+}
+
+bool DHCPMessageView::IndexDHCPOptions() {
   // DHCP options are in TLV format.
   // T: tag, L: length, V: value(data)
   // RFC 1497, RFC 1533, RFC 2132
+  const uint8_t* options = buffer_ + offsetof(RawDHCPMessage, options);
   const uint8_t* ptr = options;
-  const uint8_t* end_ptr = options + options_length;
-  std::set<uint8_t> options_set;
+  const uint8_t* end_ptr = buffer_ + length_;
   while (ptr < end_ptr) {
     uint8_t option_code = *ptr++;
     int option_code_int = static_cast<int>(option_code);
@@ -164,48 +321,67 @@ bool DHCPMessage::ParseDHCPOptions(const uint8_t* options,
     } else if (option_code == kDHCPOptionEnd) {
       // We reach the end of the option field.
       // Validate the options before we return.
-      return ContainsValidOptions(options_set);
+      return ContainsValidOptions();
     }
     if (ptr >= end_ptr) {
       LOG(ERROR) << "Failed to decode dhcp options, no option length field"
                     " for option: " << option_code_int;
       return false;
     }
-    uint8_t option_length = *ptr++;
-    if (ptr + option_length >= end_ptr) {
+    uint8_t option_length = *ptr;
+    if (ptr + 1 + option_length >= end_ptr) {
       LOG(ERROR) << "Failed to decode dhcp options, invalid option length field"
                     " for option: " << option_code_int;
       return false;
     }
-    if (options_set.find(option_code) != options_set.end()) {
+    if (option_offsets_[option_code] != 0) {
       LOG(ERROR) << "Found repeated DHCP option: " << option_code_int;
       return false;
     }
     // Here we find a valid DHCP option.
-    auto it = options_map_.find(option_code);
-    if (it != options_map_.end()) {
-      ParserContext* context = &(it->second);
-      if (!context->parser->GetOption(ptr, option_length, context->output)) {
-        return false;
-      }
-      options_set.insert(option_code);
-    } else {
-      DLOG(INFO) << "Ignore DHCP option: " << option_code_int;
-    }
+    // Only record where it is, the value is decoded on demand.
+    option_offsets_[option_code] = static_cast<uint16_t>(ptr - buffer_);
     // Move to next tag.
-    ptr += option_length;
+    ptr += 1 + option_length;
   }
   // Reach the end of message without seeing kDHCPOptionEnd.
   LOG(ERROR) << "Broken DHCP options without END tag.";
   return false;
 }
 
-bool DHCPMessage::ContainsValidOptions(const std::set<uint8_t>& options_set) {
+bool DHCPMessageView::GetNextOption(size_t* offset,
+                                    uint8_t* option_code,
+                                    const uint8_t** value,
+                                    uint8_t* length) const {
+  // IndexDHCPOptions() checked that every option fits in the buffer, up
+  // to the End option.
+  const uint8_t* options = buffer_ + offsetof(RawDHCPMessage, options);
+  const uint8_t* ptr = options + *offset;
+  while (*ptr == kDHCPOptionPad) {
+    ptr++;
+  }
+  if (*ptr == kDHCPOptionEnd) {
+    *offset = ptr - options;
+    return false;
+  }
+  *option_code = ptr[0];
+  *length = ptr[1];
+  *value = ptr + 2;
+  *offset = ptr + 2 + *length - options;
+  return true;
+}
+
+bool DHCPMessageView::ContainsValidOptions() {
   // A DHCP message must contain option 53: DHCP Message Type.
-  if (options_set.find(kDHCPOptionMessageType) == options_set.end()) {
+  const uint8_t* value;
+  uint8_t length;
+  if (!GetOption(kDHCPOptionMessageType, &value, &length)) {
     LOG(ERROR) << "Faied to find option 53: DHCP Message Type.";
     return false;
   }
+  if (!UInt8Parser().GetOption(value, length, &message_type_)) {
+    return false;
+  }
   if (message_type_ != kDHCPMessageTypeOffer &&
       message_type_ != kDHCPMessageTypeAck &&
       message_type_ != kDHCPMessageTypeNak) {
@@ -213,66 +389,226 @@ bool DHCPMessage::ContainsValidOptions(const std::set<uint8_t>& options_set) {
                << static_cast<int>(message_type_);
     return false;
   }
+  uint32_t unused_value;
   // A DHCP Offer message must contain option 51: IP Address Lease Time.
   if (message_type_ == kDHCPMessageTypeOffer) {
-    if (options_set.find(kDHCPOptionLeaseTime) == options_set.end()) {
+    if (!GetOption(kDHCPOptionLeaseTime, &value, &length)) {
       LOG(ERROR) << "Faied to find option 51: IP Address Lease Time";
       return false;
     }
+    if (!UInt32Parser().GetOption(value, length, &unused_value)) {
+      return false;
+    }
   }
   // A message from DHCP server must contain option 54: Server Identifier.
-  if (options_set.find(kDHCPOptionServerIdentifier) == options_set.end()) {
+  if (!GetOption(kDHCPOptionServerIdentifier, &value, &length)) {
     LOG(ERROR) << "Faied to find option 54: Server Identifier.";
     return false;
   }
+  if (!UInt32Parser().GetOption(value, length, &unused_value)) {
+    return false;
+  }
   return true;
 }
 
-bool DHCPMessage::IsValid() {
-  if (opcode_ != kDHCPMessageBootReply) {
-    LOG(ERROR) << "Invalid DHCP message op code";
-    return false;
-  }
-  if (hardware_address_type_ != ARPHRD_ETHER) {
-    LOG(ERROR) << "DHCP message device family id does not match";
+uint8_t DHCPMessageView::opcode() const {
+  return reinterpret_cast<const RawDHCPMessage*>(buffer_)->op;
+}
+
+uint32_t DHCPMessageView::transaction_id() const {
+  return ntohl(reinterpret_cast<const RawDHCPMessage*>(buffer_)->xid);
+}
+
+uint32_t DHCPMessageView::client_ip_address() const {
+  return ntohl(reinterpret_cast<const RawDHCPMessage*>(buffer_)->ciaddr);
+}
+
+uint32_t DHCPMessageView::your_ip_address() const {
+  return ntohl(reinterpret_cast<const RawDHCPMessage*>(buffer_)->yiaddr);
+}
+
+uint32_t DHCPMessageView::next_server_ip_address() const {
+  return ntohl(reinterpret_cast<const RawDHCPMessage*>(buffer_)->siaddr);
+}
+
+uint32_t DHCPMessageView::agent_ip_address() const {
+  return ntohl(reinterpret_cast<const RawDHCPMessage*>(buffer_)->giaddr);
+}
+
+const uint8_t* DHCPMessageView::client_hardware_address() const {
+  return reinterpret_cast<const RawDHCPMessage*>(buffer_)->chaddr;
+}
+
+uint8_t DHCPMessageView::client_hardware_address_length() const {
+  return reinterpret_cast<const RawDHCPMessage*>(buffer_)->hlen;
+}
+
+bool DHCPMessageView::GetOption(uint8_t option_code,
+                                const uint8_t** value,
+                                uint8_t* length) const {
+  uint16_t offset = option_offsets_[option_code];
+  if (offset == 0) {
     return false;
   }
-  if (hardware_address_length_ != IFHWADDRLEN) {
-    LOG(ERROR) <<
-        "DHCP message device hardware address length does not match";
-    return false;
+  *length = buffer_[offset];
+  *value = buffer_ + offset + 1;
+  return true;
+}
+
+uint32_t DHCPMessageView::GetUInt32Option(uint8_t option_code) const {
+  const uint8_t* value;
+  uint8_t length;
+  uint32_t result = 0;
+  if (!GetOption(option_code, &value, &length) ||
+      !UInt32Parser().GetOption(value, length, &result)) {
+    return 0;
   }
-  // We have nothing to do with the 'hops' field.
+  return result;
+}
 
-  // The reply message from server should have the same xid we cached in client.
-  // DHCP state machine will take charge of this checking.
+uint32_t DHCPMessageView::lease_time() const {
+  return GetUInt32Option(kDHCPOptionLeaseTime);
+}
 
-  // According to RFC 2131, all secs field in reply messages should be 0.
-  if (seconds_) {
-    LOG(ERROR) << "Invalid DHCP message secs";
+bool DHCPMessageView::rapid_commit() const {
+  const uint8_t* value;
+  uint8_t length;
+  bool rapid_commit = false;
+  return GetOption(kDHCPOptionRapidCommit, &value, &length) &&
+      FlagParser().GetOption(value, length, &rapid_commit);
+}
+
+uint32_t DHCPMessageView::rebinding_time() const {
+  return GetUInt32Option(kDHCPOptionRebindingTime);
+}
+
+uint32_t DHCPMessageView::renewal_time() const {
+  return GetUInt32Option(kDHCPOptionRenewalTime);
+}
+
+uint32_t DHCPMessageView::server_identifier() const {
+  return GetUInt32Option(kDHCPOptionServerIdentifier);
+}
+
+uint32_t DHCPMessageView::subnet_mask() const {
+  return GetUInt32Option(kDHCPOptionSubnetMask);
+}
+
+bool DHCPMessageView::GetDNSServer(std::vector<uint32_t>* dns_server) const {
+  const uint8_t* value;
+  uint8_t length;
+  return GetOption(kDHCPOptionDNSServer, &value, &length) &&
+      UInt32ListParser().GetOption(value, length, dns_server);
+}
+
+bool DHCPMessageView::GetDomainName(std::string* domain_name) const {
+  const uint8_t* value;
+  uint8_t length;
+  return GetOption(kDHCPOptionDomainName, &value, &length) &&
+      StringParser().GetOption(value, length, domain_name);
+}
+
+bool DHCPMessageView::GetErrorMessage(std::string* error_message) const {
+  const uint8_t* value;
+  uint8_t length;
+  return GetOption(kDHCPOptionMessage, &value, &length) &&
+      StringParser().GetOption(value, length, error_message);
+}
+
+bool DHCPMessageView::GetRouter(std::vector<uint32_t>* router) const {
+  const uint8_t* value;
+  uint8_t length;
+  return GetOption(kDHCPOptionRouter, &value, &length) &&
+      UInt32ListParser().GetOption(value, length, router);
+}
+
+bool DHCPMessageView::GetClasslessStaticRoutes(
+    std::vector<Route>* routes) const {
+  const uint8_t* value;
+  uint8_t length;
+  return GetOption(kDHCPOptionClasslessStaticRoute, &value, &length) &&
+      ClasslessRouteListParser().GetOption(value, length, routes);
+}
+
+bool DHCPMessageView::GetVendorSpecificInfo(
+    ByteString* vendor_specific_info) const {
+  const uint8_t* value;
+  uint8_t length;
+  return GetOption(kDHCPOptionVendorSpecificInformation, &value, &length) &&
+      ByteArrayParser().GetOption(value, length, vendor_specific_info);
+}
+
+bool DHCPMessage::InitFromBuffer(const unsigned char* buffer,
+                                 size_t length,
+                                 DHCPMessage* message) {
+  DHCPMessageView view;
+  if (!DHCPMessageView::Init(buffer, length, &view)) {
     return false;
   }
-
-  // Check broadcast flags.
-  // It should be 0 because we do not request broadcast reply.
-  if (flags_) {
-    LOG(ERROR) << "Invalid DHCP message flags";
+  const RawDHCPMessage* raw_message
+      = reinterpret_cast<const RawDHCPMessage*>(buffer);
+  message->opcode_ = raw_message->op;
+  message->hardware_address_type_ = raw_message->htype;
+  message->hardware_address_length_ = raw_message->hlen;
+  message->relay_hops_ = raw_message->hops;
+  message->transaction_id_ = ntohl(raw_message->xid);
+  message->seconds_ = ntohs(raw_message->secs);
+  message->flags_ = ntohs(raw_message->flags);
+  message->client_ip_address_ = ntohl(raw_message->ciaddr);
+  message->your_ip_address_ = ntohl(raw_message->yiaddr);
+  message->next_server_ip_address_ = ntohl(raw_message->siaddr);
+  message->agent_ip_address_ = ntohl(raw_message->giaddr);
+  message->cookie_ = ntohl(raw_message->cookie);
+  message->client_hardware_address_ = ByteString(
+      reinterpret_cast<const char*>(raw_message->chaddr),
+      message->hardware_address_length_);
+  message->servername_.assign(reinterpret_cast<const char*>(raw_message->sname),
+                              kServerNameLength);
+  message->bootfile_.assign(reinterpret_cast<const char*>(raw_message->file),
+                            kBootFileLength);
+  if (!message->ParseDHCPOptions(view)) {
+    LOG(ERROR) << "Failed to parse DHCP options";
     return false;
   }
+  return true;
+}
 
-  // We need to ensure the message contains the correct client hardware address.
-  // DHCP state machine will take charge of this checking.
+bool DHCPMessage::ParseDHCPOptions(const DHCPMessageView& view) {
+  // The view has already validated the TLV layout, and rejected repeated
+  // options. Each option present is decoded if we are interested in it.
+  size_t offset = 0;
+  uint8_t option_code;
+  const uint8_t* value;
+  uint8_t length;
+  while (view.GetNextOption(&offset, &option_code, &value, &length)) {
+    OptionDecoder decoder = kOptionDecoders[option_code];
+    if (decoder != nullptr && !decoder(value, length, this)) {
+      return false;
+    }
+  }
+  return true;
+}
 
-  // We do not use the bootfile field.
-  if (cookie_ != kMagicCookie) {
-    LOG(ERROR) << "DHCP message cookie does not match";
+bool DHCPMessage::Serialize(ByteString* data) const {
+  uint8_t buffer[kDHCPMessageMaxLength];
+  FrameWriter writer(buffer, sizeof(buffer));
+  if (!Serialize(&writer)) {
     return false;
   }
+  // The message is staged on the stack, |data| then grows once, to its
+  // final length.
+  size_t offset = data->GetLength();
+  data->Resize(offset + writer.length());
+  memcpy(data->GetData() + offset, buffer, writer.length());
   return true;
 }
 
-bool DHCPMessage::Serialize(ByteString* data) const {
+bool DHCPMessage::Serialize(FrameWriter* writer) const {
+  const size_t start = writer->length();
+  // Only the fixed fields are copied, the options are written in place.
+  const size_t fixed_length = sizeof(RawDHCPMessage) - kDHCPOptionLength;
   RawDHCPMessage raw_message;
+  memset(&raw_message, 0, fixed_length);
   raw_message.op = opcode_;
   raw_message.htype = hardware_address_type_;
   raw_message.hlen = hardware_address_length_;
@@ -304,64 +640,62 @@ bool DHCPMessage::Serialize(ByteString* data) const {
          bootfile_.c_str(),
          bootfile_.length());
   raw_message.file[bootfile_.length()] = 0;
-  data->Append(ByteString(reinterpret_cast<const char*>(&raw_message),
-                          sizeof(raw_message) - kDHCPOptionLength));
+  if (!writer->WriteBytes(&raw_message, fixed_length)) {
+    LOG(ERROR) << "No room for the DHCP message header";
+    return false;
+  }
   // Append DHCP options to the message.
-  DHCPOptionsWriter* options_writer = DHCPOptionsWriter::GetInstance();
-  if (options_writer->WriteUInt8Option(data,
-                                       kDHCPOptionMessageType,
-                                       message_type_) == -1) {
+  if (!writer->WriteUInt8Option(kDHCPOptionMessageType, message_type_)) {
     LOG(ERROR) << "Failed to write message type option";
     return false;
   }
   if (requested_ip_address_ != 0) {
-    if (options_writer->WriteUInt32Option(data,
-                                          kDHCPOptionRequestedIPAddr,
-                                          requested_ip_address_) == -1) {
+    if (!writer->WriteUInt32Option(kDHCPOptionRequestedIPAddr,
+                                   requested_ip_address_)) {
       LOG(ERROR) << "Failed to write requested ip address option";
       return false;
     }
   }
   if (lease_time_ != 0) {
-    if (options_writer->WriteUInt32Option(data,
-                                          kDHCPOptionLeaseTime,
-                                          lease_time_) == -1) {
+    if (!writer->WriteUInt32Option(kDHCPOptionLeaseTime, lease_time_)) {
       LOG(ERROR) << "Failed to write lease time option";
       return false;
     }
   }
   if (server_identifier_ != 0) {
-    if (options_writer->WriteUInt32Option(data,
-                                          kDHCPOptionServerIdentifier,
-                                          server_identifier_) == -1) {
+    if (!writer->WriteUInt32Option(kDHCPOptionServerIdentifier,
+                                   server_identifier_)) {
       LOG(ERROR) << "Failed to write server identifier option";
       return false;
     }
   }
   if (error_message_.size() != 0) {
-    if (options_writer->WriteStringOption(data,
-                                          kDHCPOptionMessage,
-                                          error_message_) == -1) {
+    if (!writer->WriteStringOption(kDHCPOptionMessage, error_message_)) {
       LOG(ERROR) << "Failed to write error message option";
       return false;
     }
   }
   if (parameter_request_list_.size() != 0) {
-    if (options_writer->WriteUInt8ListOption(data,
-                                             kDHCPOptionParameterRequestList,
-                                             parameter_request_list_) == -1) {
+    if (!writer->WriteUInt8ListOption(kDHCPOptionParameterRequestList,
+                                      parameter_request_list_)) {
       LOG(ERROR) << "Failed to write parameter request list";
       return false;
     }
   }
+  if (rapid_commit_) {
+    if (!writer->WriteFlagOption(kDHCPOptionRapidCommit)) {
+      LOG(ERROR) << "Failed to write rapid commit option";
+      return false;
+    }
+  }
   // TODO(nywang): Append other options.
   // Append end tag.
-  if (options_writer->WriteEndTag(data) == -1) {
+  if (!writer->WriteEndTag()) {
     LOG(ERROR) << "Failed to write DHCP options end tag";
     return false;
   }
   // Ensure we do not exceed the maximum length.
-  if (data->GetLength() > kDHCPMessageMaxLength) {
+  if (writer->length() - start > kDHCPMessageMaxLength) {
     LOG(ERROR) << "DHCP message length exceeds the limit";
     return false;
   }
@@ -369,20 +703,7 @@ bool DHCPMessage::Serialize(ByteString* data) const {
 }
 
 uint16_t DHCPMessage::ComputeChecksum(const uint8_t* data, size_t len) {
-  uint32_t sum = 0;
-
-  while (len > 1) {
-    sum += static_cast<uint32_t>(data[0]) << 8 | static_cast<uint32_t>(data[1]);
-    data += 2;
-    len -= 2;
-  }
-  if (len == 1) {
-    sum += static_cast<uint32_t>(*data) << 8;
-  }
-  sum = (sum >> 16) + (sum & 0xffff);
-  sum += (sum >> 16);
-
-  return ~static_cast<uint16_t>(sum);
+  return ComputeInternetChecksum(data, len);
 }
 
 void DHCPMessage::SetClientIdentifier(
@@ -416,6 +737,10 @@ void DHCPMessage::SetParameterRequestList(
   parameter_request_list_ = parameter_request_list;
 }
 
+void DHCPMessage::SetRapidCommit(bool rapid_commit) {
+  rapid_commit_ = rapid_commit;
+}
+
 void DHCPMessage::SetRequestedIpAddress(uint32_t requested_ip_address) {
   requested_ip_address_ = requested_ip_address;
 }
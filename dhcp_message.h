@@ -17,9 +17,6 @@
 #ifndef DHCP_CLIENT_DHCP_MESSAGE_H_
 #define DHCP_CLIENT_DHCP_MESSAGE_H_
 
-#include <map>
-#include <memory>
-#include <set>
 #include <string>
 #include <vector>
 
@@ -27,6 +24,8 @@
 #include <shill/net/byte_string.h>
 
 #include "dhcp_client/dhcp_options_parser.h"
+#include "dhcp_client/frame_writer.h"
+#include "dhcp_client/lease_applier_interface.h"
 
 namespace dhcp_client {
 
@@ -39,14 +38,91 @@ static const uint8_t kDHCPMessageTypeNak = 6;
 static const uint8_t kDHCPMessageTypeRelease = 7;
 static const uint8_t kDHCPMessageTypeInform = 8;
 
-typedef std::unique_ptr<DHCPOptionsParser> ParserPtr;
+// Compile-time description of how DHCP option |option_code| is decoded
+// into a DHCPMessage. Specialized in dhcp_message.cc for every option
+// the client cares about.
+template <uint8_t option_code> struct DHCPOptionTraits;
 
-struct ParserContext{
-  ParserPtr parser;
-  void* output;
-  ParserContext(DHCPOptionsParser* parser_ptr, void* output_ptr)
-      : parser(parser_ptr),
-        output(output_ptr) {}
+// Read-only view of a DHCP message held in a receive buffer.
+// Init() validates the fixed fields and the option TLVs in place and records
+// where each option lives; the accessors decode values from the underlying
+// buffer on demand, so no field is copied until it is asked for.
+// The buffer must outlive the view.
+class DHCPMessageView {
+ public:
+  DHCPMessageView();
+  ~DHCPMessageView();
+  static bool Init(const unsigned char* buffer,
+                   size_t length,
+                   DHCPMessageView* view);
+  // Cheap check of the fixed fields of a received message, to drop the
+  // replies to other clients or transactions before Init() goes through
+  // the options. Returns true if |buffer| may be a reply to transaction
+  // |transaction_id| of the client with |hardware_address|.
+  static bool IsReplyTo(const unsigned char* buffer,
+                        size_t length,
+                        uint32_t transaction_id,
+                        const shill::ByteString& hardware_address);
+
+  // Fixed field getters.
+  uint8_t opcode() const;
+  uint32_t transaction_id() const;
+  uint32_t client_ip_address() const;
+  uint32_t your_ip_address() const;
+  uint32_t next_server_ip_address() const;
+  uint32_t agent_ip_address() const;
+  // Points into the buffer, client_hardware_address_length() bytes long.
+  const uint8_t* client_hardware_address() const;
+  uint8_t client_hardware_address_length() const;
+
+  // Returns a pointer into the buffer for the value of option |option_code|.
+  // Returns false if the option is not present in the message.
+  bool GetOption(uint8_t option_code,
+                 const uint8_t** value,
+                 uint8_t* length) const;
+  bool HasOption(uint8_t option_code) const {
+    return option_offsets_[option_code] != 0;
+  }
+  // Walks the options in the order of the message. |offset| starts at 0
+  // and is advanced past each option returned. Returns false after the
+  // last option. Only for a view Init() accepted.
+  bool GetNextOption(size_t* offset,
+                     uint8_t* option_code,
+                     const uint8_t** value,
+                     uint8_t* length) const;
+
+  // DHCP option getters. Scalar getters return 0 if the option is
+  // absent or malformed; the others return false in that case.
+  uint8_t message_type() const { return message_type_; }
+  uint32_t lease_time() const;
+  // Whether a well formed Rapid Commit option is present.
+  bool rapid_commit() const;
+  uint32_t rebinding_time() const;
+  uint32_t renewal_time() const;
+  uint32_t server_identifier() const;
+  uint32_t subnet_mask() const;
+  bool GetDNSServer(std::vector<uint32_t>* dns_server) const;
+  bool GetDomainName(std::string* domain_name) const;
+  bool GetErrorMessage(std::string* error_message) const;
+  bool GetRouter(std::vector<uint32_t>* router) const;
+  bool GetClasslessStaticRoutes(std::vector<Route>* routes) const;
+  bool GetVendorSpecificInfo(shill::ByteString* vendor_specific_info) const;
+
+ private:
+  bool IsValid() const;
+  bool IndexDHCPOptions();
+  bool ContainsValidOptions();
+  uint32_t GetUInt32Option(uint8_t option_code) const;
+
+  const unsigned char* buffer_;
+  size_t length_;
+  // Offset from |buffer_| of the length byte of each option,
+  // 0 if the option is not present.
+  uint16_t option_offsets_[256];
+  // Option 53: DHCP message type, decoded during validation.
+  uint8_t message_type_;
+
+  DISALLOW_COPY_AND_ASSIGN(DHCPMessageView);
 };
 
 class DHCPMessage {
@@ -63,6 +139,8 @@ class DHCPMessage {
   // Initialize part of the data fields for outbound DHCP message.
   // Serialize the message to a buffer
   bool Serialize(shill::ByteString* data) const;
+  // Serialize the message in place after what |writer| already holds.
+  bool Serialize(FrameWriter* writer) const;
 
   // DHCP option and field setters
   void SetClientHardwareAddress(
@@ -74,6 +152,7 @@ class DHCPMessage {
   void SetMessageType(uint8_t message_type);
   void SetParameterRequestList(
       const std::vector<uint8_t>& parameter_request_list);
+  void SetRapidCommit(bool rapid_commit);
   void SetRequestedIpAddress(uint32_t requested_ip_address);
   void SetServerIdentifier(uint32_t server_identifier);
   void SetTransactionID(uint32_t transaction_id);
@@ -94,6 +173,7 @@ class DHCPMessage {
   uint8_t message_type() const { return message_type_; }
   uint32_t rebinding_time() const { return rebinding_time_; }
   uint32_t renewal_time() const { return renewal_time_; }
+  bool rapid_commit() const { return rapid_commit_; }
   const std::vector<uint32_t>& router() const { return router_; }
   uint32_t server_identifier() const { return server_identifier_; }
   uint32_t subnet_mask() const { return subnet_mask_; }
@@ -104,9 +184,9 @@ class DHCPMessage {
   uint32_t your_ip_address() const { return your_ip_address_; }
 
  private:
-  bool ParseDHCPOptions(const uint8_t* options, size_t options_length);
-  bool IsValid();
-  bool ContainsValidOptions(const std::set<uint8_t>& options_set);
+  template <uint8_t option_code> friend struct DHCPOptionTraits;
+
+  bool ParseDHCPOptions(const DHCPMessageView& view);
 
   // Message type: request or reply.
   uint8_t opcode_;
@@ -142,9 +222,6 @@ class DHCPMessage {
   std::string bootfile_;
   uint32_t cookie_;
 
-  // A map from DHCP Options number to corresponding callbacks.
-  std::map<uint8_t, ParserContext> options_map_;
-
   // Fields for DHCP Options.
   // Option 1: Subnet Mask.
   uint32_t subnet_mask_;
@@ -174,6 +251,8 @@ class DHCPMessage {
   uint32_t rebinding_time_;
   // Option 61: Client identifier.
   shill::ByteString client_identifier_;
+  // Option 80: Rapid Commit.
+  bool rapid_commit_;
 
   DISALLOW_COPY_AND_ASSIGN(DHCPMessage);
 };
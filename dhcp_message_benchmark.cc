@@ -0,0 +1,235 @@
+//
+// Copyright (C) 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "dhcp_client/dhcp_message.h"
+
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+#include <shill/net/byte_string.h>
+
+#include "dhcp_client/benchmark_corpus.h"
+#include "dhcp_client/dhcp_options.h"
+#include "dhcp_client/dhcp_options_parser.h"
+
+using shill::ByteString;
+
+namespace dhcp_client {
+namespace {
+
+// Offset of the options field in a DHCP message.
+const size_t kOptionsOffset = 240;
+
+// The Ack of the corpus the map based dispatch is compared on.
+const std::vector<uint8_t>& GetAckMessage() {
+  return GetReplyCorpus()[0].message;
+}
+
+// The option dispatch DHCPMessage used before the compile-time table:
+// one heap allocated parser per option kept in a std::map, looked up
+// for every TLV and called through the vtable.
+struct ParserContext {
+  std::unique_ptr<DHCPOptionsParser> parser;
+  void* output;
+  ParserContext(DHCPOptionsParser* parser_ptr, void* output_ptr)
+      : parser(parser_ptr),
+        output(output_ptr) {}
+};
+
+class MapBasedOptions {
+ public:
+  MapBasedOptions() {
+    options_map_.insert(std::make_pair(kDHCPOptionMessageType,
+        ParserContext(new UInt8Parser(), &message_type_)));
+    options_map_.insert(std::make_pair(kDHCPOptionLeaseTime,
+        ParserContext(new UInt32Parser(), &lease_time_)));
+    options_map_.insert(std::make_pair(kDHCPOptionMessage,
+        ParserContext(new StringParser(), &error_message_)));
+    options_map_.insert(std::make_pair(kDHCPOptionSubnetMask,
+        ParserContext(new UInt32Parser(), &subnet_mask_)));
+    options_map_.insert(std::make_pair(kDHCPOptionServerIdentifier,
+        ParserContext(new UInt32Parser(), &server_identifier_)));
+    options_map_.insert(std::make_pair(kDHCPOptionRenewalTime,
+        ParserContext(new UInt32Parser(), &renewal_time_)));
+    options_map_.insert(std::make_pair(kDHCPOptionRebindingTime,
+        ParserContext(new UInt32Parser(), &rebinding_time_)));
+    options_map_.insert(std::make_pair(kDHCPOptionDNSServer,
+        ParserContext(new UInt32ListParser(), &dns_server_)));
+    options_map_.insert(std::make_pair(kDHCPOptionRouter,
+        ParserContext(new UInt32ListParser(), &router_)));
+    options_map_.insert(std::make_pair(kDHCPOptionDomainName,
+        ParserContext(new StringParser(), &domain_name_)));
+    options_map_.insert(std::make_pair(kDHCPOptionVendorSpecificInformation,
+        ParserContext(new ByteArrayParser(), &vendor_specific_info_)));
+  }
+
+  bool Parse(const uint8_t* options, size_t options_length) {
+    const uint8_t* ptr = options;
+    const uint8_t* end_ptr = options + options_length;
+    std::set<uint8_t> options_set;
+    while (ptr < end_ptr) {
+      uint8_t option_code = *ptr++;
+      if (option_code == kDHCPOptionPad) {
+        continue;
+      } else if (option_code == kDHCPOptionEnd) {
+        return options_set.find(kDHCPOptionMessageType) != options_set.end();
+      }
+      if (ptr >= end_ptr) {
+        return false;
+      }
+      uint8_t option_length = *ptr++;
+      if (ptr + option_length >= end_ptr) {
+        return false;
+      }
+      if (options_set.find(option_code) != options_set.end()) {
+        return false;
+      }
+      auto it = options_map_.find(option_code);
+      if (it != options_map_.end()) {
+        ParserContext* context = &(it->second);
+        if (!context->parser->GetOption(ptr, option_length, context->output)) {
+          return false;
+        }
+        options_set.insert(option_code);
+      }
+      ptr += option_length;
+    }
+    return false;
+  }
+
+ private:
+  std::map<uint8_t, ParserContext> options_map_;
+  uint8_t message_type_;
+  uint32_t lease_time_;
+  std::string error_message_;
+  uint32_t subnet_mask_;
+  uint32_t server_identifier_;
+  uint32_t renewal_time_;
+  uint32_t rebinding_time_;
+  std::vector<uint32_t> dns_server_;
+  std::vector<uint32_t> router_;
+  std::string domain_name_;
+  ByteString vendor_specific_info_;
+};
+
+void BM_ConstructMessage(benchmark::State& state) {
+  while (state.KeepRunning()) {
+    DHCPMessage message;
+    benchmark::DoNotOptimize(&message);
+  }
+}
+BENCHMARK(BM_ConstructMessage);
+
+void BM_ConstructMessageMapBased(benchmark::State& state) {
+  while (state.KeepRunning()) {
+    MapBasedOptions options;
+    benchmark::DoNotOptimize(&options);
+  }
+}
+BENCHMARK(BM_ConstructMessageMapBased);
+
+void BM_InitFromBuffer(benchmark::State& state) {
+  const CorpusMessage& reply = GetReplyCorpus()[state.range(0)];
+  while (state.KeepRunning()) {
+    DHCPMessage message;
+    benchmark::DoNotOptimize(DHCPMessage::InitFromBuffer(
+        reply.message.data(), reply.message.size(), &message));
+  }
+  state.SetLabel(reply.name);
+}
+BENCHMARK(BM_InitFromBuffer)->Apply(ApplyReplyCorpus);
+
+void BM_MessageViewInit(benchmark::State& state) {
+  const CorpusMessage& reply = GetReplyCorpus()[state.range(0)];
+  while (state.KeepRunning()) {
+    DHCPMessageView view;
+    benchmark::DoNotOptimize(DHCPMessageView::Init(
+        reply.message.data(), reply.message.size(), &view));
+  }
+  state.SetLabel(reply.name);
+}
+BENCHMARK(BM_MessageViewInit)->Apply(ApplyReplyCorpus);
+
+// The prefilter drops a reply to another transaction, the common case on
+// a busy segment, without going through the options.
+void BM_IsReplyToOtherTransaction(benchmark::State& state) {
+  const CorpusMessage& reply = GetReplyCorpus()[state.range(0)];
+  // chaddr is at offset 28, the corpus uses 6 byte hardware addresses.
+  const ByteString hardware_address(&reply.message[28], 6);
+  while (state.KeepRunning()) {
+    benchmark::DoNotOptimize(DHCPMessageView::IsReplyTo(
+        reply.message.data(), reply.message.size(), 0, hardware_address));
+  }
+  state.SetLabel(reply.name);
+}
+BENCHMARK(BM_IsReplyToOtherTransaction)->Apply(ApplyReplyCorpus);
+
+void BM_InitFromBufferMapBased(benchmark::State& state) {
+  const std::vector<uint8_t>& ack = GetAckMessage();
+  while (state.KeepRunning()) {
+    // Same validation as InitFromBuffer, only the option dispatch differs.
+    DHCPMessageView view;
+    MapBasedOptions options;
+    benchmark::DoNotOptimize(
+        DHCPMessageView::Init(ack.data(), ack.size(), &view) &&
+        options.Parse(ack.data() + kOptionsOffset,
+                      ack.size() - kOptionsOffset));
+  }
+}
+BENCHMARK(BM_InitFromBufferMapBased);
+
+// The Discover and the Request of an INIT-REBOOT, as DHCPV4 builds them.
+void InitClientMessage(uint8_t message_type, DHCPMessage* message) {
+  const unsigned char kHardwareAddress[] = {0x00, 0x1a, 0x11, 0xc3, 0x02, 0x5e};
+  const uint8_t kParameterRequestList[] = {
+      kDHCPOptionSubnetMask, kDHCPOptionRouter, kDHCPOptionDNSServer,
+      kDHCPOptionDomainName, kDHCPOptionLeaseTime, kDHCPOptionRenewalTime,
+      kDHCPOptionRebindingTime};
+  DHCPMessage::InitRequest(message);
+  message->SetMessageType(message_type);
+  message->SetTransactionID(0x0f22a350);
+  message->SetClientHardwareAddress(
+      ByteString(kHardwareAddress, sizeof(kHardwareAddress)));
+  message->SetParameterRequestList(std::vector<uint8_t>(
+      kParameterRequestList,
+      kParameterRequestList + sizeof(kParameterRequestList)));
+  if (message_type == kDHCPMessageTypeRequest) {
+    message->SetRequestedIpAddress(0xc0a80117);
+  }
+}
+
+void BM_Serialize(benchmark::State& state) {
+  DHCPMessage message;
+  uint8_t message_type = static_cast<uint8_t>(state.range(0));
+  InitClientMessage(message_type, &message);
+  while (state.KeepRunning()) {
+    ByteString data;
+    benchmark::DoNotOptimize(message.Serialize(&data));
+  }
+  state.SetLabel(message_type == kDHCPMessageTypeDiscover ? "discover"
+                                                          : "request");
+}
+BENCHMARK(BM_Serialize)
+    ->Arg(kDHCPMessageTypeDiscover)
+    ->Arg(kDHCPMessageTypeRequest);
+
+}  // namespace
+}  // namespace dhcp_client
@@ -16,13 +16,16 @@
 
 #include "dhcp_client/dhcp_message.h"
 
+#include <net/if.h>
 #include <netinet/in.h>
 
 #include <cstring>
+#include <vector>
 
 #include <gtest/gtest.h>
 #include <shill/net/byte_string.h>
 
+#include "dhcp_client/allocation_counter.h"
 #include "dhcp_client/dhcp_options.h"
 
 #define SERVER_NAME 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, \
@@ -73,6 +76,8 @@
 #define SERVER_ID 0x01, 0xa2, 0x01, 0x1b
 #define LEASE_TIME 0x00, 0x00, 0x11, 0x11
 
+using shill::ByteString;
+
 namespace dhcp_client {
 namespace {
 const uint8_t kFakeBufferEvenLength[] = {0x08, 0x00, 0x00, 0x00,
@@ -149,17 +154,113 @@ const uint8_t kFakeDHCPNakMessage[] = {
     kDHCPOptionServerIdentifier, 0x04, SERVER_ID,  // server identifier option
     END_TAG  // options end tag
 };
+const uint8_t kFakeDHCPRapidAckMessage[] = {
+    REPLY,  // op, ack is a reply message
+    HARDWARE_ADDRESS_TYPE,  // htype
+    HARDWARE_ADDRESS_LENGTH,  // hlen
+    HOPS,  // hops
+    TRANSACTION_ID,  // xid
+    SECONDS,  // secs
+    FLAGS,  // flags
+    CLIENT_IP_ADDRESS,  // ciaddr
+    YOUR_IP_ADDRESS,  // yiaddr
+    NEXT_SERVER_IP_ADDRESS,  // siaddr
+    AGENT_IP_ADDRESS,  // giaddr
+    CLIENT_HARDWARE_ADDRESS,  // chaddr
+    SERVER_NAME,  // sname
+    BOOT_FILE,  // file
+    COOKIE,  // cookie
+    kDHCPOptionMessageType, 0x01, kDHCPMessageTypeAck,  // message type option
+    kDHCPOptionLeaseTime, 0x04, LEASE_TIME,  // lease time option
+    kDHCPOptionServerIdentifier, 0x04, SERVER_ID,  // server identifier option
+    kDHCPOptionRapidCommit, 0x00,  // rapid commit option
+    END_TAG  // options end tag
+};
+
 const uint8_t kFakeTransactionID[] = {TRANSACTION_ID};
 const uint8_t kFakeServerIdentifier[] = {SERVER_ID};
 const uint8_t kFakeLeaseTime[] = {LEASE_TIME};
 const uint8_t kFakeYourIPAddress[] = {YOUR_IP_ADDRESS};
 const uint8_t kFakeHardwareAddress[] = {CLIENT_HARDWARE_ADDRESS};
+
+const uint8_t kFakeDHCPAckMessageWithRouter[] = {
+    REPLY,  // op, ack is a reply message
+    HARDWARE_ADDRESS_TYPE,  // htype
+    HARDWARE_ADDRESS_LENGTH,  // hlen
+    HOPS,  // hops
+    TRANSACTION_ID,  // xid
+    SECONDS,  // secs
+    FLAGS,  // flags
+    CLIENT_IP_ADDRESS,  // ciaddr
+    YOUR_IP_ADDRESS,  // yiaddr
+    NEXT_SERVER_IP_ADDRESS,  // siaddr
+    AGENT_IP_ADDRESS,  // giaddr
+    CLIENT_HARDWARE_ADDRESS,  // chaddr
+    SERVER_NAME,  // sname
+    BOOT_FILE,  // file
+    COOKIE,  // cookie
+    kDHCPOptionMessageType, 0x01, kDHCPMessageTypeAck,  // message type option
+    kDHCPOptionServerIdentifier, 0x04, SERVER_ID,  // server identifier option
+    kDHCPOptionRouter, 0x08, SERVER_ID, YOUR_IP_ADDRESS,  // router option
+    END_TAG  // options end tag
+};
+
+const uint8_t kFakeDHCPAckMessageRepeatedOption[] = {
+    REPLY,  // op, ack is a reply message
+    HARDWARE_ADDRESS_TYPE,  // htype
+    HARDWARE_ADDRESS_LENGTH,  // hlen
+    HOPS,  // hops
+    TRANSACTION_ID,  // xid
+    SECONDS,  // secs
+    FLAGS,  // flags
+    CLIENT_IP_ADDRESS,  // ciaddr
+    YOUR_IP_ADDRESS,  // yiaddr
+    NEXT_SERVER_IP_ADDRESS,  // siaddr
+    AGENT_IP_ADDRESS,  // giaddr
+    CLIENT_HARDWARE_ADDRESS,  // chaddr
+    SERVER_NAME,  // sname
+    BOOT_FILE,  // file
+    COOKIE,  // cookie
+    kDHCPOptionMessageType, 0x01, kDHCPMessageTypeAck,  // message type option
+    kDHCPOptionServerIdentifier, 0x04, SERVER_ID,  // server identifier option
+    kDHCPOptionServerIdentifier, 0x04, SERVER_ID,  // repeated option
+    END_TAG  // options end tag
+};
+
+const uint8_t kFakeDHCPAckMessageWithoutEndTag[] = {
+    REPLY,  // op, ack is a reply message
+    HARDWARE_ADDRESS_TYPE,  // htype
+    HARDWARE_ADDRESS_LENGTH,  // hlen
+    HOPS,  // hops
+    TRANSACTION_ID,  // xid
+    SECONDS,  // secs
+    FLAGS,  // flags
+    CLIENT_IP_ADDRESS,  // ciaddr
+    YOUR_IP_ADDRESS,  // yiaddr
+    NEXT_SERVER_IP_ADDRESS,  // siaddr
+    AGENT_IP_ADDRESS,  // giaddr
+    CLIENT_HARDWARE_ADDRESS,  // chaddr
+    SERVER_NAME,  // sname
+    BOOT_FILE,  // file
+    COOKIE,  // cookie
+    kDHCPOptionMessageType, 0x01, kDHCPMessageTypeAck,  // message type option
+    kDHCPOptionServerIdentifier, 0x04, SERVER_ID  // server identifier option
+};
 size_t kFakeDHCPOfferMessageLength = sizeof(kFakeDHCPOfferMessage);
 size_t kFakeDHCPAckMessageLength = sizeof(kFakeDHCPAckMessage);
 size_t kFakeDHCPNakMessageLength = sizeof(kFakeDHCPNakMessage);
+// The options of kFakeDHCPAckMessage, which follow the cookie: the
+// message type, lease time and server identifier options, and the end
+// tag. Each option is a code and a length byte, then the value.
+const size_t kFakeDHCPAckOptionsLength =
+    (2 + 1) + (2 + sizeof(kFakeLeaseTime)) +
+    (2 + sizeof(kFakeServerIdentifier)) + 1;
+// Offset of the last byte of the cookie in kFakeDHCPAckMessage.
+const size_t kFakeDHCPAckCookieEnd =
+    sizeof(kFakeDHCPAckMessage) - kFakeDHCPAckOptionsLength - 1;
 }  // namespace
 
-class DHCPMessageTest : public testing::Test {
+class DHCPMessageTest : public AllocationBudgetTest {
  public:
   DHCPMessageTest() {}
  protected:
@@ -230,4 +331,216 @@ TEST_F(DHCPMessageTest, InitFromBufferMessageTypeNak) {
                            msg.client_hardware_address().GetLength()));
 }
 
+TEST_F(DHCPMessageTest, InitFromBufferDecodesListOption) {
+  DHCPMessage msg;
+  EXPECT_TRUE(DHCPMessage::InitFromBuffer(kFakeDHCPAckMessageWithRouter,
+                                          sizeof(kFakeDHCPAckMessageWithRouter),
+                                          &msg));
+  ASSERT_EQ(2u, msg.router().size());
+  EXPECT_EQ(ntohl(*reinterpret_cast<const uint32_t*>(kFakeServerIdentifier)),
+            msg.router()[0]);
+  EXPECT_EQ(ntohl(*reinterpret_cast<const uint32_t*>(kFakeYourIPAddress)),
+            msg.router()[1]);
+  EXPECT_TRUE(msg.dns_server().empty());
+}
+
+TEST_F(DHCPMessageTest, MessageViewTypeOffer) {
+  DHCPMessageView view;
+  EXPECT_TRUE(DHCPMessageView::Init(kFakeDHCPOfferMessage,
+                                    kFakeDHCPOfferMessageLength,
+                                    &view));
+  EXPECT_EQ(kDHCPMessageTypeOffer, view.message_type());
+  EXPECT_EQ(ntohl(*reinterpret_cast<const uint32_t*>(kFakeTransactionID)),
+            view.transaction_id());
+  EXPECT_EQ(ntohl(*reinterpret_cast<const uint32_t*>(kFakeServerIdentifier)),
+            view.server_identifier());
+  EXPECT_EQ(ntohl(*reinterpret_cast<const uint32_t*>(kFakeLeaseTime)),
+            view.lease_time());
+  EXPECT_EQ(ntohl(*reinterpret_cast<const uint32_t*>(kFakeYourIPAddress)),
+            view.your_ip_address());
+  EXPECT_EQ(IFHWADDRLEN, view.client_hardware_address_length());
+  EXPECT_EQ(0, std::memcmp(kFakeHardwareAddress,
+                           view.client_hardware_address(),
+                           view.client_hardware_address_length()));
+  // The view must point into the original buffer instead of a copy.
+  EXPECT_GE(view.client_hardware_address(), kFakeDHCPOfferMessage);
+  EXPECT_LT(view.client_hardware_address(),
+            kFakeDHCPOfferMessage + kFakeDHCPOfferMessageLength);
+  EXPECT_FALSE(view.HasOption(kDHCPOptionRouter));
+  EXPECT_EQ(0u, view.subnet_mask());
+}
+
+TEST_F(DHCPMessageTest, MessageViewLazyListOption) {
+  DHCPMessageView view;
+  EXPECT_TRUE(DHCPMessageView::Init(kFakeDHCPAckMessageWithRouter,
+                                    sizeof(kFakeDHCPAckMessageWithRouter),
+                                    &view));
+  EXPECT_EQ(kDHCPMessageTypeAck, view.message_type());
+  EXPECT_TRUE(view.HasOption(kDHCPOptionRouter));
+  std::vector<uint32_t> router;
+  EXPECT_TRUE(view.GetRouter(&router));
+  ASSERT_EQ(2u, router.size());
+  EXPECT_EQ(ntohl(*reinterpret_cast<const uint32_t*>(kFakeServerIdentifier)),
+            router[0]);
+  EXPECT_EQ(ntohl(*reinterpret_cast<const uint32_t*>(kFakeYourIPAddress)),
+            router[1]);
+  std::vector<uint32_t> dns_server;
+  EXPECT_FALSE(view.GetDNSServer(&dns_server));
+}
+
+TEST_F(DHCPMessageTest, MessageViewWalksOptionsInOrder) {
+  DHCPMessageView view;
+  ASSERT_TRUE(DHCPMessageView::Init(kFakeDHCPOfferMessage,
+                                    kFakeDHCPOfferMessageLength,
+                                    &view));
+  const uint8_t kExpectedOptions[] = {kDHCPOptionMessageType,
+                                      kDHCPOptionLeaseTime,
+                                      kDHCPOptionServerIdentifier};
+  size_t offset = 0;
+  uint8_t option_code;
+  const uint8_t* value;
+  uint8_t length;
+  for (uint8_t expected_option : kExpectedOptions) {
+    ASSERT_TRUE(view.GetNextOption(&offset, &option_code, &value, &length));
+    EXPECT_EQ(expected_option, option_code);
+    const uint8_t* indexed_value;
+    uint8_t indexed_length;
+    ASSERT_TRUE(view.GetOption(option_code, &indexed_value, &indexed_length));
+    EXPECT_EQ(indexed_value, value);
+    EXPECT_EQ(indexed_length, length);
+  }
+  EXPECT_FALSE(view.GetNextOption(&offset, &option_code, &value, &length));
+}
+
+TEST_F(DHCPMessageTest, RapidCommitAck) {
+  DHCPMessageView view;
+  EXPECT_TRUE(DHCPMessageView::Init(kFakeDHCPRapidAckMessage,
+                                    sizeof(kFakeDHCPRapidAckMessage),
+                                    &view));
+  EXPECT_EQ(kDHCPMessageTypeAck, view.message_type());
+  EXPECT_TRUE(view.rapid_commit());
+  DHCPMessage msg;
+  EXPECT_TRUE(DHCPMessage::InitFromBuffer(kFakeDHCPRapidAckMessage,
+                                          sizeof(kFakeDHCPRapidAckMessage),
+                                          &msg));
+  EXPECT_TRUE(msg.rapid_commit());
+
+  EXPECT_TRUE(DHCPMessageView::Init(kFakeDHCPAckMessage,
+                                    kFakeDHCPAckMessageLength,
+                                    &view));
+  EXPECT_FALSE(view.rapid_commit());
+}
+
+TEST_F(DHCPMessageTest, SerializeRapidCommit) {
+  DHCPMessage message;
+  DHCPMessage::InitRequest(&message);
+  message.SetMessageType(kDHCPMessageTypeDiscover);
+  message.SetClientIPAddress(0);
+  message.SetClientHardwareAddress(
+      ByteString(kFakeHardwareAddress, IFHWADDRLEN));
+  message.SetRapidCommit(true);
+  ByteString data;
+  ASSERT_TRUE(message.Serialize(&data));
+  // The option comes right before the end tag.
+  const uint8_t kRapidCommitOption[] = {kDHCPOptionRapidCommit, 0x00, END_TAG};
+  ASSERT_GT(data.GetLength(), sizeof(kRapidCommitOption));
+  EXPECT_EQ(0, std::memcmp(data.GetConstData() + data.GetLength() -
+                               sizeof(kRapidCommitOption),
+                           kRapidCommitOption,
+                           sizeof(kRapidCommitOption)));
+}
+
+TEST_F(DHCPMessageTest, MessageViewInitWithinAllocationBudget) {
+  DHCPMessageView view;
+  EXPECT_EQ(0u, CountAllocations([&]() {
+    EXPECT_TRUE(DHCPMessageView::Init(kFakeDHCPOfferMessage,
+                                      kFakeDHCPOfferMessageLength,
+                                      &view));
+  }));
+}
+
+TEST_F(DHCPMessageTest, SerializeWithinAllocationBudget) {
+  DHCPMessage message;
+  DHCPMessage::InitRequest(&message);
+  message.SetMessageType(kDHCPMessageTypeRequest);
+  message.SetClientHardwareAddress(
+      ByteString(kFakeHardwareAddress, IFHWADDRLEN));
+  message.SetParameterRequestList({kDHCPOptionSubnetMask,
+                                   kDHCPOptionRouter,
+                                   kDHCPOptionDNSServer});
+  ByteString data;
+  // The whole message is written into a single allocation.
+  EXPECT_EQ(1u, CountAllocations([&]() {
+    EXPECT_TRUE(message.Serialize(&data));
+  }));
+}
+
+TEST_F(DHCPMessageTest, IsReplyTo) {
+  const ByteString kHardwareAddress(kFakeHardwareAddress, IFHWADDRLEN);
+  const uint32_t kTransactionID =
+      ntohl(*reinterpret_cast<const uint32_t*>(kFakeTransactionID));
+  EXPECT_TRUE(DHCPMessageView::IsReplyTo(kFakeDHCPOfferMessage,
+                                         kFakeDHCPOfferMessageLength,
+                                         kTransactionID,
+                                         kHardwareAddress));
+  EXPECT_FALSE(DHCPMessageView::IsReplyTo(kFakeDHCPOfferMessage,
+                                          kFakeDHCPOfferMessageLength,
+                                          kTransactionID + 1,
+                                          kHardwareAddress));
+  ByteString other_hardware_address(kHardwareAddress);
+  other_hardware_address.GetData()[IFHWADDRLEN - 1] ^= 0xff;
+  EXPECT_FALSE(DHCPMessageView::IsReplyTo(kFakeDHCPOfferMessage,
+                                          kFakeDHCPOfferMessageLength,
+                                          kTransactionID,
+                                          other_hardware_address));
+  // Too short to hold the cookie, which ends at byte 240.
+  EXPECT_FALSE(DHCPMessageView::IsReplyTo(kFakeDHCPOfferMessage,
+                                          239,
+                                          kTransactionID,
+                                          kHardwareAddress));
+}
+
+TEST_F(DHCPMessageTest, IsReplyToRejectsBadCookie) {
+  uint8_t message[sizeof(kFakeDHCPAckMessage)];
+  memcpy(message, kFakeDHCPAckMessage, sizeof(message));
+  ASSERT_EQ(0x63, message[kFakeDHCPAckCookieEnd]);
+  message[kFakeDHCPAckCookieEnd] = 0x00;
+  EXPECT_FALSE(DHCPMessageView::IsReplyTo(
+      message, sizeof(message),
+      ntohl(*reinterpret_cast<const uint32_t*>(kFakeTransactionID)),
+      ByteString(kFakeHardwareAddress, IFHWADDRLEN)));
+}
+
+TEST_F(DHCPMessageTest, MessageViewRejectsRepeatedOption) {
+  DHCPMessageView view;
+  EXPECT_FALSE(DHCPMessageView::Init(kFakeDHCPAckMessageRepeatedOption,
+                                     sizeof(kFakeDHCPAckMessageRepeatedOption),
+                                     &view));
+}
+
+TEST_F(DHCPMessageTest, MessageViewRejectsMissingEndTag) {
+  DHCPMessageView view;
+  EXPECT_FALSE(DHCPMessageView::Init(kFakeDHCPAckMessageWithoutEndTag,
+                                     sizeof(kFakeDHCPAckMessageWithoutEndTag),
+                                     &view));
+}
+
+TEST_F(DHCPMessageTest, MessageViewRejectsBadCookie) {
+  uint8_t message[sizeof(kFakeDHCPAckMessage)];
+  memcpy(message, kFakeDHCPAckMessage, sizeof(message));
+  ASSERT_EQ(0x63, message[kFakeDHCPAckCookieEnd]);
+  message[kFakeDHCPAckCookieEnd] = 0x00;
+  DHCPMessageView view;
+  EXPECT_FALSE(DHCPMessageView::Init(message, sizeof(message), &view));
+}
+
+TEST_F(DHCPMessageTest, MessageViewRejectsTruncatedCookie) {
+  // The message ends within the magic cookie. Allocated to its exact
+  // length so an overread shows under the sanitizers.
+  std::vector<uint8_t> message(kFakeDHCPAckMessage,
+                               kFakeDHCPAckMessage + 237);
+  DHCPMessageView view;
+  EXPECT_FALSE(DHCPMessageView::Init(&message[0], message.size(), &view));
+}
+
 }  // namespace dhcp_client
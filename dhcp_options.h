@@ -34,6 +34,8 @@ const uint8_t kDHCPOptionMessage = 56;
 const uint8_t kDHCPOptionRenewalTime = 58;
 const uint8_t kDHCPOptionRebindingTime = 59;
 const uint8_t kDHCPOptionClientIdentifier = 61;
+const uint8_t kDHCPOptionRapidCommit = 80;
+const uint8_t kDHCPOptionClasslessStaticRoute = 121;
 const uint8_t kDHCPOptionEnd = 255;
 
 const int kDHCPOptionLength = 312;
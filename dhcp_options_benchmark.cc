@@ -0,0 +1,266 @@
+//
+// Copyright (C) 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+#include <shill/net/byte_string.h>
+
+#include "dhcp_client/dhcp_options.h"
+#include "dhcp_client/dhcp_options_parser.h"
+#include "dhcp_client/dhcp_options_writer.h"
+#include "dhcp_client/lease_applier_interface.h"
+
+using shill::ByteString;
+
+namespace dhcp_client {
+namespace {
+
+// RFC 3942: a site-specific option code, for the value types no
+// standard option the client sends has.
+const uint8_t kSiteSpecificOption = 224;
+
+// Decode |value| with a |Parser| into a |Value|, the way DHCPMessage
+// decodes a received option.
+template <typename Parser, typename Value>
+void RunParser(benchmark::State& state, const std::vector<uint8_t>& value) {
+  Parser parser;
+  while (state.KeepRunning()) {
+    Value output = Value();
+    benchmark::DoNotOptimize(parser.GetOption(
+        value.data(), static_cast<uint8_t>(value.size()), &output));
+    benchmark::DoNotOptimize(&output);
+  }
+}
+
+// Option values of the sizes seen in server replies.
+void BM_UInt8Parser(benchmark::State& state) {
+  RunParser<UInt8Parser, uint8_t>(state, {5});
+}
+BENCHMARK(BM_UInt8Parser);
+
+void BM_UInt16Parser(benchmark::State& state) {
+  RunParser<UInt16Parser, uint16_t>(state, {0x05, 0xdc});
+}
+BENCHMARK(BM_UInt16Parser);
+
+void BM_UInt32Parser(benchmark::State& state) {
+  RunParser<UInt32Parser, uint32_t>(state, {0x00, 0x01, 0x51, 0x80});
+}
+BENCHMARK(BM_UInt32Parser);
+
+void BM_UInt8ListParser(benchmark::State& state) {
+  RunParser<UInt8ListParser, std::vector<uint8_t>>(
+      state, {1, 3, 6, 15, 51, 58, 59});
+}
+BENCHMARK(BM_UInt8ListParser);
+
+void BM_UInt16ListParser(benchmark::State& state) {
+  RunParser<UInt16ListParser, std::vector<uint16_t>>(
+      state, {0x02, 0x40, 0x05, 0xdc, 0x1f, 0xfe});
+}
+BENCHMARK(BM_UInt16ListParser);
+
+void BM_UInt32ListParser(benchmark::State& state) {
+  RunParser<UInt32ListParser, std::vector<uint32_t>>(
+      state, {10, 0, 0, 53, 10, 0, 1, 53, 10, 0, 2, 53});
+}
+BENCHMARK(BM_UInt32ListParser);
+
+void BM_UInt32PairListParser(benchmark::State& state) {
+  RunParser<UInt32PairListParser, std::vector<std::pair<uint32_t, uint32_t>>>(
+      state, {10, 1, 0, 0, 255, 255, 0, 0, 10, 2, 0, 0, 255, 255, 0, 0});
+}
+BENCHMARK(BM_UInt32PairListParser);
+
+void BM_BoolParser(benchmark::State& state) {
+  RunParser<BoolParser, bool>(state, {1});
+}
+BENCHMARK(BM_BoolParser);
+
+void BM_FlagParser(benchmark::State& state) {
+  RunParser<FlagParser, bool>(state, {});
+}
+BENCHMARK(BM_FlagParser);
+
+void BM_StringParser(benchmark::State& state) {
+  const std::string kDomainName = "building4.corp.example";
+  RunParser<StringParser, std::string>(
+      state, std::vector<uint8_t>(kDomainName.begin(), kDomainName.end()));
+}
+BENCHMARK(BM_StringParser);
+
+void BM_ByteArrayParser(benchmark::State& state) {
+  RunParser<ByteArrayParser, ByteString>(
+      state, {0x01, 0x04, 0x0a, 0x1e, 0x00, 0x07, 0x02, 0x08,
+              'A', 'N', 'D', 'R', 'O', 'I', 'D', 0x00});
+}
+BENCHMARK(BM_ByteArrayParser);
+
+// RFC 3442 routes to a /8, a /12 and a /24, and the default route.
+void BM_ClasslessRouteListParser(benchmark::State& state) {
+  RunParser<ClasslessRouteListParser, std::vector<Route>>(
+      state, {8, 10, 10, 30, 4, 1,
+              12, 172, 16, 10, 30, 4, 1,
+              24, 192, 168, 100, 10, 30, 4, 2,
+              0, 10, 30, 4, 1});
+}
+BENCHMARK(BM_ClasslessRouteListParser);
+
+// The writers append to the message being serialized. The buffer is
+// cleared for every iteration but keeps its capacity.
+void BM_WriteUInt8Option(benchmark::State& state) {
+  ByteString buffer;
+  while (state.KeepRunning()) {
+    buffer.Clear();
+    benchmark::DoNotOptimize(DHCPOptionsWriter::GetInstance()->WriteUInt8Option(
+        &buffer, kDHCPOptionMessageType, 1));
+  }
+}
+BENCHMARK(BM_WriteUInt8Option);
+
+void BM_WriteUInt16Option(benchmark::State& state) {
+  ByteString buffer;
+  while (state.KeepRunning()) {
+    buffer.Clear();
+    benchmark::DoNotOptimize(
+        DHCPOptionsWriter::GetInstance()->WriteUInt16Option(
+            &buffer, kSiteSpecificOption, 1500));
+  }
+}
+BENCHMARK(BM_WriteUInt16Option);
+
+void BM_WriteUInt32Option(benchmark::State& state) {
+  ByteString buffer;
+  while (state.KeepRunning()) {
+    buffer.Clear();
+    benchmark::DoNotOptimize(
+        DHCPOptionsWriter::GetInstance()->WriteUInt32Option(
+            &buffer, kDHCPOptionRequestedIPAddr, 0xc0a80117));
+  }
+}
+BENCHMARK(BM_WriteUInt32Option);
+
+void BM_WriteUInt8ListOption(benchmark::State& state) {
+  const std::vector<uint8_t> kParameterRequestList = {1, 3, 6, 15, 51, 58, 59};
+  ByteString buffer;
+  while (state.KeepRunning()) {
+    buffer.Clear();
+    benchmark::DoNotOptimize(
+        DHCPOptionsWriter::GetInstance()->WriteUInt8ListOption(
+            &buffer, kDHCPOptionParameterRequestList, kParameterRequestList));
+  }
+}
+BENCHMARK(BM_WriteUInt8ListOption);
+
+void BM_WriteUInt16ListOption(benchmark::State& state) {
+  const std::vector<uint16_t> kValue = {576, 1500, 8190};
+  ByteString buffer;
+  while (state.KeepRunning()) {
+    buffer.Clear();
+    benchmark::DoNotOptimize(
+        DHCPOptionsWriter::GetInstance()->WriteUInt16ListOption(
+            &buffer, kSiteSpecificOption, kValue));
+  }
+}
+BENCHMARK(BM_WriteUInt16ListOption);
+
+void BM_WriteUInt32ListOption(benchmark::State& state) {
+  const std::vector<uint32_t> kValue = {0x0a000035, 0x0a000135, 0x0a000235};
+  ByteString buffer;
+  while (state.KeepRunning()) {
+    buffer.Clear();
+    benchmark::DoNotOptimize(
+        DHCPOptionsWriter::GetInstance()->WriteUInt32ListOption(
+            &buffer, kDHCPOptionDNSServer, kValue));
+  }
+}
+BENCHMARK(BM_WriteUInt32ListOption);
+
+void BM_WriteUInt32PairListOption(benchmark::State& state) {
+  const std::vector<std::pair<uint32_t, uint32_t>> kValue = {
+      {0x0a010000, 0xffff0000}, {0x0a020000, 0xffff0000}};
+  ByteString buffer;
+  while (state.KeepRunning()) {
+    buffer.Clear();
+    benchmark::DoNotOptimize(
+        DHCPOptionsWriter::GetInstance()->WriteUInt32PairListOption(
+            &buffer, kSiteSpecificOption, kValue));
+  }
+}
+BENCHMARK(BM_WriteUInt32PairListOption);
+
+void BM_WriteBoolOption(benchmark::State& state) {
+  ByteString buffer;
+  while (state.KeepRunning()) {
+    buffer.Clear();
+    benchmark::DoNotOptimize(DHCPOptionsWriter::GetInstance()->WriteBoolOption(
+        &buffer, kSiteSpecificOption, true));
+  }
+}
+BENCHMARK(BM_WriteBoolOption);
+
+void BM_WriteFlagOption(benchmark::State& state) {
+  ByteString buffer;
+  while (state.KeepRunning()) {
+    buffer.Clear();
+    benchmark::DoNotOptimize(DHCPOptionsWriter::GetInstance()->WriteFlagOption(
+        &buffer, kDHCPOptionRapidCommit));
+  }
+}
+BENCHMARK(BM_WriteFlagOption);
+
+void BM_WriteStringOption(benchmark::State& state) {
+  const std::string kHostname = "android-5c3b9e01a2f4d7c8";
+  ByteString buffer;
+  while (state.KeepRunning()) {
+    buffer.Clear();
+    benchmark::DoNotOptimize(
+        DHCPOptionsWriter::GetInstance()->WriteStringOption(
+            &buffer, kDHCPOptionDomainName, kHostname));
+  }
+}
+BENCHMARK(BM_WriteStringOption);
+
+void BM_WriteByteArrayOption(benchmark::State& state) {
+  const unsigned char kClientIdentifier[] = {
+      0x01, 0x00, 0x1a, 0x11, 0xc3, 0x02, 0x5e};
+  const ByteString value(kClientIdentifier, sizeof(kClientIdentifier));
+  ByteString buffer;
+  while (state.KeepRunning()) {
+    buffer.Clear();
+    benchmark::DoNotOptimize(
+        DHCPOptionsWriter::GetInstance()->WriteByteArrayOption(
+            &buffer, kDHCPOptionClientIdentifier, value));
+  }
+}
+BENCHMARK(BM_WriteByteArrayOption);
+
+void BM_WriteEndTag(benchmark::State& state) {
+  ByteString buffer;
+  while (state.KeepRunning()) {
+    buffer.Clear();
+    benchmark::DoNotOptimize(
+        DHCPOptionsWriter::GetInstance()->WriteEndTag(&buffer));
+  }
+}
+BENCHMARK(BM_WriteEndTag);
+
+}  // namespace
+}  // namespace dhcp_client
@@ -18,6 +18,7 @@
 
 #include <netinet/in.h>
 
+#include <cstring>
 #include <string>
 #include <utility>
 #include <vector>
@@ -26,6 +27,8 @@
 #include <base/macros.h>
 #include <shill/net/byte_string.h>
 
+#include "dhcp_client/lease_applier_interface.h"
+
 using shill::ByteString;
 
 namespace dhcp_client {
@@ -175,6 +178,18 @@ bool StringParser::GetOption(const uint8_t* buffer,
   return true;
 }
 
+bool FlagParser::GetOption(const uint8_t* buffer,
+                           uint8_t length,
+                           void* value) {
+  if (length != 0) {
+    LOG(ERROR) << "Invalid option length field";
+    return false;
+  }
+  bool* present = static_cast<bool*>(value);
+  *present = true;
+  return true;
+}
+
 bool ByteArrayParser::GetOption(const uint8_t* buffer,
                                 uint8_t length,
                                 void* value) {
@@ -188,4 +203,44 @@ bool ByteArrayParser::GetOption(const uint8_t* buffer,
   return true;
 }
 
+bool ClasslessRouteListParser::GetOption(const uint8_t* buffer,
+                                         uint8_t length,
+                                         void* value) {
+  if (length == 0) {
+    LOG(ERROR) << "Invalid option length field";
+    return false;
+  }
+  std::vector<Route>* routes = static_cast<std::vector<Route>*>(value);
+  const uint8_t* end = buffer + length;
+  while (buffer < end) {
+    // RFC 3442: the prefix length, the significant octets of the
+    // destination, then the router.
+    uint8_t prefix_length = *buffer++;
+    if (prefix_length > 32) {
+      LOG(ERROR) << "Invalid classless route prefix length";
+      return false;
+    }
+    size_t destination_length = (prefix_length + 7) / 8;
+    if (static_cast<size_t>(end - buffer) <
+        destination_length + sizeof(uint32_t)) {
+      LOG(ERROR) << "Invalid option length field";
+      return false;
+    }
+    uint32_t destination = 0;
+    for (size_t i = 0; i < destination_length; i++) {
+      destination |= static_cast<uint32_t>(buffer[i]) << (24 - 8 * i);
+    }
+    buffer += destination_length;
+    // Clear the bits past the prefix.
+    if (prefix_length < 32) {
+      destination &= ~(0xffffffffu >> prefix_length);
+    }
+    uint32_t gateway;
+    memcpy(&gateway, buffer, sizeof(gateway));
+    buffer += sizeof(gateway);
+    routes->push_back(Route(destination, prefix_length, ntohl(gateway)));
+  }
+  return true;
+}
+
 }  // namespace dhcp_client
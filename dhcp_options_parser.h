@@ -93,6 +93,16 @@ class BoolParser : public DHCPOptionsParser {
                  void* value) override;
 };
 
+// Parser of the options without a value, such as Rapid Commit.
+// Sets the bool pointed by |value| if the option is well formed.
+class FlagParser : public DHCPOptionsParser {
+ public:
+  FlagParser() {}
+  bool GetOption(const uint8_t* buffer,
+                 uint8_t length,
+                 void* value) override;
+};
+
 class StringParser : public DHCPOptionsParser {
  public:
   StringParser() {}
@@ -107,6 +117,16 @@ class ByteArrayParser : public DHCPOptionsParser {
                  uint8_t length,
                  void* value) override;
 };
+
+// Parser of the RFC 3442 classless static route option into a
+// std::vector<Route>.
+class ClasslessRouteListParser : public DHCPOptionsParser {
+ public:
+  ClasslessRouteListParser() {}
+  bool GetOption(const uint8_t* buffer,
+                 uint8_t length,
+                 void* value) override;
+};
 }  // namespace dhcp_client
 
 #endif  // DHCP_CLIENT_PARSER_H_
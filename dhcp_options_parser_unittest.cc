@@ -26,6 +26,8 @@
 #include <gtest/gtest.h>
 #include <shill/net/byte_string.h>
 
+#include "dhcp_client/lease_applier_interface.h"
+
 using shill::ByteString;
 
 namespace {
@@ -65,6 +67,13 @@ const unsigned char kFakeByteArrayOption[] =
 const uint8_t kFakeBoolOptionEnable[] = {0x01};
 const uint8_t kFakeBoolOptionDisable[] = {0x00};
 const uint8_t kFakeBoolOptionLength = 1;
+
+// 0.0.0.0/0 via 192.168.1.1, 10.0.0.0/8 via 192.168.1.2 and
+// 172.16.5.128/25 on link, sent with a host bit set.
+const uint8_t kFakeClasslessRouteOption[] = {0x00, 0xc0, 0xa8, 0x01, 0x01,
+                                             0x08, 0x0a, 0xc0, 0xa8, 0x01,
+                                             0x02, 0x19, 0xac, 0x10, 0x05,
+                                             0x81, 0x00, 0x00, 0x00, 0x00};
 }  // namespace
 
 namespace dhcp_client {
@@ -197,6 +206,17 @@ TEST_F(ParserTest, ParseBoolDisable) {
   EXPECT_FALSE(value);
 }
 
+TEST_F(ParserTest, ParseFlag) {
+  parser_.reset(new FlagParser());
+  bool value = false;
+  EXPECT_TRUE(parser_->GetOption(kFakeBoolOptionEnable, 0, &value));
+  EXPECT_TRUE(value);
+  // The option carries no value.
+  EXPECT_FALSE(parser_->GetOption(kFakeBoolOptionEnable,
+                                  kFakeBoolOptionLength,
+                                  &value));
+}
+
 TEST_F(ParserTest, ParseString) {
   parser_.reset(new StringParser());
   std::string value;
@@ -220,4 +240,25 @@ TEST_F(ParserTest, ParseByteArray) {
   EXPECT_TRUE(target_value.Equals(value));
 }
 
+TEST_F(ParserTest, ParseClasslessRouteList) {
+  parser_.reset(new ClasslessRouteListParser());
+  std::vector<Route> value;
+  EXPECT_TRUE(parser_->GetOption(kFakeClasslessRouteOption,
+                                 sizeof(kFakeClasslessRouteOption),
+                                 &value));
+  // The bits of the destination past the prefix are dropped.
+  std::vector<Route> target_value = {Route(0, 0, 0xc0a80101),
+                                     Route(0x0a000000, 8, 0xc0a80102),
+                                     Route(0xac100580, 25, 0)};
+  EXPECT_EQ(target_value, value);
+}
+
+TEST_F(ParserTest, ParseTruncatedClasslessRouteList) {
+  parser_.reset(new ClasslessRouteListParser());
+  std::vector<Route> value;
+  EXPECT_FALSE(parser_->GetOption(kFakeClasslessRouteOption,
+                                  sizeof(kFakeClasslessRouteOption) - 1,
+                                  &value));
+}
+
 }  // namespace dhcp_client
@@ -18,6 +18,7 @@
 
 #include <netinet/in.h>
 
+#include <cstring>
 #include <string>
 #include <utility>
 #include <vector>
@@ -31,6 +32,31 @@ using shill::ByteString;
 namespace {
 base::LazyInstance<dhcp_client::DHCPOptionsWriter> g_dhcp_options_writer
     = LAZY_INSTANCE_INITIALIZER;
+
+// Grow |buffer| by one option with a |length| bytes value, and write its
+// tag and length. Returns where the value goes. Growing the buffer in
+// place allocates only when it runs out of capacity, instead of once
+// per temporary ByteString appended.
+uint8_t* AppendOption(ByteString* buffer,
+                      uint8_t option_code,
+                      uint8_t length) {
+  size_t offset = buffer->GetLength();
+  buffer->Resize(offset + 2 + length);
+  uint8_t* option = buffer->GetData() + offset;
+  option[0] = option_code;
+  option[1] = length;
+  return option + 2;
+}
+
+void WriteUInt16(uint8_t* buffer, uint16_t value) {
+  uint16_t value_net = htons(value);
+  memcpy(buffer, &value_net, sizeof(value_net));
+}
+
+void WriteUInt32(uint8_t* buffer, uint32_t value) {
+  uint32_t value_net = htonl(value);
+  memcpy(buffer, &value_net, sizeof(value_net));
+}
 }  // namespace
 
 namespace dhcp_client {
@@ -43,12 +69,7 @@ int DHCPOptionsWriter::WriteUInt8Option(ByteString* buffer,
                                         uint8_t option_code,
                                         uint8_t value) {
   uint8_t length = sizeof(uint8_t);
-  buffer->Append(ByteString(reinterpret_cast<const char*>(&option_code),
-                            sizeof(uint8_t)));
-  buffer->Append(ByteString(reinterpret_cast<const char*>(&length),
-                            sizeof(uint8_t)));
-  buffer->Append(ByteString(reinterpret_cast<const char*>(&value),
-                            sizeof(uint8_t)));
+  *AppendOption(buffer, option_code, length) = value;
   return length + 2;
 }
 
@@ -56,13 +77,7 @@ int DHCPOptionsWriter::WriteUInt16Option(ByteString* buffer,
                                          uint8_t option_code,
                                          uint16_t value) {
   uint8_t length = sizeof(uint16_t);
-  uint16_t value_net = htons(value);
-  buffer->Append(ByteString(reinterpret_cast<const char*>(&option_code),
-                            sizeof(uint8_t)));
-  buffer->Append(ByteString(reinterpret_cast<const char*>(&length),
-                            sizeof(uint8_t)));
-  buffer->Append(ByteString(reinterpret_cast<const char*>(&value_net),
-                            sizeof(uint16_t)));
+  WriteUInt16(AppendOption(buffer, option_code, length), value);
   return length + 2;
 }
 
@@ -70,13 +85,7 @@ int DHCPOptionsWriter::WriteUInt32Option(ByteString* buffer,
                                          uint8_t option_code,
                                          uint32_t value) {
   uint8_t length = sizeof(uint32_t);
-  uint32_t value_net = htonl(value);
-  buffer->Append(ByteString(reinterpret_cast<const char*>(&option_code),
-                            sizeof(uint8_t)));
-  buffer->Append(ByteString(reinterpret_cast<const char*>(&length),
-                            sizeof(uint8_t)));
-  buffer->Append(ByteString(reinterpret_cast<const char*>(&value_net),
-                            sizeof(uint32_t)));
+  WriteUInt32(AppendOption(buffer, option_code, length), value);
   return length + 2;
 }
 
@@ -89,12 +98,7 @@ int DHCPOptionsWriter::WriteUInt8ListOption(ByteString* buffer,
     return -1;
   }
   uint8_t length = value.size() * sizeof(uint8_t);
-  buffer->Append(ByteString(reinterpret_cast<const char*>(&option_code),
-                            sizeof(uint8_t)));
-  buffer->Append(ByteString(reinterpret_cast<const char*>(&length),
-                            sizeof(uint8_t)));
-  buffer->Append(ByteString(reinterpret_cast<const char*>(&value.front()),
-                            length * sizeof(uint8_t)));
+  memcpy(AppendOption(buffer, option_code, length), &value.front(), length);
   return length + 2;
 }
 
@@ -107,14 +111,10 @@ int DHCPOptionsWriter::WriteUInt16ListOption(ByteString* buffer,
     return -1;
   }
   uint8_t length = value.size() * sizeof(uint16_t);
-  buffer->Append(ByteString(reinterpret_cast<const char*>(&option_code),
-                            sizeof(uint8_t)));
-  buffer->Append(ByteString(reinterpret_cast<const char*>(&length),
-                            sizeof(uint8_t)));
+  uint8_t* output = AppendOption(buffer, option_code, length);
   for (uint16_t element : value) {
-    uint16_t element_net = htons(element);
-    buffer->Append(ByteString(reinterpret_cast<const char *>(&element_net),
-                              sizeof(uint16_t)));
+    WriteUInt16(output, element);
+    output += sizeof(uint16_t);
   }
   return length + 2;
 }
@@ -128,14 +128,10 @@ int DHCPOptionsWriter::WriteUInt32ListOption(ByteString* buffer,
     return -1;
   }
   uint8_t length = value.size() * sizeof(uint32_t);
-  buffer->Append(ByteString(reinterpret_cast<const char*>(&option_code),
-                            sizeof(uint8_t)));
-  buffer->Append(ByteString(reinterpret_cast<const char*>(&length),
-                            sizeof(uint8_t)));
+  uint8_t* output = AppendOption(buffer, option_code, length);
   for (uint32_t element : value) {
-    uint32_t element_net = htonl(element);
-    buffer->Append(ByteString(reinterpret_cast<const char*>(&element_net),
-                              sizeof(uint32_t)));
+    WriteUInt32(output, element);
+    output += sizeof(uint32_t);
   }
   return length + 2;
 }
@@ -149,17 +145,11 @@ int DHCPOptionsWriter::WriteUInt32PairListOption(ByteString* buffer,
     return -1;
   }
   uint8_t length = value.size() * sizeof(uint32_t) * 2;
-  buffer->Append(ByteString(reinterpret_cast<const char*>(&option_code),
-                            sizeof(uint8_t)));
-  buffer->Append(ByteString(reinterpret_cast<const char*>(&length),
-                            sizeof(uint8_t)));
-  for (auto element : value) {
-    uint32_t first_net = htonl(element.first);
-    uint32_t second_net = htonl(element.second);
-    buffer->Append(ByteString(reinterpret_cast<const char*>(&first_net),
-                              sizeof(uint32_t)));
-    buffer->Append(ByteString(reinterpret_cast<const char*>(&second_net),
-                              sizeof(uint32_t)));
+  uint8_t* output = AppendOption(buffer, option_code, length);
+  for (const auto& element : value) {
+    WriteUInt32(output, element.first);
+    WriteUInt32(output + sizeof(uint32_t), element.second);
+    output += 2 * sizeof(uint32_t);
   }
   return length + 2;
 }
@@ -168,16 +158,16 @@ int DHCPOptionsWriter::WriteBoolOption(ByteString* buffer,
                                        uint8_t option_code,
                                        const bool value) {
   uint8_t length = sizeof(uint8_t);
-  uint8_t value_uint8 = value ? 1 : 0;
-  buffer->Append(ByteString(reinterpret_cast<const char*>(&option_code),
-                            sizeof(uint8_t)));
-  buffer->Append(ByteString(reinterpret_cast<const char*>(&length),
-                            sizeof(uint8_t)));
-  buffer->Append(ByteString(reinterpret_cast<const char*>(&value_uint8),
-                            sizeof(uint8_t)));
+  *AppendOption(buffer, option_code, length) = value ? 1 : 0;
   return length + 2;
 }
 
+int DHCPOptionsWriter::WriteFlagOption(ByteString* buffer,
+                                       uint8_t option_code) {
+  AppendOption(buffer, option_code, 0);
+  return 2;
+}
+
 int DHCPOptionsWriter::WriteStringOption(ByteString* buffer,
     uint8_t option_code,
     const std::string& value) {
@@ -187,12 +177,7 @@ int DHCPOptionsWriter::WriteStringOption(ByteString* buffer,
     return -1;
   }
   uint8_t length = value.size();
-  buffer->Append(ByteString(reinterpret_cast<const char*>(&option_code),
-                            sizeof(uint8_t)));
-  buffer->Append(ByteString(reinterpret_cast<const char*>(&length),
-                            sizeof(uint8_t)));
-  buffer->Append(ByteString(reinterpret_cast<const char*>(&value.front()),
-                            length * sizeof(uint8_t)));
+  memcpy(AppendOption(buffer, option_code, length), value.data(), length);
   return length + 2;
 }
 
@@ -200,19 +185,17 @@ int DHCPOptionsWriter::WriteByteArrayOption(ByteString* buffer,
                                             uint8_t option_code,
                                             const ByteString& value) {
   uint8_t length = value.GetLength();
-  buffer->Append(ByteString(reinterpret_cast<const char*>(&option_code),
-                            sizeof(uint8_t)));
-  buffer->Append(ByteString(reinterpret_cast<const char*>(&length),
-                            sizeof(uint8_t)));
-
-  buffer->Append(value);
+  uint8_t* output = AppendOption(buffer, option_code, length);
+  if (length != 0) {
+    memcpy(output, value.GetConstData(), length);
+  }
   return length + 2;
 }
 
 int DHCPOptionsWriter::WriteEndTag(ByteString* buffer) {
-  uint8_t tag = kDHCPOptionEnd;
-  buffer->Append(ByteString(reinterpret_cast<const char*>(&tag),
-                            sizeof(uint8_t)));
+  size_t offset = buffer->GetLength();
+  buffer->Resize(offset + 1);
+  buffer->GetData()[offset] = kDHCPOptionEnd;
   return 1;
 }
 
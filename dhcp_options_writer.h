@@ -55,6 +55,8 @@ class DHCPOptionsWriter {
   int WriteBoolOption(shill::ByteString* buffer,
                       uint8_t option_code,
                       const bool value);
+  // Write an option without a value.
+  int WriteFlagOption(shill::ByteString* buffer, uint8_t option_code);
   int WriteStringOption(shill::ByteString* buffer,
                         uint8_t option_code,
                         const std::string& value);
@@ -26,6 +26,7 @@
 #include <gtest/gtest.h>
 #include <shill/net/byte_string.h>
 
+#include "dhcp_client/allocation_counter.h"
 #include "dhcp_client/dhcp_options.h"
 
 using shill::ByteString;
@@ -38,7 +39,7 @@ const uint8_t kFakeOptionCode3 = 251;
 }  // namespace
 
 
-class DHCPOptionsWriterTest : public testing::Test {
+class DHCPOptionsWriterTest : public AllocationBudgetTest {
  protected:
   DHCPOptionsWriter* options_writer_;
 };
@@ -237,6 +238,20 @@ TEST_F(DHCPOptionsWriterTest, WriteBoolFalse) {
                            length));
 }
 
+TEST_F(DHCPOptionsWriterTest, WriteFlag) {
+  const uint8_t kFakeFlagOptionResult[] = {
+      kFakeOptionCode1,
+      0x00};
+
+  ByteString option;
+  options_writer_ = DHCPOptionsWriter::GetInstance();
+  int length = options_writer_->WriteFlagOption(&option, kFakeOptionCode1);
+  EXPECT_EQ(static_cast<int>(sizeof(kFakeFlagOptionResult)), length);
+  EXPECT_EQ(0, std::memcmp(option.GetConstData(),
+                           kFakeFlagOptionResult,
+                           length));
+}
+
 TEST_F(DHCPOptionsWriterTest, WriteByteArray) {
   const ByteString kFakeByteArrayOption =
       ByteString({0x06, 0x05, 0x04, 0x03, 0x02, 0x01});
@@ -276,4 +291,41 @@ TEST_F(DHCPOptionsWriterTest, WriteEndTag) {
   EXPECT_EQ(kDHCPOptionEnd, *(option.GetConstData() + length));
 }
 
+TEST_F(DHCPOptionsWriterTest, WriteWithinAllocationBudget) {
+  const std::vector<uint8_t> kFakeUInt8ListOption = {1, 3, 6, 15, 51};
+  const std::vector<uint32_t> kFakeUInt32ListOption = {0x01020304,
+                                                       0x05060708};
+  const std::string kFakeStringOption = "fakestring";
+  const uint8_t kFakeByteArray[] = {0x01, 0x02, 0x03};
+  const ByteString kFakeByteArrayOption(kFakeByteArray,
+                                        sizeof(kFakeByteArray));
+
+  options_writer_ = DHCPOptionsWriter::GetInstance();
+  // Options are appended in place, a buffer with enough room never
+  // reallocates.
+  ByteString options;
+  options.Resize(kDHCPOptionLength);
+  options.Clear();
+  size_t allocations = CountAllocations([&]() {
+    options_writer_->WriteUInt8Option(&options, kFakeOptionCode1, 1);
+    options_writer_->WriteUInt16Option(&options, kFakeOptionCode1, 2);
+    options_writer_->WriteUInt32Option(&options, kFakeOptionCode1, 3);
+    options_writer_->WriteUInt8ListOption(&options,
+                                          kFakeOptionCode2,
+                                          kFakeUInt8ListOption);
+    options_writer_->WriteUInt32ListOption(&options,
+                                           kFakeOptionCode2,
+                                           kFakeUInt32ListOption);
+    options_writer_->WriteFlagOption(&options, kFakeOptionCode3);
+    options_writer_->WriteStringOption(&options,
+                                       kFakeOptionCode3,
+                                       kFakeStringOption);
+    options_writer_->WriteByteArrayOption(&options,
+                                          kFakeOptionCode3,
+                                          kFakeByteArrayOption);
+    options_writer_->WriteEndTag(&options);
+  });
+  EXPECT_EQ(0u, allocations);
+}
+
 }  // namespace dhcp_client
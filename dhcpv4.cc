@@ -23,13 +23,21 @@
 #include <net/if_arp.h>
 #include <netinet/ip.h>
 #include <netinet/udp.h>
+#include <sys/uio.h>
 
+#include <algorithm>
 #include <random>
+#include <utility>
+#include <vector>
 
 #include <base/bind.h>
 #include <base/logging.h>
+#include <base/time/time.h>
 
+#include "dhcp_client/checksum.h"
 #include "dhcp_client/dhcp_message.h"
+#include "dhcp_client/dhcp_options.h"
+#include "dhcp_client/socket_filter.h"
 
 using base::Bind;
 using base::Unretained;
@@ -45,25 +53,62 @@ const uint16_t kDHCPClientPort = 68;
 
 const int kInvalidSocketDescriptor = -1;
 
+// Options we ask the server for.
+const uint8_t kParameterRequestList[] = {
+  kDHCPOptionSubnetMask,
+  kDHCPOptionRouter,
+  kDHCPOptionDNSServer,
+  kDHCPOptionDomainName,
+  kDHCPOptionLeaseTime,
+  kDHCPOptionRenewalTime,
+  kDHCPOptionRebindingTime,
+  kDHCPOptionClasslessStaticRoute
+};
+
 // RFC 791: the minimum value for a correct header is 20 octets.
 // The maximum value is 60 octets.
 const size_t kIPHeaderMinLength = 20;
 const size_t kIPHeaderMaxLength = 60;
 
-// Socket filter for dhcp packet.
-const sock_filter dhcp_bpf_filter[] = {
-  BPF_STMT(BPF_LD + BPF_B + BPF_ABS, 23 - ETH_HLEN),
-  BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K, IPPROTO_UDP, 0, 6),
-  BPF_STMT(BPF_LD + BPF_H + BPF_ABS, 20 - ETH_HLEN),
-  BPF_JUMP(BPF_JMP + BPF_JSET + BPF_K, 0x1fff, 4, 0),
-  BPF_STMT(BPF_LDX + BPF_B + BPF_MSH, 14 - ETH_HLEN),
-  BPF_STMT(BPF_LD + BPF_H + BPF_IND, 16 - ETH_HLEN),
-  BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K, kDHCPClientPort, 0, 1),
-  BPF_STMT(BPF_RET + BPF_K, 0x0fffffff),
-  BPF_STMT(BPF_RET + BPF_K, 0),
-};
-const int dhcp_bpf_filter_len =
-    sizeof(dhcp_bpf_filter) / sizeof(dhcp_bpf_filter[0]);
+// The kernel verified the checksum of the frame, or the frame comes from
+// this host and its checksum was never filled in. Either way there is
+// nothing left to verify.
+const uint32_t kChecksumDoneStatus =
+    TP_STATUS_CSUM_VALID | TP_STATUS_CSUMNOTREADY;
+
+// RFC 2131 section 4.1: retransmissions start after 4 seconds, the
+// interval doubles up to 64 seconds and is randomized by up to 1 second.
+const int64_t kDefaultInitialRetransmissionIntervalMs = 4000;
+const int64_t kDefaultMaxRetransmissionIntervalMs = 64000;
+const int64_t kMaxRetransmissionJitterMs = 1000;
+// A Request without reply is sent this many times before the client
+// starts over with discovery.
+const int kMaxRequestTransmissions = 4;
+// RFC 2131 section 4.4.5: in RENEWING and REBINDING the client waits
+// one half of the time remaining, down to a minimum of 60 seconds.
+const int64_t kMinRenewRetransmissionIntervalMs = 60000;
+const int64_t kMillisecondsPerSecond = 1000;
+
+uint8_t MaskToPrefixLength(uint32_t mask) {
+  uint8_t prefix_length = 0;
+  while (prefix_length < 32 && (mask & (0x80000000u >> prefix_length))) {
+    prefix_length++;
+  }
+  return prefix_length;
+}
+
+// The mask of the class of |address|, for servers sending no Subnet
+// Mask option.
+uint32_t GetClassfulMask(uint32_t address) {
+  if ((address & 0x80000000u) == 0) {
+    return 0xff000000u;
+  }
+  if ((address & 0xc0000000u) == 0x80000000u) {
+    return 0xffff0000u;
+  }
+  return 0xffffff00u;
+}
+
 }  // namespace
 
 DHCPV4::DHCPV4(const std::string& interface_name,
@@ -73,6 +118,10 @@ DHCPV4::DHCPV4(const std::string& interface_name,
                bool request_hostname,
                bool arp_gateway,
                bool unicast_arp,
+               bool use_packet_ring,
+               bool rapid_commit,
+               PacketDemuxer* packet_demuxer,
+               LeaseStoreInterface* lease_store,
                EventDispatcherInterface* event_dispatcher)
     : interface_name_(interface_name),
       hardware_address_(hardware_address),
@@ -81,14 +130,38 @@ DHCPV4::DHCPV4(const std::string& interface_name,
       request_hostname_(request_hostname),
       arp_gateway_(arp_gateway),
       unicast_arp_(unicast_arp),
+      use_packet_ring_(use_packet_ring),
+      rapid_commit_(rapid_commit),
+      packet_demuxer_(packet_demuxer),
+      lease_store_(lease_store),
+      lease_applier_(nullptr),
       event_dispatcher_(event_dispatcher),
       io_handler_factory_(
           IOHandlerFactoryContainer::GetInstance()->GetIOHandlerFactory()),
       state_(State::INIT),
+      server_identifier_(0),
+      transaction_id_(0),
+      requested_ip_address_(0),
       from_(INADDR_ANY),
       to_(INADDR_BROADCAST),
+      initial_retransmission_interval_ms_(
+          kDefaultInitialRetransmissionIntervalMs),
+      max_retransmission_interval_ms_(kDefaultMaxRetransmissionIntervalMs),
+      retransmission_interval_ms_(0),
+      transmission_count_(0),
+      retransmission_timer_(kInvalidTimerHandle),
+      state_remaining_ms_(0),
+      renew_duration_ms_(0),
+      rebind_duration_ms_(0),
+      renewal_timer_(kInvalidTimerHandle),
+      rebinding_timer_(kInvalidTimerHandle),
+      expiry_timer_(kInvalidTimerHandle),
+      bound_socket_close_timer_(kInvalidTimerHandle),
+      frame_queued_(false),
+      queued_flush_count_(0),
       socket_(kInvalidSocketDescriptor),
-      sockets_(new shill::Sockets()),
+      socket_is_udp_(false),
+      sockets_(new Sockets()),
       random_engine_(time(nullptr)) {
 }
 
@@ -96,30 +169,86 @@ DHCPV4::~DHCPV4() {
   Stop();
 }
 
-void DHCPV4::ParseRawPacket(shill::InputData* data) {
-  if (data->len < sizeof(iphdr)) {
-    LOG(ERROR) << "Invalid packet length from buffer";
-    return;
-  }
+void DHCPV4::OnSocketReady(int fd) {
+  batched_socket_->Receive(Bind(&DHCPV4::OnFrameReceived, Unretained(this)));
+}
+
+void DHCPV4::OnFrameReceived(const unsigned char* frame,
+                             size_t len,
+                             const struct sockaddr* address,
+                             uint32_t status) {
+  ProcessFrame(frame, len, status);
+}
+
+void DHCPV4::OnPacketRingReady(int fd) {
+  packet_ring_->ReadFrames(Bind(&DHCPV4::ProcessFrame, Unretained(this)));
+}
+
+void DHCPV4::OnUDPSocketReady(int fd) {
+  batched_socket_->Receive(
+      Bind(&DHCPV4::OnDatagramReceived, Unretained(this)));
+}
+
+void DHCPV4::OnDatagramReceived(const unsigned char* buffer,
+                                size_t len,
+                                const struct sockaddr* address,
+                                uint32_t status) {
+  // The kernel has checked the IP and UDP headers.
+  HandleMessage(buffer, len);
+}
+
+void DHCPV4::HandleFrame(const unsigned char* frame, size_t len) {
+  // Nothing is known about where the frame comes from.
+  ProcessFrame(frame, len, 0);
+}
+
+void DHCPV4::ProcessFrame(const unsigned char* frame,
+                          size_t len,
+                          uint32_t status) {
   // The socket filter has finished part the header validation.
   // This function will perform the remaining part.
-  int header_len = ValidatePacketHeader(data->buf, data->len);
+  int header_len = ValidatePacketHeader(frame, len);
   if (header_len == -1) {
     return;
   }
-  unsigned char* buffer = data->buf + header_len;
-  DHCPMessage msg;
-  if (!DHCPMessage::InitFromBuffer(buffer, data->len - header_len, &msg)) {
-    LOG(ERROR) << "Failed to initialize DHCP message from buffer";
+  const unsigned char* message = frame + header_len;
+  size_t message_len = len - header_len;
+  if (!IsReplyToTransaction(message, message_len)) {
     return;
   }
-  // In INIT state the client ignores all messages from server.
-  if (state_ == State::INIT) {
+  // Only the few frames meant for us are worth summing.
+  if (!(status & kChecksumDoneStatus) && !VerifyUDPChecksum(frame, len)) {
+    LOG(ERROR) << "Invalid UDP checksum";
     return;
   }
-  // Check transaction id with the existing one.
-  if (msg.transaction_id() != transaction_id_) {
-    LOG(ERROR) << "Transaction id(xid) doesn't match";
+  DispatchMessage(message, message_len);
+}
+
+bool DHCPV4::IsReplyToTransaction(const unsigned char* buffer,
+                                  size_t len) const {
+  // Outside of an exchange the client ignores all messages from server.
+  if (state_ == State::INIT || state_ == State::BOUND) {
+    return false;
+  }
+  // On a shared segment most of the replies are for other clients or
+  // transactions, drop them on the fixed fields before the options are
+  // looked at.
+  return DHCPMessageView::IsReplyTo(buffer, len, transaction_id_,
+                                    hardware_address_);
+}
+
+void DHCPV4::HandleMessage(const unsigned char* buffer, size_t len) {
+  if (IsReplyToTransaction(buffer, len)) {
+    DispatchMessage(buffer, len);
+  }
+}
+
+void DHCPV4::DispatchMessage(const unsigned char* buffer, size_t len) {
+  // Validate the message in place, options are decoded only when
+  // a handler asks for them.
+  DHCPMessageView msg;
+  if (!DHCPMessageView::Init(buffer, len, &msg)) {
+    LOG(ERROR) << "Failed to initialize DHCP message from buffer";
     return;
   }
   uint8_t message_type = msg.message_type();
@@ -139,27 +268,172 @@ void DHCPV4::ParseRawPacket(shill::InputData* data) {
   }
 }
 
-void DHCPV4::OnReadError(const std::string& error_msg) {
-  LOG(INFO) << __func__;
+bool DHCPV4::Start() {
+  if (!OpenRawSocket()) {
+    return false;
+  }
+  // Most connections are to a known network, asking for the previous
+  // address saves the Discover/Offer round trip.
+  Lease lease;
+  if (LoadLease(&lease)) {
+    StartReboot(lease);
+  } else {
+    StartInit();
+  }
+  return true;
 }
 
-bool DHCPV4::Start() {
+void DHCPV4::SetRetransmissionIntervals(int64_t initial_interval_ms,
+                                        int64_t max_interval_ms) {
+  if (initial_interval_ms > 0) {
+    initial_retransmission_interval_ms_ = initial_interval_ms;
+  }
+  if (max_interval_ms > 0) {
+    max_retransmission_interval_ms_ = max_interval_ms;
+  }
+  if (max_retransmission_interval_ms_ < initial_retransmission_interval_ms_) {
+    LOG(WARNING) << "Maximum retransmission interval raised to "
+                 << initial_retransmission_interval_ms_ << " ms";
+    max_retransmission_interval_ms_ = initial_retransmission_interval_ms_;
+  }
+}
+
+void DHCPV4::SetRandomSeed(unsigned int seed) {
+  random_engine_.seed(seed);
+}
+
+bool DHCPV4::OpenRawSocket() {
+  if (!packet_sender_.is_null()) {
+    return true;
+  }
+  if (packet_demuxer_) {
+    if (!packet_demuxer_->AddClient(
+            interface_index_,
+            hardware_address_,
+            Bind(&DHCPV4::ProcessFrame, Unretained(this)))) {
+      return false;
+    }
+    socket_ = packet_demuxer_->socket();
+    return true;
+  }
   if (!CreateRawSocket()) {
     return false;
   }
+  batched_socket_.reset(
+      new BatchedSocket(sockets_.get(), socket_, event_dispatcher_, 1));
 
-  input_handler_.reset(io_handler_factory_->CreateIOInputHandler(
-      socket_,
-      Bind(&DHCPV4::ParseRawPacket, Unretained(this)),
-      Bind(&DHCPV4::OnReadError, Unretained(this))));
+  if (packet_ring_) {
+    input_handler_.reset(io_handler_factory_->CreateIOReadyHandler(
+        socket_,
+        shill::IOHandler::kModeInput,
+        Bind(&DHCPV4::OnPacketRingReady, Unretained(this))));
+  } else {
+    input_handler_.reset(io_handler_factory_->CreateIOReadyHandler(
+        socket_,
+        shill::IOHandler::kModeInput,
+        Bind(&DHCPV4::OnSocketReady, Unretained(this))));
+  }
   return true;
 }
 
 void DHCPV4::Stop() {
+  CancelTimer(&retransmission_timer_);
+  CancelTimer(&bound_socket_close_timer_);
+  CancelLeaseTimers();
+  state_ = State::INIT;
+  CloseSocket();
+}
+
+void DHCPV4::CloseSocket() {
   input_handler_.reset();
-  if (socket_ != kInvalidSocketDescriptor) {
+  packet_ring_.reset();
+  if (socket_ == kInvalidSocketDescriptor) {
+    return;
+  }
+  // The queued frame refers to our templates.
+  FlushQueuedFrame();
+  if (packet_demuxer_ && !socket_is_udp_) {
+    packet_demuxer_->RemoveClient(interface_index_, hardware_address_);
+  } else {
+    // Do not lose the frames queued during this event loop iteration.
+    batched_socket_->Flush();
+    batched_socket_.reset();
     sockets_->Close(socket_);
   }
+  socket_ = kInvalidSocketDescriptor;
+  socket_is_udp_ = false;
+}
+
+bool DHCPV4::OpenSocketForState() {
+  if (!packet_sender_.is_null()) {
+    return true;
+  }
+  if (socket_ != kInvalidSocketDescriptor) {
+    // The raw socket works in every state, the UDP one only in RENEW.
+    if (!socket_is_udp_ || state_ == State::RENEW) {
+      return true;
+    }
+    CloseSocket();
+  }
+  if (state_ == State::RENEW) {
+    if (OpenUDPSocket()) {
+      return true;
+    }
+    // The leased address may be missing from the interface.
+    LOG(WARNING) << "Renewing over a raw socket on " << interface_name_;
+  }
+  return OpenRawSocket();
+}
+
+bool DHCPV4::OpenUDPSocket() {
+  int fd = sockets_->Socket(PF_INET,
+                            SOCK_DGRAM | SOCK_CLOEXEC | SOCK_NONBLOCK,
+                            IPPROTO_UDP);
+  if (fd == kInvalidSocketDescriptor) {
+    PLOG(ERROR) << "Failed to create UDP socket";
+    return false;
+  }
+  shill::ScopedSocketCloser socket_closer(sockets_.get(), fd);
+
+  if (sockets_->ReuseAddress(fd) == -1) {
+    PLOG(ERROR) << "Failed to reuse socket address";
+    return false;
+  }
+
+  if (sockets_->BindToDevice(fd, interface_name_) < 0) {
+    PLOG(ERROR) << "Failed to bind socket to device";
+    return false;
+  }
+
+  struct sockaddr_in local;
+  memset(&local, 0, sizeof(local));
+  local.sin_family = AF_INET;
+  local.sin_port = htons(kDHCPClientPort);
+  local.sin_addr.s_addr = htonl(lease_.ip_address);
+
+  if (sockets_->Bind(fd,
+                     reinterpret_cast<struct sockaddr*>(&local),
+                     sizeof(local)) < 0) {
+    PLOG(ERROR) << "Failed to bind to the leased address";
+    return false;
+  }
+
+  socket_ = socket_closer.Release();
+  socket_is_udp_ = true;
+  batched_socket_.reset(
+      new BatchedSocket(sockets_.get(), socket_, event_dispatcher_, 1));
+  input_handler_.reset(io_handler_factory_->CreateIOReadyHandler(
+      socket_,
+      shill::IOHandler::kModeInput,
+      Bind(&DHCPV4::OnUDPSocketReady, Unretained(this))));
+  return true;
+}
+
+void DHCPV4::OnBoundSocketCloseTimeout() {
+  bound_socket_close_timer_ = kInvalidTimerHandle;
+  if (state_ == State::BOUND) {
+    CloseSocket();
+  }
 }
 
 bool DHCPV4::CreateRawSocket() {
@@ -173,15 +447,21 @@ bool DHCPV4::CreateRawSocket() {
   shill::ScopedSocketCloser socket_closer(sockets_.get(), fd);
 
   // Apply the socket filter.
-  sock_fprog pf;
-  memset(&pf, 0, sizeof(pf));
-  pf.filter = const_cast<sock_filter*>(dhcp_bpf_filter);
-  pf.len = dhcp_bpf_filter_len;
-
-  if (sockets_->AttachFilter(fd, &pf) != 0) {
-    PLOG(ERROR) << "Failed to attach filter";
+  if (!AttachSocketFilter(fd)) {
     return false;
   }
+  // Without it the checksum of every frame is verified in software.
+  BatchedSocket::EnablePacketStatus(sockets_.get(), fd);
+
+  std::unique_ptr<PacketRing> packet_ring;
+  if (use_packet_ring_) {
+    packet_ring.reset(new PacketRing(sockets_.get()));
+    if (!packet_ring->Init(fd)) {
+      // The copying receive path still works.
+      LOG(WARNING) << "Falling back to reading packets from the socket";
+      packet_ring.reset();
+    }
+  }
 
   if (sockets_->ReuseAddress(fd) == -1) {
     PLOG(ERROR) << "Failed to reuse socket address";
@@ -207,59 +487,504 @@ bool DHCPV4::CreateRawSocket() {
   }
 
   socket_ = socket_closer.Release();
+  packet_ring_ = std::move(packet_ring);
   return true;
 }
 
-void DHCPV4::HandleOffer(const DHCPMessage& msg) {
-  return;
+void DHCPV4::StartInit() {
+  CancelLeaseTimers();
+  // The address is not ours anymore, if it ever was.
+  if (lease_applier_ != nullptr && !lease_applier_->Clear()) {
+    LOG(ERROR) << "Failed to clear the lease on " << interface_name_;
+  }
+  lease_ = Lease();
+  from_ = INADDR_ANY;
+  to_ = INADDR_BROADCAST;
+  requested_ip_address_ = 0;
+  server_identifier_ = 0;
+  StartTransaction();
+  StartExchange(State::SELECT);
+}
+
+void DHCPV4::StartReboot(const Lease& lease) {
+  // RFC 2131 section 4.3.2: the request carries the address in the
+  // 'requested IP address' option, without any server identifier.
+  from_ = INADDR_ANY;
+  to_ = INADDR_BROADCAST;
+  requested_ip_address_ = lease.ip_address;
+  server_identifier_ = 0;
+  StartTransaction();
+  StartExchange(State::REBOOT);
 }
 
-void DHCPV4::HandleAck(const DHCPMessage& msg) {
-  return;
+void DHCPV4::StartExchange(State state) {
+  CancelTimer(&retransmission_timer_);
+  state_ = state;
+  transmission_count_ = 0;
+  retransmission_interval_ms_ = initial_retransmission_interval_ms_;
+  Transmit();
 }
 
-void DHCPV4::HandleNak(const DHCPMessage& msg) {
-  return;
+void DHCPV4::Transmit() {
+  bool sent = OpenSocketForState() &&
+              (state_ == State::SELECT ? SendDiscover() : SendRequest());
+  // A failed transmission is retried like a lost message.
+  if (!sent) {
+    LOG(ERROR) << "Failed to send DHCP message on " << interface_name_;
+  }
+  transmission_count_++;
+  ScheduleRetransmission();
 }
 
-bool DHCPV4::MakeRawPacket(const DHCPMessage& message, ByteString* output) {
-  ByteString payload;
-  if (!message.Serialize(&payload)) {
-    LOG(ERROR) << "Failed to serialzie dhcp message";
+void DHCPV4::ScheduleRetransmission() {
+  int64_t delay_ms;
+  if (state_ == State::RENEW || state_ == State::REBIND) {
+    // Past the last retransmission, T2 or the lease expiry ends the
+    // state.
+    if (state_remaining_ms_ < kMinRenewRetransmissionIntervalMs) {
+      return;
+    }
+    delay_ms = std::max(state_remaining_ms_ / 2,
+                        kMinRenewRetransmissionIntervalMs);
+    state_remaining_ms_ -= delay_ms;
+  } else {
+    // Short tuned intervals get a proportionally smaller randomization.
+    int64_t jitter_ms = std::min(kMaxRetransmissionJitterMs,
+                                 retransmission_interval_ms_ / 4);
+    delay_ms = retransmission_interval_ms_ +
+        std::uniform_int_distribution<int64_t>(-jitter_ms,
+                                               jitter_ms)(random_engine_);
+    retransmission_interval_ms_ = std::min(retransmission_interval_ms_ * 2,
+                                           max_retransmission_interval_ms_);
+  }
+  retransmission_timer_ = event_dispatcher_->PostCancelableDelayedTask(
+      Bind(&DHCPV4::OnRetransmissionTimeout, Unretained(this)), delay_ms);
+}
+
+void DHCPV4::OnRetransmissionTimeout() {
+  retransmission_timer_ = kInvalidTimerHandle;
+  if ((state_ == State::REQUEST || state_ == State::REBOOT) &&
+      transmission_count_ >= kMaxRequestTransmissions) {
+    LOG(INFO) << "No reply to DHCP request on " << interface_name_;
+    StartInit();
+    return;
+  }
+  Transmit();
+}
+
+void DHCPV4::ScheduleLeaseTimers(uint32_t renewal_time,
+                                 uint32_t rebinding_time) {
+  CancelLeaseTimers();
+  if (lease_.lease_time == kInfiniteLeaseTime) {
+    return;
+  }
+  int64_t lease_ms = lease_.lease_time * kMillisecondsPerSecond;
+  // RFC 2131 section 4.4.5: T1 defaults to 0.5 * lease time, and T2 to
+  // 0.875 * lease time. Times out of order are replaced by the defaults.
+  int64_t rebinding_ms = rebinding_time * kMillisecondsPerSecond;
+  if (rebinding_ms == 0 || rebinding_ms >= lease_ms) {
+    rebinding_ms = lease_ms * 7 / 8;
+  }
+  int64_t renewal_ms = renewal_time * kMillisecondsPerSecond;
+  if (renewal_ms == 0 || renewal_ms >= rebinding_ms) {
+    renewal_ms = std::min(lease_ms / 2, rebinding_ms);
+  }
+  renew_duration_ms_ = rebinding_ms - renewal_ms;
+  rebind_duration_ms_ = lease_ms - rebinding_ms;
+  renewal_timer_ = event_dispatcher_->PostCancelableDelayedTask(
+      Bind(&DHCPV4::OnRenewalTime, Unretained(this)), renewal_ms);
+  rebinding_timer_ = event_dispatcher_->PostCancelableDelayedTask(
+      Bind(&DHCPV4::OnRebindingTime, Unretained(this)), rebinding_ms);
+  expiry_timer_ = event_dispatcher_->PostCancelableDelayedTask(
+      Bind(&DHCPV4::OnLeaseExpired, Unretained(this)), lease_ms);
+}
+
+void DHCPV4::OnRenewalTime() {
+  renewal_timer_ = kInvalidTimerHandle;
+  // Unicast to the server of the lease, from the leased address.
+  from_ = lease_.ip_address;
+  to_ = lease_.server_identifier;
+  requested_ip_address_ = 0;
+  server_identifier_ = 0;
+  StartTransaction();
+  state_remaining_ms_ = renew_duration_ms_;
+  StartExchange(State::RENEW);
+}
+
+void DHCPV4::OnRebindingTime() {
+  rebinding_timer_ = kInvalidTimerHandle;
+  // Any server may extend the lease now.
+  from_ = lease_.ip_address;
+  to_ = INADDR_BROADCAST;
+  requested_ip_address_ = 0;
+  server_identifier_ = 0;
+  StartTransaction();
+  state_remaining_ms_ = rebind_duration_ms_;
+  StartExchange(State::REBIND);
+}
+
+void DHCPV4::OnLeaseExpired() {
+  expiry_timer_ = kInvalidTimerHandle;
+  LOG(INFO) << "Lease expired on " << interface_name_;
+  if (lease_store_ != nullptr && !network_id_.empty()) {
+    lease_store_->Remove(network_id_);
+  }
+  StartInit();
+}
+
+void DHCPV4::CancelTimer(TimerHandle* timer) {
+  if (*timer != kInvalidTimerHandle) {
+    event_dispatcher_->CancelDelayedTask(*timer);
+    *timer = kInvalidTimerHandle;
+  }
+}
+
+void DHCPV4::CancelLeaseTimers() {
+  CancelTimer(&renewal_timer_);
+  CancelTimer(&rebinding_timer_);
+  CancelTimer(&expiry_timer_);
+}
+
+bool DHCPV4::LoadLease(Lease* lease) {
+  if (lease_store_ == nullptr || network_id_.empty()) {
     return false;
   }
-  const size_t header_len = sizeof(struct iphdr) + sizeof(struct udphdr);
-  const size_t payload_len = payload.GetLength();
+  if (!lease_store_->Load(network_id_, lease)) {
+    return false;
+  }
+  return !lease->IsExpired(event_dispatcher_->Now().ToTimeT());
+}
+
+void DHCPV4::SaveLease() {
+  if (lease_store_ == nullptr || network_id_.empty()) {
+    return;
+  }
+  lease_store_->Save(network_id_, lease_);
+}
+
+void DHCPV4::HandleOffer(const DHCPMessageView& msg) {
+  // A server without Rapid Commit support answers with an Offer, and the
+  // exchange goes on as usual. The first offer is taken.
+  if (state_ != State::SELECT) {
+    return;
+  }
+  // RFC 2131 section 4.3.1: an Offer carries the offered address and the
+  // Server Identifier, without which the Request cannot be answered.
+  // Keep selecting until a valid Offer comes.
+  if (msg.server_identifier() == 0 || msg.your_ip_address() == 0) {
+    LOG(WARNING) << "Ignoring DHCP Offer without server identifier or "
+                 << "offered address on " << interface_name_;
+    return;
+  }
+  // The Request keeps the transaction id of the Offer.
+  server_identifier_ = msg.server_identifier();
+  requested_ip_address_ = msg.your_ip_address();
+  StartExchange(State::REQUEST);
+}
+
+void DHCPV4::HandleAck(const DHCPMessageView& msg) {
+  // RFC 4039 section 4: in the SELECTING state, only an Ack carrying
+  // the Rapid Commit option is accepted.
+  bool rapid_ack = state_ == State::SELECT && rapid_commit_ &&
+                   msg.rapid_commit();
+  if (state_ != State::REQUEST && state_ != State::REBOOT &&
+      state_ != State::RENEW && state_ != State::REBIND && !rapid_ack) {
+    return;
+  }
+  uint32_t lease_time = msg.lease_time();
+  if (lease_time == 0) {
+    LOG(ERROR) << "Ignoring DHCP Ack without lease time";
+    return;
+  }
+  // The lease is renewed by unicast to its server, an Ack that does not
+  // name it or the address could not be used.
+  if (msg.server_identifier() == 0 || msg.your_ip_address() == 0) {
+    LOG(WARNING) << "Ignoring DHCP Ack without server identifier or "
+                 << "address on " << interface_name_;
+    return;
+  }
+  // Only the address asked for, or held when extending the lease, is
+  // taken.
+  uint32_t expected_address = 0;
+  if (state_ == State::REQUEST || state_ == State::REBOOT) {
+    expected_address = requested_ip_address_;
+  } else if (state_ == State::RENEW || state_ == State::REBIND) {
+    expected_address = lease_.ip_address;
+  }
+  if (expected_address != 0 && msg.your_ip_address() != expected_address) {
+    LOG(WARNING) << "Ignoring DHCP Ack for another address on "
+                 << interface_name_;
+    return;
+  }
+  CancelTimer(&retransmission_timer_);
+  lease_.ip_address = msg.your_ip_address();
+  lease_.subnet_mask = msg.subnet_mask();
+  lease_.server_identifier = msg.server_identifier();
+  lease_.lease_time = lease_time;
+  lease_.acquisition_time = event_dispatcher_->Now().ToTimeT();
+  state_ = State::BOUND;
+  ScheduleLeaseTimers(msg.renewal_time(), msg.rebinding_time());
+  SaveLease();
+  ApplyLease(msg);
+  // Until T1 the socket filter would only cost time on every packet of
+  // the interface. This runs within the receive path of the socket,
+  // close it from the event loop.
+  if (socket_ != kInvalidSocketDescriptor) {
+    CancelTimer(&bound_socket_close_timer_);
+    bound_socket_close_timer_ = event_dispatcher_->PostCancelableDelayedTask(
+        Bind(&DHCPV4::OnBoundSocketCloseTimeout, Unretained(this)), 0);
+  }
+}
+
+void DHCPV4::ApplyLease(const DHCPMessageView& msg) {
+  if (lease_applier_ == nullptr) {
+    return;
+  }
+  NetworkConfig config;
+  config.address = lease_.ip_address;
+  config.prefix_length = MaskToPrefixLength(lease_.subnet_mask != 0 ?
+      lease_.subnet_mask : GetClassfulMask(lease_.ip_address));
+  // RFC 3442: the Router option is ignored when classless static routes
+  // are given.
+  if (!msg.GetClasslessStaticRoutes(&config.routes)) {
+    config.routes.clear();
+    std::vector<uint32_t> routers;
+    if (msg.GetRouter(&routers) && !routers.empty()) {
+      config.routes.push_back(Route(0, 0, routers[0]));
+    }
+  }
+  // A renewal that changes nothing costs no netlink traffic. A failure
+  // is retried with the next Ack.
+  if (!lease_applier_->Apply(config)) {
+    LOG(ERROR) << "Failed to apply the lease on " << interface_name_;
+  }
+}
+
+void DHCPV4::HandleNak(const DHCPMessageView& msg) {
+  if (state_ != State::REQUEST && state_ != State::REBOOT &&
+      state_ != State::RENEW && state_ != State::REBIND) {
+    return;
+  }
+  // The address is not valid on this network anymore.
+  if (lease_store_ != nullptr && !network_id_.empty()) {
+    lease_store_->Remove(network_id_);
+  }
+  StartInit();
+}
+
+bool DHCPV4::AttachSocketFilter(int fd) {
+  sock_fprog pf;
+  std::vector<sock_filter> client_filter;
+  if (MakeDHCPClientSocketFilter(hardware_address_,
+                                 transaction_id_,
+                                 &client_filter)) {
+    memset(&pf, 0, sizeof(pf));
+    pf.filter = client_filter.data();
+    pf.len = static_cast<uint16_t>(client_filter.size());
+  } else {
+    GetDHCPSocketFilter(&pf);
+  }
+  // Attaching replaces the previous program atomically.
+  if (sockets_->AttachFilter(fd, &pf) != 0) {
+    PLOG(ERROR) << "Failed to attach filter";
+    return false;
+  }
+  return true;
+}
+
+void DHCPV4::StartTransaction() {
+  transaction_id_ = std::uniform_int_distribution<uint32_t>()(random_engine_);
+  transaction_start_time_ = event_dispatcher_->Now();
+  // Replies to the previous transaction are dropped from now on.
+  // The shared socket of |packet_demuxer_| keeps the generic filter.
+  if (!packet_demuxer_ && socket_ != kInvalidSocketDescriptor &&
+      !socket_is_udp_) {
+    AttachSocketFilter(socket_);
+  }
+}
+
+uint16_t DHCPV4::GetElapsedSeconds() const {
+  int64_t seconds = (event_dispatcher_->Now() - transaction_start_time_)
+      .InSeconds();
+  // The wall clock may have been set back.
+  return static_cast<uint16_t>(
+      std::max<int64_t>(std::min<int64_t>(seconds, UINT16_MAX), 0));
+}
 
-  char buffer[header_len + payload_len];
-  memset(buffer, 0, header_len + payload_len);
-  struct iphdr* ip = reinterpret_cast<struct iphdr*>(buffer);
-  struct udphdr* udp = reinterpret_cast<struct udphdr*>(buffer + sizeof(*ip));
+uint16_t DHCPV4::GenerateIPIdentification() {
+  return static_cast<uint16_t>(
+      std::uniform_int_distribution<unsigned int>()(
+          random_engine_) % UINT16_MAX + 1);
+}
+
+bool DHCPV4::SendDiscover() {
+  FlushQueuedFrame();
+  // The template only depends on per interface parameters,
+  // build it on the first transmission.
+  if (!discover_template_.IsInitialized() ||
+      discover_template_.source_address() != from_ ||
+      discover_template_.destination_address() != to_) {
+    DHCPMessage message;
+    DHCPMessage::InitRequest(&message);
+    message.SetMessageType(kDHCPMessageTypeDiscover);
+    message.SetTransactionID(transaction_id_);
+    message.SetClientIPAddress(0);
+    message.SetClientHardwareAddress(hardware_address_);
+    message.SetRapidCommit(rapid_commit_);
+    message.SetParameterRequestList(std::vector<uint8_t>(
+        kParameterRequestList,
+        kParameterRequestList + arraysize(kParameterRequestList)));
+    uint8_t buffer[kMaxDHCPFrameLength];
+    FrameWriter writer(buffer, sizeof(buffer));
+    if (!MakeRawPacket(message, &writer) ||
+        !discover_template_.Init(writer.span())) {
+      LOG(ERROR) << "Failed to build DHCP discover frame";
+      return false;
+    }
+  }
+  return SendFromTemplate(&discover_template_);
+}
+
+bool DHCPV4::SendRequest() {
+  FlushQueuedFrame();
+  // Rebuild the template if the options it carries no longer
+  // match the ones this request needs.
+  if (!request_template_.IsInitialized() ||
+      request_template_.source_address() != from_ ||
+      request_template_.destination_address() != to_ ||
+      request_template_.HasRequestedIPAddress() !=
+          (requested_ip_address_ != 0) ||
+      request_template_.HasServerIdentifier() != (server_identifier_ != 0)) {
+    DHCPMessage message;
+    DHCPMessage::InitRequest(&message);
+    message.SetMessageType(kDHCPMessageTypeRequest);
+    message.SetTransactionID(transaction_id_);
+    // Set while the client owns its address, in RENEW and REBIND.
+    message.SetClientIPAddress(from_);
+    message.SetClientHardwareAddress(hardware_address_);
+    message.SetRequestedIpAddress(requested_ip_address_);
+    message.SetServerIdentifier(server_identifier_);
+    message.SetParameterRequestList(std::vector<uint8_t>(
+        kParameterRequestList,
+        kParameterRequestList + arraysize(kParameterRequestList)));
+    uint8_t buffer[kMaxDHCPFrameLength];
+    FrameWriter writer(buffer, sizeof(buffer));
+    if (!MakeRawPacket(message, &writer) ||
+        !request_template_.Init(writer.span())) {
+      LOG(ERROR) << "Failed to build DHCP request frame";
+      return false;
+    }
+  }
+  if (requested_ip_address_ != 0) {
+    request_template_.SetRequestedIPAddress(requested_ip_address_);
+  }
+  if (server_identifier_ != 0) {
+    request_template_.SetServerIdentifier(server_identifier_);
+  }
+  return SendFromTemplate(&request_template_);
+}
 
-  if (!payload.CopyData(payload_len, buffer + header_len)) {
-    LOG(ERROR) << "Failed to copy data from payload";
+bool DHCPV4::SendFromTemplate(FrameTemplate* frame_template) {
+  frame_template->SetTransactionID(transaction_id_);
+  frame_template->SetSeconds(GetElapsedSeconds());
+  frame_template->SetIPIdentification(GenerateIPIdentification());
+  if (!packet_sender_.is_null()) {
+    frame_template->CopyTo(&send_buffer_);
+    return SendRawPacket(send_buffer_);
+  }
+  BatchedSocket* batched_socket = GetBatchedSocket();
+  if (batched_socket == nullptr) {
+    LOG(ERROR) << "Socket is not open";
+    return false;
+  }
+  // The frame is gathered from the template when the queue is flushed,
+  // FlushQueuedFrame() keeps the template from changing until then.
+  bool queued;
+  if (socket_is_udp_) {
+    // The kernel adds the IP and UDP headers and routes the message.
+    struct sockaddr_in remote;
+    memset(&remote, 0, sizeof(remote));
+    remote.sin_family = AF_INET;
+    remote.sin_port = htons(kDHCPServerPort);
+    remote.sin_addr.s_addr = htonl(to_);
+    queued = batched_socket->Send(frame_template->payload(),
+                                  1,
+                                  reinterpret_cast<struct sockaddr*>(&remote),
+                                  sizeof(remote));
+  } else {
+    struct sockaddr_ll remote;
+    FillBroadcastAddress(&remote);
+    queued = batched_socket->Send(frame_template->segments(),
+                                  FrameTemplate::kSegmentCount,
+                                  reinterpret_cast<struct sockaddr*>(&remote),
+                                  sizeof(remote));
+  }
+  if (!queued) {
+    return false;
+  }
+  frame_queued_ = true;
+  queued_flush_count_ = batched_socket->flush_count();
+  return true;
+}
+
+void DHCPV4::FlushQueuedFrame() {
+  if (!frame_queued_) {
+    return;
+  }
+  frame_queued_ = false;
+  BatchedSocket* batched_socket = GetBatchedSocket();
+  if (batched_socket != nullptr &&
+      batched_socket->flush_count() == queued_flush_count_) {
+    batched_socket->Flush();
+  }
+}
+
+void DHCPV4::FillBroadcastAddress(struct sockaddr_ll* remote) {
+  memset(remote, 0, sizeof(*remote));
+  remote->sll_family = AF_PACKET;
+  remote->sll_protocol = htons(ETHERTYPE_IP);
+  remote->sll_ifindex = interface_index_;
+  remote->sll_hatype = htons(ARPHRD_ETHER);
+  // Use broadcast hardware address.
+  remote->sll_halen = IFHWADDRLEN;
+  memset(remote->sll_addr, 0xff, IFHWADDRLEN);
+}
+
+bool DHCPV4::MakeRawPacket(const DHCPMessage& message, FrameWriter* writer) {
+  const size_t header_len = sizeof(struct iphdr) + sizeof(struct udphdr);
+  uint8_t* header = writer->Skip(header_len);
+  if (header == nullptr) {
+    LOG(ERROR) << "No room for the IP and UDP headers";
+    return false;
+  }
+  const size_t payload_offset = writer->length();
+  if (!message.Serialize(writer)) {
+    LOG(ERROR) << "Failed to serialzie dhcp message";
     return false;
   }
+  const size_t payload_len = writer->length() - payload_offset;
+  struct iphdr* ip = reinterpret_cast<struct iphdr*>(header);
+  struct udphdr* udp = reinterpret_cast<struct udphdr*>(header + sizeof(*ip));
+
   udp->uh_sport = htons(kDHCPClientPort);
   udp->uh_dport = htons(kDHCPServerPort);
-  udp->uh_ulen =
-      htons(static_cast<uint16_t>(sizeof(*udp) + payload.GetLength()));
+  udp->uh_ulen = htons(static_cast<uint16_t>(sizeof(*udp) + payload_len));
+  // The UDP checksum covers the pseudo header, the UDP header and the
+  // payload, each summed on its own.
+  struct iovec segments[2];
+  segments[0].iov_base = udp;
+  segments[0].iov_len = sizeof(*udp);
+  segments[1].iov_base = header + header_len;
+  segments[1].iov_len = payload_len;
+  udp->uh_sum = htons(ComputeUDPChecksum(from_, to_, segments, 2));
+  // RFC 768: a computed checksum of zero is transmitted as all ones.
+  if (udp->uh_sum == 0) {
+    udp->uh_sum = 0xffff;
+  }
 
-  // Fill pseudo header (for UDP checksum computing):
-  // Protocol.
   ip->protocol = IPPROTO_UDP;
-  // Source IP address.
   ip->saddr = htonl(from_);
-  // Destination IP address.
   ip->daddr = htonl(to_);
-  // Total length, use udp packet length for pseudo header.
-  ip->tot_len = udp->uh_ulen;
-  // Calculate udp checksum based on:
-  // IPV4 pseudo header, UDP header, and payload.
-  udp->uh_sum = htons(DHCPMessage::ComputeChecksum(
-      reinterpret_cast<const uint8_t*>(buffer),
-      header_len + payload_len));
-
   // IP version.
   ip->version = IPVERSION;
   // IP header length.
@@ -269,48 +994,49 @@ bool DHCPV4::MakeRawPacket(const DHCPMessage& message, ByteString* output) {
   // so fragmentation is not needed.
   ip->frag_off = 0;
   // Identification.
-  ip->id = static_cast<uint16_t>(
-      std::uniform_int_distribution<unsigned int>()(
-          random_engine_) % UINT16_MAX + 1);
+  ip->id = GenerateIPIdentification();
   // Time to live.
   ip->ttl = IPDEFTTL;
   // Total length.
-  ip->tot_len = htons(static_cast<uint16_t>(header_len+ payload.GetLength()));
+  ip->tot_len = htons(static_cast<uint16_t>(header_len + payload_len));
   // Calculate IP Checksum only based on IP header.
   ip->check = htons(DHCPMessage::ComputeChecksum(
       reinterpret_cast<const uint8_t*>(ip),
       sizeof(*ip)));
-
-  *output = ByteString(buffer, header_len + payload_len);
   return true;
 }
 
 bool DHCPV4::SendRawPacket(const ByteString& packet) {
+  if (!packet_sender_.is_null()) {
+    return packet_sender_.Run(packet);
+  }
   struct sockaddr_ll remote;
-  memset(&remote, 0, sizeof(remote));
-  remote.sll_family = AF_PACKET;
-  remote.sll_protocol = htons(ETHERTYPE_IP);
-  remote.sll_ifindex = interface_index_;
-  remote.sll_hatype = htons(ARPHRD_ETHER);
-  // Use broadcast hardware address.
-  remote.sll_halen = IFHWADDRLEN;
-  memset(remote.sll_addr, 0xff, IFHWADDRLEN);
-
-  size_t result = sockets_->SendTo(socket_,
-                                   packet.GetConstData(),
-                                   packet.GetLength(),
-                                   0,
-                                   reinterpret_cast<struct sockaddr *>(&remote),
-                                   sizeof(remote));
-
-  if (result != packet.GetLength()) {
-    PLOG(ERROR) << "Socket sento failed";
+  FillBroadcastAddress(&remote);
+
+  BatchedSocket* batched_socket = GetBatchedSocket();
+  if (batched_socket == nullptr) {
+    LOG(ERROR) << "Socket is not open";
     return false;
   }
-  return true;
+  // The frame is queued and goes out with the other frames sent during
+  // this event loop iteration.
+  return batched_socket->Send(packet,
+                              reinterpret_cast<struct sockaddr*>(&remote),
+                              sizeof(remote));
+}
+
+BatchedSocket* DHCPV4::GetBatchedSocket() {
+  if (packet_demuxer_ && !socket_is_udp_) {
+    return packet_demuxer_->batched_socket();
+  }
+  return batched_socket_.get();
 }
 
 int DHCPV4::ValidatePacketHeader(const unsigned char* buffer, size_t len) {
+  if (len < sizeof(struct iphdr)) {
+    LOG(ERROR) << "Invalid packet length from buffer";
+    return -1;
+  }
   const struct iphdr* ip =
       reinterpret_cast<const struct iphdr*>(buffer);
   const size_t ip_header_len = static_cast<size_t>(ip->ihl) << 2;
@@ -320,12 +1046,25 @@ int DHCPV4::ValidatePacketHeader(const unsigned char* buffer, size_t len) {
                << ip_header_len << " bytes";
     return -1;
   }
-  if (ip->tot_len != len) {
+  if (ntohs(ip->tot_len) != len) {
     LOG(ERROR) << "Invalid IP total length";
     return -1;
   }
-  // TODO(nywang): Validate other ip header fields.
+  if (ip->version != IPVERSION || ip->protocol != IPPROTO_UDP) {
+    LOG(ERROR) << "Not an IPv4 UDP packet";
+    return -1;
+  }
+  // A fragment does not hold the whole message, and the client does not
+  // reassemble them.
+  if (ntohs(ip->frag_off) & (IP_MF | IP_OFFMASK)) {
+    LOG(ERROR) << "Dropping IP fragment";
+    return -1;
+  }
 
+  if (len < ip_header_len + sizeof(struct udphdr)) {
+    LOG(ERROR) << "Truncated UDP header";
+    return -1;
+  }
   const struct udphdr* udp =
       reinterpret_cast<const struct udphdr*>(buffer + ip_header_len);
   if (udp->uh_sport != htons(kDHCPServerPort) ||
@@ -333,14 +1072,32 @@ int DHCPV4::ValidatePacketHeader(const unsigned char* buffer, size_t len) {
     LOG(ERROR) << "Invlaid UDP ports";
     return -1;
   }
-  if (udp->uh_ulen != len - ip_header_len) {
+  const size_t udp_len = ntohs(udp->uh_ulen);
+  if (udp_len < sizeof(*udp) || udp_len != len - ip_header_len) {
     LOG(ERROR) << "Invalid UDP total length";
     return -1;
   }
-  // TODO(nywang): Validate UDP checksum.
+  // The UDP checksum is verified by VerifyUDPChecksum(), once the
+  // message is known to be ours.
 
   return ip_header_len + sizeof(*udp);
 }
 
+bool DHCPV4::VerifyUDPChecksum(const unsigned char* buffer, size_t len) {
+  const struct iphdr* ip =
+      reinterpret_cast<const struct iphdr*>(buffer);
+  const size_t ip_header_len = static_cast<size_t>(ip->ihl) << 2;
+  const struct udphdr* udp =
+      reinterpret_cast<const struct udphdr*>(buffer + ip_header_len);
+  // RFC 768: an all zero checksum means the sender did not compute one.
+  if (udp->uh_sum == 0) {
+    return true;
+  }
+  return ComputeUDPChecksum(ntohl(ip->saddr),
+                            ntohl(ip->daddr),
+                            buffer + ip_header_len,
+                            len - ip_header_len) == 0;
+}
+
 }  // namespace dhcp_client
 
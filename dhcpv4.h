@@ -20,20 +20,34 @@
 #include <random>
 #include <string>
 
+#include <base/callback.h>
 #include <base/macros.h>
 #include <base/strings/stringprintf.h>
+#include <base/time/time.h>
 #include <shill/net/byte_string.h>
 #include <shill/net/io_handler_factory_container.h>
-#include <shill/net/sockets.h>
 
+#include "dhcp_client/batched_socket.h"
 #include "dhcp_client/dhcp.h"
 #include "dhcp_client/dhcp_message.h"
 #include "dhcp_client/event_dispatcher_interface.h"
+#include "dhcp_client/frame_template.h"
+#include "dhcp_client/frame_writer.h"
+#include "dhcp_client/lease_applier_interface.h"
+#include "dhcp_client/lease_store_interface.h"
+#include "dhcp_client/packet_demuxer.h"
+#include "dhcp_client/packet_ring.h"
+#include "dhcp_client/sockets.h"
+
+struct sockaddr_ll;
 
 namespace dhcp_client {
 
 class DHCPV4 : public DHCP {
  public:
+  // Sends an IP packet to the broadcast hardware address.
+  typedef base::Callback<bool(const shill::ByteString& packet)> PacketSender;
+
   DHCPV4(const std::string& interface_name,
          const shill::ByteString& hardware_address,
          unsigned int interface_index,
@@ -41,6 +55,10 @@ class DHCPV4 : public DHCP {
          bool request_hostname,
          bool arp_gateway,
          bool unicast_arp,
+         bool use_packet_ring,
+         bool rapid_commit,
+         PacketDemuxer* packet_demuxer,
+         LeaseStoreInterface* lease_store,
          EventDispatcherInterface* event_dispatcher);
 
   virtual ~DHCPV4();
@@ -48,19 +66,125 @@ class DHCPV4 : public DHCP {
   bool Start();
   void Stop();
 
+  // RFC 2131 section 4.1: the first retransmission comes after
+  // |initial_interval_ms|, and every next one after twice the previous
+  // interval, up to |max_interval_ms|. Each interval is randomized.
+  // An interval that is not positive keeps its current value.
+  void SetRetransmissionIntervals(int64_t initial_interval_ms,
+                                  int64_t max_interval_ms);
+  void SetRandomSeed(unsigned int seed);
+  // Send the packets through |packet_sender| instead of a socket. Start()
+  // then opens no socket, received packets are passed to HandleFrame().
+  // Otherwise the client receives on a raw socket, closes it once BOUND
+  // and renews over a UDP socket bound to the leased address.
+  void set_packet_sender(const PacketSender& packet_sender) {
+    packet_sender_ = packet_sender;
+  }
+  // Program the acknowledged leases on the interface with
+  // |lease_applier|, which must outlive this object.
+  void set_lease_applier(LeaseApplierInterface* lease_applier) {
+    lease_applier_ = lease_applier;
+  }
+
+  // Handle a received IP packet.
+  void HandleFrame(const unsigned char* frame, size_t len);
+
+  State state() const { return state_; }
+
  private:
+  friend class DHCPV4Benchmark;
+  friend class DHCPV4Test;
+
+  // Open the raw |socket_|, or register with |packet_demuxer_|.
+  bool OpenRawSocket();
   bool CreateRawSocket();
-  bool MakeRawPacket(const DHCPMessage& message, shill::ByteString* buffer);
-  void OnReadError(const std::string& error_msg);
-  void ParseRawPacket(shill::InputData* data);
+  // Open a UDP |socket_| bound to the leased address.
+  bool OpenUDPSocket();
+  // Make sure |socket_| can carry the messages of the current state.
+  bool OpenSocketForState();
+  void CloseSocket();
+  // Nothing is received while BOUND.
+  void OnBoundSocketCloseTimeout();
+  // Begin acquiring a lease with a DHCP Discover.
+  void StartInit();
+  // INIT-REBOOT: ask for the address of |lease| with a DHCP Request,
+  // falling back to discovery if the server does not answer.
+  void StartReboot(const Lease& lease);
+  // Enter |state| and send its first message.
+  void StartExchange(State state);
+  // Send the message of the current state and schedule its
+  // retransmission.
+  void Transmit();
+  void ScheduleRetransmission();
+  void OnRetransmissionTimeout();
+  // Arm the renewal, rebinding and expiry timers of |lease_|. The times
+  // are in seconds, 0 for the RFC 2131 defaults.
+  void ScheduleLeaseTimers(uint32_t renewal_time, uint32_t rebinding_time);
+  void OnRenewalTime();
+  void OnRebindingTime();
+  void OnLeaseExpired();
+  void CancelTimer(TimerHandle* timer);
+  void CancelLeaseTimers();
+  // The unexpired lease stored for |network_id_|, if any.
+  bool LoadLease(Lease* lease);
+  void SaveLease();
+  // Apply the configuration carried by the Ack |msg|.
+  void ApplyLease(const DHCPMessageView& msg);
+  // Attach the socket filter for the current transaction to |fd|.
+  bool AttachSocketFilter(int fd);
+  // Write the IP/UDP frame carrying |message| after what |writer| holds.
+  bool MakeRawPacket(const DHCPMessage& message, FrameWriter* writer);
+  // Begin a new exchange with a fresh transaction id.
+  void StartTransaction();
+  // Send a DHCP Discover/Request for the current transaction.
+  // The frames are built once and patched for later transmissions.
+  bool SendDiscover();
+  bool SendRequest();
+  // Patch the per transmission fields of |frame_template| and send it.
+  bool SendFromTemplate(FrameTemplate* frame_template);
+  // Frames are queued on the socket in place, send the one queued from
+  // our templates before they change.
+  void FlushQueuedFrame();
+  void FillBroadcastAddress(struct sockaddr_ll* remote);
+  uint16_t GetElapsedSeconds() const;
+  uint16_t GenerateIPIdentification();
+  // Called when |socket_| has frames to read.
+  void OnSocketReady(int fd);
+  void OnFrameReceived(const unsigned char* frame,
+                       size_t len,
+                       const struct sockaddr* address,
+                       uint32_t status);
+  // Called when the packet ring has frames to read.
+  void OnPacketRingReady(int fd);
+  // Called when the UDP |socket_| has messages to read.
+  void OnUDPSocketReady(int fd);
+  void OnDatagramReceived(const unsigned char* buffer,
+                          size_t len,
+                          const struct sockaddr* address,
+                          uint32_t status);
+  // Handle a received IP packet. The UDP checksum is verified unless
+  // the TP_STATUS_* bits in |status| say the kernel took care of it.
+  void ProcessFrame(const unsigned char* frame, size_t len, uint32_t status);
+  // Whether the DHCP message in |buffer| is a reply to the current
+  // transaction. Checks the fixed fields only.
+  bool IsReplyToTransaction(const unsigned char* buffer, size_t len) const;
+  // Handle a DHCP message received in the current transaction.
+  void HandleMessage(const unsigned char* buffer, size_t len);
+  // Decode a reply that passed IsReplyToTransaction() and act on it.
+  void DispatchMessage(const unsigned char* buffer, size_t len);
   bool SendRawPacket(const shill::ByteString& buffer);
+  // The batched socket frames are sent through.
+  BatchedSocket* GetBatchedSocket();
   // Validate the IP and UDP header and return the total headers length.
   // Return -1 if any header is invalid.
   int ValidatePacketHeader(const unsigned char* buffer, size_t len);
+  // Whether the UDP checksum of the packet in |buffer|, which passed
+  // ValidatePacketHeader(), is absent or correct.
+  bool VerifyUDPChecksum(const unsigned char* buffer, size_t len);
 
-  void HandleOffer(const DHCPMessage& msg);
-  void HandleAck(const DHCPMessage& msg);
-  void HandleNak(const DHCPMessage& msg);
+  void HandleOffer(const DHCPMessageView& msg);
+  void HandleAck(const DHCPMessageView& msg);
+  void HandleNak(const DHCPMessageView& msg);
 
   // Interface parameters.
   std::string interface_name_;
@@ -78,6 +202,17 @@ class DHCPV4 : public DHCP {
   bool arp_gateway_;
   // Enable unicast ARP on renew.
   bool unicast_arp_;
+  // Receive through a memory mapped ring instead of reading each packet.
+  bool use_packet_ring_;
+  // Ask for the two message exchange of RFC 4039 in DHCP Discovers.
+  bool rapid_commit_;
+  // If set, packets are received through this shared socket
+  // instead of a socket of our own.
+  PacketDemuxer* packet_demuxer_;
+  // Where the lease of |network_id_| is kept, may be null.
+  LeaseStoreInterface* lease_store_;
+  // Programs the lease on the interface, may be null.
+  LeaseApplierInterface* lease_applier_;
 
   EventDispatcherInterface* event_dispatcher_;
   shill::IOHandlerFactory *io_handler_factory_;
@@ -87,13 +222,57 @@ class DHCPV4 : public DHCP {
   State state_;
   uint32_t server_identifier_;
   uint32_t transaction_id_;
+  // Address requested in the Request message, 0 if none.
+  uint32_t requested_ip_address_;
   uint32_t from_;
   uint32_t to_;
+  // Time when the current transaction started, used for the secs field.
+  base::Time transaction_start_time_;
+  // Lease the client is bound to, in BOUND, RENEW and REBIND.
+  Lease lease_;
+
+  // Retransmission of the message of the current state.
+  int64_t initial_retransmission_interval_ms_;
+  int64_t max_retransmission_interval_ms_;
+  // Interval until the next retransmission, before randomization.
+  int64_t retransmission_interval_ms_;
+  int transmission_count_;
+  TimerHandle retransmission_timer_;
+  // Time left in RENEW until T2, or in REBIND until the lease expires.
+  int64_t state_remaining_ms_;
+  // Durations of RENEW and REBIND for |lease_|.
+  int64_t renew_duration_ms_;
+  int64_t rebind_duration_ms_;
+  TimerHandle renewal_timer_;
+  TimerHandle rebinding_timer_;
+  TimerHandle expiry_timer_;
+  // Closes |socket_| once BOUND, outside of its receive path.
+  TimerHandle bound_socket_close_timer_;
+
+  PacketSender packet_sender_;
+
+  // Prebuilt frames for this interface.
+  FrameTemplate discover_template_;
+  FrameTemplate request_template_;
+  // Whether a frame from the templates was queued on the socket before
+  // its |queued_flush_count_|th flush.
+  bool frame_queued_;
+  uint64_t queued_flush_count_;
+  // Contiguous copy of a template frame for |packet_sender_|.
+  shill::ByteString send_buffer_;
 
   // Socket used for sending and receiving DHCP messages.
+  // Owned by |packet_demuxer_| if it is set and |socket_| is raw.
   int socket_;
+  // Whether |socket_| is the UDP socket used in RENEW.
+  bool socket_is_udp_;
   // Helper class with wrapped socket relavent functions.
-  std::unique_ptr<shill::Sockets> sockets_;
+  std::unique_ptr<Sockets> sockets_;
+  // Batched I/O on |socket_|, unset when the raw socket of
+  // |packet_demuxer_| is used.
+  std::unique_ptr<BatchedSocket> batched_socket_;
+  // Receive ring of |socket_|, only set up if |use_packet_ring_| is set.
+  std::unique_ptr<PacketRing> packet_ring_;
 
   std::default_random_engine random_engine_;
 
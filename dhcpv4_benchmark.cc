@@ -0,0 +1,100 @@
+//
+// Copyright (C) 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+
+#include "dhcp_client/dhcpv4.h"
+
+#include <memory>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+#include <shill/net/byte_string.h>
+
+#include "dhcp_client/benchmark_corpus.h"
+#include "dhcp_client/dhcp_message.h"
+#include "dhcp_client/dhcp_options.h"
+
+using shill::ByteString;
+
+namespace dhcp_client {
+
+namespace {
+const unsigned char kHardwareAddress[] = {0x00, 0x1a, 0x11, 0xc3, 0x02, 0x5e};
+}  // namespace
+
+// Gives the benchmarks access to the frame building and validation of
+// a DHCPV4 that is never started.
+class DHCPV4Benchmark : public benchmark::Fixture {
+ public:
+  void SetUp(const benchmark::State& state) override {
+    dhcpv4_.reset(new DHCPV4("eth0",
+                             ByteString(kHardwareAddress,
+                                        sizeof(kHardwareAddress)),
+                             2,
+                             std::string(),
+                             false,
+                             false,
+                             false,
+                             false,
+                             false,
+                             nullptr,
+                             nullptr,
+                             nullptr));
+  }
+  void TearDown(const benchmark::State& state) override { dhcpv4_.reset(); }
+
+ protected:
+  bool MakeRawPacket(const DHCPMessage& message, FrameWriter* writer) {
+    return dhcpv4_->MakeRawPacket(message, writer);
+  }
+  int ValidatePacketHeader(const ByteString& frame) {
+    return dhcpv4_->ValidatePacketHeader(frame.GetConstData(),
+                                         frame.GetLength());
+  }
+
+  std::unique_ptr<DHCPV4> dhcpv4_;
+};
+
+BENCHMARK_DEFINE_F(DHCPV4Benchmark, MakeRawPacket)(benchmark::State& state) {
+  DHCPMessage message;
+  DHCPMessage::InitRequest(&message);
+  message.SetMessageType(kDHCPMessageTypeDiscover);
+  message.SetTransactionID(0x0f22a350);
+  message.SetClientHardwareAddress(
+      ByteString(kHardwareAddress, sizeof(kHardwareAddress)));
+  message.SetParameterRequestList(std::vector<uint8_t>{
+      kDHCPOptionSubnetMask, kDHCPOptionRouter, kDHCPOptionDNSServer,
+      kDHCPOptionDomainName, kDHCPOptionLeaseTime});
+  while (state.KeepRunning()) {
+    uint8_t buffer[kMaxDHCPFrameLength];
+    FrameWriter writer(buffer, sizeof(buffer));
+    benchmark::DoNotOptimize(MakeRawPacket(message, &writer));
+  }
+}
+BENCHMARK_REGISTER_F(DHCPV4Benchmark, MakeRawPacket);
+
+BENCHMARK_DEFINE_F(DHCPV4Benchmark, ValidatePacketHeader)(
+    benchmark::State& state) {
+  const CorpusMessage& reply = GetReplyCorpus()[state.range(0)];
+  while (state.KeepRunning()) {
+    benchmark::DoNotOptimize(ValidatePacketHeader(reply.frame));
+  }
+  state.SetLabel(reply.name);
+}
+BENCHMARK_REGISTER_F(DHCPV4Benchmark, ValidatePacketHeader)
+    ->Apply(ApplyReplyCorpus);
+
+}  // namespace dhcp_client
@@ -0,0 +1,1041 @@
+//
+// Copyright (C) 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+
+#include "dhcp_client/dhcpv4.h"
+
+#include <arpa/inet.h>
+#include <linux/if_packet.h>
+#include <netinet/ip.h>
+#include <netinet/udp.h>
+
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <base/bind.h>
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include <shill/net/mock_io_handler_factory.h>
+
+#include "dhcp_client/allocation_counter.h"
+#include "dhcp_client/checksum.h"
+#include "dhcp_client/dhcp_options.h"
+#include "dhcp_client/mock_sockets.h"
+#include "dhcp_client/simulated_event_dispatcher.h"
+
+using base::Bind;
+using base::Unretained;
+using shill::ByteString;
+using shill::IOHandler;
+using shill::MockIOHandlerFactory;
+using testing::_;
+using testing::Mock;
+using testing::NiceMock;
+using testing::Return;
+using testing::ReturnArg;
+
+namespace dhcp_client {
+
+namespace {
+const char kFakeInterfaceName[] = "eth0";
+const unsigned char kFakeHardwareAddress[] = {
+    0x00, 0x11, 0x22, 0x33, 0x44, 0x55};
+const unsigned int kFakeInterfaceIndex = 2;
+const char kFakeNetworkIdentifier[] = "home_network";
+const uint32_t kFakeClientAddress = 0xc0a80164;  // 192.168.1.100
+const uint32_t kFakeServerAddress = 0xc0a80101;  // 192.168.1.1
+const uint32_t kFakeSubnetMask = 0xffffff00;
+const uint32_t kFakeLeaseTime = 3600;
+const uint32_t kBroadcastAddress = 0xffffffff;
+const int64_t kOneSecondMs = 1000;
+// Never read from or written to by the tests.
+const int kFakeRawSocket = 1000;
+const int kFakeUDPSocket = 1001;
+
+const size_t kDHCPHeaderLength = 236;
+const size_t kChaddrOffset = 28;
+const uint8_t kMagicCookie[] = {0x63, 0x82, 0x53, 0x63};
+
+class FakeLeaseStore : public LeaseStoreInterface {
+ public:
+  FakeLeaseStore() {}
+  ~FakeLeaseStore() override {}
+
+  bool Load(const std::string& network_id, Lease* lease) override {
+    auto it = leases_.find(network_id);
+    if (it == leases_.end()) {
+      return false;
+    }
+    *lease = it->second;
+    return true;
+  }
+  bool Save(const std::string& network_id, const Lease& lease) override {
+    leases_[network_id] = lease;
+    return true;
+  }
+  bool Remove(const std::string& network_id) override {
+    return leases_.erase(network_id) != 0;
+  }
+
+ private:
+  std::map<std::string, Lease> leases_;
+};
+
+class FakeLeaseApplier : public LeaseApplierInterface {
+ public:
+  FakeLeaseApplier() : clear_count_(0) {}
+  ~FakeLeaseApplier() override {}
+
+  bool Apply(const NetworkConfig& config) override {
+    applied_.push_back(config);
+    return true;
+  }
+  bool Clear() override {
+    clear_count_++;
+    return true;
+  }
+
+  const std::vector<NetworkConfig>& applied() const { return applied_; }
+  int clear_count() const { return clear_count_; }
+
+ private:
+  std::vector<NetworkConfig> applied_;
+  int clear_count_;
+};
+
+// The fields of a sent message the state machine decides on.
+struct SentMessage {
+  int64_t time_ms;
+  uint8_t message_type;
+  uint32_t transaction_id;
+  uint32_t client_ip_address;
+  uint32_t destination_address;
+  uint32_t requested_ip_address;
+  uint32_t server_identifier;
+  bool rapid_commit;
+};
+
+uint32_t ReadUInt32(const unsigned char* data) {
+  uint32_t value;
+  memcpy(&value, data, sizeof(value));
+  return ntohl(value);
+}
+
+void AppendUInt32(uint32_t value, std::vector<unsigned char>* data) {
+  for (int shift = 24; shift >= 0; shift -= 8) {
+    data->push_back(static_cast<unsigned char>(value >> shift));
+  }
+}
+
+void AppendUInt32Option(uint8_t code,
+                        uint32_t value,
+                        std::vector<unsigned char>* data) {
+  data->push_back(code);
+  data->push_back(sizeof(value));
+  AppendUInt32(value, data);
+}
+
+MATCHER_P2(IsInetAddress, address, port, "") {
+  const struct sockaddr_in* in =
+      reinterpret_cast<const struct sockaddr_in*>(arg);
+  return in->sin_family == AF_INET &&
+      ntohl(in->sin_addr.s_addr) == address &&
+      ntohs(in->sin_port) == port;
+}
+}  // namespace
+
+class DHCPV4Test : public AllocationBudgetTest {
+ public:
+  DHCPV4Test() : sockets_(nullptr) {
+    // Keep the capture of the sent messages out of the allocation counts.
+    sent_messages_.reserve(64);
+    CreateClient(false);
+  }
+
+  bool SendPacket(const ByteString& packet) {
+    const size_t header_len = sizeof(struct iphdr) + sizeof(struct udphdr);
+    EXPECT_GT(packet.GetLength(), header_len + kDHCPHeaderLength);
+    const unsigned char* ip = packet.GetConstData();
+    const unsigned char* dhcp = ip + header_len;
+    SentMessage message = {};
+    message.time_ms = dispatcher_.now_ms();
+    message.transaction_id = ReadUInt32(dhcp + 4);
+    message.client_ip_address = ReadUInt32(dhcp + 12);
+    message.destination_address = ReadUInt32(
+        ip + offsetof(struct iphdr, daddr));
+    const unsigned char* option = dhcp + kDHCPHeaderLength +
+                                  sizeof(kMagicCookie);
+    const unsigned char* end = ip + packet.GetLength();
+    while (option < end && *option != kDHCPOptionEnd) {
+      if (*option == kDHCPOptionPad) {
+        option++;
+        continue;
+      }
+      uint8_t code = option[0];
+      const unsigned char* value = option + 2;
+      if (code == kDHCPOptionMessageType) {
+        message.message_type = value[0];
+      } else if (code == kDHCPOptionRequestedIPAddr) {
+        message.requested_ip_address = ReadUInt32(value);
+      } else if (code == kDHCPOptionServerIdentifier) {
+        message.server_identifier = ReadUInt32(value);
+      } else if (code == kDHCPOptionRapidCommit) {
+        message.rapid_commit = true;
+      }
+      option += 2 + option[1];
+    }
+    sent_messages_.push_back(message);
+    return true;
+  }
+
+ protected:
+  void CreateClient(bool rapid_commit) {
+    dhcpv4_.reset(new DHCPV4(kFakeInterfaceName,
+                             ByteString(kFakeHardwareAddress,
+                                        sizeof(kFakeHardwareAddress)),
+                             kFakeInterfaceIndex,
+                             kFakeNetworkIdentifier,
+                             false,
+                             false,
+                             false,
+                             false,
+                             rapid_commit,
+                             nullptr,
+                             &lease_store_,
+                             &dispatcher_));
+    dhcpv4_->SetRandomSeed(1);
+    dhcpv4_->set_packet_sender(
+        Bind(&DHCPV4Test::SendPacket, Unretained(this)));
+  }
+
+  // Build a reply from the server, |renewal_time|, |rebinding_time|
+  // and |lease_time| are left out when 0.
+  std::vector<unsigned char> BuildReply(uint8_t message_type,
+                                        uint32_t transaction_id,
+                                        uint32_t lease_time,
+                                        uint32_t renewal_time,
+                                        uint32_t rebinding_time,
+                                        bool rapid_commit) {
+    std::vector<unsigned char> message(kDHCPHeaderLength, 0);
+    message[0] = 2;  // BOOTREPLY
+    message[1] = 1;  // Ethernet
+    message[2] = sizeof(kFakeHardwareAddress);
+    for (int i = 0; i < 4; i++) {
+      message[4 + i] =
+          static_cast<unsigned char>(transaction_id >> (24 - 8 * i));
+    }
+    if (message_type != kDHCPMessageTypeNak) {
+      for (int i = 0; i < 4; i++) {
+        message[16 + i] =
+            static_cast<unsigned char>(kFakeClientAddress >> (24 - 8 * i));
+      }
+    }
+    memcpy(&message[kChaddrOffset], kFakeHardwareAddress,
+           sizeof(kFakeHardwareAddress));
+    message.insert(message.end(), kMagicCookie,
+                   kMagicCookie + sizeof(kMagicCookie));
+    message.push_back(kDHCPOptionMessageType);
+    message.push_back(1);
+    message.push_back(message_type);
+    AppendUInt32Option(kDHCPOptionServerIdentifier, kFakeServerAddress,
+                       &message);
+    if (message_type != kDHCPMessageTypeNak) {
+      AppendUInt32Option(kDHCPOptionSubnetMask, kFakeSubnetMask, &message);
+      AppendUInt32Option(kDHCPOptionRouter, kFakeServerAddress, &message);
+    }
+    if (lease_time != 0) {
+      AppendUInt32Option(kDHCPOptionLeaseTime, lease_time, &message);
+    }
+    if (renewal_time != 0) {
+      AppendUInt32Option(kDHCPOptionRenewalTime, renewal_time, &message);
+    }
+    if (rebinding_time != 0) {
+      AppendUInt32Option(kDHCPOptionRebindingTime, rebinding_time, &message);
+    }
+    if (rapid_commit) {
+      message.push_back(kDHCPOptionRapidCommit);
+      message.push_back(0);
+    }
+    message.push_back(kDHCPOptionEnd);
+    return message;
+  }
+
+  // Wrap |message| in the IP and UDP headers of a frame from the server.
+  std::vector<unsigned char> BuildFrame(
+      const std::vector<unsigned char>& message) {
+    const size_t header_len = sizeof(struct iphdr) + sizeof(struct udphdr);
+    std::vector<unsigned char> frame(header_len, 0);
+    frame.insert(frame.end(), message.begin(), message.end());
+    struct iphdr* ip = reinterpret_cast<struct iphdr*>(&frame[0]);
+    struct udphdr* udp =
+        reinterpret_cast<struct udphdr*>(&frame[sizeof(*ip)]);
+    ip->version = 4;
+    ip->ihl = sizeof(*ip) >> 2;
+    ip->protocol = IPPROTO_UDP;
+    ip->tot_len = htons(static_cast<uint16_t>(frame.size()));
+    udp->uh_sport = htons(67);
+    udp->uh_dport = htons(68);
+    udp->uh_ulen =
+        htons(static_cast<uint16_t>(frame.size() - sizeof(*ip)));
+    return frame;
+  }
+
+  void ReceiveReply(uint8_t message_type,
+                    uint32_t transaction_id,
+                    uint32_t lease_time,
+                    uint32_t renewal_time,
+                    uint32_t rebinding_time,
+                    bool rapid_commit) {
+    std::vector<unsigned char> message =
+        BuildReply(message_type, transaction_id, lease_time, renewal_time,
+                   rebinding_time, rapid_commit);
+    ReceiveMessage(message);
+  }
+
+  void ReceiveMessage(const std::vector<unsigned char>& message) {
+    dhcpv4_->HandleMessage(&message[0], message.size());
+  }
+
+  void ReceiveOffer() {
+    ReceiveReply(kDHCPMessageTypeOffer, last_message().transaction_id,
+                 kFakeLeaseTime, 0, 0, false);
+  }
+
+  void ReceiveAck() {
+    ReceiveReply(kDHCPMessageTypeAck, last_message().transaction_id,
+                 kFakeLeaseTime, 0, 0, false);
+  }
+
+  // Go through Discover/Offer/Request/Ack.
+  void AcquireLease() {
+    ASSERT_TRUE(dhcpv4_->Start());
+    ReceiveOffer();
+    ReceiveAck();
+    ASSERT_EQ(DHCP::State::BOUND, dhcpv4_->state());
+  }
+
+  bool MakeRawPacket(const DHCPMessage& message, FrameWriter* writer) {
+    return dhcpv4_->MakeRawPacket(message, writer);
+  }
+
+  bool SendRequest() { return dhcpv4_->SendRequest(); }
+
+  // Send and receive through sockets from |sockets_| instead of
+  // SendPacket(), with the socket handlers created by
+  // |io_handler_factory_|. The sent messages are not captured.
+  void UseSockets() {
+    sockets_ = new NiceMock<MockSockets>();
+    ON_CALL(*sockets_, Socket(PF_PACKET, _, _))
+        .WillByDefault(Return(kFakeRawSocket));
+    ON_CALL(*sockets_, Socket(PF_INET, _, _))
+        .WillByDefault(Return(kFakeUDPSocket));
+    ON_CALL(*sockets_, SendMmsg(_, _, _, _)).WillByDefault(ReturnArg<2>());
+    dhcpv4_->sockets_.reset(sockets_);
+    dhcpv4_->io_handler_factory_ = &io_handler_factory_;
+    dhcpv4_->set_packet_sender(DHCPV4::PacketSender());
+  }
+
+  uint32_t transaction_id() const { return dhcpv4_->transaction_id_; }
+
+  // Acquire a lease through the sockets of UseSockets().
+  void AcquireLeaseOverSockets() {
+    EXPECT_CALL(*sockets_, Socket(PF_PACKET, _, _)).Times(1);
+    EXPECT_CALL(io_handler_factory_,
+                CreateIOReadyHandler(kFakeRawSocket, IOHandler::kModeInput, _))
+        .WillOnce(Return(new IOHandler()));
+    ASSERT_TRUE(dhcpv4_->Start());
+    ReceiveReply(kDHCPMessageTypeOffer, transaction_id(),
+                 kFakeLeaseTime, 0, 0, false);
+    ReceiveReply(kDHCPMessageTypeAck, transaction_id(),
+                 kFakeLeaseTime, 0, 0, false);
+    ASSERT_EQ(DHCP::State::BOUND, dhcpv4_->state());
+    EXPECT_CALL(*sockets_, Close(kFakeRawSocket)).Times(1);
+    dispatcher_.RunFor(kOneSecondMs);
+    Mock::VerifyAndClearExpectations(sockets_);
+    Mock::VerifyAndClearExpectations(&io_handler_factory_);
+  }
+
+  void ProcessFrame(const std::vector<unsigned char>& frame,
+                    uint32_t status) {
+    dhcpv4_->ProcessFrame(&frame[0], frame.size(), status);
+  }
+
+  // Validate the headers of the first |len| bytes of |frame|, with the
+  // IP total length set to match.
+  int ValidatePacketHeader(std::vector<unsigned char>* frame, size_t len) {
+    struct iphdr* ip = reinterpret_cast<struct iphdr*>(&(*frame)[0]);
+    ip->tot_len = htons(static_cast<uint16_t>(len));
+    return dhcpv4_->ValidatePacketHeader(&(*frame)[0], len);
+  }
+
+  void SetUDPLength(std::vector<unsigned char>* frame, uint16_t udp_len) {
+    struct udphdr* udp =
+        reinterpret_cast<struct udphdr*>(&(*frame)[sizeof(struct iphdr)]);
+    udp->uh_ulen = htons(udp_len);
+  }
+
+  // Like BuildFrame(), with the UDP checksum filled in.
+  std::vector<unsigned char> BuildChecksummedFrame(
+      const std::vector<unsigned char>& message) {
+    std::vector<unsigned char> frame = BuildFrame(message);
+    struct iphdr* ip = reinterpret_cast<struct iphdr*>(&frame[0]);
+    struct udphdr* udp =
+        reinterpret_cast<struct udphdr*>(&frame[sizeof(*ip)]);
+    ip->saddr = htonl(kFakeServerAddress);
+    ip->daddr = htonl(kFakeClientAddress);
+    udp->uh_sum = htons(ComputeUDPChecksum(
+        kFakeServerAddress, kFakeClientAddress,
+        &frame[sizeof(*ip)], frame.size() - sizeof(*ip)));
+    return frame;
+  }
+
+  std::vector<unsigned char> BuildOffer() {
+    return BuildReply(kDHCPMessageTypeOffer, last_message().transaction_id,
+                      kFakeLeaseTime, 0, 0, false);
+  }
+
+  const SentMessage& last_message() const { return sent_messages_.back(); }
+
+  // Times between the consecutive sent messages.
+  std::vector<int64_t> GetIntervals() const {
+    std::vector<int64_t> intervals;
+    for (size_t i = 1; i < sent_messages_.size(); i++) {
+      intervals.push_back(sent_messages_[i].time_ms -
+                          sent_messages_[i - 1].time_ms);
+    }
+    return intervals;
+  }
+
+  SimulatedEventDispatcher dispatcher_;
+  FakeLeaseStore lease_store_;
+  NiceMock<MockIOHandlerFactory> io_handler_factory_;
+  MockSockets* sockets_;  // Owned by dhcpv4_, set by UseSockets().
+  std::vector<SentMessage> sent_messages_;
+  std::unique_ptr<DHCPV4> dhcpv4_;
+};
+
+TEST_F(DHCPV4Test, StartSendsDiscover) {
+  ASSERT_TRUE(dhcpv4_->Start());
+  EXPECT_EQ(DHCP::State::SELECT, dhcpv4_->state());
+  ASSERT_EQ(1u, sent_messages_.size());
+  EXPECT_EQ(kDHCPMessageTypeDiscover, last_message().message_type);
+  EXPECT_EQ(kBroadcastAddress, last_message().destination_address);
+  EXPECT_EQ(0u, last_message().client_ip_address);
+  EXPECT_FALSE(last_message().rapid_commit);
+}
+
+TEST_F(DHCPV4Test, DiscoverRetransmissionBackoff) {
+  ASSERT_TRUE(dhcpv4_->Start());
+  dispatcher_.RunFor(300 * kOneSecondMs);
+  const int64_t kExpectedIntervalsMs[] = {4000, 8000, 16000, 32000, 64000,
+                                          64000, 64000};
+  std::vector<int64_t> intervals = GetIntervals();
+  ASSERT_GE(intervals.size(), arraysize(kExpectedIntervalsMs));
+  for (size_t i = 0; i < arraysize(kExpectedIntervalsMs); i++) {
+    EXPECT_GE(intervals[i], kExpectedIntervalsMs[i] - kOneSecondMs);
+    EXPECT_LE(intervals[i], kExpectedIntervalsMs[i] + kOneSecondMs);
+  }
+  // All the retransmissions belong to the same transaction.
+  for (const auto& message : sent_messages_) {
+    EXPECT_EQ(kDHCPMessageTypeDiscover, message.message_type);
+    EXPECT_EQ(sent_messages_[0].transaction_id, message.transaction_id);
+  }
+}
+
+TEST_F(DHCPV4Test, TunedRetransmissionIntervals) {
+  dhcpv4_->SetRetransmissionIntervals(1000, 4000);
+  ASSERT_TRUE(dhcpv4_->Start());
+  dispatcher_.RunFor(20 * kOneSecondMs);
+  // The randomization is a quarter of short intervals.
+  const int64_t kExpectedIntervalsMs[] = {1000, 2000, 4000, 4000};
+  std::vector<int64_t> intervals = GetIntervals();
+  ASSERT_GE(intervals.size(), arraysize(kExpectedIntervalsMs));
+  for (size_t i = 0; i < arraysize(kExpectedIntervalsMs); i++) {
+    EXPECT_GE(intervals[i], kExpectedIntervalsMs[i] * 3 / 4);
+    EXPECT_LE(intervals[i], kExpectedIntervalsMs[i] * 5 / 4);
+  }
+}
+
+TEST_F(DHCPV4Test, TuneOneRetransmissionInterval) {
+  // The initial interval keeps its default.
+  dhcpv4_->SetRetransmissionIntervals(0, 8000);
+  ASSERT_TRUE(dhcpv4_->Start());
+  dispatcher_.RunFor(30 * kOneSecondMs);
+  const int64_t kExpectedIntervalsMs[] = {4000, 8000, 8000};
+  std::vector<int64_t> intervals = GetIntervals();
+  ASSERT_GE(intervals.size(), arraysize(kExpectedIntervalsMs));
+  for (size_t i = 0; i < arraysize(kExpectedIntervalsMs); i++) {
+    EXPECT_GE(intervals[i], kExpectedIntervalsMs[i] - kOneSecondMs);
+    EXPECT_LE(intervals[i], kExpectedIntervalsMs[i] + kOneSecondMs);
+  }
+}
+
+TEST_F(DHCPV4Test, RetransmissionIsDeterministicUnderSeed) {
+  ASSERT_TRUE(dhcpv4_->Start());
+  dispatcher_.RunFor(120 * kOneSecondMs);
+  std::vector<int64_t> intervals = GetIntervals();
+  sent_messages_.clear();
+  CreateClient(false);
+  ASSERT_TRUE(dhcpv4_->Start());
+  dispatcher_.RunFor(120 * kOneSecondMs);
+  EXPECT_EQ(intervals, GetIntervals());
+}
+
+TEST_F(DHCPV4Test, OfferMovesToRequest) {
+  ASSERT_TRUE(dhcpv4_->Start());
+  uint32_t transaction_id = last_message().transaction_id;
+  ReceiveOffer();
+  EXPECT_EQ(DHCP::State::REQUEST, dhcpv4_->state());
+  ASSERT_EQ(2u, sent_messages_.size());
+  EXPECT_EQ(kDHCPMessageTypeRequest, last_message().message_type);
+  EXPECT_EQ(transaction_id, last_message().transaction_id);
+  EXPECT_EQ(kFakeClientAddress, last_message().requested_ip_address);
+  EXPECT_EQ(kFakeServerAddress, last_message().server_identifier);
+  EXPECT_EQ(0u, last_message().client_ip_address);
+  // The Discover is not retransmitted anymore.
+  dispatcher_.RunFor(5 * kOneSecondMs);
+  EXPECT_EQ(kDHCPMessageTypeRequest, last_message().message_type);
+}
+
+TEST_F(DHCPV4Test, IgnoreIncompleteOffer) {
+  ASSERT_TRUE(dhcpv4_->Start());
+  // No offered address.
+  std::vector<unsigned char> message = BuildOffer();
+  memset(&message[16], 0, 4);
+  ReceiveMessage(message);
+  EXPECT_EQ(DHCP::State::SELECT, dhcpv4_->state());
+  // No Server Identifier, right after the Message Type option.
+  message = BuildOffer();
+  std::vector<unsigned char>::iterator server_identifier =
+      message.begin() + kDHCPHeaderLength + sizeof(kMagicCookie) + 3;
+  ASSERT_EQ(kDHCPOptionServerIdentifier, *server_identifier);
+  message.erase(server_identifier, server_identifier + 6);
+  ReceiveMessage(message);
+  EXPECT_EQ(DHCP::State::SELECT, dhcpv4_->state());
+  EXPECT_EQ(1u, sent_messages_.size());
+  // A valid Offer is still taken.
+  ReceiveOffer();
+  EXPECT_EQ(DHCP::State::REQUEST, dhcpv4_->state());
+}
+
+TEST_F(DHCPV4Test, IgnoreIncompleteAck) {
+  ASSERT_TRUE(dhcpv4_->Start());
+  ReceiveOffer();
+  ASSERT_EQ(DHCP::State::REQUEST, dhcpv4_->state());
+  // No address.
+  std::vector<unsigned char> message =
+      BuildReply(kDHCPMessageTypeAck, last_message().transaction_id,
+                 kFakeLeaseTime, 0, 0, false);
+  memset(&message[16], 0, 4);
+  ReceiveMessage(message);
+  EXPECT_EQ(DHCP::State::REQUEST, dhcpv4_->state());
+  // No Server Identifier, right after the Message Type option.
+  message = BuildReply(kDHCPMessageTypeAck, last_message().transaction_id,
+                       kFakeLeaseTime, 0, 0, false);
+  std::vector<unsigned char>::iterator server_identifier =
+      message.begin() + kDHCPHeaderLength + sizeof(kMagicCookie) + 3;
+  ASSERT_EQ(kDHCPOptionServerIdentifier, *server_identifier);
+  message.erase(server_identifier, server_identifier + 6);
+  ReceiveMessage(message);
+  EXPECT_EQ(DHCP::State::REQUEST, dhcpv4_->state());
+  Lease lease;
+  EXPECT_FALSE(lease_store_.Load(kFakeNetworkIdentifier, &lease));
+  // A valid Ack is still taken.
+  ReceiveAck();
+  EXPECT_EQ(DHCP::State::BOUND, dhcpv4_->state());
+}
+
+TEST_F(DHCPV4Test, IgnoreAckForOtherAddress) {
+  ASSERT_TRUE(dhcpv4_->Start());
+  ReceiveOffer();
+  ASSERT_EQ(DHCP::State::REQUEST, dhcpv4_->state());
+  std::vector<unsigned char> message =
+      BuildReply(kDHCPMessageTypeAck, last_message().transaction_id,
+                 kFakeLeaseTime, 0, 0, false);
+  message[19] ^= 0x01;
+  ReceiveMessage(message);
+  EXPECT_EQ(DHCP::State::REQUEST, dhcpv4_->state());
+  ReceiveAck();
+  ASSERT_EQ(DHCP::State::BOUND, dhcpv4_->state());
+  // Same when extending the lease.
+  dispatcher_.RunFor(kFakeLeaseTime * kOneSecondMs / 2);
+  ASSERT_EQ(DHCP::State::RENEW, dhcpv4_->state());
+  message = BuildReply(kDHCPMessageTypeAck, last_message().transaction_id,
+                       kFakeLeaseTime, 0, 0, false);
+  message[19] ^= 0x01;
+  ReceiveMessage(message);
+  EXPECT_EQ(DHCP::State::RENEW, dhcpv4_->state());
+  Lease lease;
+  ASSERT_TRUE(lease_store_.Load(kFakeNetworkIdentifier, &lease));
+  EXPECT_EQ(kFakeClientAddress, lease.ip_address);
+}
+
+TEST_F(DHCPV4Test, IgnoreReplyToOtherTransaction) {
+  ASSERT_TRUE(dhcpv4_->Start());
+  ReceiveReply(kDHCPMessageTypeOffer, last_message().transaction_id + 1,
+               kFakeLeaseTime, 0, 0, false);
+  EXPECT_EQ(DHCP::State::SELECT, dhcpv4_->state());
+  EXPECT_EQ(1u, sent_messages_.size());
+}
+
+TEST_F(DHCPV4Test, AcceptValidChecksum) {
+  ASSERT_TRUE(dhcpv4_->Start());
+  ProcessFrame(BuildChecksummedFrame(BuildOffer()), 0);
+  EXPECT_EQ(DHCP::State::REQUEST, dhcpv4_->state());
+}
+
+TEST_F(DHCPV4Test, DropCorruptedChecksum) {
+  ASSERT_TRUE(dhcpv4_->Start());
+  std::vector<unsigned char> frame = BuildChecksummedFrame(BuildOffer());
+  frame[sizeof(struct iphdr) + offsetof(struct udphdr, uh_sum)] ^= 0x01;
+  ProcessFrame(frame, 0);
+  EXPECT_EQ(DHCP::State::SELECT, dhcpv4_->state());
+  EXPECT_EQ(1u, sent_messages_.size());
+}
+
+TEST_F(DHCPV4Test, TrustChecksumVerifiedByKernel) {
+  ASSERT_TRUE(dhcpv4_->Start());
+  std::vector<unsigned char> frame = BuildChecksummedFrame(BuildOffer());
+  frame[sizeof(struct iphdr) + offsetof(struct udphdr, uh_sum)] ^= 0x01;
+  ProcessFrame(frame, TP_STATUS_CSUM_VALID);
+  EXPECT_EQ(DHCP::State::REQUEST, dhcpv4_->state());
+}
+
+TEST_F(DHCPV4Test, RejectTruncatedHeaders) {
+  std::vector<unsigned char> frame = BuildFrame(
+      BuildReply(kDHCPMessageTypeOffer, 0, kFakeLeaseTime, 0, 0, false));
+  const size_t kHeadersLength = sizeof(struct iphdr) + sizeof(struct udphdr);
+  EXPECT_EQ(-1, ValidatePacketHeader(&frame, sizeof(struct iphdr) - 1));
+  // The UDP length agrees with the frame, but the frame ends within the
+  // UDP header.
+  SetUDPLength(&frame, sizeof(struct udphdr) / 2);
+  EXPECT_EQ(-1, ValidatePacketHeader(
+      &frame, sizeof(struct iphdr) + sizeof(struct udphdr) / 2));
+  SetUDPLength(&frame, sizeof(struct udphdr));
+  EXPECT_EQ(static_cast<int>(kHeadersLength),
+            ValidatePacketHeader(&frame, kHeadersLength));
+}
+
+TEST_F(DHCPV4Test, RejectOtherIPPackets) {
+  std::vector<unsigned char> frame = BuildFrame(
+      BuildReply(kDHCPMessageTypeOffer, 0, kFakeLeaseTime, 0, 0, false));
+  struct iphdr* ip = reinterpret_cast<struct iphdr*>(&frame[0]);
+  ip->protocol = IPPROTO_TCP;
+  EXPECT_EQ(-1, ValidatePacketHeader(&frame, frame.size()));
+  ip->protocol = IPPROTO_UDP;
+  ip->version = 6;
+  EXPECT_EQ(-1, ValidatePacketHeader(&frame, frame.size()));
+  ip->version = 4;
+  EXPECT_LT(0, ValidatePacketHeader(&frame, frame.size()));
+}
+
+TEST_F(DHCPV4Test, RejectFragments) {
+  std::vector<unsigned char> frame = BuildFrame(
+      BuildReply(kDHCPMessageTypeOffer, 0, kFakeLeaseTime, 0, 0, false));
+  struct iphdr* ip = reinterpret_cast<struct iphdr*>(&frame[0]);
+  // First fragment.
+  ip->frag_off = htons(IP_MF);
+  EXPECT_EQ(-1, ValidatePacketHeader(&frame, frame.size()));
+  // Last fragment.
+  ip->frag_off = htons(64 >> 3);
+  EXPECT_EQ(-1, ValidatePacketHeader(&frame, frame.size()));
+  // Don't Fragment alone is fine.
+  ip->frag_off = htons(IP_DF);
+  EXPECT_LT(0, ValidatePacketHeader(&frame, frame.size()));
+}
+
+TEST_F(DHCPV4Test, RejectShortUDPLength) {
+  std::vector<unsigned char> frame = BuildFrame(
+      BuildReply(kDHCPMessageTypeOffer, 0, kFakeLeaseTime, 0, 0, false));
+  SetUDPLength(&frame, sizeof(struct udphdr) - 1);
+  EXPECT_EQ(-1, ValidatePacketHeader(
+      &frame, sizeof(struct iphdr) + sizeof(struct udphdr) - 1));
+  EXPECT_EQ(-1, ValidatePacketHeader(&frame, frame.size()));
+}
+
+TEST_F(DHCPV4Test, DropTruncatedFrame) {
+  ASSERT_TRUE(dhcpv4_->Start());
+  std::vector<unsigned char> frame = BuildFrame(BuildOffer());
+  frame.resize(sizeof(struct iphdr) + sizeof(struct udphdr) / 2);
+  struct iphdr* ip = reinterpret_cast<struct iphdr*>(&frame[0]);
+  ip->tot_len = htons(static_cast<uint16_t>(frame.size()));
+  ProcessFrame(frame, 0);
+  EXPECT_EQ(DHCP::State::SELECT, dhcpv4_->state());
+}
+
+TEST_F(DHCPV4Test, IgnoreReplyToOtherClient) {
+  ASSERT_TRUE(dhcpv4_->Start());
+  std::vector<unsigned char> message =
+      BuildReply(kDHCPMessageTypeOffer, last_message().transaction_id,
+                 kFakeLeaseTime, 0, 0, false);
+  message[kChaddrOffset + sizeof(kFakeHardwareAddress) - 1] ^= 0xff;
+  dhcpv4_->HandleFrame(&BuildFrame(message)[0],
+                       message.size() + sizeof(struct iphdr) +
+                           sizeof(struct udphdr));
+  EXPECT_EQ(DHCP::State::SELECT, dhcpv4_->state());
+  EXPECT_EQ(1u, sent_messages_.size());
+}
+
+TEST_F(DHCPV4Test, AckMovesToBound) {
+  AcquireLease();
+  Lease lease;
+  ASSERT_TRUE(lease_store_.Load(kFakeNetworkIdentifier, &lease));
+  EXPECT_EQ(kFakeClientAddress, lease.ip_address);
+  EXPECT_EQ(kFakeSubnetMask, lease.subnet_mask);
+  EXPECT_EQ(kFakeServerAddress, lease.server_identifier);
+  EXPECT_EQ(kFakeLeaseTime, lease.lease_time);
+  // Nothing is sent until T1.
+  size_t sent_count = sent_messages_.size();
+  dispatcher_.RunFor(kFakeLeaseTime * kOneSecondMs / 2 - 1);
+  EXPECT_EQ(sent_count, sent_messages_.size());
+  EXPECT_EQ(DHCP::State::BOUND, dhcpv4_->state());
+}
+
+TEST_F(DHCPV4Test, LeaseTimesFollowDispatcherClock) {
+  dispatcher_.RunFor(30 * kOneSecondMs);
+  AcquireLease();
+  Lease lease;
+  ASSERT_TRUE(lease_store_.Load(kFakeNetworkIdentifier, &lease));
+  EXPECT_EQ(dispatcher_.Now().ToTimeT(), lease.acquisition_time);
+}
+
+TEST_F(DHCPV4Test, RequestTimeoutRestartsDiscovery) {
+  ASSERT_TRUE(dhcpv4_->Start());
+  ReceiveOffer();
+  uint32_t transaction_id = last_message().transaction_id;
+  // 4 Requests, with 4, 8 and 16 seconds in between, then 32 seconds
+  // until the client gives up.
+  dispatcher_.RunFor(65 * kOneSecondMs);
+  size_t request_count = 0;
+  for (const auto& message : sent_messages_) {
+    if (message.message_type == kDHCPMessageTypeRequest) {
+      request_count++;
+    }
+  }
+  EXPECT_EQ(4u, request_count);
+  EXPECT_EQ(DHCP::State::SELECT, dhcpv4_->state());
+  EXPECT_EQ(kDHCPMessageTypeDiscover, last_message().message_type);
+  EXPECT_NE(transaction_id, last_message().transaction_id);
+}
+
+TEST_F(DHCPV4Test, NakRestartsDiscovery) {
+  ASSERT_TRUE(dhcpv4_->Start());
+  ReceiveOffer();
+  ReceiveReply(kDHCPMessageTypeNak, last_message().transaction_id,
+               0, 0, 0, false);
+  EXPECT_EQ(DHCP::State::SELECT, dhcpv4_->state());
+  EXPECT_EQ(kDHCPMessageTypeDiscover, last_message().message_type);
+}
+
+TEST_F(DHCPV4Test, RenewAtT1) {
+  AcquireLease();
+  uint32_t transaction_id = last_message().transaction_id;
+  dispatcher_.RunFor(kFakeLeaseTime * kOneSecondMs / 2);
+  EXPECT_EQ(DHCP::State::RENEW, dhcpv4_->state());
+  EXPECT_EQ(kDHCPMessageTypeRequest, last_message().message_type);
+  EXPECT_NE(transaction_id, last_message().transaction_id);
+  // RFC 2131 section 4.3.2: unicast, with the address in ciaddr only.
+  EXPECT_EQ(kFakeServerAddress, last_message().destination_address);
+  EXPECT_EQ(kFakeClientAddress, last_message().client_ip_address);
+  EXPECT_EQ(0u, last_message().requested_ip_address);
+  EXPECT_EQ(0u, last_message().server_identifier);
+  // The retransmission comes after half of the time until T2.
+  size_t sent_count = sent_messages_.size();
+  const int64_t kRenewDurationMs = kFakeLeaseTime * kOneSecondMs * 3 / 8;
+  dispatcher_.RunFor(kRenewDurationMs / 2);
+  ASSERT_EQ(sent_count + 1, sent_messages_.size());
+  EXPECT_EQ(kRenewDurationMs / 2,
+            last_message().time_ms - sent_messages_[sent_count - 1].time_ms);
+}
+
+TEST_F(DHCPV4Test, AckInRenewExtendsLease) {
+  AcquireLease();
+  dispatcher_.RunFor(kFakeLeaseTime * kOneSecondMs / 2);
+  ASSERT_EQ(DHCP::State::RENEW, dhcpv4_->state());
+  ReceiveAck();
+  EXPECT_EQ(DHCP::State::BOUND, dhcpv4_->state());
+  // The previous lease would have expired by now.
+  dispatcher_.RunFor(kFakeLeaseTime * kOneSecondMs / 2);
+  EXPECT_EQ(DHCP::State::RENEW, dhcpv4_->state());
+}
+
+TEST_F(DHCPV4Test, ServerRenewalAndRebindingTimes) {
+  ASSERT_TRUE(dhcpv4_->Start());
+  ReceiveOffer();
+  ReceiveReply(kDHCPMessageTypeAck, last_message().transaction_id,
+               kFakeLeaseTime, 100, 200, false);
+  ASSERT_EQ(DHCP::State::BOUND, dhcpv4_->state());
+  dispatcher_.RunFor(100 * kOneSecondMs);
+  EXPECT_EQ(DHCP::State::RENEW, dhcpv4_->state());
+  dispatcher_.RunFor(100 * kOneSecondMs);
+  EXPECT_EQ(DHCP::State::REBIND, dhcpv4_->state());
+}
+
+TEST_F(DHCPV4Test, RebindAtT2) {
+  AcquireLease();
+  dispatcher_.RunFor(kFakeLeaseTime * kOneSecondMs * 7 / 8);
+  EXPECT_EQ(DHCP::State::REBIND, dhcpv4_->state());
+  EXPECT_EQ(kDHCPMessageTypeRequest, last_message().message_type);
+  EXPECT_EQ(kBroadcastAddress, last_message().destination_address);
+  EXPECT_EQ(kFakeClientAddress, last_message().client_ip_address);
+  ReceiveAck();
+  EXPECT_EQ(DHCP::State::BOUND, dhcpv4_->state());
+}
+
+TEST_F(DHCPV4Test, LeaseExpiryRestartsDiscovery) {
+  AcquireLease();
+  dispatcher_.RunFor(kFakeLeaseTime * kOneSecondMs);
+  EXPECT_EQ(DHCP::State::SELECT, dhcpv4_->state());
+  EXPECT_EQ(kDHCPMessageTypeDiscover, last_message().message_type);
+  EXPECT_EQ(0u, last_message().client_ip_address);
+  Lease lease;
+  EXPECT_FALSE(lease_store_.Load(kFakeNetworkIdentifier, &lease));
+}
+
+TEST_F(DHCPV4Test, NakInRenewRestartsDiscovery) {
+  AcquireLease();
+  dispatcher_.RunFor(kFakeLeaseTime * kOneSecondMs / 2);
+  ReceiveReply(kDHCPMessageTypeNak, last_message().transaction_id,
+               0, 0, 0, false);
+  EXPECT_EQ(DHCP::State::SELECT, dhcpv4_->state());
+  Lease lease;
+  EXPECT_FALSE(lease_store_.Load(kFakeNetworkIdentifier, &lease));
+  // The timers of the previous lease are cancelled.
+  dispatcher_.RunFor(kFakeLeaseTime * kOneSecondMs);
+  EXPECT_EQ(DHCP::State::SELECT, dhcpv4_->state());
+}
+
+TEST_F(DHCPV4Test, RebootWithStoredLease) {
+  Lease lease;
+  lease.ip_address = kFakeClientAddress;
+  lease.server_identifier = kFakeServerAddress;
+  lease.lease_time = kFakeLeaseTime;
+  lease.acquisition_time = dispatcher_.Now().ToTimeT();
+  lease_store_.Save(kFakeNetworkIdentifier, lease);
+  ASSERT_TRUE(dhcpv4_->Start());
+  EXPECT_EQ(DHCP::State::REBOOT, dhcpv4_->state());
+  EXPECT_EQ(kDHCPMessageTypeRequest, last_message().message_type);
+  EXPECT_EQ(kFakeClientAddress, last_message().requested_ip_address);
+  EXPECT_EQ(0u, last_message().server_identifier);
+  ReceiveAck();
+  EXPECT_EQ(DHCP::State::BOUND, dhcpv4_->state());
+}
+
+TEST_F(DHCPV4Test, RebootTimeoutRestartsDiscovery) {
+  Lease lease;
+  lease.ip_address = kFakeClientAddress;
+  lease.lease_time = kInfiniteLeaseTime;
+  lease_store_.Save(kFakeNetworkIdentifier, lease);
+  ASSERT_TRUE(dhcpv4_->Start());
+  ASSERT_EQ(DHCP::State::REBOOT, dhcpv4_->state());
+  dispatcher_.RunFor(65 * kOneSecondMs);
+  EXPECT_EQ(DHCP::State::SELECT, dhcpv4_->state());
+  EXPECT_EQ(kDHCPMessageTypeDiscover, last_message().message_type);
+}
+
+TEST_F(DHCPV4Test, InfiniteLeaseArmsNoTimer) {
+  ASSERT_TRUE(dhcpv4_->Start());
+  ReceiveOffer();
+  ReceiveReply(kDHCPMessageTypeAck, last_message().transaction_id,
+               kInfiniteLeaseTime, 0, 0, false);
+  ASSERT_EQ(DHCP::State::BOUND, dhcpv4_->state());
+  size_t sent_count = sent_messages_.size();
+  dispatcher_.RunFor(30 * 24 * 3600 * kOneSecondMs);
+  EXPECT_EQ(DHCP::State::BOUND, dhcpv4_->state());
+  EXPECT_EQ(sent_count, sent_messages_.size());
+}
+
+TEST_F(DHCPV4Test, RapidCommitAck) {
+  CreateClient(true);
+  ASSERT_TRUE(dhcpv4_->Start());
+  EXPECT_TRUE(last_message().rapid_commit);
+  // An Ack without Rapid Commit is not valid in SELECT.
+  ReceiveReply(kDHCPMessageTypeAck, last_message().transaction_id,
+               kFakeLeaseTime, 0, 0, false);
+  EXPECT_EQ(DHCP::State::SELECT, dhcpv4_->state());
+  ReceiveReply(kDHCPMessageTypeAck, last_message().transaction_id,
+               kFakeLeaseTime, 0, 0, true);
+  EXPECT_EQ(DHCP::State::BOUND, dhcpv4_->state());
+  EXPECT_EQ(1u, sent_messages_.size());
+}
+
+TEST_F(DHCPV4Test, RapidCommitFallsBackToOffer) {
+  CreateClient(true);
+  ASSERT_TRUE(dhcpv4_->Start());
+  EXPECT_TRUE(last_message().rapid_commit);
+  uint32_t transaction_id = last_message().transaction_id;
+  // The server does not support Rapid Commit and answers with an Offer.
+  ReceiveOffer();
+  EXPECT_EQ(DHCP::State::REQUEST, dhcpv4_->state());
+  ASSERT_EQ(2u, sent_messages_.size());
+  EXPECT_EQ(kDHCPMessageTypeRequest, last_message().message_type);
+  EXPECT_EQ(transaction_id, last_message().transaction_id);
+  EXPECT_EQ(kFakeClientAddress, last_message().requested_ip_address);
+  EXPECT_EQ(kFakeServerAddress, last_message().server_identifier);
+  ReceiveAck();
+  EXPECT_EQ(DHCP::State::BOUND, dhcpv4_->state());
+}
+
+TEST_F(DHCPV4Test, ReceiveWithinAllocationBudget) {
+  ASSERT_TRUE(dhcpv4_->Start());
+  ReceiveOffer();
+  // A second Offer goes through the whole receive path and is ignored.
+  std::vector<unsigned char> frame = BuildFrame(
+      BuildReply(kDHCPMessageTypeOffer, last_message().transaction_id,
+                 kFakeLeaseTime, 0, 0, false));
+  // The headers and the options are validated in place.
+  EXPECT_EQ(0u, CountAllocations([&]() {
+    dhcpv4_->HandleFrame(&frame[0], frame.size());
+  }));
+}
+
+TEST_F(DHCPV4Test, MakeRawPacketWithinAllocationBudget) {
+  DHCPMessage message;
+  DHCPMessage::InitRequest(&message);
+  message.SetMessageType(kDHCPMessageTypeDiscover);
+  message.SetClientHardwareAddress(
+      ByteString(kFakeHardwareAddress, sizeof(kFakeHardwareAddress)));
+  uint8_t buffer[kMaxDHCPFrameLength];
+  FrameWriter writer(buffer, sizeof(buffer));
+  // The frame is written into the caller storage.
+  EXPECT_EQ(0u, CountAllocations([&]() {
+    EXPECT_TRUE(MakeRawPacket(message, &writer));
+  }));
+  FrameSpan frame = writer.span();
+  EXPECT_EQ(buffer, frame.data);
+  const struct iphdr* ip = reinterpret_cast<const struct iphdr*>(frame.data);
+  EXPECT_EQ(frame.length, ntohs(ip->tot_len));
+}
+
+TEST_F(DHCPV4Test, RenewWithinAllocationBudget) {
+  AcquireLease();
+  dispatcher_.RunFor(kFakeLeaseTime * kOneSecondMs / 2);
+  ASSERT_EQ(DHCP::State::RENEW, dhcpv4_->state());
+  // Retransmissions patch and send the frame built for the first one.
+  size_t sent_count = sent_messages_.size();
+  EXPECT_EQ(0u, CountAllocations([&]() {
+    EXPECT_TRUE(SendRequest());
+  }));
+  EXPECT_EQ(sent_count + 1, sent_messages_.size());
+}
+
+TEST_F(DHCPV4Test, RenewOverUDPSocket) {
+  UseSockets();
+  AcquireLeaseOverSockets();
+  EXPECT_CALL(*sockets_, Socket(PF_INET, _, IPPROTO_UDP)).Times(1);
+  EXPECT_CALL(*sockets_,
+              Bind(kFakeUDPSocket,
+                   IsInetAddress(kFakeClientAddress, 68),
+                   sizeof(struct sockaddr_in)))
+      .Times(1);
+  EXPECT_CALL(*sockets_, Socket(PF_PACKET, _, _)).Times(0);
+  EXPECT_CALL(io_handler_factory_,
+              CreateIOReadyHandler(kFakeUDPSocket, IOHandler::kModeInput, _))
+      .WillOnce(Return(new IOHandler()));
+  // The Request goes out of the UDP socket.
+  EXPECT_CALL(*sockets_, SendMmsg(kFakeUDPSocket, _, 1, _))
+      .WillOnce(Return(1));
+  dispatcher_.RunFor(kFakeLeaseTime * kOneSecondMs / 2);
+  ASSERT_EQ(DHCP::State::RENEW, dhcpv4_->state());
+  Mock::VerifyAndClearExpectations(sockets_);
+  Mock::VerifyAndClearExpectations(&io_handler_factory_);
+  ReceiveReply(kDHCPMessageTypeAck, transaction_id(),
+               kFakeLeaseTime, 0, 0, false);
+  EXPECT_EQ(DHCP::State::BOUND, dhcpv4_->state());
+  EXPECT_CALL(*sockets_, Close(kFakeUDPSocket)).Times(1);
+  dispatcher_.RunFor(kOneSecondMs);
+}
+
+TEST_F(DHCPV4Test, RebindReopensRawSocket) {
+  UseSockets();
+  AcquireLeaseOverSockets();
+  dispatcher_.RunFor(kFakeLeaseTime * kOneSecondMs / 2);
+  ASSERT_EQ(DHCP::State::RENEW, dhcpv4_->state());
+  EXPECT_CALL(*sockets_, Close(kFakeUDPSocket)).Times(1);
+  EXPECT_CALL(*sockets_, Socket(PF_PACKET, _, _)).Times(1);
+  dispatcher_.RunFor(kFakeLeaseTime * kOneSecondMs * 3 / 8);
+  EXPECT_EQ(DHCP::State::REBIND, dhcpv4_->state());
+  Mock::VerifyAndClearExpectations(sockets_);
+  EXPECT_CALL(*sockets_, Close(kFakeRawSocket)).Times(1);
+  dhcpv4_->Stop();
+}
+
+TEST_F(DHCPV4Test, RenewFallsBackToRawSocket) {
+  UseSockets();
+  AcquireLeaseOverSockets();
+  EXPECT_CALL(*sockets_, Socket(PF_INET, _, IPPROTO_UDP)).Times(1);
+  // The leased address is not on the interface.
+  EXPECT_CALL(*sockets_, Bind(kFakeUDPSocket, _, _)).WillOnce(Return(-1));
+  EXPECT_CALL(*sockets_, Close(kFakeUDPSocket)).Times(1);
+  EXPECT_CALL(*sockets_, Socket(PF_PACKET, _, _)).Times(1);
+  EXPECT_CALL(*sockets_, Bind(kFakeRawSocket, _, _)).Times(1);
+  dispatcher_.RunFor(kFakeLeaseTime * kOneSecondMs / 2);
+  EXPECT_EQ(DHCP::State::RENEW, dhcpv4_->state());
+  Mock::VerifyAndClearExpectations(sockets_);
+  EXPECT_CALL(*sockets_, Close(kFakeRawSocket)).Times(1);
+  dhcpv4_->Stop();
+}
+
+TEST_F(DHCPV4Test, AckAppliesLease) {
+  FakeLeaseApplier lease_applier;
+  dhcpv4_->set_lease_applier(&lease_applier);
+  AcquireLease();
+  ASSERT_EQ(1u, lease_applier.applied().size());
+  const NetworkConfig& config = lease_applier.applied()[0];
+  EXPECT_EQ(kFakeClientAddress, config.address);
+  EXPECT_EQ(24, config.prefix_length);
+  std::vector<Route> routes = {Route(0, 0, kFakeServerAddress)};
+  EXPECT_EQ(routes, config.routes);
+  // Renewals apply the lease again, the applier skips what is unchanged.
+  dispatcher_.RunFor(kFakeLeaseTime * kOneSecondMs / 2);
+  ReceiveAck();
+  EXPECT_EQ(2u, lease_applier.applied().size());
+}
+
+TEST_F(DHCPV4Test, ClasslessRoutesOverrideRouter) {
+  FakeLeaseApplier lease_applier;
+  dhcpv4_->set_lease_applier(&lease_applier);
+  ASSERT_TRUE(dhcpv4_->Start());
+  ReceiveOffer();
+  std::vector<unsigned char> message =
+      BuildReply(kDHCPMessageTypeAck, last_message().transaction_id,
+                 kFakeLeaseTime, 0, 0, false);
+  // 10.0.0.0/8 via 192.168.1.2, before the end option.
+  const unsigned char kClasslessRoute[] = {
+      kDHCPOptionClasslessStaticRoute, 6, 8, 10, 192, 168, 1, 2};
+  message.insert(message.end() - 1, kClasslessRoute,
+                 kClasslessRoute + sizeof(kClasslessRoute));
+  ReceiveMessage(message);
+  ASSERT_EQ(DHCP::State::BOUND, dhcpv4_->state());
+  ASSERT_EQ(1u, lease_applier.applied().size());
+  std::vector<Route> routes = {Route(0x0a000000, 8, 0xc0a80102)};
+  EXPECT_EQ(routes, lease_applier.applied()[0].routes);
+}
+
+TEST_F(DHCPV4Test, LeaseExpiryClearsLease) {
+  FakeLeaseApplier lease_applier;
+  dhcpv4_->set_lease_applier(&lease_applier);
+  AcquireLease();
+  int clear_count = lease_applier.clear_count();
+  dispatcher_.RunFor(kFakeLeaseTime * kOneSecondMs);
+  EXPECT_EQ(DHCP::State::SELECT, dhcpv4_->state());
+  EXPECT_EQ(clear_count + 1, lease_applier.clear_count());
+}
+
+}  // namespace dhcp_client
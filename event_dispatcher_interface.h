@@ -17,10 +17,17 @@
 #ifndef DHCP_CLIENT_EVENT_DISPATCHER_INTERFACE_H_
 #define DHCP_CLIENT_EVENT_DISPATCHER_INTERFACE_H_
 
+#include <cstdint>
+
 #include <base/callback.h>
+#include <base/time/time.h>
 
 namespace dhcp_client {
 
+// Identifies a task posted with PostCancelableDelayedTask().
+typedef uint64_t TimerHandle;
+const TimerHandle kInvalidTimerHandle = 0;
+
 // Abstract class for dispatching tasks.
 class EventDispatcherInterface {
  public:
@@ -29,6 +36,15 @@ class EventDispatcherInterface {
   virtual bool PostTask(const base::Closure& task) = 0;
   virtual bool PostDelayedTask(const base::Closure& task,
                                int64_t delay_ms) = 0;
+  // Same as PostDelayedTask(), but the task can be cancelled until it
+  // runs. Returns kInvalidTimerHandle on failure.
+  virtual TimerHandle PostCancelableDelayedTask(const base::Closure& task,
+                                                int64_t delay_ms) = 0;
+  // Returns false if the task of |handle| already ran or was cancelled.
+  virtual bool CancelDelayedTask(TimerHandle handle) = 0;
+  // The time on the clock the delays are counted on, which is the wall
+  // clock unless the dispatcher simulates time.
+  virtual base::Time Now() = 0;
 };
 
 }  // namespace dhcp_client
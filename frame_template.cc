@@ -0,0 +1,246 @@
+//
+// Copyright (C) 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "dhcp_client/frame_template.h"
+
+#include <netinet/in.h>
+#include <netinet/ip.h>
+#include <netinet/udp.h>
+#include <sys/uio.h>
+
+#include <cstddef>
+#include <cstring>
+
+#include <base/logging.h>
+
+#include "dhcp_client/dhcp_options.h"
+
+using shill::ByteString;
+
+namespace dhcp_client {
+
+namespace {
+// Frame layout. MakeRawPacket always emits an IP header without options.
+const size_t kIPHeaderLength = sizeof(struct iphdr);
+const size_t kIPIdentificationOffset = offsetof(struct iphdr, id);
+const size_t kIPChecksumOffset = offsetof(struct iphdr, check);
+const size_t kIPSourceOffset = offsetof(struct iphdr, saddr);
+const size_t kIPDestinationOffset = offsetof(struct iphdr, daddr);
+const size_t kUDPChecksumOffset =
+    kIPHeaderLength + offsetof(struct udphdr, uh_sum);
+const size_t kDHCPMessageOffset = FrameTemplate::kHeaderLength;
+const size_t kTransactionIDOffset = kDHCPMessageOffset + 4;
+const size_t kSecondsOffset = kDHCPMessageOffset + 8;
+const size_t kOptionsOffset = kDHCPMessageOffset + 240;
+
+// Returns the one's complement sum of the |length| bytes of |field|,
+// found at |offset| in the frame. Both checksums in the frame start at
+// an even offset, so a byte at an even offset is the high half of its
+// 16 bit word.
+uint32_t SumBytes(const uint8_t* field, size_t offset, size_t length) {
+  uint32_t sum = 0;
+  for (size_t i = 0; i < length; i++) {
+    sum += ((offset + i) % 2 == 0) ? static_cast<uint32_t>(field[i]) << 8
+                                   : field[i];
+  }
+  while (sum >> 16) {
+    sum = (sum >> 16) + (sum & 0xffff);
+  }
+  return sum;
+}
+
+uint16_t ReadUInt16(const uint8_t* field) {
+  return static_cast<uint16_t>(field[0] << 8 | field[1]);
+}
+
+void WriteUInt16(uint8_t* field, uint16_t value) {
+  field[0] = static_cast<uint8_t>(value >> 8);
+  field[1] = static_cast<uint8_t>(value);
+}
+}  // namespace
+
+const size_t FrameTemplate::kHeaderLength;
+const size_t FrameTemplate::kSegmentCount;
+
+FrameTemplate::FrameTemplate()
+    : requested_ip_offset_(0),
+      server_identifier_offset_(0) {
+  memset(header_, 0, sizeof(header_));
+  memset(segments_, 0, sizeof(segments_));
+}
+
+FrameTemplate::~FrameTemplate() {}
+
+bool FrameTemplate::Init(const ByteString& frame) {
+  return Init(FrameSpan{frame.GetConstData(), frame.GetLength()});
+}
+
+bool FrameTemplate::Init(const FrameSpan& frame) {
+  Reset();
+  const uint8_t* data = frame.data;
+  size_t length = frame.length;
+  if (length <= kOptionsOffset) {
+    LOG(ERROR) << "Frame is too short for a DHCP message";
+    return false;
+  }
+  if (static_cast<size_t>(data[0] & 0x0f) << 2 != kIPHeaderLength) {
+    LOG(ERROR) << "Frame templates do not support IP options";
+    return false;
+  }
+  // Locate the options we may have to patch.
+  // The frame was built by us, the TLVs are well formed.
+  size_t requested_ip_offset = 0;
+  size_t server_identifier_offset = 0;
+  size_t offset = kOptionsOffset;
+  while (offset < length && data[offset] != kDHCPOptionEnd) {
+    if (data[offset] == kDHCPOptionPad) {
+      offset++;
+      continue;
+    }
+    if (offset + 1 >= length || offset + 2 + data[offset + 1] > length) {
+      LOG(ERROR) << "Truncated option in frame";
+      return false;
+    }
+    if (data[offset] == kDHCPOptionRequestedIPAddr &&
+        data[offset + 1] == sizeof(uint32_t)) {
+      requested_ip_offset = offset + 2;
+    } else if (data[offset] == kDHCPOptionServerIdentifier &&
+               data[offset + 1] == sizeof(uint32_t)) {
+      server_identifier_offset = offset + 2;
+    }
+    offset += 2 + data[offset + 1];
+  }
+  // Reuses the storage of the previous frame.
+  memcpy(header_, data, kHeaderLength);
+  payload_.Resize(length - kHeaderLength);
+  memcpy(payload_.GetData(), data + kHeaderLength, length - kHeaderLength);
+  segments_[0].iov_base = header_;
+  segments_[0].iov_len = kHeaderLength;
+  segments_[1].iov_base = payload_.GetData();
+  segments_[1].iov_len = payload_.GetLength();
+  requested_ip_offset_ = requested_ip_offset;
+  server_identifier_offset_ = server_identifier_offset;
+  return true;
+}
+
+void FrameTemplate::Reset() {
+  payload_.Clear();
+  memset(segments_, 0, sizeof(segments_));
+  requested_ip_offset_ = 0;
+  server_identifier_offset_ = 0;
+}
+
+void FrameTemplate::SetIPIdentification(uint16_t identification) {
+  uint16_t value = htons(identification);
+  Patch(kIPIdentificationOffset, &value, sizeof(value), kIPChecksumOffset);
+}
+
+void FrameTemplate::SetTransactionID(uint32_t transaction_id) {
+  uint32_t value = htonl(transaction_id);
+  Patch(kTransactionIDOffset, &value, sizeof(value), kUDPChecksumOffset);
+}
+
+void FrameTemplate::SetSeconds(uint16_t seconds) {
+  uint16_t value = htons(seconds);
+  Patch(kSecondsOffset, &value, sizeof(value), kUDPChecksumOffset);
+}
+
+bool FrameTemplate::SetRequestedIPAddress(uint32_t requested_ip_address) {
+  if (!HasRequestedIPAddress()) {
+    return false;
+  }
+  uint32_t value = htonl(requested_ip_address);
+  Patch(requested_ip_offset_, &value, sizeof(value), kUDPChecksumOffset);
+  return true;
+}
+
+bool FrameTemplate::SetServerIdentifier(uint32_t server_identifier) {
+  if (!HasServerIdentifier()) {
+    return false;
+  }
+  uint32_t value = htonl(server_identifier);
+  Patch(server_identifier_offset_, &value, sizeof(value), kUDPChecksumOffset);
+  return true;
+}
+
+uint32_t FrameTemplate::source_address() const {
+  uint32_t address;
+  memcpy(&address, header_ + kIPSourceOffset, sizeof(address));
+  return ntohl(address);
+}
+
+uint32_t FrameTemplate::destination_address() const {
+  uint32_t address;
+  memcpy(&address, header_ + kIPDestinationOffset, sizeof(address));
+  return ntohl(address);
+}
+
+size_t FrameTemplate::length() const {
+  return kHeaderLength + payload_.GetLength();
+}
+
+void FrameTemplate::CopyTo(ByteString* frame) const {
+  DCHECK(IsInitialized());
+  frame->Resize(length());
+  memcpy(frame->GetData(), header_, kHeaderLength);
+  memcpy(frame->GetData() + kHeaderLength,
+         payload_.GetConstData(),
+         payload_.GetLength());
+}
+
+uint16_t FrameTemplate::UpdateChecksum(uint16_t checksum,
+                                       uint16_t old_sum,
+                                       uint16_t new_sum) {
+  // HC' = ~(~HC + ~m + m')
+  uint32_t sum = static_cast<uint16_t>(~checksum);
+  sum += static_cast<uint16_t>(~old_sum);
+  sum += new_sum;
+  while (sum >> 16) {
+    sum = (sum >> 16) + (sum & 0xffff);
+  }
+  return static_cast<uint16_t>(~sum);
+}
+
+void FrameTemplate::Patch(size_t offset,
+                          const void* value,
+                          size_t length,
+                          size_t checksum_offset) {
+  DCHECK(IsInitialized());
+  DCHECK_LE(offset + length, this->length());
+  uint8_t* field = At(offset);
+  uint16_t old_sum = SumBytes(field, offset, length);
+  memcpy(field, value, length);
+  uint16_t new_sum = SumBytes(field, offset, length);
+  uint8_t* checksum_field = At(checksum_offset);
+  uint16_t checksum = UpdateChecksum(ReadUInt16(checksum_field),
+                                     old_sum,
+                                     new_sum);
+  // RFC 768: a computed UDP checksum of zero is transmitted as all ones.
+  if (checksum_offset == kUDPChecksumOffset && checksum == 0) {
+    checksum = 0xffff;
+  }
+  WriteUInt16(checksum_field, checksum);
+}
+
+uint8_t* FrameTemplate::At(size_t offset) {
+  // No patched field spans both segments.
+  if (offset < kHeaderLength) {
+    return header_ + offset;
+  }
+  return payload_.GetData() + offset - kHeaderLength;
+}
+
+}  // namespace dhcp_client
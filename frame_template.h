@@ -0,0 +1,107 @@
+//
+// Copyright (C) 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef DHCP_CLIENT_FRAME_TEMPLATE_H_
+#define DHCP_CLIENT_FRAME_TEMPLATE_H_
+
+#include <netinet/ip.h>
+#include <netinet/udp.h>
+#include <sys/uio.h>
+
+#include <cstddef>
+#include <cstdint>
+
+#include <base/macros.h>
+#include <shill/net/byte_string.h>
+
+#include "dhcp_client/frame_writer.h"
+
+namespace dhcp_client {
+
+// A fully built IP/UDP/DHCP frame kept around for retransmissions.
+// The fields that change between transmissions are patched in place and
+// the IP and UDP checksums are updated incrementally (RFC 1624) instead
+// of serializing the message and summing the whole frame again.
+// The frame is held in two segments, the IP and UDP headers and the DHCP
+// message, which are handed to the kernel as they are.
+class FrameTemplate {
+ public:
+  static const size_t kHeaderLength =
+      sizeof(struct iphdr) + sizeof(struct udphdr);
+  static const size_t kSegmentCount = 2;
+
+  FrameTemplate();
+  ~FrameTemplate();
+
+  // Take a copy of |frame|, as built by DHCPV4::MakeRawPacket, and locate
+  // the patchable fields in it.
+  bool Init(const FrameSpan& frame);
+  bool Init(const shill::ByteString& frame);
+  void Reset();
+  bool IsInitialized() const { return !payload_.IsEmpty(); }
+
+  // Patch a field and fix up the checksum covering it.
+  void SetIPIdentification(uint16_t identification);
+  void SetTransactionID(uint32_t transaction_id);
+  void SetSeconds(uint16_t seconds);
+  // These return false if the frame does not carry the option, in which
+  // case a new template has to be built.
+  bool SetRequestedIPAddress(uint32_t requested_ip_address);
+  bool SetServerIdentifier(uint32_t server_identifier);
+
+  bool HasRequestedIPAddress() const { return requested_ip_offset_ != 0; }
+  bool HasServerIdentifier() const { return server_identifier_offset_ != 0; }
+  uint32_t source_address() const;
+  uint32_t destination_address() const;
+  // The frame, as kSegmentCount segments that stay valid until the next
+  // call to a non const method.
+  const struct iovec* segments() const { return segments_; }
+  // The DHCP message alone, for sockets adding the IP and UDP headers.
+  const struct iovec* payload() const { return &segments_[1]; }
+  size_t length() const;
+  // Copy the frame into |frame|, reusing its storage.
+  void CopyTo(shill::ByteString* frame) const;
+
+  // Returns |checksum| updated for a change of the covered data from
+  // |old_sum| to |new_sum|, both being 16 bit one's complement sums.
+  // This is equation 3 of RFC 1624.
+  static uint16_t UpdateChecksum(uint16_t checksum,
+                                 uint16_t old_sum,
+                                 uint16_t new_sum);
+
+ private:
+  // Overwrite |length| bytes at |offset| with |value| and update
+  // the checksum stored at |checksum_offset|.
+  void Patch(size_t offset,
+             const void* value,
+             size_t length,
+             size_t checksum_offset);
+  // Where the byte at |offset| in the frame is kept.
+  uint8_t* At(size_t offset);
+
+  uint8_t header_[kHeaderLength];
+  shill::ByteString payload_;
+  struct iovec segments_[kSegmentCount];
+  // Offsets of the option values in the frame, 0 if the option is absent.
+  size_t requested_ip_offset_;
+  size_t server_identifier_offset_;
+
+  DISALLOW_COPY_AND_ASSIGN(FrameTemplate);
+};
+
+}  // namespace dhcp_client
+
+#endif  // DHCP_CLIENT_FRAME_TEMPLATE_H_
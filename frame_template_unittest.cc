@@ -0,0 +1,233 @@
+//
+// Copyright (C) 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "dhcp_client/frame_template.h"
+
+#include <netinet/in.h>
+#include <netinet/ip.h>
+#include <netinet/udp.h>
+
+#include <cstring>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include <shill/net/byte_string.h>
+
+#include "dhcp_client/checksum.h"
+#include "dhcp_client/dhcp_message.h"
+#include "dhcp_client/dhcp_options.h"
+
+using shill::ByteString;
+
+namespace dhcp_client {
+
+namespace {
+const uint8_t kFakeHardwareAddress[] = {0x02, 0x1a, 0x2b, 0x3c, 0x4d, 0x5e};
+const uint32_t kFakeTransactionID = 0x3a1b2c4d;
+const uint32_t kFakeRequestedIPAddress = 0xc0a80117;
+const uint32_t kFakeServerIdentifier = 0xc0a80101;
+const uint16_t kFakeIPIdentification = 0x1f2e;
+const uint16_t kFakeSeconds = 3;
+const uint16_t kDHCPClientPort = 68;
+const uint16_t kDHCPServerPort = 67;
+const size_t kHeaderLength = sizeof(struct iphdr) + sizeof(struct udphdr);
+
+struct FrameFields {
+  uint32_t transaction_id;
+  uint16_t seconds;
+  uint16_t ip_identification;
+  uint32_t requested_ip_address;
+  uint32_t server_identifier;
+};
+
+// Builds a frame the same way DHCPV4::MakeRawPacket does.
+ByteString BuildFrame(const FrameFields& fields) {
+  DHCPMessage message;
+  DHCPMessage::InitRequest(&message);
+  message.SetMessageType(kDHCPMessageTypeRequest);
+  message.SetTransactionID(fields.transaction_id);
+  message.SetClientIPAddress(0);
+  message.SetClientHardwareAddress(
+      ByteString(kFakeHardwareAddress, sizeof(kFakeHardwareAddress)));
+  message.SetRequestedIpAddress(fields.requested_ip_address);
+  message.SetServerIdentifier(fields.server_identifier);
+  message.SetParameterRequestList(std::vector<uint8_t>(
+      {kDHCPOptionSubnetMask, kDHCPOptionRouter, kDHCPOptionDNSServer}));
+  ByteString payload;
+  EXPECT_TRUE(message.Serialize(&payload));
+  // DHCPMessage has no setter for secs, write it into the payload.
+  payload.GetData()[8] = static_cast<uint8_t>(fields.seconds >> 8);
+  payload.GetData()[9] = static_cast<uint8_t>(fields.seconds);
+
+  std::vector<uint8_t> buffer(kHeaderLength + payload.GetLength(), 0);
+  struct iphdr* ip = reinterpret_cast<struct iphdr*>(buffer.data());
+  struct udphdr* udp =
+      reinterpret_cast<struct udphdr*>(buffer.data() + sizeof(*ip));
+  memcpy(buffer.data() + kHeaderLength,
+         payload.GetConstData(),
+         payload.GetLength());
+  udp->uh_sport = htons(kDHCPClientPort);
+  udp->uh_dport = htons(kDHCPServerPort);
+  udp->uh_ulen =
+      htons(static_cast<uint16_t>(sizeof(*udp) + payload.GetLength()));
+  // Pseudo header.
+  ip->protocol = IPPROTO_UDP;
+  ip->saddr = htonl(INADDR_ANY);
+  ip->daddr = htonl(INADDR_BROADCAST);
+  ip->tot_len = udp->uh_ulen;
+  udp->uh_sum = htons(DHCPMessage::ComputeChecksum(buffer.data(),
+                                                   buffer.size()));
+  if (udp->uh_sum == 0) {
+    udp->uh_sum = 0xffff;
+  }
+  ip->version = IPVERSION;
+  ip->ihl = sizeof(*ip) >> 2;
+  ip->id = htons(fields.ip_identification);
+  ip->ttl = IPDEFTTL;
+  ip->tot_len = htons(static_cast<uint16_t>(buffer.size()));
+  ip->check = htons(DHCPMessage::ComputeChecksum(buffer.data(), sizeof(*ip)));
+  return ByteString(buffer.data(), buffer.size());
+}
+
+bool IPChecksumIsValid(const ByteString& frame) {
+  return DHCPMessage::ComputeChecksum(frame.GetConstData(),
+                                      sizeof(struct iphdr)) == 0;
+}
+
+bool UDPChecksumIsValid(const ByteString& frame) {
+  // Rebuild the pseudo header in place of the IP header.
+  std::vector<uint8_t> buffer(frame.GetConstData(),
+                              frame.GetConstData() + frame.GetLength());
+  const struct udphdr* udp =
+      reinterpret_cast<const struct udphdr*>(
+          buffer.data() + sizeof(struct iphdr));
+  struct iphdr* ip = reinterpret_cast<struct iphdr*>(buffer.data());
+  uint32_t saddr = ip->saddr;
+  uint32_t daddr = ip->daddr;
+  memset(ip, 0, sizeof(*ip));
+  ip->protocol = IPPROTO_UDP;
+  ip->saddr = saddr;
+  ip->daddr = daddr;
+  ip->tot_len = udp->uh_ulen;
+  return DHCPMessage::ComputeChecksum(buffer.data(), buffer.size()) == 0;
+}
+
+}  // namespace
+
+class FrameTemplateTest : public testing::Test {
+ protected:
+  FrameTemplateTest() {
+    fields_.transaction_id = kFakeTransactionID;
+    fields_.seconds = 0;
+    fields_.ip_identification = 1;
+    fields_.requested_ip_address = kFakeRequestedIPAddress;
+    fields_.server_identifier = kFakeServerIdentifier;
+  }
+
+  ByteString GetFrame() const {
+    ByteString frame;
+    frame_template_.CopyTo(&frame);
+    return frame;
+  }
+
+  FrameFields fields_;
+  FrameTemplate frame_template_;
+};
+
+TEST_F(FrameTemplateTest, InitLocatesOptions) {
+  EXPECT_FALSE(frame_template_.IsInitialized());
+  EXPECT_TRUE(frame_template_.Init(BuildFrame(fields_)));
+  EXPECT_TRUE(frame_template_.IsInitialized());
+  EXPECT_TRUE(frame_template_.HasRequestedIPAddress());
+  EXPECT_TRUE(frame_template_.HasServerIdentifier());
+  EXPECT_EQ(INADDR_ANY, frame_template_.source_address());
+  EXPECT_EQ(INADDR_BROADCAST, frame_template_.destination_address());
+}
+
+TEST_F(FrameTemplateTest, InitWithoutOptions) {
+  fields_.requested_ip_address = 0;
+  fields_.server_identifier = 0;
+  EXPECT_TRUE(frame_template_.Init(BuildFrame(fields_)));
+  EXPECT_FALSE(frame_template_.HasRequestedIPAddress());
+  EXPECT_FALSE(frame_template_.HasServerIdentifier());
+  EXPECT_FALSE(frame_template_.SetRequestedIPAddress(kFakeRequestedIPAddress));
+  EXPECT_FALSE(frame_template_.SetServerIdentifier(kFakeServerIdentifier));
+}
+
+TEST_F(FrameTemplateTest, InitRejectsShortFrame) {
+  ByteString frame = BuildFrame(fields_);
+  frame.Resize(kHeaderLength + 100);
+  EXPECT_FALSE(frame_template_.Init(frame));
+  EXPECT_FALSE(frame_template_.IsInitialized());
+}
+
+TEST_F(FrameTemplateTest, PatchedFrameMatchesRebuild) {
+  EXPECT_TRUE(frame_template_.Init(BuildFrame(fields_)));
+  fields_.transaction_id = 0x01020304;
+  fields_.seconds = kFakeSeconds;
+  fields_.ip_identification = kFakeIPIdentification;
+  fields_.requested_ip_address = 0x0a000005;
+  fields_.server_identifier = 0x0a000001;
+  frame_template_.SetTransactionID(fields_.transaction_id);
+  frame_template_.SetSeconds(fields_.seconds);
+  frame_template_.SetIPIdentification(fields_.ip_identification);
+  EXPECT_TRUE(
+      frame_template_.SetRequestedIPAddress(fields_.requested_ip_address));
+  EXPECT_TRUE(frame_template_.SetServerIdentifier(fields_.server_identifier));
+  EXPECT_TRUE(GetFrame().Equals(BuildFrame(fields_)));
+  EXPECT_TRUE(IPChecksumIsValid(GetFrame()));
+  EXPECT_TRUE(UDPChecksumIsValid(GetFrame()));
+}
+
+TEST_F(FrameTemplateTest, RepeatedPatchesKeepChecksumsValid) {
+  EXPECT_TRUE(frame_template_.Init(BuildFrame(fields_)));
+  for (uint32_t i = 0; i < 1000; i++) {
+    uint32_t transaction_id = i * 0x9e3779b9;
+    frame_template_.SetTransactionID(transaction_id);
+    frame_template_.SetSeconds(static_cast<uint16_t>(i));
+    frame_template_.SetIPIdentification(static_cast<uint16_t>(~i));
+    EXPECT_TRUE(IPChecksumIsValid(GetFrame()));
+    EXPECT_TRUE(UDPChecksumIsValid(GetFrame()));
+  }
+}
+
+TEST_F(FrameTemplateTest, SegmentsHoldHeadersAndMessage) {
+  ByteString frame = BuildFrame(fields_);
+  EXPECT_TRUE(frame_template_.Init(frame));
+  frame_template_.SetTransactionID(0x01020304);
+  const struct iovec* segments = frame_template_.segments();
+  ASSERT_EQ(2u, FrameTemplate::kSegmentCount);
+  EXPECT_EQ(kHeaderLength, segments[0].iov_len);
+  EXPECT_EQ(frame.GetLength() - kHeaderLength, segments[1].iov_len);
+  EXPECT_EQ(frame.GetLength(), frame_template_.length());
+  // The UDP checksum still holds over the segments.
+  struct iovec udp_segments[2] = {segments[0], segments[1]};
+  udp_segments[0].iov_base =
+      static_cast<uint8_t*>(udp_segments[0].iov_base) + sizeof(struct iphdr);
+  udp_segments[0].iov_len -= sizeof(struct iphdr);
+  EXPECT_EQ(0, ComputeUDPChecksum(INADDR_ANY, INADDR_BROADCAST,
+                                  udp_segments, 2));
+}
+
+TEST_F(FrameTemplateTest, UpdateChecksum) {
+  // Changing a covered word from 0x5555 to 0x3285 in a block whose
+  // checksum was 0xdd2f (RFC 1624 section 4).
+  EXPECT_EQ(0x0000, FrameTemplate::UpdateChecksum(0xdd2f, 0x5555, 0x3285));
+  // No change in the covered data keeps the checksum.
+  EXPECT_EQ(0x1234, FrameTemplate::UpdateChecksum(0x1234, 0xabcd, 0xabcd));
+}
+
+}  // namespace dhcp_client
@@ -0,0 +1,162 @@
+//
+// Copyright (C) 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+
+#include "dhcp_client/frame_writer.h"
+
+#include <netinet/in.h>
+
+#include <cstring>
+
+#include <base/logging.h>
+
+#include "dhcp_client/dhcp_options.h"
+
+namespace dhcp_client {
+
+namespace {
+// Option code and length bytes.
+const size_t kOptionHeaderLength = 2;
+const size_t kOptionMaxLength = 255;
+}  // namespace
+
+FrameWriter::FrameWriter(uint8_t* buffer, size_t capacity)
+    : buffer_(buffer),
+      capacity_(capacity),
+      length_(0),
+      overflowed_(false) {}
+
+FrameWriter::~FrameWriter() {}
+
+uint8_t* FrameWriter::Append(size_t length) {
+  if (overflowed_ || length > capacity_ - length_) {
+    overflowed_ = true;
+    return nullptr;
+  }
+  uint8_t* field = buffer_ + length_;
+  length_ += length;
+  return field;
+}
+
+uint8_t* FrameWriter::AppendOption(uint8_t option_code, size_t length) {
+  if (length > kOptionMaxLength) {
+    LOG(ERROR) << "Option " << static_cast<int>(option_code)
+               << " is too long: " << length << " bytes";
+    overflowed_ = true;
+    return nullptr;
+  }
+  uint8_t* option = Append(kOptionHeaderLength + length);
+  if (option == nullptr) {
+    return nullptr;
+  }
+  option[0] = option_code;
+  option[1] = static_cast<uint8_t>(length);
+  return option + kOptionHeaderLength;
+}
+
+uint8_t* FrameWriter::Skip(size_t length) {
+  uint8_t* field = Append(length);
+  if (field != nullptr) {
+    memset(field, 0, length);
+  }
+  return field;
+}
+
+bool FrameWriter::WriteBytes(const void* data, size_t length) {
+  uint8_t* field = Append(length);
+  if (field == nullptr) {
+    return false;
+  }
+  memcpy(field, data, length);
+  return true;
+}
+
+bool FrameWriter::WriteUInt8Option(uint8_t option_code, uint8_t value) {
+  uint8_t* option = AppendOption(option_code, sizeof(value));
+  if (option == nullptr) {
+    return false;
+  }
+  *option = value;
+  return true;
+}
+
+bool FrameWriter::WriteUInt16Option(uint8_t option_code, uint16_t value) {
+  uint8_t* option = AppendOption(option_code, sizeof(value));
+  if (option == nullptr) {
+    return false;
+  }
+  uint16_t value_net = htons(value);
+  memcpy(option, &value_net, sizeof(value_net));
+  return true;
+}
+
+bool FrameWriter::WriteUInt32Option(uint8_t option_code, uint32_t value) {
+  uint8_t* option = AppendOption(option_code, sizeof(value));
+  if (option == nullptr) {
+    return false;
+  }
+  uint32_t value_net = htonl(value);
+  memcpy(option, &value_net, sizeof(value_net));
+  return true;
+}
+
+bool FrameWriter::WriteUInt8ListOption(uint8_t option_code,
+                                       const std::vector<uint8_t>& value) {
+  if (value.size() == 0) {
+    LOG(ERROR) << "Failed to write option: " << static_cast<int>(option_code)
+               << ", because value size cannot be 0";
+    return false;
+  }
+  return WriteByteArrayOption(option_code, &value[0], value.size());
+}
+
+bool FrameWriter::WriteStringOption(uint8_t option_code,
+                                    const std::string& value) {
+  if (value.size() == 0) {
+    LOG(ERROR) << "Failed to write option: " << static_cast<int>(option_code)
+               << ", because value size cannot be 0";
+    return false;
+  }
+  return WriteByteArrayOption(
+      option_code, reinterpret_cast<const uint8_t*>(value.data()),
+      value.size());
+}
+
+bool FrameWriter::WriteByteArrayOption(uint8_t option_code,
+                                       const uint8_t* value,
+                                       size_t length) {
+  uint8_t* option = AppendOption(option_code, length);
+  if (option == nullptr) {
+    return false;
+  }
+  memcpy(option, value, length);
+  return true;
+}
+
+bool FrameWriter::WriteFlagOption(uint8_t option_code) {
+  return AppendOption(option_code, 0) != nullptr;
+}
+
+bool FrameWriter::WriteEndTag() {
+  uint8_t* tag = Append(1);
+  if (tag == nullptr) {
+    return false;
+  }
+  *tag = kDHCPOptionEnd;
+  return true;
+}
+
+}  // namespace dhcp_client
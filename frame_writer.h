@@ -0,0 +1,90 @@
+//
+// Copyright (C) 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+
+#ifndef DHCP_CLIENT_FRAME_WRITER_H_
+#define DHCP_CLIENT_FRAME_WRITER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <base/macros.h>
+
+namespace dhcp_client {
+
+// RFC 2131 section 2: a DHCP client must be prepared to receive an IP
+// datagram of up to 576 bytes, the frames we send never exceed it.
+const size_t kMaxDHCPFrameLength = 576;
+
+// Bytes written into storage owned by someone else.
+struct FrameSpan {
+  const uint8_t* data;
+  size_t length;
+};
+
+// Writes a frame into caller provided storage of a fixed capacity.
+// Every write checks the bounds once for the whole field and fails
+// without writing anything if it does not fit, after which all the
+// writes fail. Nothing is allocated or copied around.
+class FrameWriter {
+ public:
+  FrameWriter(uint8_t* buffer, size_t capacity);
+  ~FrameWriter();
+
+  // Reserve |length| zeroed bytes and return where they start, for
+  // fields filled in after the rest of the frame. Returns null if they
+  // do not fit.
+  uint8_t* Skip(size_t length);
+  bool WriteBytes(const void* data, size_t length);
+
+  // DHCP options, in the TLV format of RFC 2132.
+  bool WriteUInt8Option(uint8_t option_code, uint8_t value);
+  bool WriteUInt16Option(uint8_t option_code, uint16_t value);
+  bool WriteUInt32Option(uint8_t option_code, uint32_t value);
+  bool WriteUInt8ListOption(uint8_t option_code,
+                            const std::vector<uint8_t>& value);
+  bool WriteStringOption(uint8_t option_code, const std::string& value);
+  bool WriteByteArrayOption(uint8_t option_code,
+                            const uint8_t* value,
+                            size_t length);
+  // Write an option without a value.
+  bool WriteFlagOption(uint8_t option_code);
+  bool WriteEndTag();
+
+  // The bytes written so far.
+  FrameSpan span() const { return FrameSpan{buffer_, length_}; }
+  size_t length() const { return length_; }
+  bool overflowed() const { return overflowed_; }
+
+ private:
+  // Reserve room for an option with a |length| bytes value, write its
+  // code and length and return where the value goes.
+  uint8_t* AppendOption(uint8_t option_code, size_t length);
+  uint8_t* Append(size_t length);
+
+  uint8_t* buffer_;
+  size_t capacity_;
+  size_t length_;
+  bool overflowed_;
+
+  DISALLOW_COPY_AND_ASSIGN(FrameWriter);
+};
+
+}  // namespace dhcp_client
+
+#endif  // DHCP_CLIENT_FRAME_WRITER_H_
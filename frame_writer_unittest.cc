@@ -0,0 +1,144 @@
+//
+// Copyright (C) 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+
+#include "dhcp_client/frame_writer.h"
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include <shill/net/byte_string.h>
+
+#include "dhcp_client/dhcp_message.h"
+#include "dhcp_client/dhcp_options.h"
+
+using shill::ByteString;
+
+namespace dhcp_client {
+
+namespace {
+const uint8_t kFakeOptionCode1 = 3;
+const uint8_t kFakeOptionCode2 = 45;
+const uint8_t kFakeHardwareAddress[] = {0x02, 0x1a, 0x2b, 0x3c, 0x4d, 0x5e};
+}  // namespace
+
+class FrameWriterTest : public testing::Test {
+ public:
+  FrameWriterTest() : writer_(buffer_, sizeof(buffer_)) {}
+
+ protected:
+  uint8_t buffer_[kMaxDHCPFrameLength];
+  FrameWriter writer_;
+};
+
+TEST_F(FrameWriterTest, WriteOptions) {
+  const uint8_t kExpectedOptions[] = {
+      kFakeOptionCode1, sizeof(uint8_t), 0x22,
+      kFakeOptionCode1, sizeof(uint16_t), 0x01, 0x02,
+      kFakeOptionCode1, sizeof(uint32_t), 0x01, 0x02, 0x03, 0x04,
+      kFakeOptionCode2, 3, 0x01, 0x03, 0x06,
+      kFakeOptionCode2, 4, 'f', 'a', 'k', 'e',
+      kFakeOptionCode2, 0,
+      kDHCPOptionEnd};
+  EXPECT_TRUE(writer_.WriteUInt8Option(kFakeOptionCode1, 0x22));
+  EXPECT_TRUE(writer_.WriteUInt16Option(kFakeOptionCode1, 0x0102));
+  EXPECT_TRUE(writer_.WriteUInt32Option(kFakeOptionCode1, 0x01020304));
+  EXPECT_TRUE(writer_.WriteUInt8ListOption(kFakeOptionCode2,
+                                           std::vector<uint8_t>{1, 3, 6}));
+  EXPECT_TRUE(writer_.WriteStringOption(kFakeOptionCode2, "fake"));
+  EXPECT_TRUE(writer_.WriteFlagOption(kFakeOptionCode2));
+  EXPECT_TRUE(writer_.WriteEndTag());
+  FrameSpan span = writer_.span();
+  // The span refers to the caller storage.
+  EXPECT_EQ(buffer_, span.data);
+  ASSERT_EQ(sizeof(kExpectedOptions), span.length);
+  EXPECT_EQ(0, memcmp(kExpectedOptions, span.data, span.length));
+}
+
+TEST_F(FrameWriterTest, SkipZeroes) {
+  memset(buffer_, 0xff, sizeof(buffer_));
+  EXPECT_TRUE(writer_.WriteUInt8Option(kFakeOptionCode1, 0x22));
+  uint8_t* field = writer_.Skip(4);
+  ASSERT_EQ(buffer_ + 3, field);
+  for (int i = 0; i < 4; i++) {
+    EXPECT_EQ(0, field[i]);
+  }
+  EXPECT_EQ(7u, writer_.length());
+}
+
+TEST_F(FrameWriterTest, RejectsOverflow) {
+  uint8_t buffer[5];
+  FrameWriter writer(buffer, sizeof(buffer));
+  EXPECT_TRUE(writer.WriteUInt8Option(kFakeOptionCode1, 0x22));
+  // Needs 6 bytes, 2 are left: nothing is written.
+  EXPECT_FALSE(writer.WriteUInt32Option(kFakeOptionCode1, 0x01020304));
+  EXPECT_TRUE(writer.overflowed());
+  EXPECT_EQ(3u, writer.length());
+  // A frame missing a field must not be completed.
+  EXPECT_FALSE(writer.WriteEndTag());
+  EXPECT_EQ(nullptr, writer.Skip(1));
+  EXPECT_EQ(3u, writer.length());
+}
+
+TEST_F(FrameWriterTest, RejectsLongOption) {
+  EXPECT_FALSE(writer_.WriteStringOption(kFakeOptionCode1,
+                                         std::string(256, 'a')));
+  EXPECT_TRUE(writer_.overflowed());
+  EXPECT_EQ(0u, writer_.length());
+}
+
+TEST_F(FrameWriterTest, RejectsEmptyList) {
+  EXPECT_FALSE(writer_.WriteUInt8ListOption(kFakeOptionCode1,
+                                            std::vector<uint8_t>()));
+  EXPECT_EQ(0u, writer_.length());
+}
+
+TEST_F(FrameWriterTest, SerializeInPlace) {
+  DHCPMessage message;
+  DHCPMessage::InitRequest(&message);
+  message.SetMessageType(kDHCPMessageTypeRequest);
+  message.SetTransactionID(0x3a1b2c4d);
+  message.SetClientHardwareAddress(
+      ByteString(kFakeHardwareAddress, sizeof(kFakeHardwareAddress)));
+  message.SetRequestedIpAddress(0xc0a80117);
+  message.SetServerIdentifier(0xc0a80101);
+  message.SetParameterRequestList(std::vector<uint8_t>(
+      {kDHCPOptionSubnetMask, kDHCPOptionRouter, kDHCPOptionDNSServer}));
+  ByteString expected;
+  ASSERT_TRUE(message.Serialize(&expected));
+  // The message goes after the headers already written.
+  ASSERT_NE(nullptr, writer_.Skip(28));
+  ASSERT_TRUE(message.Serialize(&writer_));
+  ASSERT_EQ(28 + expected.GetLength(), writer_.length());
+  EXPECT_EQ(0, memcmp(expected.GetConstData(), buffer_ + 28,
+                      expected.GetLength()));
+}
+
+TEST_F(FrameWriterTest, SerializeRejectsSmallBuffer) {
+  DHCPMessage message;
+  DHCPMessage::InitRequest(&message);
+  message.SetMessageType(kDHCPMessageTypeDiscover);
+  message.SetClientHardwareAddress(
+      ByteString(kFakeHardwareAddress, sizeof(kFakeHardwareAddress)));
+  uint8_t buffer[240];
+  FrameWriter writer(buffer, sizeof(buffer));
+  EXPECT_FALSE(message.Serialize(&writer));
+  EXPECT_TRUE(writer.overflowed());
+}
+
+}  // namespace dhcp_client
@@ -0,0 +1,82 @@
+//
+// Copyright (C) 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+
+#ifndef DHCP_CLIENT_LEASE_APPLIER_INTERFACE_H_
+#define DHCP_CLIENT_LEASE_APPLIER_INTERFACE_H_
+
+#include <cstdint>
+#include <vector>
+
+namespace dhcp_client {
+
+// An IPv4 route of a lease. Addresses are in host byte order.
+struct Route {
+  Route() : destination(0), prefix_length(0), gateway(0) {}
+  Route(uint32_t destination, uint8_t prefix_length, uint32_t gateway)
+      : destination(destination),
+        prefix_length(prefix_length),
+        gateway(gateway) {}
+
+  bool operator==(const Route& other) const {
+    return destination == other.destination &&
+           prefix_length == other.prefix_length &&
+           gateway == other.gateway;
+  }
+  bool operator!=(const Route& other) const { return !(*this == other); }
+
+  uint32_t destination;
+  uint8_t prefix_length;
+  // 0 for a route to a directly attached network.
+  uint32_t gateway;
+};
+
+// The configuration of an interface derived from an acknowledged lease.
+struct NetworkConfig {
+  NetworkConfig() : address(0), prefix_length(0) {}
+
+  bool operator==(const NetworkConfig& other) const {
+    return address == other.address &&
+           prefix_length == other.prefix_length &&
+           routes == other.routes;
+  }
+  bool operator!=(const NetworkConfig& other) const {
+    return !(*this == other);
+  }
+
+  // In host byte order, 0 if no address is configured.
+  uint32_t address;
+  uint8_t prefix_length;
+  std::vector<Route> routes;
+};
+
+// Abstract class for programming the configuration of a lease on the
+// interface of a DHCPV4 state machine.
+class LeaseApplierInterface {
+ public:
+  virtual ~LeaseApplierInterface() {}
+
+  // Make |config| the configuration of the interface, replacing the one
+  // applied before. Returns false if any part of it could not be
+  // applied, in which case the next call applies it all again.
+  virtual bool Apply(const NetworkConfig& config) = 0;
+  // Remove everything applied so far.
+  virtual bool Clear() = 0;
+};
+
+}  // namespace dhcp_client
+
+#endif  // DHCP_CLIENT_LEASE_APPLIER_INTERFACE_H_
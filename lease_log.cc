@@ -0,0 +1,619 @@
+//
+// Copyright (C) 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+
+#include "dhcp_client/lease_log.h"
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+
+#include <base/bind.h>
+#include <base/files/file_util.h>
+#include <base/location.h>
+#include <base/logging.h>
+
+namespace dhcp_client {
+
+namespace {
+const int kInvalidFileDescriptor = -1;
+
+// The log starts with a magic number and a version.
+const uint32_t kLogMagic = 0x44484c47;  // "DHLG"
+const uint32_t kLogVersion = 1;
+const size_t kLogHeaderSize = 2 * sizeof(uint32_t);
+
+// The file grows by doubling, up to the address range reserved for it.
+const size_t kInitialFileSize = 64 * 1024;
+const size_t kMaxFileSize = 64 * 1024 * 1024;
+// Smaller logs are not worth compacting.
+const size_t kMinCompactionSize = 64 * 1024;
+
+const size_t kRecordAlignment = 8;
+const size_t kMaxNetworkIdLength = 1024;
+const size_t kLeaseDataLength = 4 * sizeof(uint32_t) + sizeof(uint64_t);
+
+// A record is this header, the network identifier and, for a save, the
+// lease. The checksum covers all the bytes after it. A zero length
+// marks the end of the log, the unused part of the file being zeroed.
+// The fields are in network byte order in the file.
+struct RecordHeader {
+  // Without the padding.
+  uint32_t length;
+  uint32_t checksum;
+  uint8_t type;
+  uint8_t reserved;
+  uint16_t network_id_length;
+};
+static_assert(sizeof(RecordHeader) == 12, "Unexpected record header size");
+const size_t kChecksumOffset = offsetof(RecordHeader, type);
+
+size_t AlignRecordSize(size_t size) {
+  return (size + kRecordAlignment - 1) & ~(kRecordAlignment - 1);
+}
+
+// CRC-32C (Castagnoli), reflected.
+class CRC32CTable {
+ public:
+  CRC32CTable() {
+    for (uint32_t i = 0; i < 256; i++) {
+      uint32_t crc = i;
+      for (int bit = 0; bit < 8; bit++) {
+        crc = (crc >> 1) ^ ((crc & 1) ? 0x82f63b78 : 0);
+      }
+      entries_[i] = crc;
+    }
+  }
+
+  uint32_t Compute(const char* data, size_t len) const {
+    uint32_t crc = 0xffffffff;
+    for (size_t i = 0; i < len; i++) {
+      crc = (crc >> 8) ^ entries_[(crc ^ static_cast<uint8_t>(data[i])) & 0xff];
+    }
+    return crc ^ 0xffffffff;
+  }
+
+ private:
+  uint32_t entries_[256];
+};
+
+uint32_t ComputeCRC32C(const char* data, size_t len) {
+  static const CRC32CTable table;
+  return table.Compute(data, len);
+}
+
+void AppendUInt32(uint32_t value, std::string* data) {
+  uint32_t network_value = htonl(value);
+  data->append(reinterpret_cast<const char*>(&network_value),
+               sizeof(network_value));
+}
+
+uint32_t ReadUInt32(const char* data) {
+  uint32_t network_value;
+  memcpy(&network_value, data, sizeof(network_value));
+  return ntohl(network_value);
+}
+
+// Make a rename in |directory| durable.
+void SyncDirectory(const base::FilePath& directory) {
+  int fd = open(directory.value().c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (fd == kInvalidFileDescriptor) {
+    PLOG(ERROR) << "Failed to open " << directory.value();
+    return;
+  }
+  if (fsync(fd) != 0) {
+    PLOG(ERROR) << "Failed to sync " << directory.value();
+  }
+  close(fd);
+}
+}  // namespace
+
+LeaseLog::LeaseLog(const base::FilePath& path)
+    : path_(path),
+      io_thread_("lease_log_io"),
+      fd_(kInvalidFileDescriptor),
+      mapping_(nullptr),
+      file_size_(0),
+      append_offset_(0),
+      live_size_(0),
+      synced_offset_(0),
+      sync_pending_(false),
+      compaction_pending_(false) {
+}
+
+LeaseLog::~LeaseLog() {
+  // Let the pending sync and compaction finish first.
+  io_thread_.Stop();
+  if (mapping_ && synced_offset_ < append_offset_) {
+    SyncRange(mapping_, synced_offset_, append_offset_);
+  }
+  Unmap();
+}
+
+bool LeaseLog::Open() {
+  if (!base::CreateDirectory(path_.DirName())) {
+    PLOG(ERROR) << "Failed to create directory of " << path_.value();
+    return false;
+  }
+  int fd = open(path_.value().c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+  if (fd == kInvalidFileDescriptor) {
+    PLOG(ERROR) << "Failed to open " << path_.value();
+    return false;
+  }
+  struct stat file_stat;
+  if (fstat(fd, &file_stat) != 0) {
+    PLOG(ERROR) << "Failed to stat " << path_.value();
+    close(fd);
+    return false;
+  }
+  size_t file_size = static_cast<size_t>(file_stat.st_size);
+  if (file_size < kInitialFileSize) {
+    // A new log, or one whose creation did not complete. The missing
+    // part of the file reads as zeros.
+    if (ftruncate(fd, kInitialFileSize) != 0) {
+      PLOG(ERROR) << "Failed to resize " << path_.value();
+      close(fd);
+      return false;
+    }
+    file_size = kInitialFileSize;
+  } else if (file_size > kMaxFileSize) {
+    // Only the reserved address range is mapped, and the log never grows
+    // past it: what lies beyond can not be a record.
+    LOG(WARNING) << "Truncating oversized " << path_.value();
+    if (ftruncate(fd, kMaxFileSize) != 0) {
+      PLOG(ERROR) << "Failed to resize " << path_.value();
+      close(fd);
+      return false;
+    }
+    file_size = kMaxFileSize;
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!MapAndRecover(fd, file_size)) {
+    Unmap();
+    return false;
+  }
+  if (!io_thread_.Start()) {
+    LOG(WARNING) << "Lease log compaction is disabled, saves are synced "
+                 << "by the caller";
+  }
+  return true;
+}
+
+bool LeaseLog::Load(const std::string& network_id, Lease* lease) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = entries_.find(network_id);
+  if (it == entries_.end()) {
+    return false;
+  }
+  *lease = it->second.lease;
+  return true;
+}
+
+bool LeaseLog::Save(const std::string& network_id, const Lease& lease) {
+  if (network_id.size() > kMaxNetworkIdLength) {
+    LOG(ERROR) << "Network identifier too long: " << network_id;
+    return false;
+  }
+  std::string record;
+  AppendRecord(kRecordTypeSave, network_id, &lease, &record);
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!AppendLocked(record)) {
+    return false;
+  }
+  Entry& entry = entries_[network_id];
+  live_size_ += record.size() - entry.record_size;
+  entry.lease = lease;
+  entry.record_size = record.size();
+  MaybeCompactLocked();
+  return ScheduleSyncLocked();
+}
+
+bool LeaseLog::Remove(const std::string& network_id) {
+  std::string record;
+  AppendRecord(kRecordTypeRemove, network_id, nullptr, &record);
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = entries_.find(network_id);
+  if (it == entries_.end()) {
+    return true;
+  }
+  if (!AppendLocked(record)) {
+    return false;
+  }
+  live_size_ -= it->second.record_size;
+  entries_.erase(it);
+  MaybeCompactLocked();
+  return ScheduleSyncLocked();
+}
+
+// static
+void LeaseLog::SerializeLease(const Lease& lease, std::string* data) {
+  AppendUInt32(lease.ip_address, data);
+  AppendUInt32(lease.subnet_mask, data);
+  AppendUInt32(lease.server_identifier, data);
+  AppendUInt32(lease.lease_time, data);
+  uint64_t acquisition_time = static_cast<uint64_t>(lease.acquisition_time);
+  AppendUInt32(static_cast<uint32_t>(acquisition_time >> 32), data);
+  AppendUInt32(static_cast<uint32_t>(acquisition_time), data);
+}
+
+// static
+bool LeaseLog::ParseLease(const char* data, size_t len, Lease* lease) {
+  if (len != kLeaseDataLength) {
+    return false;
+  }
+  lease->ip_address = ReadUInt32(data);
+  lease->subnet_mask = ReadUInt32(data + 4);
+  lease->server_identifier = ReadUInt32(data + 8);
+  lease->lease_time = ReadUInt32(data + 12);
+  uint64_t acquisition_time = static_cast<uint64_t>(ReadUInt32(data + 16))
+      << 32;
+  acquisition_time |= ReadUInt32(data + 20);
+  lease->acquisition_time = static_cast<int64_t>(acquisition_time);
+  return true;
+}
+
+// static
+void LeaseLog::AppendRecord(RecordType type,
+                            const std::string& network_id,
+                            const Lease* lease,
+                            std::string* data) {
+  size_t start = data->size();
+  RecordHeader header;
+  memset(&header, 0, sizeof(header));
+  header.type = type;
+  header.network_id_length =
+      htons(static_cast<uint16_t>(network_id.size()));
+  data->append(reinterpret_cast<const char*>(&header), sizeof(header));
+  data->append(network_id);
+  if (lease) {
+    SerializeLease(*lease, data);
+  }
+  size_t length = data->size() - start;
+  uint32_t checksum = ComputeCRC32C(data->data() + start + kChecksumOffset,
+                                    length - kChecksumOffset);
+  uint32_t length32 = htonl(static_cast<uint32_t>(length));
+  checksum = htonl(checksum);
+  data->replace(start + offsetof(RecordHeader, length), sizeof(length32),
+                reinterpret_cast<const char*>(&length32), sizeof(length32));
+  data->replace(start + offsetof(RecordHeader, checksum), sizeof(checksum),
+                reinterpret_cast<const char*>(&checksum), sizeof(checksum));
+  data->resize(start + AlignRecordSize(length), '\0');
+}
+
+bool LeaseLog::MapAndRecover(int fd, size_t file_size) {
+  void* mapping = mmap(nullptr, kMaxFileSize, PROT_READ | PROT_WRITE,
+                       MAP_SHARED, fd, 0);
+  if (mapping == MAP_FAILED) {
+    PLOG(ERROR) << "Failed to map " << path_.value();
+    close(fd);
+    return false;
+  }
+  fd_ = fd;
+  mapping_ = static_cast<char*>(mapping);
+  file_size_ = file_size;
+
+  uint32_t magic = ReadUInt32(mapping_);
+  if (magic == 0) {
+    std::string header;
+    AppendUInt32(kLogMagic, &header);
+    AppendUInt32(kLogVersion, &header);
+    memcpy(mapping_, header.data(), header.size());
+  } else if (magic != kLogMagic ||
+             ReadUInt32(mapping_ + sizeof(magic)) != kLogVersion) {
+    LOG(ERROR) << path_.value() << " is not a lease log";
+    return false;
+  }
+
+  entries_.clear();
+  live_size_ = kLogHeaderSize;
+  size_t offset = kLogHeaderSize;
+  while (size_t record_size = ReplayRecord(offset)) {
+    offset += record_size;
+  }
+  append_offset_ = offset;
+  // Clear what is left of a torn record, so that it can not be taken
+  // for the end of a record appended over it later.
+  char* end = mapping_ + file_size_;
+  if (std::find_if(mapping_ + append_offset_, end,
+                   [](char c) { return c != 0; }) != end) {
+    LOG(WARNING) << "Dropping the torn end of " << path_.value();
+    memset(mapping_ + append_offset_, 0, file_size_ - append_offset_);
+  }
+  if (msync(mapping_, file_size_, MS_SYNC) != 0) {
+    PLOG(ERROR) << "Failed to sync " << path_.value();
+    return false;
+  }
+  synced_offset_ = append_offset_;
+  return true;
+}
+
+void LeaseLog::Unmap() {
+  if (mapping_) {
+    munmap(mapping_, kMaxFileSize);
+    mapping_ = nullptr;
+  }
+  if (fd_ != kInvalidFileDescriptor) {
+    close(fd_);
+    fd_ = kInvalidFileDescriptor;
+  }
+}
+
+size_t LeaseLog::ReplayRecord(size_t offset) {
+  if (file_size_ - offset < sizeof(RecordHeader)) {
+    return 0;
+  }
+  const char* record = mapping_ + offset;
+  RecordHeader header;
+  memcpy(&header, record, sizeof(header));
+  header.length = ntohl(header.length);
+  header.checksum = ntohl(header.checksum);
+  header.network_id_length = ntohs(header.network_id_length);
+  size_t record_size = AlignRecordSize(header.length);
+  if (header.length < sizeof(header) ||
+      record_size > file_size_ - offset ||
+      header.network_id_length > header.length - sizeof(header)) {
+    return 0;
+  }
+  if (ComputeCRC32C(record + kChecksumOffset,
+                    header.length - kChecksumOffset) != header.checksum) {
+    return 0;
+  }
+  std::string network_id(record + sizeof(header), header.network_id_length);
+  const char* lease_data = record + sizeof(header) + network_id.size();
+  size_t lease_data_len = header.length - sizeof(header) - network_id.size();
+  if (header.type != kRecordTypeSave && header.type != kRecordTypeRemove) {
+    return 0;
+  }
+  Lease lease;
+  if (header.type == kRecordTypeSave &&
+      !ParseLease(lease_data, lease_data_len, &lease)) {
+    return 0;
+  }
+  auto it = entries_.find(network_id);
+  if (it != entries_.end()) {
+    live_size_ -= it->second.record_size;
+    entries_.erase(it);
+  }
+  if (header.type == kRecordTypeSave) {
+    Entry& entry = entries_[network_id];
+    entry.lease = lease;
+    entry.record_size = record_size;
+    live_size_ += record_size;
+  }
+  return record_size;
+}
+
+bool LeaseLog::AppendLocked(const std::string& record) {
+  if (mapping_ == nullptr) {
+    LOG(ERROR) << "Lease log is not open";
+    return false;
+  }
+  if (!ReserveLocked(append_offset_ + record.size())) {
+    return false;
+  }
+  memcpy(mapping_ + append_offset_, record.data(), record.size());
+  append_offset_ += record.size();
+  return true;
+}
+
+bool LeaseLog::ReserveLocked(size_t size) {
+  if (size <= file_size_) {
+    return true;
+  }
+  if (size > kMaxFileSize) {
+    LOG(ERROR) << "Lease log is full";
+    return false;
+  }
+  size_t file_size = file_size_;
+  while (file_size < size) {
+    file_size *= 2;
+  }
+  file_size = std::min(file_size, kMaxFileSize);
+  if (ftruncate(fd_, file_size) != 0) {
+    PLOG(ERROR) << "Failed to resize " << path_.value();
+    return false;
+  }
+  file_size_ = file_size;
+  return true;
+}
+
+bool LeaseLog::ScheduleSyncLocked() {
+  if (sync_pending_) {
+    return true;
+  }
+  if (!io_thread_.IsRunning()) {
+    if (!SyncRange(mapping_, synced_offset_, append_offset_)) {
+      return false;
+    }
+    synced_offset_ = append_offset_;
+    return true;
+  }
+  // The sync covers every record appended until it runs.
+  sync_pending_ = true;
+  io_thread_.task_runner()->PostTask(
+      FROM_HERE, base::Bind(&LeaseLog::Sync, base::Unretained(this)));
+  return true;
+}
+
+void LeaseLog::MaybeCompactLocked() {
+  if (compaction_pending_ || !io_thread_.IsRunning() ||
+      append_offset_ < kMinCompactionSize || append_offset_ < 2 * live_size_) {
+    return;
+  }
+  compaction_pending_ = true;
+  io_thread_.task_runner()->PostTask(
+      FROM_HERE, base::Bind(&LeaseLog::Compact, base::Unretained(this)));
+}
+
+bool LeaseLog::SyncRange(char* mapping, size_t begin, size_t end) {
+  size_t page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+  begin &= ~(page_size - 1);
+  if (msync(mapping + begin, end - begin, MS_SYNC) != 0) {
+    PLOG(ERROR) << "Failed to sync " << path_.value();
+    return false;
+  }
+  return true;
+}
+
+void LeaseLog::Sync() {
+  // |io_thread_| is the only one to replace the mapping, so it can be
+  // synced without holding the lock.
+  char* mapping;
+  size_t begin;
+  size_t end;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    sync_pending_ = false;
+    if (mapping_ == nullptr || synced_offset_ >= append_offset_) {
+      return;
+    }
+    mapping = mapping_;
+    begin = synced_offset_;
+    end = append_offset_;
+  }
+  if (!SyncRange(mapping, begin, end)) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  synced_offset_ = std::max(synced_offset_, end);
+}
+
+void LeaseLog::Compact() {
+  // The lock is only held to snapshot the live leases and to copy the
+  // records appended since, the saves go on while the new log is
+  // written and synced.
+  std::string data;
+  size_t copied_offset;
+  size_t file_size;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (mapping_ == nullptr) {
+      compaction_pending_ = false;
+      return;
+    }
+    data.reserve(live_size_);
+    AppendUInt32(kLogMagic, &data);
+    AppendUInt32(kLogVersion, &data);
+    for (const auto& id_and_entry : entries_) {
+      AppendRecord(kRecordTypeSave, id_and_entry.first,
+                   &id_and_entry.second.lease, &data);
+    }
+    copied_offset = append_offset_;
+    // The live leases and the records appended after them never take
+    // more room than the old log.
+    file_size = file_size_;
+  }
+
+  base::FilePath compact_path = path_.AddExtension("compact");
+  int fd = open(compact_path.value().c_str(),
+                O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+  if (fd == kInvalidFileDescriptor) {
+    PLOG(ERROR) << "Failed to create " << compact_path.value();
+    std::lock_guard<std::mutex> lock(mutex_);
+    compaction_pending_ = false;
+    return;
+  }
+  char* mapping = nullptr;
+  if (base::WriteFileDescriptor(fd, data.data(),
+                                static_cast<int>(data.size())) &&
+      ftruncate(fd, file_size) == 0 && fdatasync(fd) == 0) {
+    void* new_mapping = mmap(nullptr, kMaxFileSize, PROT_READ | PROT_WRITE,
+                             MAP_SHARED, fd, 0);
+    if (new_mapping != MAP_FAILED) {
+      mapping = static_cast<char*>(new_mapping);
+    }
+  }
+  if (mapping == nullptr) {
+    PLOG(ERROR) << "Failed to compact " << path_.value();
+    close(fd);
+    unlink(compact_path.value().c_str());
+    std::lock_guard<std::mutex> lock(mutex_);
+    compaction_pending_ = false;
+    return;
+  }
+
+  // Copy to the new log the records appended to the old one since
+  // |copied_offset|. Called with the lock held.
+  size_t offset = data.size();
+  auto copy_tail_locked = [&]() {
+    size_t tail_size = append_offset_ - copied_offset;
+    if (offset + tail_size > file_size) {
+      if (ftruncate(fd, file_size_) != 0) {
+        return false;
+      }
+      file_size = file_size_;
+    }
+    memcpy(mapping + offset, mapping_ + copied_offset, tail_size);
+    copied_offset += tail_size;
+    offset += tail_size;
+    return true;
+  };
+
+  // Sync most of the tail before holding the saves for the switch.
+  bool success;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    success = copy_tail_locked();
+  }
+  size_t synced_offset = data.size();
+  if (success && SyncRange(mapping, synced_offset, offset)) {
+    synced_offset = offset;
+  }
+
+  // The new log must be complete on disk before it replaces the old
+  // one, a crash right after the rename would lose the rest otherwise.
+  std::unique_lock<std::mutex> lock(mutex_);
+  success = success && copy_tail_locked() &&
+            SyncRange(mapping, synced_offset, offset) &&
+            fdatasync(fd) == 0 &&
+            rename(compact_path.value().c_str(), path_.value().c_str()) == 0;
+  if (!success) {
+    PLOG(ERROR) << "Failed to compact " << path_.value();
+    compaction_pending_ = false;
+    lock.unlock();
+    munmap(mapping, kMaxFileSize);
+    close(fd);
+    unlink(compact_path.value().c_str());
+    return;
+  }
+  int old_fd = fd_;
+  char* old_mapping = mapping_;
+  fd_ = fd;
+  mapping_ = mapping;
+  file_size_ = file_size;
+  append_offset_ = offset;
+  synced_offset_ = offset;
+  lock.unlock();
+
+  // The old log is only read by this thread, it can go once the rename
+  // is durable.
+  SyncDirectory(path_.DirName());
+  munmap(old_mapping, kMaxFileSize);
+  close(old_fd);
+
+  lock.lock();
+  compaction_pending_ = false;
+}
+
+}  // namespace dhcp_client
@@ -0,0 +1,132 @@
+//
+// Copyright (C) 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+
+#ifndef DHCP_CLIENT_LEASE_LOG_H_
+#define DHCP_CLIENT_LEASE_LOG_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include <base/files/file_path.h>
+#include <base/macros.h>
+#include <base/threading/thread.h>
+
+#include "dhcp_client/lease_store_interface.h"
+
+namespace dhcp_client {
+
+// Keeps the leases of all the networks in a single append-only log.
+// The log file is memory mapped, and every save or removal appends a
+// checksummed record to it. The latest lease of each network is kept
+// in a hash table, so loads do not touch the file.
+// Saves and removals return once their record is in the mapping, the
+// file is synced on an I/O thread of the log: one msync() covers all
+// the records appended since the previous one, from every thread.
+// When most of the log is made of superseded records, it is rewritten
+// with the live leases only, on the same thread.
+// Open() recovers the leases by reading the log once from start to end,
+// a torn or corrupted record ends the log.
+// All the fields of the file, headers and leases, are in network byte
+// order.
+class LeaseLog : public LeaseStoreInterface {
+ public:
+  explicit LeaseLog(const base::FilePath& path);
+  ~LeaseLog() override;
+
+  bool Open();
+
+  bool Load(const std::string& network_id, Lease* lease) override;
+  bool Save(const std::string& network_id, const Lease& lease) override;
+  bool Remove(const std::string& network_id) override;
+
+ private:
+  friend class LeaseLogTest;
+
+  enum RecordType : uint8_t {
+    kRecordTypeSave = 1,
+    kRecordTypeRemove = 2
+  };
+
+  struct Entry {
+    Entry() : record_size(0) {}
+    Lease lease;
+    // Size of the record holding |lease|, padding included.
+    size_t record_size;
+  };
+
+  // Fixed size encoding of a lease, in network byte order.
+  static void SerializeLease(const Lease& lease, std::string* data);
+  static bool ParseLease(const char* data, size_t len, Lease* lease);
+  // Append to |data| a record, padded to the record alignment.
+  static void AppendRecord(RecordType type,
+                           const std::string& network_id,
+                           const Lease* lease,
+                           std::string* data);
+
+  // Map the file of |fd|, which has |file_size| bytes, and replay its
+  // records into |entries_|.
+  bool MapAndRecover(int fd, size_t file_size);
+  void Unmap();
+  // Apply the record at |offset| of the mapping. Returns the size of
+  // the record, or 0 if there is no valid record there.
+  size_t ReplayRecord(size_t offset);
+  bool AppendLocked(const std::string& record);
+  // Grow the file so that |size| bytes fit in it.
+  bool ReserveLocked(size_t size);
+  // Have the records appended so far synced by |io_thread_|, or right
+  // away if it is not running. Returns false if that sync failed.
+  bool ScheduleSyncLocked();
+  // Post a compaction if superseded records make most of the log.
+  void MaybeCompactLocked();
+  // Sync the mapping from |begin| to |end|.
+  bool SyncRange(char* mapping, size_t begin, size_t end);
+  // Run on |io_thread_|, which is the only thread that replaces the
+  // mapping once the log is open.
+  void Sync();
+  void Compact();
+
+  base::FilePath path_;
+  base::Thread io_thread_;
+
+  // Guards all the members below.
+  std::mutex mutex_;
+  int fd_;
+  // The whole address range the log can grow to is reserved up front,
+  // so that records never move while the file grows.
+  char* mapping_;
+  size_t file_size_;
+  // End of the last record.
+  size_t append_offset_;
+  // Bytes of the records of |entries_|, plus the file header.
+  size_t live_size_;
+  // The file is known to be on disk up to this offset.
+  size_t synced_offset_;
+  bool sync_pending_;
+  // Set from the time a compaction is posted until the compacted log
+  // has replaced the old one.
+  bool compaction_pending_;
+  std::unordered_map<std::string, Entry> entries_;
+
+  DISALLOW_COPY_AND_ASSIGN(LeaseLog);
+};
+
+}  // namespace dhcp_client
+
+#endif  // DHCP_CLIENT_LEASE_LOG_H_
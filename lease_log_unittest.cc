@@ -0,0 +1,240 @@
+//
+// Copyright (C) 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+
+#include "dhcp_client/lease_log.h"
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <base/files/file_util.h>
+#include <base/files/scoped_temp_dir.h>
+#include <base/strings/stringprintf.h>
+#include <gtest/gtest.h>
+
+namespace dhcp_client {
+
+namespace {
+const char kFakeNetworkIdentifier[] = "home_network";
+const char kOtherNetworkIdentifier[] = "office_network";
+const uint32_t kFakeIPAddress = 0xc0a80102;
+const uint32_t kFakeSubnetMask = 0xffffff00;
+const uint32_t kFakeServerIdentifier = 0xc0a80101;
+const uint32_t kFakeLeaseTime = 3600;
+const int64_t kFakeAcquisitionTime = 1444000000;
+const size_t kThreadCount = 4;
+const size_t kNetworksPerThread = 100;
+}  // namespace
+
+class LeaseLogTest : public testing::Test {
+ protected:
+  void SetUp() override {
+    ASSERT_TRUE(temp_dir_.CreateUniqueTempDir());
+    path_ = temp_dir_.path().Append("leases.log");
+    ReopenLog();
+    lease_.ip_address = kFakeIPAddress;
+    lease_.subnet_mask = kFakeSubnetMask;
+    lease_.server_identifier = kFakeServerIdentifier;
+    lease_.lease_time = kFakeLeaseTime;
+    lease_.acquisition_time = kFakeAcquisitionTime;
+  }
+
+  void ReopenLog() {
+    log_.reset();
+    log_.reset(new LeaseLog(path_));
+    ASSERT_TRUE(log_->Open());
+  }
+
+  // Wait for the pending sync and compaction, if any.
+  void StopIOThread() { log_->io_thread_.Stop(); }
+  size_t append_offset() { return log_->append_offset_; }
+  size_t synced_offset() { return log_->synced_offset_; }
+  size_t live_size() { return log_->live_size_; }
+  void Compact() { log_->Compact(); }
+  bool compaction_pending() { return log_->compaction_pending_; }
+
+  base::ScopedTempDir temp_dir_;
+  base::FilePath path_;
+  std::unique_ptr<LeaseLog> log_;
+  Lease lease_;
+};
+
+TEST_F(LeaseLogTest, SaveAndLoad) {
+  Lease lease;
+  EXPECT_FALSE(log_->Load(kFakeNetworkIdentifier, &lease));
+  ASSERT_TRUE(log_->Save(kFakeNetworkIdentifier, lease_));
+  ASSERT_TRUE(log_->Load(kFakeNetworkIdentifier, &lease));
+  EXPECT_EQ(kFakeIPAddress, lease.ip_address);
+  EXPECT_EQ(kFakeSubnetMask, lease.subnet_mask);
+  EXPECT_EQ(kFakeServerIdentifier, lease.server_identifier);
+  EXPECT_EQ(kFakeLeaseTime, lease.lease_time);
+  EXPECT_EQ(kFakeAcquisitionTime, lease.acquisition_time);
+  EXPECT_FALSE(log_->Load(kOtherNetworkIdentifier, &lease));
+}
+
+TEST_F(LeaseLogTest, Remove) {
+  ASSERT_TRUE(log_->Save(kFakeNetworkIdentifier, lease_));
+  EXPECT_TRUE(log_->Remove(kFakeNetworkIdentifier));
+  Lease lease;
+  EXPECT_FALSE(log_->Load(kFakeNetworkIdentifier, &lease));
+  // Removing a missing lease is not an error.
+  EXPECT_TRUE(log_->Remove(kFakeNetworkIdentifier));
+}
+
+TEST_F(LeaseLogTest, SyncInBackground) {
+  ASSERT_TRUE(log_->Save(kFakeNetworkIdentifier, lease_));
+  ASSERT_TRUE(log_->Save(kOtherNetworkIdentifier, lease_));
+  ASSERT_TRUE(log_->Remove(kOtherNetworkIdentifier));
+  StopIOThread();
+  EXPECT_EQ(append_offset(), synced_offset());
+}
+
+TEST_F(LeaseLogTest, RecoverAfterReopen) {
+  ASSERT_TRUE(log_->Save(kFakeNetworkIdentifier, lease_));
+  ASSERT_TRUE(log_->Save(kOtherNetworkIdentifier, lease_));
+  Lease renewed_lease = lease_;
+  renewed_lease.acquisition_time = kFakeAcquisitionTime + kFakeLeaseTime;
+  ASSERT_TRUE(log_->Save(kFakeNetworkIdentifier, renewed_lease));
+  ASSERT_TRUE(log_->Remove(kOtherNetworkIdentifier));
+  ReopenLog();
+
+  Lease lease;
+  ASSERT_TRUE(log_->Load(kFakeNetworkIdentifier, &lease));
+  EXPECT_EQ(kFakeAcquisitionTime + kFakeLeaseTime, lease.acquisition_time);
+  EXPECT_FALSE(log_->Load(kOtherNetworkIdentifier, &lease));
+}
+
+TEST_F(LeaseLogTest, TornRecordEndsLog) {
+  ASSERT_TRUE(log_->Save(kFakeNetworkIdentifier, lease_));
+  ASSERT_TRUE(log_->Save(kOtherNetworkIdentifier, lease_));
+  log_.reset();
+
+  // Corrupt the identifier of the last record.
+  std::string data;
+  ASSERT_TRUE(base::ReadFileToString(path_, &data));
+  size_t offset = data.find(kOtherNetworkIdentifier);
+  ASSERT_NE(std::string::npos, offset);
+  data[offset] ^= 0xff;
+  ASSERT_EQ(static_cast<int>(data.size()),
+            base::WriteFile(path_, data.data(), data.size()));
+
+  ReopenLog();
+  Lease lease;
+  EXPECT_TRUE(log_->Load(kFakeNetworkIdentifier, &lease));
+  EXPECT_FALSE(log_->Load(kOtherNetworkIdentifier, &lease));
+
+  // The log goes on after the last valid record.
+  ASSERT_TRUE(log_->Save(kOtherNetworkIdentifier, lease_));
+  ReopenLog();
+  EXPECT_TRUE(log_->Load(kFakeNetworkIdentifier, &lease));
+  EXPECT_TRUE(log_->Load(kOtherNetworkIdentifier, &lease));
+}
+
+TEST_F(LeaseLogTest, RejectUnknownFile) {
+  log_.reset();
+  const char kGarbage[] = "not a lease log";
+  ASSERT_EQ(static_cast<int>(sizeof(kGarbage)),
+            base::WriteFile(path_, kGarbage, sizeof(kGarbage)));
+  LeaseLog log(path_);
+  EXPECT_FALSE(log.Open());
+}
+
+TEST_F(LeaseLogTest, TruncateOversizedFile) {
+  ASSERT_TRUE(log_->Save(kFakeNetworkIdentifier, lease_));
+  log_.reset();
+  const off_t kMaxFileSize = 64 * 1024 * 1024;
+  ASSERT_EQ(0, truncate(path_.value().c_str(), kMaxFileSize + 1));
+  ReopenLog();
+  struct stat file_stat;
+  ASSERT_EQ(0, stat(path_.value().c_str(), &file_stat));
+  EXPECT_EQ(kMaxFileSize, file_stat.st_size);
+  Lease lease;
+  EXPECT_TRUE(log_->Load(kFakeNetworkIdentifier, &lease));
+}
+
+TEST_F(LeaseLogTest, CompactSupersededRecords) {
+  size_t header_size = append_offset();
+  ASSERT_TRUE(log_->Save(kFakeNetworkIdentifier, lease_));
+  size_t record_size = append_offset() - header_size;
+  // Renew the same lease until the log is worth compacting.
+  Lease lease = lease_;
+  for (int i = 0; i < 5000; i++) {
+    lease.acquisition_time = kFakeAcquisitionTime + i;
+    ASSERT_TRUE(log_->Save(kFakeNetworkIdentifier, lease));
+  }
+  ASSERT_TRUE(log_->Save(kOtherNetworkIdentifier, lease_));
+  StopIOThread();
+  EXPECT_FALSE(compaction_pending());
+  EXPECT_FALSE(base::PathExists(path_.AddExtension("compact")));
+  EXPECT_EQ(append_offset(), synced_offset());
+  // The renewals appended while the compaction ran were carried over to
+  // the new log, the ones before it were dropped.
+  EXPECT_LT(append_offset(), 5000 * record_size);
+
+  // Once the log is idle, compaction leaves the live leases only.
+  Compact();
+  EXPECT_EQ(live_size(), append_offset());
+  EXPECT_EQ(append_offset(), synced_offset());
+
+  ReopenLog();
+  Lease loaded_lease;
+  ASSERT_TRUE(log_->Load(kFakeNetworkIdentifier, &loaded_lease));
+  EXPECT_EQ(lease.acquisition_time, loaded_lease.acquisition_time);
+  EXPECT_TRUE(log_->Load(kOtherNetworkIdentifier, &loaded_lease));
+}
+
+TEST_F(LeaseLogTest, ConcurrentSaves) {
+  std::vector<std::thread> threads;
+  for (size_t thread = 0; thread < kThreadCount; thread++) {
+    threads.push_back(std::thread([this, thread]() {
+      for (size_t i = 0; i < kNetworksPerThread; i++) {
+        Lease lease = lease_;
+        lease.ip_address = static_cast<uint32_t>(i);
+        EXPECT_TRUE(log_->Save(
+            base::StringPrintf("network_%zu_%zu", thread, i), lease));
+      }
+    }));
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  ReopenLog();
+  for (size_t thread = 0; thread < kThreadCount; thread++) {
+    for (size_t i = 0; i < kNetworksPerThread; i++) {
+      Lease lease;
+      ASSERT_TRUE(log_->Load(
+          base::StringPrintf("network_%zu_%zu", thread, i), &lease));
+      EXPECT_EQ(i, lease.ip_address);
+    }
+  }
+}
+
+TEST(LeaseTest, Expiry) {
+  Lease lease;
+  lease.lease_time = kFakeLeaseTime;
+  lease.acquisition_time = kFakeAcquisitionTime;
+  EXPECT_FALSE(lease.IsExpired(kFakeAcquisitionTime + kFakeLeaseTime - 1));
+  EXPECT_TRUE(lease.IsExpired(kFakeAcquisitionTime + kFakeLeaseTime));
+  lease.lease_time = kInfiniteLeaseTime;
+  EXPECT_FALSE(lease.IsExpired(kFakeAcquisitionTime + kFakeLeaseTime));
+}
+
+}  // namespace dhcp_client
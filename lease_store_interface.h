@@ -0,0 +1,69 @@
+//
+// Copyright (C) 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+
+#ifndef DHCP_CLIENT_LEASE_STORE_INTERFACE_H_
+#define DHCP_CLIENT_LEASE_STORE_INTERFACE_H_
+
+#include <cstdint>
+#include <string>
+
+namespace dhcp_client {
+
+// RFC 2132: a lease time of 0xffffffff means infinity.
+const uint32_t kInfiniteLeaseTime = 0xffffffff;
+
+// The part of an acknowledged DHCPv4 lease needed to reclaim it on a
+// later connection to the same network.
+struct Lease {
+  Lease()
+      : ip_address(0),
+        subnet_mask(0),
+        server_identifier(0),
+        lease_time(0),
+        acquisition_time(0) {}
+
+  bool IsExpired(int64_t now) const {
+    return lease_time != kInfiniteLeaseTime &&
+           now >= acquisition_time + static_cast<int64_t>(lease_time);
+  }
+
+  // Addresses are in host byte order.
+  uint32_t ip_address;
+  uint32_t subnet_mask;
+  uint32_t server_identifier;
+  // In seconds.
+  uint32_t lease_time;
+  // Wall clock time of the acknowledgment, in seconds since the epoch.
+  int64_t acquisition_time;
+};
+
+// Abstract class for the persistent storage of leases, keyed by network
+// identifier. Services on different threads share one store, so the
+// methods can be called from any thread.
+class LeaseStoreInterface {
+ public:
+  virtual ~LeaseStoreInterface() {}
+
+  // Returns false if no valid lease is stored for |network_id|.
+  virtual bool Load(const std::string& network_id, Lease* lease) = 0;
+  virtual bool Save(const std::string& network_id, const Lease& lease) = 0;
+  virtual bool Remove(const std::string& network_id) = 0;
+};
+
+}  // namespace dhcp_client
+
+#endif  // DHCP_CLIENT_LEASE_STORE_INTERFACE_H_
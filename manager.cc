@@ -17,30 +17,181 @@
 #include "dhcp_client/manager.h"
 #include "dhcp_client/service.h"
 
+#include <sched.h>
+
+#include <utility>
+
+#include <base/bind.h>
+#include <base/logging.h>
+#include <base/time/default_tick_clock.h>
+
+#include "dhcp_client/device_info.h"
+#include "dhcp_client/lease_log.h"
 #include "dhcp_client/message_loop_event_dispatcher.h"
+#include "dhcp_client/timer_wheel_event_dispatcher.h"
 
 namespace dhcp_client {
 
+namespace {
+const char kLeaseLogPath[] = "/data/misc/dhcp_client/leases.log";
+
+void StartServicesOnShard(
+    const std::vector<scoped_refptr<Service>>& services) {
+  for (const auto& service : services) {
+    service->Start();
+  }
+}
+
+void StopServiceOnShard(const scoped_refptr<Service>& service) {
+  service->Stop();
+}
+
+// Returns null if the lease log cannot be opened.
+std::unique_ptr<LeaseStoreInterface> OpenLeaseLog() {
+  LeaseLog* lease_log = new LeaseLog(base::FilePath(kLeaseLogPath));
+  std::unique_ptr<LeaseStoreInterface> lease_store(lease_log);
+  if (!lease_log->Open()) {
+    LOG(ERROR) << "Leases will not be persisted";
+    return nullptr;
+  }
+  return lease_store;
+}
+
+// The CPUs this process may run on.
+std::vector<int> GetAllowedCPUs() {
+  std::vector<int> cpus;
+  cpu_set_t cpu_set;
+  if (sched_getaffinity(0, sizeof(cpu_set), &cpu_set) != 0) {
+    PLOG(ERROR) << "Failed to get CPU affinity";
+    return cpus;
+  }
+  for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+    if (CPU_ISSET(cpu, &cpu_set)) {
+      cpus.push_back(cpu);
+    }
+  }
+  return cpus;
+}
+}  // namespace
+
 Manager::Manager()
+    : Manager(
+          // Lease and retransmission timers of all the services share
+          // one timer wheel, on top of the message loop.
+          std::unique_ptr<EventDispatcherInterface>(
+              new TimerWheelEventDispatcher(
+                  std::unique_ptr<EventDispatcherInterface>(
+                      new MessageLoopEventDispatcher()),
+                  std::unique_ptr<base::TickClock>(
+                      new base::DefaultTickClock()))),
+          OpenLeaseLog()) {
+  // Interface lookups of the services are served from a table kept
+  // current by link notifications.
+  DeviceInfo::GetInstance()->Start();
+  dump_links_ = true;
+}
+
+Manager::Manager(std::unique_ptr<EventDispatcherInterface> event_dispatcher,
+                 std::unique_ptr<LeaseStoreInterface> lease_store)
     : service_identifier_(0),
-      event_dispatcher_(new MessageLoopEventDispatcher()) {
+      dump_links_(false),
+      event_dispatcher_(std::move(event_dispatcher)),
+      packet_demuxer_(event_dispatcher_.get()),
+      lease_store_(std::move(lease_store)) {
 }
 
-Manager::~Manager() {}
+Manager::Manager(size_t shard_count) : Manager() {
+  std::vector<int> cpus = GetAllowedCPUs();
+  for (size_t i = 0; i < shard_count; i++) {
+    int cpu = cpus.empty() ? -1 : cpus[i % cpus.size()];
+    std::unique_ptr<ManagerShard> shard(new ManagerShard(i, cpu));
+    if (!shard->Start()) {
+      LOG(ERROR) << "Failed to start shard " << i;
+      break;
+    }
+    shards_.push_back(std::move(shard));
+  }
+}
+
+Manager::~Manager() {
+  // The services use the demuxer and the lease store, and their callers
+  // may keep them alive past this point.
+  if (shards_.empty()) {
+    for (const auto& service : services_) {
+      service->Stop();
+    }
+  } else {
+    for (const auto& service : services_) {
+      GetShard(*service)->PostControlTask(
+          base::Bind(&StopServiceOnShard, service));
+    }
+    // Join the threads before the services go away.
+    shards_.clear();
+  }
+  services_.clear();
+}
 
 scoped_refptr<Service> Manager::StartService(
     const brillo::VariantDictionary& configs) {
-  scoped_refptr<Service> service = new Service(this,
-                                               service_identifier_++,
-                                               event_dispatcher_.get(),
-                                               configs);
-  services_.push_back(service);
-  return service;
+  return StartServices(
+      std::vector<brillo::VariantDictionary>(1, configs)).front();
+}
+
+std::vector<scoped_refptr<Service>> Manager::StartServices(
+    const std::vector<brillo::VariantDictionary>& configs) {
+  std::vector<scoped_refptr<Service>> services;
+  services.reserve(configs.size());
+  // Services to start, per shard.
+  std::vector<std::vector<scoped_refptr<Service>>> shard_services(
+      shards_.size());
+  // A single dump brings the link table up to date for the whole batch,
+  // the interfaces are then all resolved from it without a system call.
+  // A lone service is cheaper to look up on its own. If the dump fails,
+  // the interfaces missing from the table are looked up in the kernel.
+  bool link_table_only = dump_links_ && configs.size() > 1 &&
+                         DeviceInfo::GetInstance()->DumpLinks();
+  for (const auto& service_configs : configs) {
+    int identifier = service_identifier_++;
+    ManagerShard* shard =
+        shards_.empty() ? nullptr : shards_[identifier % shards_.size()].get();
+    scoped_refptr<Service> service = new Service(
+        this,
+        identifier,
+        shard ? shard->event_dispatcher() : event_dispatcher_.get(),
+        shard ? shard->packet_demuxer() : &packet_demuxer_,
+        lease_store_.get(),
+        service_configs);
+    services.push_back(service);
+    // Resolved on the calling thread, so that a service whose interface
+    // is unknown is never posted to a shard.
+    if (!service->ResolveDevice(link_table_only)) {
+      continue;
+    }
+    if (shard) {
+      shard_services[shard->index()].push_back(service);
+    } else {
+      service->Start();
+    }
+  }
+  for (size_t i = 0; i < shards_.size(); i++) {
+    if (!shard_services[i].empty()) {
+      shards_[i]->PostControlTask(
+          base::Bind(&StartServicesOnShard, shard_services[i]));
+    }
+  }
+  services_.insert(services_.end(), services.begin(), services.end());
+  return services;
 }
 
 bool Manager::StopService(const scoped_refptr<Service>& service) {
   for (auto it = services_.begin(); it != services_.end(); ++it) {
     if (*it == service) {
+      if (shards_.empty()) {
+        service->Stop();
+      } else {
+        GetShard(*service)->PostControlTask(
+            base::Bind(&StopServiceOnShard, service));
+      }
       services_.erase(it);
       return true;
     }
@@ -48,5 +199,8 @@ bool Manager::StopService(const scoped_refptr<Service>& service) {
   return false;
 }
 
-}  // namespace dhcp_client
+ManagerShard* Manager::GetShard(const Service& service) {
+  return shards_[service.identifier() % shards_.size()].get();
+}
 
+}  // namespace dhcp_client
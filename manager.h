@@ -17,12 +17,16 @@
 #ifndef DHCP_CLIENT_MANAGER_H_
 #define DHCP_CLIENT_MANAGER_H_
 
+#include <memory>
 #include <vector>
 
 #include <base/macros.h>
 #include <brillo/variant_dictionary.h>
 
 #include "dhcp_client/event_dispatcher_interface.h"
+#include "dhcp_client/lease_store_interface.h"
+#include "dhcp_client/manager_shard.h"
+#include "dhcp_client/packet_demuxer.h"
 
 namespace dhcp_client {
 
@@ -31,16 +35,57 @@ class Service;
 class Manager {
  public:
   Manager();
+  // Sharded mode: the services are spread over |shard_count| threads,
+  // each pinned to a core and running its own event loop. Services are
+  // started and stopped on their shard.
+  explicit Manager(size_t shard_count);
   virtual ~Manager();
 
+  // Create a service and start it: the DHCP state machine of the service
+  // runs as soon as its interface is resolved, on the event loop of the
+  // manager or of its shard. A service whose interface can not be
+  // resolved is returned without being started.
   scoped_refptr<Service> StartService(const brillo::VariantDictionary& configs);
+  // Same as StartService() for each element of |configs|. The interfaces
+  // are all resolved up front from the link table, brought up to date by
+  // a single dump of the links. Then each shard starts its share of the
+  // services from a single control task, the shards running in parallel.
+  // Must be called on the thread of the RTNL handler.
+  std::vector<scoped_refptr<Service>> StartServices(
+      const std::vector<brillo::VariantDictionary>& configs);
 
+  // The service is stopped even if the caller still holds a reference
+  // to it, the same goes for the services left when the manager is
+  // destroyed.
   bool StopService(const scoped_refptr<Service>& service);
 
+  // Receive engine shared by the services configured to use it.
+  PacketDemuxer* packet_demuxer() { return &packet_demuxer_; }
+
+  size_t shard_count() const { return shards_.size(); }
+
  private:
+  friend class ManagerTest;
+
+  // Non-sharded, without link notifications. |lease_store| may be null.
+  Manager(std::unique_ptr<EventDispatcherInterface> event_dispatcher,
+          std::unique_ptr<LeaseStoreInterface> lease_store);
+
+  ManagerShard* GetShard(const Service& service);
+
   int service_identifier_;
+  // Whether StartServices() dumps the links before resolving the batch,
+  // only set when the link table is kept by DeviceInfo.
+  bool dump_links_;
   std::unique_ptr<EventDispatcherInterface> event_dispatcher_;
+  PacketDemuxer packet_demuxer_;
+  // Leases of the services with a network identifier, shared by all
+  // the shards.
+  std::unique_ptr<LeaseStoreInterface> lease_store_;
+  // Declared after what the services use, they go first.
   std::vector<scoped_refptr<Service>> services_;
+  // Empty unless sharded.
+  std::vector<std::unique_ptr<ManagerShard>> shards_;
 
   DISALLOW_COPY_AND_ASSIGN(Manager);
 };
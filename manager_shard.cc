@@ -0,0 +1,156 @@
+//
+// Copyright (C) 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "dhcp_client/manager_shard.h"
+
+#include <sched.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <base/bind.h>
+#include <base/location.h>
+#include <base/logging.h>
+#include <base/message_loop/message_loop.h>
+#include <base/strings/stringprintf.h>
+#include <base/time/default_tick_clock.h>
+
+#include "dhcp_client/message_loop_event_dispatcher.h"
+#include "dhcp_client/timer_wheel_event_dispatcher.h"
+
+using base::Bind;
+using base::Unretained;
+using shill::IOHandlerFactoryContainer;
+
+namespace dhcp_client {
+
+namespace {
+const int kInvalidFileDescriptor = -1;
+}  // namespace
+
+ManagerShard::ManagerShard(size_t index, int cpu)
+    : index_(index),
+      cpu_(cpu),
+      thread_(base::StringPrintf("dhcp_shard_%zu", index)),
+      pending_control_tasks_(0),
+      wakeup_fd_(kInvalidFileDescriptor),
+      event_dispatcher_(new TimerWheelEventDispatcher(
+          std::unique_ptr<EventDispatcherInterface>(
+              new MessageLoopEventDispatcher()),
+          std::unique_ptr<base::TickClock>(new base::DefaultTickClock()))),
+      packet_demuxer_(new PacketDemuxer(event_dispatcher_.get())),
+      io_handler_factory_(
+          IOHandlerFactoryContainer::GetInstance()->GetIOHandlerFactory()) {
+}
+
+ManagerShard::~ManagerShard() {
+  Stop();
+}
+
+bool ManagerShard::Start() {
+  wakeup_fd_ = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+  if (wakeup_fd_ == kInvalidFileDescriptor) {
+    PLOG(ERROR) << "Failed to create eventfd";
+    return false;
+  }
+  base::Thread::Options options(base::MessageLoop::TYPE_IO, 0);
+  if (!thread_.StartWithOptions(options)) {
+    LOG(ERROR) << "Failed to start thread of shard " << index_;
+    close(wakeup_fd_);
+    wakeup_fd_ = kInvalidFileDescriptor;
+    return false;
+  }
+  thread_.task_runner()->PostTask(
+      FROM_HERE,
+      Bind(&ManagerShard::InitOnShardThread, Unretained(this)));
+  return true;
+}
+
+void ManagerShard::Stop() {
+  if (!thread_.IsRunning()) {
+    return;
+  }
+  thread_.task_runner()->PostTask(
+      FROM_HERE,
+      Bind(&ManagerShard::ShutDownOnShardThread, Unretained(this)));
+  thread_.Stop();
+  close(wakeup_fd_);
+  wakeup_fd_ = kInvalidFileDescriptor;
+}
+
+void ManagerShard::PostControlTask(const base::Closure& task) {
+  control_tasks_.Push(task);
+  // The task is counted once it is linked, so the shard always finds
+  // the tasks it was woken up for.
+  if (pending_control_tasks_.fetch_add(1, std::memory_order_acq_rel) == 0) {
+    uint64_t value = 1;
+    if (write(wakeup_fd_, &value, sizeof(value)) != sizeof(value)) {
+      PLOG(ERROR) << "Failed to wake up shard " << index_;
+    }
+  }
+}
+
+void ManagerShard::InitOnShardThread() {
+  if (cpu_ >= 0) {
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(cpu_, &cpus);
+    if (sched_setaffinity(0, sizeof(cpus), &cpus) != 0) {
+      PLOG(WARNING) << "Unable to pin shard " << index_ << " to CPU " << cpu_;
+    }
+  }
+  // The eventfd may already be readable, the handler then runs as soon
+  // as the message loop polls it.
+  wakeup_handler_.reset(io_handler_factory_->CreateIOReadyHandler(
+      wakeup_fd_,
+      shill::IOHandler::kModeInput,
+      Bind(&ManagerShard::OnWakeup, Unretained(this))));
+}
+
+void ManagerShard::ShutDownOnShardThread() {
+  RunControlTasks();
+  wakeup_handler_.reset();
+  packet_demuxer_.reset();
+  event_dispatcher_.reset();
+}
+
+void ManagerShard::OnWakeup(int fd) {
+  uint64_t value;
+  if (read(wakeup_fd_, &value, sizeof(value)) != sizeof(value)) {
+    PLOG(ERROR) << "Failed to read eventfd of shard " << index_;
+  }
+  RunControlTasks();
+}
+
+void ManagerShard::RunControlTasks() {
+  size_t count = pending_control_tasks_.load(std::memory_order_acquire);
+  while (count != 0) {
+    for (size_t i = 0; i < count; i++) {
+      base::Closure task;
+      // A counted task is linked, it can only be hidden for a moment
+      // by an older Push() still in progress.
+      while (!control_tasks_.Pop(&task)) {
+        sched_yield();
+      }
+      task.Run();
+    }
+    // Tasks posted meanwhile did not wake us up, run them as well.
+    count = pending_control_tasks_.fetch_sub(count,
+                                             std::memory_order_acq_rel) -
+        count;
+  }
+}
+
+}  // namespace dhcp_client
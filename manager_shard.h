@@ -0,0 +1,89 @@
+//
+// Copyright (C) 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef DHCP_CLIENT_MANAGER_SHARD_H_
+#define DHCP_CLIENT_MANAGER_SHARD_H_
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+
+#include <base/callback.h>
+#include <base/macros.h>
+#include <base/threading/thread.h>
+#include <shill/net/io_handler_factory_container.h>
+
+#include "dhcp_client/event_dispatcher_interface.h"
+#include "dhcp_client/mpsc_queue.h"
+#include "dhcp_client/packet_demuxer.h"
+
+namespace dhcp_client {
+
+// A worker thread of a sharded Manager, with its own message loop,
+// event dispatcher and shared packet socket. The services placed on a
+// shard only run on its thread.
+// Control tasks from other threads go through a lock-free queue, the
+// shard thread is woken up through an eventfd when the queue stops
+// being empty.
+class ManagerShard {
+ public:
+  // Pin the thread to |cpu|, unless it is negative.
+  ManagerShard(size_t index, int cpu);
+  ~ManagerShard();
+
+  bool Start();
+  // Run the pending control tasks, and stop the thread.
+  void Stop();
+
+  // Run |task| on the shard thread. Can be called from any thread.
+  void PostControlTask(const base::Closure& task);
+
+  // To be used on the shard thread only.
+  EventDispatcherInterface* event_dispatcher() {
+    return event_dispatcher_.get();
+  }
+  PacketDemuxer* packet_demuxer() { return packet_demuxer_.get(); }
+
+  size_t index() const { return index_; }
+
+ private:
+  void InitOnShardThread();
+  void ShutDownOnShardThread();
+  void OnWakeup(int fd);
+  void RunControlTasks();
+
+  size_t index_;
+  int cpu_;
+  base::Thread thread_;
+
+  MPSCQueue<base::Closure> control_tasks_;
+  // Number of control tasks posted and not run yet. The producer that
+  // moves it from 0 wakes the shard up.
+  std::atomic<size_t> pending_control_tasks_;
+  int wakeup_fd_;
+
+  // Used on the shard thread only.
+  std::unique_ptr<EventDispatcherInterface> event_dispatcher_;
+  std::unique_ptr<PacketDemuxer> packet_demuxer_;
+  shill::IOHandlerFactory* io_handler_factory_;
+  std::unique_ptr<shill::IOHandler> wakeup_handler_;
+
+  DISALLOW_COPY_AND_ASSIGN(ManagerShard);
+};
+
+}  // namespace dhcp_client
+
+#endif  // DHCP_CLIENT_MANAGER_SHARD_H_
@@ -0,0 +1,233 @@
+//
+// Copyright (C) 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+
+#include "dhcp_client/manager.h"
+
+#include <linux/rtnetlink.h>
+
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <brillo/variant_dictionary.h>
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include <shill/net/byte_string.h>
+#include <shill/net/mock_io_handler_factory.h>
+#include <shill/net/mock_sockets.h>
+
+#include "dhcp_client/device_info.h"
+#include "dhcp_client/mock_sockets.h"
+#include "dhcp_client/service.h"
+#include "dhcp_client/simulated_event_dispatcher.h"
+
+using shill::ByteString;
+using shill::IOHandler;
+using shill::MockIOHandlerFactory;
+using ::testing::_;
+using ::testing::Invoke;
+using ::testing::NiceMock;
+using ::testing::Return;
+using ::testing::ReturnArg;
+
+namespace dhcp_client {
+
+namespace {
+const int kFakeFd = 99;
+const int kFakeInterfaceIndex = 3;
+const char kFakeInterfaceName[] = "eth0";
+const uint8_t kFakeHardwareAddress[] = {0x02, 0x00, 0x00, 0x00, 0x00, 0x01};
+const int kFakeNetlinkFd = 98;
+const int kFakeOtherInterfaceIndex = 4;
+const char kFakeOtherInterfaceName[] = "eth1";
+const char kFakeMissingInterfaceName[] = "eth2";
+
+void AddAttribute(uint16_t type,
+                  const void* data,
+                  size_t length,
+                  std::vector<uint8_t>* dump) {
+  size_t offset = dump->size();
+  dump->resize(offset + RTA_SPACE(length), 0);
+  struct rtattr attribute;
+  attribute.rta_len = RTA_LENGTH(length);
+  attribute.rta_type = type;
+  memcpy(&(*dump)[offset], &attribute, sizeof(attribute));
+  memcpy(&(*dump)[offset + RTA_LENGTH(0)], data, length);
+}
+
+// Append a message answering the link dump |sequence| to |dump|, a link
+// if |interface_name| is not null.
+void AddDumpMessage(uint16_t type,
+                    uint32_t sequence,
+                    int interface_index,
+                    const char* interface_name,
+                    std::vector<uint8_t>* dump) {
+  size_t offset = dump->size();
+  dump->resize(offset + NLMSG_SPACE(sizeof(struct ifinfomsg)), 0);
+  struct ifinfomsg info;
+  memset(&info, 0, sizeof(info));
+  info.ifi_index = interface_index;
+  memcpy(&(*dump)[offset + NLMSG_HDRLEN], &info, sizeof(info));
+  if (interface_name) {
+    AddAttribute(IFLA_IFNAME, interface_name, strlen(interface_name) + 1,
+                 dump);
+    AddAttribute(IFLA_ADDRESS, kFakeHardwareAddress,
+                 sizeof(kFakeHardwareAddress), dump);
+  }
+  struct nlmsghdr header;
+  memset(&header, 0, sizeof(header));
+  header.nlmsg_len = dump->size() - offset;
+  header.nlmsg_type = type;
+  header.nlmsg_flags = NLM_F_MULTI;
+  header.nlmsg_seq = sequence;
+  memcpy(&(*dump)[offset], &header, sizeof(header));
+}
+}  // namespace
+
+class ManagerTest : public testing::Test {
+ public:
+  void SetUp() {
+    // Serve the interface from the link table instead of the kernel.
+    DeviceInfo::GetInstance()->AddLink(
+        kFakeInterfaceIndex,
+        kFakeInterfaceName,
+        ByteString(kFakeHardwareAddress, sizeof(kFakeHardwareAddress)));
+    manager_.reset(new Manager(
+        std::unique_ptr<EventDispatcherInterface>(
+            new SimulatedEventDispatcher()),
+        nullptr));
+    PacketDemuxer* demuxer = manager_->packet_demuxer();
+    sockets_ = new NiceMock<MockSockets>();
+    ON_CALL(*sockets_, Socket(PF_PACKET, _, _)).WillByDefault(Return(kFakeFd));
+    ON_CALL(*sockets_, SendMmsg(_, _, _, _)).WillByDefault(ReturnArg<2>());
+    demuxer->sockets_.reset(sockets_);
+    demuxer->io_handler_factory_ = &io_handler_factory_;
+    ON_CALL(io_handler_factory_, CreateIOReadyHandler(kFakeFd, _, _))
+        .WillByDefault(Invoke([](int fd,
+                                 IOHandler::ReadyMode mode,
+                                 const IOHandler::ReadyCallback& callback) {
+          return new IOHandler();
+        }));
+  }
+
+  void TearDown() {
+    manager_.reset();
+    DeviceInfo* device_info = DeviceInfo::GetInstance();
+    device_info->Stop();
+    device_info->sockets_.reset(new shill::Sockets());
+  }
+
+ protected:
+  // Start a service receiving on the shared socket of the demuxer.
+  scoped_refptr<Service> StartService() {
+    brillo::VariantDictionary configs;
+    configs["interface_name"] = std::string(kFakeInterfaceName);
+    configs["shared_socket"] = true;
+    return manager_->StartService(configs);
+  }
+
+  // Make the manager dump the links before resolving a batch, and let
+  // the dump return |dump|. The lookups in the kernel fail.
+  void ExpectLinkDump(const std::vector<uint8_t>& dump) {
+    manager_->dump_links_ = true;
+    shill::MockSockets* sockets = new shill::MockSockets();
+    DeviceInfo::GetInstance()->sockets_.reset(sockets);
+    EXPECT_CALL(*sockets, Socket(PF_NETLINK, _, NETLINK_ROUTE))
+        .WillOnce(Return(kFakeNetlinkFd));
+    EXPECT_CALL(*sockets, Socket(AF_INET, _, _)).Times(0);
+    EXPECT_CALL(*sockets, Send(kFakeNetlinkFd, _, _, _))
+        .WillOnce(ReturnArg<2>());
+    EXPECT_CALL(*sockets, RecvFrom(kFakeNetlinkFd, _, _, _, _, _))
+        .WillOnce(Invoke([dump](int fd, void* buf, size_t len, int flags,
+                                struct sockaddr* src_addr,
+                                socklen_t* addrlen) {
+          memcpy(buf, dump.data(), dump.size());
+          return static_cast<ssize_t>(dump.size());
+        }));
+    EXPECT_CALL(*sockets, Close(kFakeNetlinkFd)).WillOnce(Return(0));
+  }
+
+  uint32_t NextDumpSequence() const {
+    return DeviceInfo::GetInstance()->dump_sequence_;
+  }
+
+  // The shared socket may only be closed once no client is left.
+  void ExpectSocketClosedWithoutClients() {
+    PacketDemuxer* demuxer = manager_->packet_demuxer();
+    EXPECT_CALL(*sockets_, Close(kFakeFd))
+        .WillOnce(Invoke([demuxer](int fd) {
+          EXPECT_EQ(0u, demuxer->client_count());
+          return 0;
+        }));
+  }
+
+  NiceMock<MockIOHandlerFactory> io_handler_factory_;
+  std::unique_ptr<Manager> manager_;
+  MockSockets* sockets_;  // Owned by the demuxer of |manager_|.
+};
+
+TEST_F(ManagerTest, DestroyWithRunningService) {
+  StartService();
+  ASSERT_EQ(1u, manager_->packet_demuxer()->client_count());
+  ExpectSocketClosedWithoutClients();
+  manager_.reset();
+}
+
+TEST_F(ManagerTest, DestroyStopsServiceStillReferenced) {
+  scoped_refptr<Service> service = StartService();
+  ASSERT_EQ(1u, manager_->packet_demuxer()->client_count());
+  ExpectSocketClosedWithoutClients();
+  manager_.reset();
+  // Releasing the service must not touch the demuxer that is gone.
+  service = nullptr;
+}
+
+TEST_F(ManagerTest, StopServiceStillReferenced) {
+  scoped_refptr<Service> service = StartService();
+  ExpectSocketClosedWithoutClients();
+  EXPECT_TRUE(manager_->StopService(service));
+  EXPECT_EQ(0u, manager_->packet_demuxer()->client_count());
+  EXPECT_FALSE(manager_->StopService(service));
+}
+
+TEST_F(ManagerTest, StartServicesResolvesFromOneDump) {
+  uint32_t sequence = NextDumpSequence();
+  std::vector<uint8_t> dump;
+  AddDumpMessage(RTM_NEWLINK, sequence, kFakeInterfaceIndex,
+                 kFakeInterfaceName, &dump);
+  AddDumpMessage(RTM_NEWLINK, sequence, kFakeOtherInterfaceIndex,
+                 kFakeOtherInterfaceName, &dump);
+  AddDumpMessage(NLMSG_DONE, sequence, 0, nullptr, &dump);
+  ExpectLinkDump(dump);
+
+  std::vector<brillo::VariantDictionary> configs(3);
+  configs[0]["interface_name"] = std::string(kFakeInterfaceName);
+  configs[1]["interface_name"] = std::string(kFakeOtherInterfaceName);
+  configs[2]["interface_name"] = std::string(kFakeMissingInterfaceName);
+  for (auto& service_configs : configs) {
+    service_configs["shared_socket"] = true;
+  }
+  std::vector<scoped_refptr<Service>> services =
+      manager_->StartServices(configs);
+  ASSERT_EQ(3u, services.size());
+  // The two links of the dump are started, the missing one is not.
+  EXPECT_EQ(2u, manager_->packet_demuxer()->client_count());
+  ExpectSocketClosedWithoutClients();
+}
+
+}  // namespace dhcp_client
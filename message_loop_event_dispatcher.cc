@@ -16,13 +16,16 @@
 
 #include "dhcp_client/message_loop_event_dispatcher.h"
 
+#include <base/bind.h>
 #include <base/location.h>
 #include <base/message_loop/message_loop.h>
 #include <base/time/time.h>
 
 namespace dhcp_client {
 
-MessageLoopEventDispatcher::MessageLoopEventDispatcher() {}
+MessageLoopEventDispatcher::MessageLoopEventDispatcher()
+    : next_handle_(kInvalidTimerHandle + 1),
+      weak_ptr_factory_(this) {}
 MessageLoopEventDispatcher::~MessageLoopEventDispatcher() {}
 
 bool MessageLoopEventDispatcher::PostTask(const base::Closure& task) {
@@ -41,4 +44,38 @@ bool MessageLoopEventDispatcher::PostDelayedTask(const base::Closure& task,
   return true;
 }
 
+TimerHandle MessageLoopEventDispatcher::PostCancelableDelayedTask(
+    const base::Closure& task, int64_t delay_ms) {
+  TimerHandle handle = next_handle_;
+  if (!PostDelayedTask(
+          base::Bind(&MessageLoopEventDispatcher::RunCancelableTask,
+                     weak_ptr_factory_.GetWeakPtr(),
+                     handle),
+          delay_ms)) {
+    return kInvalidTimerHandle;
+  }
+  next_handle_++;
+  cancelable_tasks_[handle] = task;
+  return handle;
+}
+
+bool MessageLoopEventDispatcher::CancelDelayedTask(TimerHandle handle) {
+  // The message loop task stays queued and finds nothing to run.
+  return cancelable_tasks_.erase(handle) != 0;
+}
+
+base::Time MessageLoopEventDispatcher::Now() {
+  return base::Time::Now();
+}
+
+void MessageLoopEventDispatcher::RunCancelableTask(TimerHandle handle) {
+  auto it = cancelable_tasks_.find(handle);
+  if (it == cancelable_tasks_.end()) {
+    return;
+  }
+  base::Closure task = it->second;
+  cancelable_tasks_.erase(it);
+  task.Run();
+}
+
 }  // namespace dhcp_client
@@ -17,7 +17,11 @@
 #ifndef DHCP_CLIENT_MESSAGE_LOOP_EVENT_DISPATCHER_H_
 #define DHCP_CLIENT_MESSAGE_LOOP_EVENT_DISPATCHER_H_
 
+#include <map>
+
 #include <base/callback.h>
+#include <base/macros.h>
+#include <base/memory/weak_ptr.h>
 
 #include <dhcp_client/event_dispatcher_interface.h>
 
@@ -34,8 +38,20 @@ class MessageLoopEventDispatcher : public EventDispatcherInterface {
   bool PostTask(const base::Closure& task) override;
   bool PostDelayedTask(const base::Closure& task,
                        int64_t delay_ms) override;
+  TimerHandle PostCancelableDelayedTask(const base::Closure& task,
+                                        int64_t delay_ms) override;
+  bool CancelDelayedTask(TimerHandle handle) override;
+  base::Time Now() override;
 
  private:
+  void RunCancelableTask(TimerHandle handle);
+
+  // Tasks posted with PostCancelableDelayedTask() that did not run yet.
+  std::map<TimerHandle, base::Closure> cancelable_tasks_;
+  TimerHandle next_handle_;
+
+  base::WeakPtrFactory<MessageLoopEventDispatcher> weak_ptr_factory_;
+
   DISALLOW_COPY_AND_ASSIGN(MessageLoopEventDispatcher);
 };
 
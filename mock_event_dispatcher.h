@@ -0,0 +1,47 @@
+//
+// Copyright (C) 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+
+#ifndef DHCP_CLIENT_MOCK_EVENT_DISPATCHER_H_
+#define DHCP_CLIENT_MOCK_EVENT_DISPATCHER_H_
+
+#include <base/macros.h>
+#include <gmock/gmock.h>
+
+#include "dhcp_client/event_dispatcher_interface.h"
+
+namespace dhcp_client {
+
+class MockEventDispatcher : public EventDispatcherInterface {
+ public:
+  MockEventDispatcher() {}
+  ~MockEventDispatcher() override {}
+
+  MOCK_METHOD1(PostTask, bool(const base::Closure& task));
+  MOCK_METHOD2(PostDelayedTask, bool(const base::Closure& task,
+                                     int64_t delay_ms));
+  MOCK_METHOD2(PostCancelableDelayedTask,
+               TimerHandle(const base::Closure& task, int64_t delay_ms));
+  MOCK_METHOD1(CancelDelayedTask, bool(TimerHandle handle));
+  MOCK_METHOD0(Now, base::Time());
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(MockEventDispatcher);
+};
+
+}  // namespace dhcp_client
+
+#endif  // DHCP_CLIENT_MOCK_EVENT_DISPATCHER_H_
@@ -0,0 +1,89 @@
+//
+// Copyright (C) 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+
+#ifndef DHCP_CLIENT_MOCK_SOCKETS_H_
+#define DHCP_CLIENT_MOCK_SOCKETS_H_
+
+#include <string>
+
+#include <base/macros.h>
+#include <gmock/gmock.h>
+
+#include "dhcp_client/sockets.h"
+
+namespace dhcp_client {
+
+class MockSockets : public Sockets {
+ public:
+  MockSockets() {}
+  ~MockSockets() override {}
+
+  MOCK_CONST_METHOD2(AttachFilter, int(int sockfd, struct sock_fprog* pf));
+  MOCK_CONST_METHOD3(Bind, int(int sockfd,
+                               const struct sockaddr* addr,
+                               socklen_t addrlen));
+  MOCK_CONST_METHOD2(BindToDevice, int(int sockfd,
+                                       const std::string& device));
+  MOCK_CONST_METHOD1(ReuseAddress, int(int sockfd));
+  MOCK_CONST_METHOD1(Close, int(int fd));
+  MOCK_CONST_METHOD3(Ioctl, int(int d, int request, void* argp));
+  MOCK_CONST_METHOD6(RecvFrom, ssize_t(int sockfd,
+                                       void* buf,
+                                       size_t len,
+                                       int flags,
+                                       struct sockaddr* src_addr,
+                                       socklen_t* addrlen));
+  MOCK_CONST_METHOD4(Send, ssize_t(int sockfd,
+                                   const void* buf,
+                                   size_t len,
+                                   int flags));
+  MOCK_CONST_METHOD6(SendTo, ssize_t(int sockfd,
+                                     const void* buf,
+                                     size_t len,
+                                     int flags,
+                                     const struct sockaddr* dest_addr,
+                                     socklen_t addrlen));
+  MOCK_CONST_METHOD2(SetReceiveBuffer, int(int sockfd, int size));
+  MOCK_CONST_METHOD3(Socket, int(int domain, int type, int protocol));
+  MOCK_CONST_METHOD5(SetSockOpt, int(int sockfd,
+                                     int level,
+                                     int optname,
+                                     const void* optval,
+                                     socklen_t optlen));
+  MOCK_CONST_METHOD4(RecvMmsg, int(int sockfd,
+                                   struct mmsghdr* msgvec,
+                                   unsigned int vlen,
+                                   int flags));
+  MOCK_CONST_METHOD4(SendMmsg, int(int sockfd,
+                                   struct mmsghdr* msgvec,
+                                   unsigned int vlen,
+                                   int flags));
+  MOCK_CONST_METHOD6(Mmap, void*(void* addr,
+                                 size_t length,
+                                 int prot,
+                                 int flags,
+                                 int fd,
+                                 off_t offset));
+  MOCK_CONST_METHOD2(Munmap, int(void* addr, size_t length));
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(MockSockets);
+};
+
+}  // namespace dhcp_client
+
+#endif  // DHCP_CLIENT_MOCK_SOCKETS_H_
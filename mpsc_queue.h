@@ -0,0 +1,84 @@
+//
+// Copyright (C) 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef DHCP_CLIENT_MPSC_QUEUE_H_
+#define DHCP_CLIENT_MPSC_QUEUE_H_
+
+#include <atomic>
+#include <utility>
+
+#include <base/macros.h>
+
+namespace dhcp_client {
+
+// Unbounded lock-free queue with multiple producers and a single
+// consumer, after Dmitry Vyukov's intrusive MPSC node-based queue.
+// A push is a single atomic exchange. The consumer always keeps one
+// node, whose value was already taken, at the tail of the list.
+template <typename T>
+class MPSCQueue {
+ public:
+  MPSCQueue() : head_(new Node()), tail_(head_.load()) {}
+
+  ~MPSCQueue() {
+    T value;
+    while (Pop(&value)) {}
+    delete tail_;
+  }
+
+  // Can be called from any thread.
+  void Push(const T& value) {
+    Node* node = new Node(value);
+    Node* previous = head_.exchange(node, std::memory_order_acq_rel);
+    // Until this store the node is not reachable from the tail, Pop()
+    // then sees the queue as empty.
+    previous->next.store(node, std::memory_order_release);
+  }
+
+  // Must only be called from the consumer thread. Returns false if the
+  // queue is empty, or if the oldest Push() is still in progress.
+  bool Pop(T* value) {
+    Node* tail = tail_;
+    Node* next = tail->next.load(std::memory_order_acquire);
+    if (next == nullptr) {
+      return false;
+    }
+    *value = std::move(next->value);
+    next->value = T();
+    tail_ = next;
+    delete tail;
+    return true;
+  }
+
+ private:
+  struct Node {
+    Node() : next(nullptr) {}
+    explicit Node(const T& node_value) : value(node_value), next(nullptr) {}
+    T value;
+    std::atomic<Node*> next;
+  };
+
+  // Newest node, written by the producers.
+  std::atomic<Node*> head_;
+  // Oldest node, only used by the consumer.
+  Node* tail_;
+
+  DISALLOW_COPY_AND_ASSIGN(MPSCQueue);
+};
+
+}  // namespace dhcp_client
+
+#endif  // DHCP_CLIENT_MPSC_QUEUE_H_
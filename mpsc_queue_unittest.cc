@@ -0,0 +1,102 @@
+//
+// Copyright (C) 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "dhcp_client/mpsc_queue.h"
+
+#include <memory>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace dhcp_client {
+
+namespace {
+const size_t kProducerCount = 4;
+const size_t kItemsPerProducer = 20000;
+}  // namespace
+
+TEST(MPSCQueueTest, EmptyQueue) {
+  MPSCQueue<int> queue;
+  int value = 0;
+  EXPECT_FALSE(queue.Pop(&value));
+}
+
+TEST(MPSCQueueTest, FirstInFirstOut) {
+  MPSCQueue<int> queue;
+  for (int i = 0; i < 10; i++) {
+    queue.Push(i);
+  }
+  for (int i = 0; i < 10; i++) {
+    int value = -1;
+    ASSERT_TRUE(queue.Pop(&value));
+    EXPECT_EQ(i, value);
+  }
+  int value = 0;
+  EXPECT_FALSE(queue.Pop(&value));
+}
+
+TEST(MPSCQueueTest, ReleasesRemainingItems) {
+  std::shared_ptr<int> item(new int(0));
+  {
+    MPSCQueue<std::shared_ptr<int>> queue;
+    queue.Push(item);
+    queue.Push(item);
+    std::shared_ptr<int> popped;
+    ASSERT_TRUE(queue.Pop(&popped));
+    EXPECT_EQ(3, item.use_count());
+  }
+  EXPECT_EQ(1, item.use_count());
+}
+
+TEST(MPSCQueueTest, ConcurrentProducers) {
+  // Items are (producer, sequence number) pairs.
+  MPSCQueue<std::pair<size_t, size_t>> queue;
+  std::vector<std::thread> producers;
+  for (size_t producer = 0; producer < kProducerCount; producer++) {
+    producers.push_back(std::thread([&queue, producer]() {
+      for (size_t i = 0; i < kItemsPerProducer; i++) {
+        queue.Push(std::make_pair(producer, i));
+      }
+    }));
+  }
+
+  // Every producer's items come out in order, none is lost.
+  std::vector<size_t> next_sequence(kProducerCount, 0);
+  size_t received = 0;
+  while (received < kProducerCount * kItemsPerProducer) {
+    std::pair<size_t, size_t> item;
+    if (!queue.Pop(&item)) {
+      std::this_thread::yield();
+      continue;
+    }
+    received++;
+    if (item.first >= kProducerCount) {
+      ADD_FAILURE() << "Unexpected producer " << item.first;
+      continue;
+    }
+    EXPECT_EQ(next_sequence[item.first], item.second);
+    next_sequence[item.first] = item.second + 1;
+  }
+  for (auto& producer : producers) {
+    producer.join();
+  }
+  std::pair<size_t, size_t> item;
+  EXPECT_FALSE(queue.Pop(&item));
+}
+
+}  // namespace dhcp_client
@@ -0,0 +1,216 @@
+//
+// Copyright (C) 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "dhcp_client/packet_demuxer.h"
+
+#include <linux/if_packet.h>
+#include <net/ethernet.h>
+#include <netinet/ip.h>
+#include <netinet/udp.h>
+
+#include <cstring>
+#include <utility>
+
+#include <base/bind.h>
+#include <base/logging.h>
+
+#include "dhcp_client/socket_filter.h"
+
+using base::Bind;
+using base::Unretained;
+using shill::ByteString;
+using shill::IOHandlerFactoryContainer;
+
+namespace dhcp_client {
+
+namespace {
+const int kInvalidSocketDescriptor = -1;
+// Offset of chaddr in a DHCP message.
+const size_t kClientHardwareAddressOffset = 28;
+}  // namespace
+
+bool PacketDemuxer::ClientKey::operator==(const ClientKey& other) const {
+  return interface_index == other.interface_index &&
+      memcmp(hardware_address, other.hardware_address,
+             sizeof(hardware_address)) == 0;
+}
+
+size_t PacketDemuxer::ClientKeyHash::operator()(const ClientKey& key) const {
+  uint64_t value = 0;
+  memcpy(&value, key.hardware_address, sizeof(key.hardware_address));
+  // The low bits of a MAC address are the most random ones, mix in the
+  // interface index with a multiplicative hash.
+  value ^= static_cast<uint64_t>(key.interface_index) << 48;
+  return static_cast<size_t>(value * 0x9e3779b97f4a7c15ULL >> 16);
+}
+
+PacketDemuxer::PacketDemuxer(EventDispatcherInterface* event_dispatcher)
+    : event_dispatcher_(event_dispatcher),
+      socket_(kInvalidSocketDescriptor),
+      sockets_(new Sockets()),
+      io_handler_factory_(
+          IOHandlerFactoryContainer::GetInstance()->GetIOHandlerFactory()) {
+}
+
+PacketDemuxer::~PacketDemuxer() {
+  CloseSocket();
+}
+
+bool PacketDemuxer::MakeClientKey(unsigned int interface_index,
+                                  const uint8_t* hardware_address,
+                                  size_t hardware_address_length,
+                                  ClientKey* key) {
+  if (hardware_address_length != IFHWADDRLEN) {
+    return false;
+  }
+  key->interface_index = interface_index;
+  memcpy(key->hardware_address, hardware_address, IFHWADDRLEN);
+  return true;
+}
+
+bool PacketDemuxer::AddClient(unsigned int interface_index,
+                              const ByteString& hardware_address,
+                              const FrameCallback& callback) {
+  ClientKey key;
+  if (!MakeClientKey(interface_index,
+                     hardware_address.GetConstData(),
+                     hardware_address.GetLength(),
+                     &key)) {
+    LOG(ERROR) << "Unsupported hardware address length: "
+               << hardware_address.GetLength();
+    return false;
+  }
+  if (clients_.find(key) != clients_.end()) {
+    LOG(ERROR) << "A client is already registered for this address"
+               << " on interface " << interface_index;
+    return false;
+  }
+  if (socket_ == kInvalidSocketDescriptor && !CreateSocket()) {
+    return false;
+  }
+  clients_.insert(std::make_pair(key, callback));
+  return true;
+}
+
+void PacketDemuxer::RemoveClient(unsigned int interface_index,
+                                 const ByteString& hardware_address) {
+  ClientKey key;
+  if (!MakeClientKey(interface_index,
+                     hardware_address.GetConstData(),
+                     hardware_address.GetLength(),
+                     &key)) {
+    return;
+  }
+  clients_.erase(key);
+  if (clients_.empty()) {
+    CloseSocket();
+  }
+}
+
+bool PacketDemuxer::CreateSocket() {
+  int fd = sockets_->Socket(PF_PACKET,
+                            SOCK_DGRAM | SOCK_CLOEXEC | SOCK_NONBLOCK,
+                            htons(ETHERTYPE_IP));
+  if (fd == kInvalidSocketDescriptor) {
+    PLOG(ERROR) << "Failed to create shared socket";
+    return false;
+  }
+  shill::ScopedSocketCloser socket_closer(sockets_.get(), fd);
+
+  sock_fprog pf;
+  GetDHCPSocketFilter(&pf);
+  if (sockets_->AttachFilter(fd, &pf) != 0) {
+    PLOG(ERROR) << "Failed to attach filter";
+    return false;
+  }
+  // Without it the checksum of every frame is verified in software.
+  BatchedSocket::EnablePacketStatus(sockets_.get(), fd);
+  // The socket stays unbound so it receives on every interface.
+  socket_ = socket_closer.Release();
+  batched_socket_.reset(
+      new BatchedSocket(sockets_.get(), socket_, event_dispatcher_,
+                        BatchedSocket::kBatchSize));
+  ready_handler_.reset(io_handler_factory_->CreateIOReadyHandler(
+      socket_,
+      shill::IOHandler::kModeInput,
+      Bind(&PacketDemuxer::OnSocketReady, Unretained(this))));
+  return true;
+}
+
+void PacketDemuxer::CloseSocket() {
+  ready_handler_.reset();
+  if (batched_socket_) {
+    batched_socket_->Flush();
+    batched_socket_.reset();
+  }
+  if (socket_ != kInvalidSocketDescriptor) {
+    sockets_->Close(socket_);
+    socket_ = kInvalidSocketDescriptor;
+  }
+}
+
+void PacketDemuxer::OnSocketReady(int fd) {
+  // A client may remove itself while handling a frame, which closes
+  // the socket with the last one. Receive() stops in that case.
+  batched_socket_->Receive(
+      Bind(&PacketDemuxer::OnFrameReceived, Unretained(this)));
+}
+
+void PacketDemuxer::OnFrameReceived(const unsigned char* frame,
+                                    size_t len,
+                                    const struct sockaddr* address,
+                                    uint32_t status) {
+  const struct sockaddr_ll* remote =
+      reinterpret_cast<const struct sockaddr_ll*>(address);
+  if (remote->sll_pkttype == PACKET_OUTGOING) {
+    return;
+  }
+  DispatchFrame(static_cast<unsigned int>(remote->sll_ifindex),
+                frame,
+                len,
+                status);
+}
+
+void PacketDemuxer::DispatchFrame(unsigned int interface_index,
+                                  const unsigned char* frame,
+                                  size_t len,
+                                  uint32_t status) {
+  if (len < sizeof(struct iphdr)) {
+    return;
+  }
+  const struct iphdr* ip = reinterpret_cast<const struct iphdr*>(frame);
+  size_t chaddr_offset = (static_cast<size_t>(ip->ihl) << 2) +
+      sizeof(struct udphdr) + kClientHardwareAddressOffset;
+  ClientKey key;
+  if (chaddr_offset + IFHWADDRLEN > len ||
+      !MakeClientKey(interface_index,
+                     frame + chaddr_offset,
+                     IFHWADDRLEN,
+                     &key)) {
+    return;
+  }
+  auto it = clients_.find(key);
+  if (it == clients_.end()) {
+    // A reply for another host on the segment.
+    return;
+  }
+  // The client may remove itself from |clients_| while it handles the
+  // frame, run a copy of its callback.
+  FrameCallback callback = it->second;
+  callback.Run(frame, len, status);
+}
+
+}  // namespace dhcp_client
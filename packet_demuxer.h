@@ -0,0 +1,117 @@
+//
+// Copyright (C) 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef DHCP_CLIENT_PACKET_DEMUXER_H_
+#define DHCP_CLIENT_PACKET_DEMUXER_H_
+
+#include <net/if.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+
+#include <base/callback.h>
+#include <base/macros.h>
+#include <shill/net/byte_string.h>
+#include <shill/net/io_handler_factory_container.h>
+
+#include "dhcp_client/batched_socket.h"
+#include "dhcp_client/event_dispatcher_interface.h"
+#include "dhcp_client/sockets.h"
+
+namespace dhcp_client {
+
+// A single packet socket, not bound to any interface, shared by all the
+// DHCPV4 clients of a Manager. The socket filter runs once per packet
+// instead of once per client, and replies are routed to their client
+// through a hash table keyed on the receiving interface and chaddr.
+// The transaction id is left for the client to check.
+class PacketDemuxer {
+ public:
+  // Called with a frame starting at its IP header. |frame| is only
+  // valid during the call. |status| holds the TP_STATUS_* bits the
+  // kernel reported for the frame.
+  typedef base::Callback<void(const unsigned char* frame,
+                              size_t len,
+                              uint32_t status)>
+      FrameCallback;
+
+  explicit PacketDemuxer(EventDispatcherInterface* event_dispatcher);
+  virtual ~PacketDemuxer();
+
+  // Route the DHCP replies for |hardware_address| received on
+  // |interface_index| to |callback|. The shared socket is opened
+  // when the first client is added.
+  bool AddClient(unsigned int interface_index,
+                 const shill::ByteString& hardware_address,
+                 const FrameCallback& callback);
+  // The socket is closed once the last client is removed.
+  void RemoveClient(unsigned int interface_index,
+                    const shill::ByteString& hardware_address);
+
+  // The shared socket, clients send their frames through
+  // |batched_socket()|. Returns -1 if there is no client.
+  int socket() const { return socket_; }
+  BatchedSocket* batched_socket() { return batched_socket_.get(); }
+  size_t client_count() const { return clients_.size(); }
+
+ private:
+  friend class ManagerTest;
+  friend class PacketDemuxerTest;
+
+  struct ClientKey {
+    unsigned int interface_index;
+    uint8_t hardware_address[IFHWADDRLEN];
+    bool operator==(const ClientKey& other) const;
+  };
+  struct ClientKeyHash {
+    size_t operator()(const ClientKey& key) const;
+  };
+
+  static bool MakeClientKey(unsigned int interface_index,
+                            const uint8_t* hardware_address,
+                            size_t hardware_address_length,
+                            ClientKey* key);
+
+  bool CreateSocket();
+  void CloseSocket();
+  // Drain the socket and dispatch every frame.
+  void OnSocketReady(int fd);
+  void OnFrameReceived(const unsigned char* frame,
+                       size_t len,
+                       const struct sockaddr* address,
+                       uint32_t status);
+  void DispatchFrame(unsigned int interface_index,
+                     const unsigned char* frame,
+                     size_t len,
+                     uint32_t status);
+
+  std::unordered_map<ClientKey, FrameCallback, ClientKeyHash> clients_;
+
+  EventDispatcherInterface* event_dispatcher_;
+  int socket_;
+  std::unique_ptr<Sockets> sockets_;
+  std::unique_ptr<BatchedSocket> batched_socket_;
+  shill::IOHandlerFactory* io_handler_factory_;
+  std::unique_ptr<shill::IOHandler> ready_handler_;
+
+  DISALLOW_COPY_AND_ASSIGN(PacketDemuxer);
+};
+
+}  // namespace dhcp_client
+
+#endif  // DHCP_CLIENT_PACKET_DEMUXER_H_
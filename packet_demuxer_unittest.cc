@@ -0,0 +1,285 @@
+//
+// Copyright (C) 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "dhcp_client/packet_demuxer.h"
+
+#include <linux/if_packet.h>
+#include <netinet/ip.h>
+#include <netinet/udp.h>
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include <base/bind.h>
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include <shill/net/byte_string.h>
+#include <shill/net/mock_io_handler_factory.h>
+
+#include "dhcp_client/mock_sockets.h"
+
+using base::Bind;
+using base::Unretained;
+using shill::ByteString;
+using shill::IOHandler;
+using shill::MockIOHandlerFactory;
+using ::testing::_;
+using ::testing::Invoke;
+using ::testing::NiceMock;
+using ::testing::Return;
+
+namespace dhcp_client {
+
+namespace {
+const int kFakeFd = 99;
+const unsigned int kFakeInterfaceIndex1 = 3;
+const unsigned int kFakeInterfaceIndex2 = 4;
+const uint8_t kFakeHardwareAddress1[] = {0x02, 0x00, 0x00, 0x00, 0x00, 0x01};
+const uint8_t kFakeHardwareAddress2[] = {0x02, 0x00, 0x00, 0x00, 0x00, 0x02};
+// IP header + UDP header + DHCP fixed fields up to the end of chaddr.
+const size_t kFakeFrameLength =
+    sizeof(struct iphdr) + sizeof(struct udphdr) + 44;
+const size_t kChaddrOffset = sizeof(struct iphdr) + sizeof(struct udphdr) + 28;
+
+std::vector<uint8_t> MakeFrame(const uint8_t* hardware_address) {
+  std::vector<uint8_t> frame(kFakeFrameLength, 0);
+  frame[0] = 0x45;  // IPv4, no options.
+  memcpy(&frame[kChaddrOffset], hardware_address, IFHWADDRLEN);
+  return frame;
+}
+
+class FrameCounter {
+ public:
+  FrameCounter() : count_(0), status_(0) {}
+  void OnFrame(const unsigned char* frame, size_t len, uint32_t status) {
+    count_++;
+    status_ = status;
+    if (!on_frame_.is_null()) {
+      on_frame_.Run();
+    }
+  }
+  int count() const { return count_; }
+  uint32_t status() const { return status_; }
+  // Run after each frame is counted.
+  void set_on_frame(const base::Closure& on_frame) { on_frame_ = on_frame; }
+
+ private:
+  int count_;
+  uint32_t status_;
+  base::Closure on_frame_;
+};
+
+// A frame as received from the packet socket.
+struct FakeFrame {
+  std::vector<uint8_t> data;
+  unsigned int interface_index;
+  unsigned char packet_type;
+  uint32_t status;
+};
+}  // namespace
+
+class PacketDemuxerTest : public testing::Test {
+ public:
+  PacketDemuxerTest()
+      : hardware_address1_(kFakeHardwareAddress1,
+                           sizeof(kFakeHardwareAddress1)),
+        hardware_address2_(kFakeHardwareAddress2,
+                           sizeof(kFakeHardwareAddress2)),
+        demuxer_(nullptr) {}
+
+  void SetUp() {
+    sockets_ = new MockSockets();
+    demuxer_.sockets_.reset(sockets_);
+    demuxer_.io_handler_factory_ = &io_handler_factory_;
+    ON_CALL(*sockets_, Socket(_, _, _)).WillByDefault(Return(kFakeFd));
+    ON_CALL(*sockets_, AttachFilter(_, _)).WillByDefault(Return(0));
+  }
+
+ protected:
+  // Hand |frames_| to the demuxer in one recvmmsg batch, as the kernel
+  // would once its socket is readable.
+  void ReceiveFrames() {
+    EXPECT_CALL(*sockets_, RecvMmsg(kFakeFd, _, _, _))
+        .WillOnce(Invoke(this, &PacketDemuxerTest::FillMessages));
+    demuxer_.OnSocketReady(kFakeFd);
+  }
+
+  int FillMessages(int fd,
+                   struct mmsghdr* messages,
+                   unsigned int vlen,
+                   int flags) {
+    size_t count = std::min<size_t>(vlen, frames_.size());
+    for (size_t i = 0; i < count; i++) {
+      const FakeFrame& frame = frames_[i];
+      struct msghdr* header = &messages[i].msg_hdr;
+      EXPECT_GE(header->msg_iov[0].iov_len, frame.data.size());
+      memcpy(header->msg_iov[0].iov_base, frame.data.data(),
+             frame.data.size());
+      messages[i].msg_len = frame.data.size();
+
+      struct sockaddr_ll remote;
+      memset(&remote, 0, sizeof(remote));
+      remote.sll_family = AF_PACKET;
+      remote.sll_ifindex = static_cast<int>(frame.interface_index);
+      remote.sll_pkttype = frame.packet_type;
+      EXPECT_GE(header->msg_namelen, sizeof(remote));
+      memcpy(header->msg_name, &remote, sizeof(remote));
+      header->msg_namelen = sizeof(remote);
+
+      struct tpacket_auxdata auxdata;
+      memset(&auxdata, 0, sizeof(auxdata));
+      auxdata.tp_status = frame.status;
+      EXPECT_GE(header->msg_controllen, CMSG_SPACE(sizeof(auxdata)));
+      header->msg_controllen = CMSG_SPACE(sizeof(auxdata));
+      struct cmsghdr* control = CMSG_FIRSTHDR(header);
+      control->cmsg_level = SOL_PACKET;
+      control->cmsg_type = PACKET_AUXDATA;
+      control->cmsg_len = CMSG_LEN(sizeof(auxdata));
+      memcpy(CMSG_DATA(control), &auxdata, sizeof(auxdata));
+    }
+    return static_cast<int>(count);
+  }
+
+  bool AddClient(unsigned int interface_index,
+                 const ByteString& hardware_address,
+                 FrameCounter* counter) {
+    return demuxer_.AddClient(
+        interface_index,
+        hardware_address,
+        Bind(&FrameCounter::OnFrame, Unretained(counter)));
+  }
+
+  ByteString hardware_address1_;
+  ByteString hardware_address2_;
+  std::vector<FakeFrame> frames_;
+  NiceMock<MockIOHandlerFactory> io_handler_factory_;
+  PacketDemuxer demuxer_;
+  MockSockets* sockets_;  // Owned by demuxer_.
+};
+
+TEST_F(PacketDemuxerTest, SocketSharedByClients) {
+  FrameCounter counter1;
+  FrameCounter counter2;
+  EXPECT_CALL(*sockets_, Socket(PF_PACKET, _, _)).Times(1);
+  EXPECT_CALL(*sockets_, AttachFilter(kFakeFd, _)).Times(1);
+  EXPECT_CALL(io_handler_factory_,
+              CreateIOReadyHandler(kFakeFd, IOHandler::kModeInput, _))
+      .WillOnce(Return(new IOHandler()));
+  EXPECT_TRUE(AddClient(kFakeInterfaceIndex1, hardware_address1_, &counter1));
+  EXPECT_TRUE(AddClient(kFakeInterfaceIndex2, hardware_address1_, &counter2));
+  EXPECT_EQ(kFakeFd, demuxer_.socket());
+  EXPECT_EQ(2u, demuxer_.client_count());
+
+  EXPECT_CALL(*sockets_, Close(kFakeFd)).Times(1);
+  demuxer_.RemoveClient(kFakeInterfaceIndex1, hardware_address1_);
+  EXPECT_EQ(kFakeFd, demuxer_.socket());
+  demuxer_.RemoveClient(kFakeInterfaceIndex2, hardware_address1_);
+  EXPECT_EQ(-1, demuxer_.socket());
+}
+
+TEST_F(PacketDemuxerTest, AddClientRejectsDuplicate) {
+  FrameCounter counter;
+  EXPECT_CALL(*sockets_, Socket(_, _, _)).Times(1);
+  EXPECT_TRUE(AddClient(kFakeInterfaceIndex1, hardware_address1_, &counter));
+  EXPECT_FALSE(AddClient(kFakeInterfaceIndex1, hardware_address1_, &counter));
+  EXPECT_EQ(1u, demuxer_.client_count());
+  EXPECT_CALL(*sockets_, Close(kFakeFd)).Times(1);
+}
+
+TEST_F(PacketDemuxerTest, AddClientRejectsInvalidHardwareAddress) {
+  FrameCounter counter;
+  EXPECT_CALL(*sockets_, Socket(_, _, _)).Times(0);
+  EXPECT_FALSE(AddClient(kFakeInterfaceIndex1,
+                         ByteString(kFakeHardwareAddress1, 4),
+                         &counter));
+}
+
+TEST_F(PacketDemuxerTest, AddClientFailsWithoutSocket) {
+  FrameCounter counter;
+  EXPECT_CALL(*sockets_, Socket(_, _, _)).WillOnce(Return(-1));
+  EXPECT_FALSE(AddClient(kFakeInterfaceIndex1, hardware_address1_, &counter));
+  EXPECT_EQ(0u, demuxer_.client_count());
+}
+
+TEST_F(PacketDemuxerTest, RoutesByInterfaceAndHardwareAddress) {
+  FrameCounter counter1;
+  FrameCounter counter2;
+  FrameCounter counter3;
+  EXPECT_TRUE(AddClient(kFakeInterfaceIndex1, hardware_address1_, &counter1));
+  EXPECT_TRUE(AddClient(kFakeInterfaceIndex1, hardware_address2_, &counter2));
+  EXPECT_TRUE(AddClient(kFakeInterfaceIndex2, hardware_address1_, &counter3));
+  frames_ = {
+      {MakeFrame(kFakeHardwareAddress1), kFakeInterfaceIndex1, PACKET_HOST},
+      {MakeFrame(kFakeHardwareAddress2), kFakeInterfaceIndex1,
+       PACKET_BROADCAST},
+      {MakeFrame(kFakeHardwareAddress2), kFakeInterfaceIndex1, PACKET_HOST},
+      {MakeFrame(kFakeHardwareAddress1), kFakeInterfaceIndex2, PACKET_HOST},
+      // Unknown interface.
+      {MakeFrame(kFakeHardwareAddress2), kFakeInterfaceIndex2, PACKET_HOST},
+      // Sent by this host.
+      {MakeFrame(kFakeHardwareAddress1), kFakeInterfaceIndex1,
+       PACKET_OUTGOING},
+  };
+  ReceiveFrames();
+  EXPECT_EQ(1, counter1.count());
+  EXPECT_EQ(2, counter2.count());
+  EXPECT_EQ(1, counter3.count());
+  EXPECT_CALL(*sockets_, Close(kFakeFd)).Times(1);
+}
+
+TEST_F(PacketDemuxerTest, ClientRemovesItselfOnFrame) {
+  FrameCounter counter;
+  EXPECT_TRUE(AddClient(kFakeInterfaceIndex1, hardware_address1_, &counter));
+  counter.set_on_frame(Bind(&PacketDemuxer::RemoveClient,
+                            Unretained(&demuxer_),
+                            kFakeInterfaceIndex1,
+                            hardware_address1_));
+  frames_ = {
+      {MakeFrame(kFakeHardwareAddress1), kFakeInterfaceIndex1, PACKET_HOST},
+      {MakeFrame(kFakeHardwareAddress1), kFakeInterfaceIndex1, PACKET_HOST},
+  };
+  // The last client is gone, so is the socket and the rest of the batch.
+  EXPECT_CALL(*sockets_, Close(kFakeFd)).Times(1);
+  ReceiveFrames();
+  EXPECT_EQ(1, counter.count());
+  EXPECT_EQ(0u, demuxer_.client_count());
+  EXPECT_EQ(-1, demuxer_.socket());
+}
+
+TEST_F(PacketDemuxerTest, DropsTruncatedFrame) {
+  FrameCounter counter;
+  EXPECT_TRUE(AddClient(kFakeInterfaceIndex1, hardware_address1_, &counter));
+  std::vector<uint8_t> frame = MakeFrame(kFakeHardwareAddress1);
+  frame.resize(kChaddrOffset + 2);
+  frames_ = {{frame, kFakeInterfaceIndex1, PACKET_HOST}};
+  ReceiveFrames();
+  EXPECT_EQ(0, counter.count());
+  EXPECT_CALL(*sockets_, Close(kFakeFd)).Times(1);
+}
+
+TEST_F(PacketDemuxerTest, ForwardsPacketStatus) {
+  FrameCounter counter;
+  EXPECT_TRUE(AddClient(kFakeInterfaceIndex1, hardware_address1_, &counter));
+  frames_ = {{MakeFrame(kFakeHardwareAddress1), kFakeInterfaceIndex1,
+              PACKET_HOST, TP_STATUS_CSUM_VALID}};
+  ReceiveFrames();
+  EXPECT_EQ(1, counter.count());
+  EXPECT_EQ(static_cast<uint32_t>(TP_STATUS_CSUM_VALID), counter.status());
+  EXPECT_CALL(*sockets_, Close(kFakeFd)).Times(1);
+}
+
+}  // namespace dhcp_client
@@ -0,0 +1,145 @@
+//
+// Copyright (C) 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "dhcp_client/packet_ring.h"
+
+#include <linux/if_packet.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+
+#include <cstring>
+
+#include <base/logging.h>
+
+namespace dhcp_client {
+
+namespace {
+// Ring geometry. DHCP traffic is light and the frames are small,
+// a few small blocks are enough to absorb bursts on a busy segment.
+const unsigned int kBlockSize = 1 << 14;
+const unsigned int kBlockCount = 8;
+const unsigned int kFrameSize = 1 << 11;
+// Hand a partially filled block to userspace after this many milliseconds.
+const unsigned int kBlockRetireTimeoutMilliseconds = 4;
+
+tpacket_block_desc* GetBlock(uint8_t* ring, size_t index) {
+  return reinterpret_cast<tpacket_block_desc*>(ring + index * kBlockSize);
+}
+}  // namespace
+
+PacketRing::PacketRing(Sockets* sockets)
+    : sockets_(sockets),
+      ring_(nullptr),
+      ring_size_(0),
+      current_block_(0) {
+}
+
+PacketRing::~PacketRing() {
+  if (ring_ != nullptr) {
+    sockets_->Munmap(ring_, ring_size_);
+  }
+}
+
+bool PacketRing::Init(int fd) {
+  if (ring_ != nullptr) {
+    LOG(ERROR) << "Packet ring is already initialized";
+    return false;
+  }
+  int version = TPACKET_V3;
+  if (sockets_->SetSockOpt(fd, SOL_PACKET, PACKET_VERSION,
+                           &version, sizeof(version)) != 0) {
+    PLOG(ERROR) << "Failed to set TPACKET_V3";
+    return false;
+  }
+  tpacket_req3 request;
+  memset(&request, 0, sizeof(request));
+  request.tp_block_size = kBlockSize;
+  request.tp_block_nr = kBlockCount;
+  request.tp_frame_size = kFrameSize;
+  request.tp_frame_nr = kBlockSize / kFrameSize * kBlockCount;
+  request.tp_retire_blk_tov = kBlockRetireTimeoutMilliseconds;
+  if (sockets_->SetSockOpt(fd, SOL_PACKET, PACKET_RX_RING,
+                           &request, sizeof(request)) != 0) {
+    PLOG(ERROR) << "Failed to set up the receive ring";
+    RestoreVersion(fd);
+    return false;
+  }
+  size_t ring_size = static_cast<size_t>(kBlockSize) * kBlockCount;
+  void* ring = sockets_->Mmap(nullptr, ring_size, PROT_READ | PROT_WRITE,
+                              MAP_SHARED | MAP_LOCKED, fd, 0);
+  if (ring == MAP_FAILED) {
+    // MAP_LOCKED fails without CAP_IPC_LOCK beyond RLIMIT_MEMLOCK.
+    ring = sockets_->Mmap(nullptr, ring_size, PROT_READ | PROT_WRITE,
+                          MAP_SHARED, fd, 0);
+  }
+  if (ring == MAP_FAILED) {
+    PLOG(ERROR) << "Failed to map the receive ring";
+    // With a ring set up the socket no longer queues frames for recv,
+    // a request without blocks releases it.
+    memset(&request, 0, sizeof(request));
+    if (sockets_->SetSockOpt(fd, SOL_PACKET, PACKET_RX_RING,
+                             &request, sizeof(request)) != 0) {
+      PLOG(ERROR) << "Failed to release the receive ring";
+    }
+    RestoreVersion(fd);
+    return false;
+  }
+  ring_ = static_cast<uint8_t*>(ring);
+  ring_size_ = ring_size;
+  current_block_ = 0;
+  return true;
+}
+
+void PacketRing::RestoreVersion(int fd) {
+  int version = TPACKET_V1;
+  if (sockets_->SetSockOpt(fd, SOL_PACKET, PACKET_VERSION,
+                           &version, sizeof(version)) != 0) {
+    PLOG(ERROR) << "Failed to restore TPACKET_V1";
+  }
+}
+
+size_t PacketRing::ReadFrames(const FrameCallback& callback) {
+  DCHECK(IsInitialized());
+  size_t frame_count = 0;
+  while (true) {
+    tpacket_block_desc* block = GetBlock(ring_, current_block_);
+    if ((__atomic_load_n(&block->hdr.bh1.block_status, __ATOMIC_ACQUIRE) &
+         TP_STATUS_USER) == 0) {
+      break;
+    }
+    uint8_t* frame = reinterpret_cast<uint8_t*>(block) +
+        block->hdr.bh1.offset_to_first_pkt;
+    for (uint32_t i = 0; i < block->hdr.bh1.num_pkts; i++) {
+      const tpacket3_hdr* header = reinterpret_cast<tpacket3_hdr*>(frame);
+      const sockaddr_ll* address = reinterpret_cast<const sockaddr_ll*>(
+          frame + TPACKET_ALIGN(sizeof(tpacket3_hdr)));
+      if (address->sll_pkttype != PACKET_OUTGOING) {
+        callback.Run(frame + header->tp_net,
+                     header->tp_snaplen - (header->tp_net - header->tp_mac),
+                     header->tp_status);
+        frame_count++;
+      }
+      frame += header->tp_next_offset;
+    }
+    // Retire the whole block at once.
+    __atomic_store_n(&block->hdr.bh1.block_status, TP_STATUS_KERNEL,
+                     __ATOMIC_RELEASE);
+    current_block_ = (current_block_ + 1) % kBlockCount;
+  }
+  return frame_count;
+}
+
+}  // namespace dhcp_client
@@ -0,0 +1,75 @@
+//
+// Copyright (C) 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef DHCP_CLIENT_PACKET_RING_H_
+#define DHCP_CLIENT_PACKET_RING_H_
+
+#include <cstddef>
+#include <cstdint>
+
+#include <base/callback.h>
+#include <base/macros.h>
+
+#include "dhcp_client/sockets.h"
+
+namespace dhcp_client {
+
+// A TPACKET_V3 memory mapped receive ring on a packet socket.
+// The kernel fills whole blocks of frames; frames are read in place and
+// a block is handed back to the kernel once all of its frames are read,
+// so no syscall or copy is needed per packet.
+class PacketRing {
+ public:
+  // Called for every received frame. |buffer| points into the ring and is
+  // only valid during the call. For SOCK_DGRAM sockets it starts at the
+  // network header. |status| is the tp_status of the frame, holding the
+  // TP_STATUS_CSUM_* bits.
+  typedef base::Callback<void(const unsigned char* buffer,
+                              size_t len,
+                              uint32_t status)>
+      FrameCallback;
+
+  // |sockets| is not owned.
+  explicit PacketRing(Sockets* sockets);
+  ~PacketRing();
+
+  // Set up and map the ring on the packet socket |fd|. On failure the
+  // socket is left as it was, so it can still be read from.
+  bool Init(int fd);
+  bool IsInitialized() const { return ring_ != nullptr; }
+
+  // Pass the frames of every block the kernel has handed over to
+  // |callback|, then give the blocks back to the kernel.
+  // Frames sent by this host are skipped.
+  // Returns the number of frames passed to |callback|.
+  size_t ReadFrames(const FrameCallback& callback);
+
+ private:
+  // Put |fd| back to the default TPACKET_V1 frame format.
+  void RestoreVersion(int fd);
+
+  Sockets* sockets_;
+  uint8_t* ring_;
+  size_t ring_size_;
+  // Index of the next block to read.
+  size_t current_block_;
+
+  DISALLOW_COPY_AND_ASSIGN(PacketRing);
+};
+
+}  // namespace dhcp_client
+
+#endif  // DHCP_CLIENT_PACKET_RING_H_
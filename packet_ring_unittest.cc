@@ -0,0 +1,274 @@
+//
+// Copyright (C) 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "dhcp_client/packet_ring.h"
+
+#include <arpa/inet.h>
+#include <linux/if_packet.h>
+#include <net/ethernet.h>
+#include <net/if.h>
+#include <netinet/ip.h>
+#include <netinet/udp.h>
+#include <poll.h>
+#include <sched.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <base/bind.h>
+#include <base/logging.h>
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include "dhcp_client/mock_sockets.h"
+
+using base::Bind;
+using base::Unretained;
+using ::testing::_;
+using ::testing::InSequence;
+using ::testing::Not;
+using ::testing::Return;
+
+namespace dhcp_client {
+
+namespace {
+const int kFakeFd = 99;
+const uint16_t kDHCPClientPort = 68;
+const char kLoopbackInterface[] = "lo";
+// Enough datagrams to fill several blocks of the ring.
+const size_t kDatagramCount = 64;
+const size_t kPayloadLength = 300;
+const int kPollTimeoutMilliseconds = 1000;
+
+class FrameCollector {
+ public:
+  void OnFrame(const unsigned char* buffer, size_t len, uint32_t status) {
+    frames_.push_back(std::string(reinterpret_cast<const char*>(buffer), len));
+  }
+  const std::vector<std::string>& frames() const { return frames_; }
+
+ private:
+  std::vector<std::string> frames_;
+};
+
+// Exits the child process with a message on stderr.
+// _exit() skips the at exit handlers of the test framework.
+void Fail(const char* message) {
+  fprintf(stderr, "%s: %s\n", message, strerror(errno));
+  fflush(stderr);
+  _exit(1);
+}
+
+bool BringUpInterface(const char* interface_name) {
+  int fd = socket(AF_INET, SOCK_DGRAM, 0);
+  if (fd < 0) {
+    return false;
+  }
+  struct ifreq request;
+  memset(&request, 0, sizeof(request));
+  strncpy(request.ifr_name, interface_name, IFNAMSIZ - 1);
+  bool result = ioctl(fd, SIOCGIFFLAGS, &request) == 0;
+  request.ifr_flags |= IFF_UP;
+  result = result && ioctl(fd, SIOCSIFFLAGS, &request) == 0;
+  close(fd);
+  return result;
+}
+
+// Returns true if this process may create a network namespace
+// with a packet socket in it.
+bool CanCreateNetworkNamespace() {
+  pid_t pid = fork();
+  if (pid == 0) {
+    if (unshare(CLONE_NEWNET) != 0) {
+      _exit(1);
+    }
+    int fd = socket(PF_PACKET, SOCK_DGRAM, htons(ETHERTYPE_IP));
+    _exit(fd < 0 ? 1 : 0);
+  }
+  int status;
+  return pid > 0 && waitpid(pid, &status, 0) == pid &&
+      WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+// Runs in a child process inside a private network namespace, where the
+// loopback interface carries nothing but the datagrams sent here.
+void ReceiveThroughRing() {
+  if (unshare(CLONE_NEWNET) != 0) {
+    Fail("unshare");
+  }
+  if (!BringUpInterface(kLoopbackInterface)) {
+    Fail("Failed to bring up loopback");
+  }
+  int packet_socket = socket(PF_PACKET, SOCK_DGRAM, htons(ETHERTYPE_IP));
+  if (packet_socket < 0) {
+    Fail("Failed to create packet socket");
+  }
+  Sockets sockets;
+  PacketRing ring(&sockets);
+  if (!ring.Init(packet_socket)) {
+    Fail("Failed to set up the ring");
+  }
+  struct sockaddr_ll local;
+  memset(&local, 0, sizeof(local));
+  local.sll_family = PF_PACKET;
+  local.sll_protocol = htons(ETHERTYPE_IP);
+  local.sll_ifindex = static_cast<int>(if_nametoindex(kLoopbackInterface));
+  if (bind(packet_socket,
+           reinterpret_cast<struct sockaddr*>(&local),
+           sizeof(local)) != 0) {
+    Fail("Failed to bind packet socket");
+  }
+
+  // Keep a listener on the port so the kernel does not answer with
+  // ICMP port unreachable.
+  struct sockaddr_in address;
+  memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_port = htons(kDHCPClientPort);
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  int listener = socket(AF_INET, SOCK_DGRAM, 0);
+  if (listener < 0 ||
+      bind(listener, reinterpret_cast<struct sockaddr*>(&address),
+           sizeof(address)) != 0) {
+    Fail("Failed to bind UDP listener");
+  }
+  int sender = socket(AF_INET, SOCK_DGRAM, 0);
+  if (sender < 0) {
+    Fail("Failed to create UDP sender");
+  }
+  for (size_t i = 0; i < kDatagramCount; i++) {
+    std::vector<uint8_t> payload(kPayloadLength, static_cast<uint8_t>(i));
+    if (sendto(sender, payload.data(), payload.size(), 0,
+               reinterpret_cast<struct sockaddr*>(&address),
+               sizeof(address)) != static_cast<ssize_t>(payload.size())) {
+      Fail("Failed to send datagram");
+    }
+  }
+
+  FrameCollector collector;
+  while (collector.frames().size() < kDatagramCount) {
+    struct pollfd poll_fd = {packet_socket, POLLIN, 0};
+    if (poll(&poll_fd, 1, kPollTimeoutMilliseconds) <= 0) {
+      Fail("Timed out waiting for frames");
+    }
+    ring.ReadFrames(Bind(&FrameCollector::OnFrame, Unretained(&collector)));
+  }
+
+  if (collector.frames().size() != kDatagramCount) {
+    Fail("Unexpected number of frames");
+  }
+  const size_t kFrameLength =
+      sizeof(struct iphdr) + sizeof(struct udphdr) + kPayloadLength;
+  for (size_t i = 0; i < kDatagramCount; i++) {
+    const std::string& frame = collector.frames()[i];
+    if (frame.size() != kFrameLength) {
+      Fail("Unexpected frame length");
+    }
+    const struct udphdr* udp = reinterpret_cast<const struct udphdr*>(
+        frame.data() + sizeof(struct iphdr));
+    if (ntohs(udp->uh_dport) != kDHCPClientPort) {
+      Fail("Unexpected destination port");
+    }
+    // Frames come out in order, and only once although the loopback
+    // interface also reports them as outgoing.
+    if (frame.back() != static_cast<char>(i)) {
+      Fail("Unexpected payload");
+    }
+  }
+  _exit(0);
+}
+
+MATCHER_P(PointsToVersion, version, "") {
+  return *static_cast<const int*>(arg) == version;
+}
+
+MATCHER(IsRingRelease, "") {
+  tpacket_req3 release;
+  memset(&release, 0, sizeof(release));
+  return memcmp(arg, &release, sizeof(release)) == 0;
+}
+
+}  // namespace
+
+TEST(PacketRingTest, InitFailsOnNonPacketSocket) {
+  int fd = socket(AF_INET, SOCK_DGRAM, 0);
+  ASSERT_GE(fd, 0);
+  Sockets sockets;
+  PacketRing ring(&sockets);
+  EXPECT_FALSE(ring.Init(fd));
+  EXPECT_FALSE(ring.IsInitialized());
+  close(fd);
+}
+
+TEST(PacketRingTest, InitRestoresVersionIfRingIsRefused) {
+  MockSockets sockets;
+  PacketRing ring(&sockets);
+  InSequence sequence;
+  EXPECT_CALL(sockets, SetSockOpt(kFakeFd, SOL_PACKET, PACKET_VERSION,
+                                  PointsToVersion(TPACKET_V3), _))
+      .WillOnce(Return(0));
+  EXPECT_CALL(sockets, SetSockOpt(kFakeFd, SOL_PACKET, PACKET_RX_RING, _, _))
+      .WillOnce(Return(-1));
+  EXPECT_CALL(sockets, SetSockOpt(kFakeFd, SOL_PACKET, PACKET_VERSION,
+                                  PointsToVersion(TPACKET_V1), _))
+      .WillOnce(Return(0));
+  EXPECT_FALSE(ring.Init(kFakeFd));
+  EXPECT_FALSE(ring.IsInitialized());
+}
+
+TEST(PacketRingTest, InitReleasesRingIfMappingFails) {
+  MockSockets sockets;
+  PacketRing ring(&sockets);
+  InSequence sequence;
+  EXPECT_CALL(sockets, SetSockOpt(kFakeFd, SOL_PACKET, PACKET_VERSION,
+                                  PointsToVersion(TPACKET_V3), _))
+      .WillOnce(Return(0));
+  EXPECT_CALL(sockets, SetSockOpt(kFakeFd, SOL_PACKET, PACKET_RX_RING,
+                                  Not(IsRingRelease()),
+                                  sizeof(tpacket_req3)))
+      .WillOnce(Return(0));
+  // With and then without MAP_LOCKED.
+  EXPECT_CALL(sockets, Mmap(_, _, _, _, kFakeFd, 0))
+      .Times(2)
+      .WillRepeatedly(Return(MAP_FAILED));
+  // The socket goes back to queueing frames for recv.
+  EXPECT_CALL(sockets, SetSockOpt(kFakeFd, SOL_PACKET, PACKET_RX_RING,
+                                  IsRingRelease(), sizeof(tpacket_req3)))
+      .WillOnce(Return(0));
+  EXPECT_CALL(sockets, SetSockOpt(kFakeFd, SOL_PACKET, PACKET_VERSION,
+                                  PointsToVersion(TPACKET_V1), _))
+      .WillOnce(Return(0));
+  EXPECT_CALL(sockets, Munmap(_, _)).Times(0);
+  EXPECT_FALSE(ring.Init(kFakeFd));
+  EXPECT_FALSE(ring.IsInitialized());
+}
+
+TEST(PacketRingTest, ReceiveInNetworkNamespace) {
+  if (!CanCreateNetworkNamespace()) {
+    LOG(WARNING) << "Skipping test, unable to create a network namespace";
+    return;
+  }
+  EXPECT_EXIT(ReceiveThroughRing(), testing::ExitedWithCode(0), "");
+}
+
+}  // namespace dhcp_client
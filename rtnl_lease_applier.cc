@@ -0,0 +1,322 @@
+//
+// Copyright (C) 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+
+#include "dhcp_client/rtnl_lease_applier.h"
+
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include <base/logging.h>
+
+namespace dhcp_client {
+
+namespace {
+const int kInvalidSocketDescriptor = -1;
+// Room for a few acknowledgments, each echoing its request.
+const size_t kReceiveBufferSize = 8192;
+
+uint32_t PrefixLengthToMask(uint8_t prefix_length) {
+  return prefix_length == 0 ? 0 : 0xffffffffu << (32 - prefix_length);
+}
+
+// Whether the kernel answered a removal with |error| because the object
+// was not there.
+bool IsMissingError(int error) {
+  return error == ENOENT || error == ESRCH || error == EADDRNOTAVAIL;
+}
+
+bool ContainsRoute(const std::vector<Route>& routes, const Route& route) {
+  return std::find(routes.begin(), routes.end(), route) != routes.end();
+}
+}  // namespace
+
+RTNLLeaseApplier::RTNLLeaseApplier(unsigned int interface_index)
+    : interface_index_(interface_index),
+      sockets_(new shill::Sockets()),
+      socket_(kInvalidSocketDescriptor),
+      sequence_(1),
+      in_sync_(true),
+      message_offset_(0),
+      first_sequence_(0),
+      receive_buffer_(kReceiveBufferSize) {
+}
+
+RTNLLeaseApplier::~RTNLLeaseApplier() {
+  if (socket_ != kInvalidSocketDescriptor) {
+    sockets_->Close(socket_);
+  }
+}
+
+bool RTNLLeaseApplier::Init() {
+  int fd = sockets_->Socket(PF_NETLINK,
+                            SOCK_RAW | SOCK_CLOEXEC,
+                            NETLINK_ROUTE);
+  if (fd == kInvalidSocketDescriptor) {
+    PLOG(ERROR) << "Failed to create rtnetlink socket";
+    return false;
+  }
+  shill::ScopedSocketCloser socket_closer(sockets_.get(), fd);
+
+  struct sockaddr_nl local;
+  memset(&local, 0, sizeof(local));
+  local.nl_family = AF_NETLINK;
+  if (sockets_->Bind(fd,
+                     reinterpret_cast<struct sockaddr*>(&local),
+                     sizeof(local)) < 0) {
+    PLOG(ERROR) << "Failed to bind rtnetlink socket";
+    return false;
+  }
+
+  socket_ = socket_closer.Release();
+  return true;
+}
+
+bool RTNLLeaseApplier::Apply(const NetworkConfig& config) {
+  if (in_sync_ && config == applied_ && failed_removals_.empty()) {
+    return true;
+  }
+  batch_.clear();
+  requests_.clear();
+  first_sequence_ = sequence_;
+  std::vector<Request> retried_removals;
+  retried_removals.swap(failed_removals_);
+
+  for (const Route& route : applied_.routes) {
+    if (!ContainsRoute(config.routes, route)) {
+      AddRouteRequest(RTM_DELROUTE, route, 0);
+    }
+  }
+  for (const Request& removal : retried_removals) {
+    if (removal.type == RTM_DELROUTE &&
+        !ContainsRoute(config.routes, removal.route) &&
+        !ContainsRoute(applied_.routes, removal.route)) {
+      AddRouteRequest(RTM_DELROUTE, removal.route, 0);
+    }
+  }
+  bool address_changed = config.address != applied_.address ||
+                         config.prefix_length != applied_.prefix_length;
+  if (address_changed && applied_.address != 0) {
+    AddAddressRequest(RTM_DELADDR, applied_.address, applied_.prefix_length);
+  }
+  for (const Request& removal : retried_removals) {
+    if (removal.type == RTM_DELADDR &&
+        removal.address != config.address &&
+        !(address_changed && removal.address == applied_.address)) {
+      AddAddressRequest(RTM_DELADDR, removal.address, removal.prefix_length);
+    }
+  }
+  // The routes with the old address as source went away with it.
+  bool add_all = address_changed || !in_sync_;
+  if (add_all && config.address != 0) {
+    AddAddressRequest(RTM_NEWADDR, config.address, config.prefix_length);
+  }
+  // The kernel refuses a route through a gateway it cannot reach, add
+  // the routes to the directly attached networks first.
+  for (bool on_link : {true, false}) {
+    for (const Route& route : config.routes) {
+      if ((route.gateway == 0) == on_link &&
+          (add_all || !ContainsRoute(applied_.routes, route))) {
+        AddRouteRequest(RTM_NEWROUTE, route, config.address);
+      }
+    }
+  }
+
+  bool success = requests_.empty() || Transact();
+  // Each request is handled on its own. Whatever failed is sent again
+  // by the next call, and whatever went through is removed by it if
+  // the next configuration does not have it. The objects whose removal
+  // failed are not in |config|, they are remembered apart.
+  for (const Request& request : requests_) {
+    if (request.is_removal && !request.succeeded) {
+      failed_removals_.push_back(request);
+    }
+  }
+  applied_ = config;
+  in_sync_ = success;
+  return success;
+}
+
+bool RTNLLeaseApplier::Clear() {
+  return Apply(NetworkConfig());
+}
+
+void RTNLLeaseApplier::AddAddressRequest(uint16_t type,
+                                         uint32_t address,
+                                         uint8_t prefix_length) {
+  bool is_removal = type == RTM_DELADDR;
+  struct ifaddrmsg header;
+  memset(&header, 0, sizeof(header));
+  header.ifa_family = AF_INET;
+  header.ifa_prefixlen = prefix_length;
+  header.ifa_scope = RT_SCOPE_UNIVERSE;
+  header.ifa_index = interface_index_;
+  BeginMessage(type,
+               is_removal ? 0 : NLM_F_CREATE | NLM_F_REPLACE,
+               &header,
+               sizeof(header));
+  requests_.back().address = address;
+  requests_.back().prefix_length = prefix_length;
+  uint32_t address_net = htonl(address);
+  AddAttribute(IFA_LOCAL, &address_net, sizeof(address_net));
+  AddAttribute(IFA_ADDRESS, &address_net, sizeof(address_net));
+  if (!is_removal && prefix_length < 31) {
+    uint32_t broadcast_net =
+        htonl(address | ~PrefixLengthToMask(prefix_length));
+    AddAttribute(IFA_BROADCAST, &broadcast_net, sizeof(broadcast_net));
+  }
+}
+
+void RTNLLeaseApplier::AddRouteRequest(uint16_t type,
+                                       const Route& route,
+                                       uint32_t source) {
+  bool is_removal = type == RTM_DELROUTE;
+  struct rtmsg header;
+  memset(&header, 0, sizeof(header));
+  header.rtm_family = AF_INET;
+  header.rtm_dst_len = route.prefix_length;
+  header.rtm_table = RT_TABLE_MAIN;
+  header.rtm_protocol = RTPROT_DHCP;
+  if (is_removal) {
+    header.rtm_scope = RT_SCOPE_NOWHERE;
+  } else {
+    header.rtm_scope = route.gateway != 0 ? RT_SCOPE_UNIVERSE : RT_SCOPE_LINK;
+  }
+  header.rtm_type = RTN_UNICAST;
+  BeginMessage(type,
+               is_removal ? 0 : NLM_F_CREATE | NLM_F_REPLACE,
+               &header,
+               sizeof(header));
+  requests_.back().route = route;
+  if (route.prefix_length != 0) {
+    uint32_t destination_net = htonl(route.destination);
+    AddAttribute(RTA_DST, &destination_net, sizeof(destination_net));
+  }
+  if (route.gateway != 0) {
+    uint32_t gateway_net = htonl(route.gateway);
+    AddAttribute(RTA_GATEWAY, &gateway_net, sizeof(gateway_net));
+  }
+  uint32_t interface_index = interface_index_;
+  AddAttribute(RTA_OIF, &interface_index, sizeof(interface_index));
+  if (!is_removal && source != 0) {
+    uint32_t source_net = htonl(source);
+    AddAttribute(RTA_PREFSRC, &source_net, sizeof(source_net));
+  }
+}
+
+void RTNLLeaseApplier::BeginMessage(uint16_t type,
+                                    uint16_t flags,
+                                    const void* header,
+                                    size_t header_length) {
+  message_offset_ = batch_.size();
+  size_t message_length = NLMSG_LENGTH(header_length);
+  batch_.resize(message_offset_ + NLMSG_ALIGN(message_length), 0);
+  struct nlmsghdr message;
+  memset(&message, 0, sizeof(message));
+  message.nlmsg_len = message_length;
+  message.nlmsg_type = type;
+  message.nlmsg_flags = NLM_F_REQUEST | NLM_F_ACK | flags;
+  message.nlmsg_seq = sequence_++;
+  memcpy(&batch_[message_offset_], &message, sizeof(message));
+  memcpy(&batch_[message_offset_ + NLMSG_HDRLEN], header, header_length);
+  Request request;
+  request.type = type;
+  request.is_removal = type == RTM_DELADDR || type == RTM_DELROUTE;
+  request.acknowledged = false;
+  request.succeeded = false;
+  request.address = 0;
+  request.prefix_length = 0;
+  requests_.push_back(request);
+}
+
+void RTNLLeaseApplier::AddAttribute(uint16_t type,
+                                    const void* data,
+                                    size_t length) {
+  // Messages are padded to NLMSG_ALIGNTO, which is also RTA_ALIGNTO.
+  size_t offset = batch_.size();
+  batch_.resize(offset + RTA_SPACE(length), 0);
+  struct rtattr attribute;
+  attribute.rta_len = RTA_LENGTH(length);
+  attribute.rta_type = type;
+  memcpy(&batch_[offset], &attribute, sizeof(attribute));
+  memcpy(&batch_[offset + RTA_LENGTH(0)], data, length);
+  uint32_t message_length = batch_.size() - message_offset_;
+  memcpy(&batch_[message_offset_ + offsetof(struct nlmsghdr, nlmsg_len)],
+         &message_length,
+         sizeof(message_length));
+}
+
+bool RTNLLeaseApplier::Transact() {
+  if (socket_ == kInvalidSocketDescriptor) {
+    LOG(ERROR) << "Rtnetlink socket is not open";
+    return false;
+  }
+  ssize_t sent = sockets_->Send(socket_, batch_.data(), batch_.size(), 0);
+  if (sent != static_cast<ssize_t>(batch_.size())) {
+    PLOG(ERROR) << "Failed to send rtnetlink requests";
+    return false;
+  }
+  // The kernel handles the requests in order within the send, all the
+  // acknowledgments are queued by now.
+  size_t pending = requests_.size();
+  bool success = true;
+  while (pending > 0) {
+    ssize_t received = sockets_->RecvFrom(socket_,
+                                          receive_buffer_.data(),
+                                          receive_buffer_.size(),
+                                          MSG_DONTWAIT,
+                                          nullptr,
+                                          nullptr);
+    if (received <= 0) {
+      PLOG(ERROR) << "Missing " << pending << " rtnetlink acknowledgments";
+      return false;
+    }
+    int remaining = static_cast<int>(received);
+    for (const struct nlmsghdr* message =
+             reinterpret_cast<const struct nlmsghdr*>(receive_buffer_.data());
+         NLMSG_OK(message, remaining);
+         message = NLMSG_NEXT(message, remaining)) {
+      uint32_t index = message->nlmsg_seq - first_sequence_;
+      if (message->nlmsg_type != NLMSG_ERROR ||
+          message->nlmsg_len < NLMSG_LENGTH(sizeof(struct nlmsgerr)) ||
+          index >= requests_.size() ||
+          requests_[index].acknowledged) {
+        continue;
+      }
+      Request* request = &requests_[index];
+      request->acknowledged = true;
+      pending--;
+      int error = -static_cast<const struct nlmsgerr*>(
+          NLMSG_DATA(message))->error;
+      if (error != 0 && !(request->is_removal && IsMissingError(error))) {
+        LOG(ERROR) << "Rtnetlink request " << message->nlmsg_seq
+                   << " failed with error " << error;
+        success = false;
+      } else {
+        request->succeeded = true;
+      }
+    }
+  }
+  return success;
+}
+
+}  // namespace dhcp_client
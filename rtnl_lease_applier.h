@@ -0,0 +1,108 @@
+//
+// Copyright (C) 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+
+#ifndef DHCP_CLIENT_RTNL_LEASE_APPLIER_H_
+#define DHCP_CLIENT_RTNL_LEASE_APPLIER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include <base/macros.h>
+#include <shill/net/sockets.h>
+
+#include "dhcp_client/lease_applier_interface.h"
+
+namespace dhcp_client {
+
+// Applies leases to an interface with rtnetlink.
+// All the address and route changes of a lease are sent in a single
+// batch of requests, each asking for an acknowledgment, and the
+// acknowledgments are then collected in one pass instead of a round trip
+// per change. The configuration applied last is kept and the next one is
+// diffed against it, so a renewal that changes nothing sends nothing.
+// Removals that fail are kept and sent again with the next change.
+class RTNLLeaseApplier : public LeaseApplierInterface {
+ public:
+  explicit RTNLLeaseApplier(unsigned int interface_index);
+  ~RTNLLeaseApplier() override;
+
+  // Open the rtnetlink socket.
+  bool Init();
+
+  bool Apply(const NetworkConfig& config) override;
+  bool Clear() override;
+
+ private:
+  friend class RTNLLeaseApplierTest;
+
+  // A request of the batch being built or sent.
+  struct Request {
+    uint16_t type;
+    // Removals succeed if the object is already gone.
+    bool is_removal;
+    bool acknowledged;
+    bool succeeded;
+    // What a removal removes, to send it again if it fails.
+    uint32_t address;
+    uint8_t prefix_length;
+    Route route;
+  };
+
+  void AddAddressRequest(uint16_t type,
+                         uint32_t address,
+                         uint8_t prefix_length);
+  // |source| is the preferred source address of an added route.
+  void AddRouteRequest(uint16_t type, const Route& route, uint32_t source);
+  // Append a message of |type| starting with the |header_length| bytes
+  // of |header| to |batch_|, the attributes are added after it.
+  void BeginMessage(uint16_t type,
+                    uint16_t flags,
+                    const void* header,
+                    size_t header_length);
+  void AddAttribute(uint16_t type, const void* data, size_t length);
+  // Send |batch_| and collect the acknowledgments of its requests.
+  bool Transact();
+
+  unsigned int interface_index_;
+  std::unique_ptr<shill::Sockets> sockets_;
+  int socket_;
+  // Sequence number of the next request.
+  uint32_t sequence_;
+  NetworkConfig applied_;
+  // Whether all of |applied_| is known to be on the interface.
+  bool in_sync_;
+  // Removals that were not acknowledged as done, sent again by the next
+  // call unless its configuration has the object.
+  std::vector<Request> failed_removals_;
+
+  // Kept between transactions to reuse their storage.
+  std::vector<uint8_t> batch_;
+  // Offset in |batch_| of the message being built.
+  size_t message_offset_;
+  // Sequence number of the first request of |batch_|.
+  uint32_t first_sequence_;
+  std::vector<Request> requests_;
+  std::vector<uint8_t> receive_buffer_;
+
+  DISALLOW_COPY_AND_ASSIGN(RTNLLeaseApplier);
+};
+
+}  // namespace dhcp_client
+
+#endif  // DHCP_CLIENT_RTNL_LEASE_APPLIER_H_
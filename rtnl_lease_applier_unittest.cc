@@ -0,0 +1,319 @@
+//
+// Copyright (C) 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+
+#include "dhcp_client/rtnl_lease_applier.h"
+
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <netinet/in.h>
+
+#include <cerrno>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <vector>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include <shill/net/mock_sockets.h>
+
+using shill::MockSockets;
+using testing::_;
+using testing::Invoke;
+using testing::Return;
+
+namespace dhcp_client {
+
+namespace {
+const int kFakeFd = 99;
+const unsigned int kFakeInterfaceIndex = 3;
+const uint32_t kFakeAddress = 0xc0a80164;  // 192.168.1.100
+const uint32_t kFakeOtherAddress = 0xc0a80165;  // 192.168.1.101
+const uint32_t kFakeGateway = 0xc0a80101;  // 192.168.1.1
+const uint32_t kFakeOtherGateway = 0xc0a80102;  // 192.168.1.2
+const uint32_t kFakeNetwork = 0x0a000000;  // 10.0.0.0
+
+// The fields of a sent request the tests look at.
+struct SentRequest {
+  uint16_t type;
+  uint32_t address;
+  uint8_t prefix_length;
+  uint32_t gateway;
+};
+}  // namespace
+
+class RTNLLeaseApplierTest : public testing::Test {
+ public:
+  RTNLLeaseApplierTest()
+      : applier_(kFakeInterfaceIndex),
+        sockets_(new MockSockets()),
+        send_count_(0) {
+    applier_.sockets_.reset(sockets_);
+    ON_CALL(*sockets_, Socket(PF_NETLINK, _, NETLINK_ROUTE))
+        .WillByDefault(Return(kFakeFd));
+    ON_CALL(*sockets_, Send(kFakeFd, _, _, _))
+        .WillByDefault(Invoke(this, &RTNLLeaseApplierTest::Send));
+    ON_CALL(*sockets_, RecvFrom(kFakeFd, _, _, _, _, _))
+        .WillByDefault(Invoke(this, &RTNLLeaseApplierTest::RecvFrom));
+    EXPECT_CALL(*sockets_, Socket(PF_NETLINK, _, NETLINK_ROUTE)).Times(1);
+    EXPECT_TRUE(applier_.Init());
+  }
+
+  ~RTNLLeaseApplierTest() override {
+    EXPECT_CALL(*sockets_, Close(kFakeFd)).Times(1);
+  }
+
+  // Plays the kernel: records the requests of a batch and queues an
+  // acknowledgment for each.
+  ssize_t Send(int fd, const void* buffer, size_t length, int flags) {
+    send_count_++;
+    sent_.clear();
+    int remaining = static_cast<int>(length);
+    for (const struct nlmsghdr* message =
+             static_cast<const struct nlmsghdr*>(buffer);
+         NLMSG_OK(message, remaining);
+         message = NLMSG_NEXT(message, remaining)) {
+      EXPECT_TRUE(message->nlmsg_flags & NLM_F_ACK);
+      sent_.push_back(ParseRequest(message));
+      Acknowledgment ack;
+      ack.sequence = message->nlmsg_seq;
+      auto it = errors_.find(message->nlmsg_type);
+      ack.error = it != errors_.end() ? it->second : 0;
+      acks_.push_back(ack);
+    }
+    return length;
+  }
+
+  ssize_t RecvFrom(int fd,
+                   void* buffer,
+                   size_t length,
+                   int flags,
+                   struct sockaddr* address,
+                   socklen_t* address_length) {
+    if (acks_.empty()) {
+      errno = EAGAIN;
+      return -1;
+    }
+    Acknowledgment ack = acks_.front();
+    acks_.pop_front();
+    size_t ack_length = NLMSG_LENGTH(sizeof(struct nlmsgerr));
+    EXPECT_GE(length, ack_length);
+    memset(buffer, 0, ack_length);
+    struct nlmsghdr* message = static_cast<struct nlmsghdr*>(buffer);
+    message->nlmsg_len = ack_length;
+    message->nlmsg_type = NLMSG_ERROR;
+    message->nlmsg_seq = ack.sequence;
+    static_cast<struct nlmsgerr*>(NLMSG_DATA(message))->error = -ack.error;
+    return ack_length;
+  }
+
+ protected:
+  struct Acknowledgment {
+    uint32_t sequence;
+    int error;
+  };
+
+  static SentRequest ParseRequest(const struct nlmsghdr* message) {
+    SentRequest request = {};
+    request.type = message->nlmsg_type;
+    const struct rtattr* attribute;
+    int remaining;
+    if (request.type == RTM_NEWADDR || request.type == RTM_DELADDR) {
+      const struct ifaddrmsg* header =
+          static_cast<const struct ifaddrmsg*>(NLMSG_DATA(message));
+      EXPECT_EQ(kFakeInterfaceIndex, header->ifa_index);
+      request.prefix_length = header->ifa_prefixlen;
+      attribute = IFA_RTA(header);
+      remaining = IFA_PAYLOAD(message);
+    } else {
+      const struct rtmsg* header =
+          static_cast<const struct rtmsg*>(NLMSG_DATA(message));
+      request.prefix_length = header->rtm_dst_len;
+      attribute = RTM_RTA(header);
+      remaining = RTM_PAYLOAD(message);
+    }
+    for (; RTA_OK(attribute, remaining);
+         attribute = RTA_NEXT(attribute, remaining)) {
+      uint32_t value;
+      memcpy(&value, RTA_DATA(attribute), sizeof(value));
+      if (request.type == RTM_NEWADDR || request.type == RTM_DELADDR) {
+        if (attribute->rta_type == IFA_LOCAL) {
+          request.address = ntohl(value);
+        }
+      } else if (attribute->rta_type == RTA_DST) {
+        request.address = ntohl(value);
+      } else if (attribute->rta_type == RTA_GATEWAY) {
+        request.gateway = ntohl(value);
+      } else if (attribute->rta_type == RTA_OIF) {
+        EXPECT_EQ(kFakeInterfaceIndex, value);
+      }
+    }
+    return request;
+  }
+
+  static NetworkConfig MakeConfig(uint32_t address, uint32_t gateway) {
+    NetworkConfig config;
+    config.address = address;
+    config.prefix_length = 24;
+    config.routes.push_back(Route(0, 0, gateway));
+    config.routes.push_back(Route(kFakeNetwork, 8, 0));
+    return config;
+  }
+
+  RTNLLeaseApplier applier_;
+  MockSockets* sockets_;  // Owned by applier_.
+  int send_count_;
+  // The requests of the last batch.
+  std::vector<SentRequest> sent_;
+  std::deque<Acknowledgment> acks_;
+  // Error acknowledged to the requests of a type.
+  std::map<uint16_t, int> errors_;
+};
+
+TEST_F(RTNLLeaseApplierTest, ApplyInOneBatch) {
+  EXPECT_TRUE(applier_.Apply(MakeConfig(kFakeAddress, kFakeGateway)));
+  EXPECT_EQ(1, send_count_);
+  ASSERT_EQ(3u, sent_.size());
+  EXPECT_EQ(RTM_NEWADDR, sent_[0].type);
+  EXPECT_EQ(kFakeAddress, sent_[0].address);
+  EXPECT_EQ(24, sent_[0].prefix_length);
+  // The on link route comes before the one through a gateway.
+  EXPECT_EQ(RTM_NEWROUTE, sent_[1].type);
+  EXPECT_EQ(kFakeNetwork, sent_[1].address);
+  EXPECT_EQ(0u, sent_[1].gateway);
+  EXPECT_EQ(RTM_NEWROUTE, sent_[2].type);
+  EXPECT_EQ(0, sent_[2].prefix_length);
+  EXPECT_EQ(kFakeGateway, sent_[2].gateway);
+  EXPECT_TRUE(acks_.empty());
+}
+
+TEST_F(RTNLLeaseApplierTest, UnchangedLeaseSendsNothing) {
+  EXPECT_TRUE(applier_.Apply(MakeConfig(kFakeAddress, kFakeGateway)));
+  EXPECT_TRUE(applier_.Apply(MakeConfig(kFakeAddress, kFakeGateway)));
+  EXPECT_EQ(1, send_count_);
+}
+
+TEST_F(RTNLLeaseApplierTest, ApplyOnlyChangedRoutes) {
+  EXPECT_TRUE(applier_.Apply(MakeConfig(kFakeAddress, kFakeGateway)));
+  EXPECT_TRUE(applier_.Apply(MakeConfig(kFakeAddress, kFakeOtherGateway)));
+  EXPECT_EQ(2, send_count_);
+  ASSERT_EQ(2u, sent_.size());
+  EXPECT_EQ(RTM_DELROUTE, sent_[0].type);
+  EXPECT_EQ(kFakeGateway, sent_[0].gateway);
+  EXPECT_EQ(RTM_NEWROUTE, sent_[1].type);
+  EXPECT_EQ(kFakeOtherGateway, sent_[1].gateway);
+}
+
+TEST_F(RTNLLeaseApplierTest, AddressChangeAddsRoutesAgain) {
+  EXPECT_TRUE(applier_.Apply(MakeConfig(kFakeAddress, kFakeGateway)));
+  EXPECT_TRUE(applier_.Apply(MakeConfig(kFakeOtherAddress, kFakeGateway)));
+  ASSERT_EQ(4u, sent_.size());
+  EXPECT_EQ(RTM_DELADDR, sent_[0].type);
+  EXPECT_EQ(kFakeAddress, sent_[0].address);
+  EXPECT_EQ(RTM_NEWADDR, sent_[1].type);
+  EXPECT_EQ(kFakeOtherAddress, sent_[1].address);
+  EXPECT_EQ(RTM_NEWROUTE, sent_[2].type);
+  EXPECT_EQ(RTM_NEWROUTE, sent_[3].type);
+}
+
+TEST_F(RTNLLeaseApplierTest, FailedApplyIsRetried) {
+  errors_[RTM_NEWROUTE] = EPERM;
+  EXPECT_FALSE(applier_.Apply(MakeConfig(kFakeAddress, kFakeGateway)));
+  // Every acknowledgment was read.
+  EXPECT_TRUE(acks_.empty());
+  errors_.clear();
+  EXPECT_TRUE(applier_.Apply(MakeConfig(kFakeAddress, kFakeGateway)));
+  EXPECT_EQ(2, send_count_);
+  EXPECT_EQ(3u, sent_.size());
+}
+
+TEST_F(RTNLLeaseApplierTest, ClearRemovesEverything) {
+  EXPECT_TRUE(applier_.Apply(MakeConfig(kFakeAddress, kFakeGateway)));
+  // Removing the address may have taken the routes with it.
+  errors_[RTM_DELROUTE] = ESRCH;
+  EXPECT_TRUE(applier_.Clear());
+  ASSERT_EQ(3u, sent_.size());
+  EXPECT_EQ(RTM_DELROUTE, sent_[0].type);
+  EXPECT_EQ(RTM_DELROUTE, sent_[1].type);
+  EXPECT_EQ(RTM_DELADDR, sent_[2].type);
+  // Nothing is left to remove.
+  EXPECT_TRUE(applier_.Clear());
+  EXPECT_EQ(2, send_count_);
+}
+
+TEST_F(RTNLLeaseApplierTest, FailedAddressRemovalIsRetried) {
+  EXPECT_TRUE(applier_.Apply(MakeConfig(kFakeAddress, kFakeGateway)));
+  errors_[RTM_DELADDR] = EBUSY;
+  EXPECT_FALSE(applier_.Apply(MakeConfig(kFakeOtherAddress, kFakeGateway)));
+  ASSERT_EQ(4u, sent_.size());
+  EXPECT_EQ(RTM_DELADDR, sent_[0].type);
+  EXPECT_EQ(kFakeAddress, sent_[0].address);
+
+  // The old address is removed by the next call, even though the
+  // configuration did not change.
+  errors_.clear();
+  EXPECT_TRUE(applier_.Apply(MakeConfig(kFakeOtherAddress, kFakeGateway)));
+  EXPECT_EQ(3, send_count_);
+  ASSERT_LE(1u, sent_.size());
+  EXPECT_EQ(RTM_DELADDR, sent_[0].type);
+  EXPECT_EQ(kFakeAddress, sent_[0].address);
+  EXPECT_EQ(24, sent_[0].prefix_length);
+  for (size_t i = 1; i < sent_.size(); i++) {
+    EXPECT_NE(RTM_DELADDR, sent_[i].type);
+  }
+  // Nothing is left to do.
+  EXPECT_TRUE(applier_.Apply(MakeConfig(kFakeOtherAddress, kFakeGateway)));
+  EXPECT_EQ(3, send_count_);
+}
+
+TEST_F(RTNLLeaseApplierTest, FailedRouteRemovalIsRetried) {
+  EXPECT_TRUE(applier_.Apply(MakeConfig(kFakeAddress, kFakeGateway)));
+  errors_[RTM_DELROUTE] = EPERM;
+  EXPECT_FALSE(applier_.Clear());
+  errors_.clear();
+  EXPECT_TRUE(applier_.Clear());
+  ASSERT_EQ(2u, sent_.size());
+  EXPECT_EQ(RTM_DELROUTE, sent_[0].type);
+  EXPECT_EQ(RTM_DELROUTE, sent_[1].type);
+  EXPECT_TRUE(applier_.Clear());
+  EXPECT_EQ(3, send_count_);
+}
+
+TEST_F(RTNLLeaseApplierTest, RemovalNotRetriedOnceApplied) {
+  EXPECT_TRUE(applier_.Apply(MakeConfig(kFakeAddress, kFakeGateway)));
+  errors_[RTM_DELADDR] = EBUSY;
+  EXPECT_FALSE(applier_.Apply(MakeConfig(kFakeOtherAddress, kFakeGateway)));
+  // The lease came back to the address that failed to go away.
+  errors_.clear();
+  EXPECT_TRUE(applier_.Apply(MakeConfig(kFakeAddress, kFakeGateway)));
+  ASSERT_LE(2u, sent_.size());
+  EXPECT_EQ(RTM_DELADDR, sent_[0].type);
+  EXPECT_EQ(kFakeOtherAddress, sent_[0].address);
+  EXPECT_EQ(RTM_NEWADDR, sent_[1].type);
+  EXPECT_EQ(kFakeAddress, sent_[1].address);
+  for (size_t i = 2; i < sent_.size(); i++) {
+    EXPECT_NE(RTM_DELADDR, sent_[i].type);
+  }
+}
+
+TEST_F(RTNLLeaseApplierTest, MissingAcknowledgment) {
+  EXPECT_CALL(*sockets_, RecvFrom(kFakeFd, _, _, _, _, _))
+      .WillOnce(Return(-1));
+  EXPECT_FALSE(applier_.Apply(MakeConfig(kFakeAddress, kFakeGateway)));
+}
+
+}  // namespace dhcp_client
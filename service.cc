@@ -30,6 +30,14 @@ const char kConstantNetworkIdentifier[] = "identifier";
 const char kConstantRequestHostname[] = "request_hostname";
 const char kConstantArpGateway[] = "arp_gateway";
 const char kConstantUnicastArp[] = "unicast_arp";
+const char kConstantUsePacketRing[] = "packet_ring";
+const char kConstantUseSharedSocket[] = "shared_socket";
+const char kConstantRapidCommit[] = "rapid_commit";
+const char kConstantApplyLease[] = "apply_lease";
+const char kConstantRetransmissionInitialInterval[] =
+    "retransmission_initial_interval";
+const char kConstantRetransmissionMaxInterval[] =
+    "retransmission_max_interval";
 const char kConstantRequestNontemporaryAddress[] = "request_na";
 const char kConstantRequestPrefixDelegation[] = "request_pf";
 }
@@ -39,14 +47,26 @@ namespace dhcp_client {
 Service::Service(Manager* manager,
                  int service_identifier,
                  EventDispatcherInterface* event_dispatcher,
+                 PacketDemuxer* packet_demuxer,
+                 LeaseStoreInterface* lease_store,
                  const brillo::VariantDictionary& configs)
     : manager_(manager),
       identifier_(service_identifier),
       event_dispatcher_(event_dispatcher),
+      packet_demuxer_(packet_demuxer),
+      lease_store_(lease_store),
+      interface_index_(0),
+      device_resolved_(false),
       type_(DHCP::SERVICE_TYPE_IPV4),
       request_hostname_(false),
       arp_gateway_(false),
       unicast_arp_(false),
+      use_packet_ring_(false),
+      use_shared_socket_(false),
+      rapid_commit_(false),
+      apply_lease_(false),
+      retransmission_initial_interval_(0),
+      retransmission_max_interval_(0),
       request_na_(false),
       request_pd_(false) {
   ParseConfigs(configs);
@@ -56,14 +76,31 @@ Service::~Service() {
   Stop();
 }
 
-bool Service::Start() {
-  if (!DeviceInfo::GetInstance()->GetDeviceInfo(interface_name_,
-                                                &hardware_address_,
-                                                &interface_index_)) {
+bool Service::ResolveDevice(bool link_table_only) {
+  if (device_resolved_) {
+    return true;
+  }
+  DeviceInfo* device_info = DeviceInfo::GetInstance();
+  bool found = link_table_only ?
+      device_info->GetDeviceInfoFromTable(interface_name_,
+                                          &hardware_address_,
+                                          &interface_index_) :
+      device_info->GetDeviceInfo(interface_name_,
+                                 &hardware_address_,
+                                 &interface_index_);
+  if (!found) {
     LOG(ERROR) << "Unable to get interface information for: "
                << interface_name_;
     return false;
   }
+  device_resolved_ = true;
+  return true;
+}
+
+bool Service::Start() {
+  if (!ResolveDevice(false)) {
+    return false;
+  }
 
   if (type_ == DHCP::SERVICE_TYPE_IPV4 ||
       type_ == DHCP::SERVICE_TYPE_BOTH) {
@@ -74,7 +111,37 @@ bool Service::Start() {
                                          request_hostname_,
                                          arp_gateway_,
                                          unicast_arp_,
+                                         use_packet_ring_,
+                                         rapid_commit_,
+                                         use_shared_socket_ ?
+                                             packet_demuxer_ : nullptr,
+                                         lease_store_,
                                          event_dispatcher_));
+    if (apply_lease_) {
+      lease_applier_.reset(new RTNLLeaseApplier(interface_index_));
+      if (lease_applier_->Init()) {
+        state_machine_ipv4_->set_lease_applier(lease_applier_.get());
+      } else {
+        LOG(ERROR) << "Leases will not be applied on " << interface_name_;
+        lease_applier_.reset();
+      }
+    }
+    // Each interval can be set on its own, the other one keeps its
+    // default.
+    if (retransmission_initial_interval_ < 0 ||
+        retransmission_max_interval_ < 0) {
+      LOG(WARNING) << "Ignoring negative retransmission intervals of "
+                   << interface_name_;
+    }
+    if (retransmission_initial_interval_ > 0 ||
+        retransmission_max_interval_ > 0) {
+      LOG(INFO) << "Retransmission intervals of " << interface_name_
+                << ": initial " << retransmission_initial_interval_
+                << " ms, max " << retransmission_max_interval_
+                << " ms (0 is the default)";
+      state_machine_ipv4_->SetRetransmissionIntervals(
+          retransmission_initial_interval_, retransmission_max_interval_);
+    }
   }
   if (type_ == DHCP::SERVICE_TYPE_IPV6 ||
       type_ == DHCP::SERVICE_TYPE_BOTH) {
@@ -92,33 +159,63 @@ void Service::Stop() {
     state_machine_ipv4_->Stop();
     state_machine_ipv4_.reset();
   }
+  lease_applier_.reset();
   // TODO(nywang): Stop DHCP state machine for IPV6.
 }
 
+// static
+const Service::ConfigKeyTable& Service::GetConfigKeyTable() {
+  // Built once, parsing a config is then one hash lookup per key.
+  static const ConfigKeyTable* table = new ConfigKeyTable{
+      {kConstantInterfaceName,
+       {&Service::interface_name_, nullptr, nullptr, false}},
+      {kConstantDHCPType, {nullptr, nullptr, nullptr, true}},
+      {kConstantNetworkIdentifier,
+       {&Service::network_id_, nullptr, nullptr, false}},
+      {kConstantRequestHostname,
+       {nullptr, &Service::request_hostname_, nullptr, false}},
+      {kConstantArpGateway, {nullptr, &Service::arp_gateway_, nullptr, false}},
+      {kConstantUnicastArp, {nullptr, &Service::unicast_arp_, nullptr, false}},
+      {kConstantUsePacketRing,
+       {nullptr, &Service::use_packet_ring_, nullptr, false}},
+      {kConstantUseSharedSocket,
+       {nullptr, &Service::use_shared_socket_, nullptr, false}},
+      {kConstantRapidCommit,
+       {nullptr, &Service::rapid_commit_, nullptr, false}},
+      {kConstantApplyLease,
+       {nullptr, &Service::apply_lease_, nullptr, false}},
+      {kConstantRequestNontemporaryAddress,
+       {nullptr, &Service::request_na_, nullptr, false}},
+      {kConstantRequestPrefixDelegation,
+       {nullptr, &Service::request_pd_, nullptr, false}},
+      {kConstantRetransmissionInitialInterval,
+       {nullptr, nullptr, &Service::retransmission_initial_interval_, false}},
+      {kConstantRetransmissionMaxInterval,
+       {nullptr, nullptr, &Service::retransmission_max_interval_, false}},
+  };
+  return *table;
+}
+
 void Service::ParseConfigs(const brillo::VariantDictionary& configs) {
+  const ConfigKeyTable& table = GetConfigKeyTable();
   for (const auto& key_and_value : configs) {
     const std::string& key = key_and_value.first;
     const auto& value = key_and_value.second;
-    if (key ==  kConstantInterfaceName && value.IsTypeCompatible<string>()) {
-      interface_name_ = value.Get<string>();
-    } else if (key == kConstantDHCPType && value.IsTypeCompatible<int32_t>()) {
+    auto it = table.find(key);
+    if (it == table.end()) {
+      LOG(ERROR) << "Invalid configuration with key: " << key;
+      continue;
+    }
+    const ConfigKey& config_key = it->second;
+    if (config_key.string_member && value.IsTypeCompatible<string>()) {
+      this->*config_key.string_member = value.Get<string>();
+    } else if (config_key.bool_member && value.IsTypeCompatible<bool>()) {
+      this->*config_key.bool_member = value.Get<bool>();
+    } else if (config_key.int_member && value.IsTypeCompatible<int32_t>()) {
+      this->*config_key.int_member = value.Get<int32_t>();
+    } else if (config_key.is_service_type &&
+               value.IsTypeCompatible<int32_t>()) {
       type_  = static_cast<DHCP::ServiceType>(value.Get<int32_t>());
-    } else if (key == kConstantNetworkIdentifier &&
-               value.IsTypeCompatible<string>()) {
-      network_id_ = value.Get<string>();
-    } else if (key == kConstantRequestHostname &&
-               value.IsTypeCompatible<bool>()) {
-      request_hostname_ = value.Get<bool>();
-    } else if (key == kConstantArpGateway && value.IsTypeCompatible<bool>()) {
-      arp_gateway_ = value.Get<bool>();
-    } else if (key == kConstantUnicastArp && value.IsTypeCompatible<bool>()) {
-      unicast_arp_ = value.Get<bool>();
-    } else if (key == kConstantRequestNontemporaryAddress &&
-      value.IsTypeCompatible<bool>()) {
-      request_na_ = value.Get<bool>();
-    } else if (key == kConstantRequestPrefixDelegation &&
-               value.IsTypeCompatible<bool>()) {
-      request_pd_ = value.Get<bool>();
     } else {
       LOG(ERROR) << "Invalid configuration with key: " << key;
     }
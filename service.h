@@ -18,6 +18,7 @@
 #define DHCP_CLIENT_SERVICE_H_
 
 #include <string>
+#include <unordered_map>
 
 #include <base/macros.h>
 #include <base/memory/ref_counted.h>
@@ -26,32 +27,51 @@
 #include "dhcp_client/dhcp.h"
 #include "dhcp_client/dhcpv4.h"
 #include "dhcp_client/event_dispatcher_interface.h"
+#include "dhcp_client/lease_store_interface.h"
+#include "dhcp_client/packet_demuxer.h"
+#include "dhcp_client/rtnl_lease_applier.h"
 #include "shill/net/byte_string.h"
 
 namespace dhcp_client {
 
 class Manager;
 
-class Service : public base::RefCounted<Service> {
+// Services of a sharded Manager are referenced from both the Manager
+// thread and their shard thread.
+class Service : public base::RefCountedThreadSafe<Service> {
  public:
   Service(Manager* manager,
           int service_identifier,
           EventDispatcherInterface* event_dispatcher,
+          PacketDemuxer* packet_demuxer,
+          LeaseStoreInterface* lease_store,
           const brillo::VariantDictionary& configs);
 
   virtual ~Service();
+  // Look up the interface of the service, Start() does it if needed.
+  // With |link_table_only|, the interface is only looked up in the link
+  // table of DeviceInfo, which the caller made current.
+  bool ResolveDevice(bool link_table_only);
   bool Start();
   void Stop();
 
+  int identifier() const { return identifier_; }
+
  private:
+  friend class ServiceTest;
+
   Manager* manager_;
   // Indentifier number of this service.
   int identifier_;
   EventDispatcherInterface* event_dispatcher_;
+  // Used if |use_shared_socket_| is set.
+  PacketDemuxer* packet_demuxer_;
+  LeaseStoreInterface* lease_store_;
   // Interface parameters.
   std::string interface_name_;
   shill::ByteString hardware_address_;
   unsigned int interface_index_;
+  bool device_resolved_;
 
   // Unique network/connection identifier,
   // lease will persist to storage if this identifier is specified.
@@ -68,6 +88,20 @@ class Service : public base::RefCounted<Service> {
   bool arp_gateway_;
   // Enable unicast ARP on renew.
   bool unicast_arp_;
+  // Receive through a TPACKET_V3 memory mapped ring.
+  bool use_packet_ring_;
+  // Receive through the socket shared by the services of the same event
+  // loop.
+  bool use_shared_socket_;
+  // Use the Rapid Commit two message exchange when the server supports
+  // it.
+  bool rapid_commit_;
+  // Program the acknowledged leases on the interface.
+  bool apply_lease_;
+  // Retransmission intervals of DHCP messages in milliseconds, 0 for the
+  // RFC 2131 defaults.
+  int32_t retransmission_initial_interval_;
+  int32_t retransmission_max_interval_;
 
   // DHCP IPv6 configurations:
   // Request non-temporary address.
@@ -75,7 +109,19 @@ class Service : public base::RefCounted<Service> {
   // Request prefix delegation.
   bool request_pd_;
 
+  std::unique_ptr<RTNLLeaseApplier> lease_applier_;
   std::unique_ptr<DHCPV4> state_machine_ipv4_;
+
+  // Member set by a configuration key.
+  struct ConfigKey {
+    std::string Service::*string_member;
+    bool Service::*bool_member;
+    int32_t Service::*int_member;
+    bool is_service_type;
+  };
+  typedef std::unordered_map<std::string, ConfigKey> ConfigKeyTable;
+  static const ConfigKeyTable& GetConfigKeyTable();
+
   // Parse DHCP configurations from the VariantDictionary.
   void ParseConfigs(const brillo::VariantDictionary& configs);
 
@@ -0,0 +1,118 @@
+//
+// Copyright (C) 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "dhcp_client/service.h"
+
+#include <string>
+
+#include <brillo/variant_dictionary.h>
+#include <gtest/gtest.h>
+
+namespace dhcp_client {
+
+namespace {
+const char kFakeInterfaceName[] = "eth0";
+const char kFakeNetworkIdentifier[] = "home_network";
+}  // namespace
+
+class ServiceTest : public testing::Test {
+ protected:
+  void CreateService(const brillo::VariantDictionary& configs) {
+    service_ = new Service(nullptr, 0, nullptr, nullptr, nullptr, configs);
+  }
+
+  const std::string& interface_name() { return service_->interface_name_; }
+  DHCP::ServiceType type() { return service_->type_; }
+  const std::string& network_id() { return service_->network_id_; }
+  bool request_hostname() { return service_->request_hostname_; }
+  bool arp_gateway() { return service_->arp_gateway_; }
+  bool unicast_arp() { return service_->unicast_arp_; }
+  bool use_packet_ring() { return service_->use_packet_ring_; }
+  bool use_shared_socket() { return service_->use_shared_socket_; }
+  bool rapid_commit() { return service_->rapid_commit_; }
+  bool apply_lease() { return service_->apply_lease_; }
+  int32_t retransmission_initial_interval() {
+    return service_->retransmission_initial_interval_;
+  }
+  int32_t retransmission_max_interval() {
+    return service_->retransmission_max_interval_;
+  }
+  bool request_na() { return service_->request_na_; }
+  bool request_pd() { return service_->request_pd_; }
+
+  scoped_refptr<Service> service_;
+};
+
+TEST_F(ServiceTest, ParseAllConfigs) {
+  brillo::VariantDictionary configs;
+  configs["interface_name"] = std::string(kFakeInterfaceName);
+  configs["type"] = static_cast<int32_t>(DHCP::SERVICE_TYPE_BOTH);
+  configs["identifier"] = std::string(kFakeNetworkIdentifier);
+  configs["request_hostname"] = true;
+  configs["arp_gateway"] = true;
+  configs["unicast_arp"] = true;
+  configs["packet_ring"] = true;
+  configs["shared_socket"] = true;
+  configs["rapid_commit"] = true;
+  configs["apply_lease"] = true;
+  configs["retransmission_initial_interval"] = static_cast<int32_t>(2000);
+  configs["retransmission_max_interval"] = static_cast<int32_t>(32000);
+  configs["request_na"] = true;
+  configs["request_pf"] = true;
+  CreateService(configs);
+  EXPECT_EQ(kFakeInterfaceName, interface_name());
+  EXPECT_EQ(DHCP::SERVICE_TYPE_BOTH, type());
+  EXPECT_EQ(kFakeNetworkIdentifier, network_id());
+  EXPECT_TRUE(request_hostname());
+  EXPECT_TRUE(arp_gateway());
+  EXPECT_TRUE(unicast_arp());
+  EXPECT_TRUE(use_packet_ring());
+  EXPECT_TRUE(use_shared_socket());
+  EXPECT_TRUE(rapid_commit());
+  EXPECT_TRUE(apply_lease());
+  EXPECT_EQ(2000, retransmission_initial_interval());
+  EXPECT_EQ(32000, retransmission_max_interval());
+  EXPECT_TRUE(request_na());
+  EXPECT_TRUE(request_pd());
+}
+
+TEST_F(ServiceTest, ParseDefaults) {
+  CreateService(brillo::VariantDictionary());
+  EXPECT_TRUE(interface_name().empty());
+  EXPECT_EQ(DHCP::SERVICE_TYPE_IPV4, type());
+  EXPECT_FALSE(request_hostname());
+  EXPECT_FALSE(use_shared_socket());
+  EXPECT_FALSE(rapid_commit());
+  EXPECT_FALSE(apply_lease());
+  EXPECT_EQ(0, retransmission_initial_interval());
+}
+
+TEST_F(ServiceTest, IgnoreInvalidConfigs) {
+  brillo::VariantDictionary configs;
+  configs["unknown_key"] = true;
+  // Wrong value types.
+  configs["interface_name"] = true;
+  configs["arp_gateway"] = std::string(kFakeInterfaceName);
+  configs["type"] = std::string(kFakeInterfaceName);
+  configs["retransmission_max_interval"] = true;
+  CreateService(configs);
+  EXPECT_TRUE(interface_name().empty());
+  EXPECT_FALSE(arp_gateway());
+  EXPECT_EQ(DHCP::SERVICE_TYPE_IPV4, type());
+  EXPECT_EQ(0, retransmission_max_interval());
+}
+
+}  // namespace dhcp_client
@@ -0,0 +1,77 @@
+//
+// Copyright (C) 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+
+#include "dhcp_client/simulated_event_dispatcher.h"
+
+#include <algorithm>
+
+namespace dhcp_client {
+
+SimulatedEventDispatcher::SimulatedEventDispatcher()
+    : now_ms_(0),
+      last_handle_(kInvalidTimerHandle) {
+}
+
+SimulatedEventDispatcher::~SimulatedEventDispatcher() {}
+
+bool SimulatedEventDispatcher::PostTask(const base::Closure& task) {
+  return PostDelayedTask(task, 0);
+}
+
+bool SimulatedEventDispatcher::PostDelayedTask(const base::Closure& task,
+                                               int64_t delay_ms) {
+  return PostCancelableDelayedTask(task, delay_ms) != kInvalidTimerHandle;
+}
+
+TimerHandle SimulatedEventDispatcher::PostCancelableDelayedTask(
+    const base::Closure& task,
+    int64_t delay_ms) {
+  Task entry;
+  entry.due_ms = now_ms_ + std::max<int64_t>(delay_ms, 0);
+  entry.handle = ++last_handle_;
+  entry.closure = task;
+  tasks_.push(entry);
+  pending_.insert(entry.handle);
+  return entry.handle;
+}
+
+bool SimulatedEventDispatcher::CancelDelayedTask(TimerHandle handle) {
+  return pending_.erase(handle) != 0;
+}
+
+base::Time SimulatedEventDispatcher::Now() {
+  return base::Time::UnixEpoch() + base::TimeDelta::FromMilliseconds(now_ms_);
+}
+
+size_t SimulatedEventDispatcher::RunUntil(int64_t time_ms) {
+  size_t run_count = 0;
+  while (!tasks_.empty() && tasks_.top().due_ms <= time_ms) {
+    // The task may post new ones, take it out of the queue first.
+    Task task = tasks_.top();
+    tasks_.pop();
+    if (pending_.erase(task.handle) == 0) {
+      continue;
+    }
+    now_ms_ = task.due_ms;
+    task.closure.Run();
+    run_count++;
+  }
+  now_ms_ = std::max(now_ms_, time_ms);
+  return run_count;
+}
+
+}  // namespace dhcp_client
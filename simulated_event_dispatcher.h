@@ -0,0 +1,85 @@
+//
+// Copyright (C) 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+
+#ifndef DHCP_CLIENT_SIMULATED_EVENT_DISPATCHER_H_
+#define DHCP_CLIENT_SIMULATED_EVENT_DISPATCHER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <queue>
+#include <unordered_set>
+#include <vector>
+
+#include <base/callback.h>
+#include <base/macros.h>
+
+#include "dhcp_client/event_dispatcher_interface.h"
+
+namespace dhcp_client {
+
+// Runs tasks on a virtual clock, for simulations and tests. Time only
+// moves when the owner runs the dispatcher, jumping straight to the next
+// due task, so hours of timers run in as long as their tasks take.
+// Tasks due at the same time run in the order they were posted, which
+// keeps a simulation deterministic. Now() starts at the Unix epoch.
+class SimulatedEventDispatcher : public EventDispatcherInterface {
+ public:
+  SimulatedEventDispatcher();
+  ~SimulatedEventDispatcher() override;
+
+  bool PostTask(const base::Closure& task) override;
+  bool PostDelayedTask(const base::Closure& task,
+                       int64_t delay_ms) override;
+  TimerHandle PostCancelableDelayedTask(const base::Closure& task,
+                                        int64_t delay_ms) override;
+  bool CancelDelayedTask(TimerHandle handle) override;
+  base::Time Now() override;
+
+  // Run the tasks due up to |time_ms|, including the ones they post,
+  // and leave the clock at |time_ms|. Returns the number of tasks run.
+  size_t RunUntil(int64_t time_ms);
+  size_t RunFor(int64_t duration_ms) { return RunUntil(now_ms_ + duration_ms); }
+
+  int64_t now_ms() const { return now_ms_; }
+  size_t pending_task_count() const { return pending_.size(); }
+
+ private:
+  struct Task {
+    int64_t due_ms;
+    // Posting order, also the handle of the task.
+    TimerHandle handle;
+    base::Closure closure;
+  };
+  struct LaterTask {
+    bool operator()(const Task& a, const Task& b) const {
+      return a.due_ms != b.due_ms ? a.due_ms > b.due_ms : a.handle > b.handle;
+    }
+  };
+
+  int64_t now_ms_;
+  TimerHandle last_handle_;
+  std::priority_queue<Task, std::vector<Task>, LaterTask> tasks_;
+  // Handles of the tasks not run or cancelled yet. Cancelled tasks stay
+  // in |tasks_| and are skipped when they come up.
+  std::unordered_set<TimerHandle> pending_;
+
+  DISALLOW_COPY_AND_ASSIGN(SimulatedEventDispatcher);
+};
+
+}  // namespace dhcp_client
+
+#endif  // DHCP_CLIENT_SIMULATED_EVENT_DISPATCHER_H_
@@ -0,0 +1,112 @@
+//
+// Copyright (C) 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+
+#include "dhcp_client/simulated_event_dispatcher.h"
+
+#include <vector>
+
+#include <base/bind.h>
+#include <gtest/gtest.h>
+
+using base::Bind;
+using base::Unretained;
+
+namespace dhcp_client {
+
+class SimulatedEventDispatcherTest : public testing::Test {
+ public:
+  void OnTask(int id) {
+    run_ids_.push_back(id);
+    run_times_ms_.push_back(dispatcher_.now_ms());
+  }
+
+  void PostFollowUp(int id, int64_t delay_ms) {
+    OnTask(id);
+    dispatcher_.PostDelayedTask(
+        Bind(&SimulatedEventDispatcherTest::OnTask, Unretained(this), id + 1),
+        delay_ms);
+  }
+
+ protected:
+  SimulatedEventDispatcher dispatcher_;
+  std::vector<int> run_ids_;
+  std::vector<int64_t> run_times_ms_;
+};
+
+TEST_F(SimulatedEventDispatcherTest, RunInTimeOrder) {
+  dispatcher_.PostDelayedTask(
+      Bind(&SimulatedEventDispatcherTest::OnTask, Unretained(this), 1), 300);
+  dispatcher_.PostDelayedTask(
+      Bind(&SimulatedEventDispatcherTest::OnTask, Unretained(this), 2), 100);
+  dispatcher_.PostTask(
+      Bind(&SimulatedEventDispatcherTest::OnTask, Unretained(this), 3));
+  EXPECT_EQ(3u, dispatcher_.RunFor(1000));
+  EXPECT_EQ((std::vector<int>{3, 2, 1}), run_ids_);
+  EXPECT_EQ((std::vector<int64_t>{0, 100, 300}), run_times_ms_);
+  EXPECT_EQ(1000, dispatcher_.now_ms());
+}
+
+TEST_F(SimulatedEventDispatcherTest, SameTimeRunsInPostingOrder) {
+  for (int id = 0; id < 5; id++) {
+    dispatcher_.PostDelayedTask(
+        Bind(&SimulatedEventDispatcherTest::OnTask, Unretained(this), id), 50);
+  }
+  dispatcher_.RunFor(50);
+  EXPECT_EQ((std::vector<int>{0, 1, 2, 3, 4}), run_ids_);
+}
+
+TEST_F(SimulatedEventDispatcherTest, StopAtEndTime) {
+  dispatcher_.PostDelayedTask(
+      Bind(&SimulatedEventDispatcherTest::OnTask, Unretained(this), 1), 500);
+  EXPECT_EQ(0u, dispatcher_.RunFor(499));
+  EXPECT_TRUE(run_ids_.empty());
+  EXPECT_EQ(1u, dispatcher_.RunFor(1));
+  EXPECT_EQ(500, run_times_ms_[0]);
+}
+
+TEST_F(SimulatedEventDispatcherTest, RunTasksPostedByTasks) {
+  dispatcher_.PostDelayedTask(
+      Bind(&SimulatedEventDispatcherTest::PostFollowUp, Unretained(this), 1,
+           200),
+      100);
+  dispatcher_.RunFor(1000);
+  EXPECT_EQ((std::vector<int>{1, 2}), run_ids_);
+  EXPECT_EQ((std::vector<int64_t>{100, 300}), run_times_ms_);
+}
+
+TEST_F(SimulatedEventDispatcherTest, CancelTask) {
+  TimerHandle handle = dispatcher_.PostCancelableDelayedTask(
+      Bind(&SimulatedEventDispatcherTest::OnTask, Unretained(this), 1), 100);
+  dispatcher_.PostCancelableDelayedTask(
+      Bind(&SimulatedEventDispatcherTest::OnTask, Unretained(this), 2), 100);
+  EXPECT_NE(kInvalidTimerHandle, handle);
+  EXPECT_EQ(2u, dispatcher_.pending_task_count());
+  EXPECT_TRUE(dispatcher_.CancelDelayedTask(handle));
+  EXPECT_FALSE(dispatcher_.CancelDelayedTask(handle));
+  EXPECT_EQ(1u, dispatcher_.pending_task_count());
+  dispatcher_.RunFor(100);
+  EXPECT_EQ((std::vector<int>{2}), run_ids_);
+  EXPECT_EQ(0u, dispatcher_.pending_task_count());
+}
+
+TEST_F(SimulatedEventDispatcherTest, NowFollowsVirtualClock) {
+  base::Time start = dispatcher_.Now();
+  dispatcher_.RunFor(1500);
+  EXPECT_EQ(1500, (dispatcher_.Now() - start).InMilliseconds());
+}
+
+}  // namespace dhcp_client
@@ -0,0 +1,128 @@
+//
+// Copyright (C) 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+
+#include "dhcp_client/simulated_network.h"
+
+#include <netinet/ip.h>
+#include <netinet/udp.h>
+
+#include <base/bind.h>
+#include <base/logging.h>
+
+using base::Bind;
+using base::Unretained;
+using shill::ByteString;
+
+namespace dhcp_client {
+
+namespace {
+// Offset of chaddr in a DHCP message.
+const size_t kChaddrOffset = 28;
+
+std::string MakeClientKey(const unsigned char* hardware_address) {
+  return std::string(reinterpret_cast<const char*>(hardware_address),
+                     IFHWADDRLEN);
+}
+}  // namespace
+
+SimulatedNetwork::SimulatedNetwork(EventDispatcherInterface* event_dispatcher,
+                                   unsigned int seed)
+    : event_dispatcher_(event_dispatcher),
+      latency_ms_(1),
+      loss_rate_(0),
+      random_engine_(seed),
+      frames_sent_(0),
+      frames_dropped_(0) {
+}
+
+SimulatedNetwork::~SimulatedNetwork() {}
+
+void SimulatedNetwork::SetServer(const FrameCallback& callback) {
+  server_callback_ = callback;
+}
+
+DHCPV4::PacketSender SimulatedNetwork::AddClient(
+    const ByteString& hardware_address,
+    const FrameCallback& callback) {
+  CHECK_EQ(static_cast<size_t>(IFHWADDRLEN), hardware_address.GetLength());
+  clients_[MakeClientKey(hardware_address.GetConstData())] = callback;
+  return Bind(&SimulatedNetwork::SendToServer, Unretained(this));
+}
+
+void SimulatedNetwork::RemoveClient(const ByteString& hardware_address) {
+  clients_.erase(MakeClientKey(hardware_address.GetConstData()));
+}
+
+bool SimulatedNetwork::DropFrame() {
+  frames_sent_++;
+  if (loss_rate_ <= 0 ||
+      std::uniform_real_distribution<double>()(random_engine_) >= loss_rate_) {
+    return false;
+  }
+  frames_dropped_++;
+  return true;
+}
+
+bool SimulatedNetwork::SendToServer(const ByteString& frame) {
+  if (DropFrame()) {
+    return true;
+  }
+  event_dispatcher_->PostDelayedTask(
+      Bind(&SimulatedNetwork::DeliverToServer, Unretained(this), frame),
+      latency_ms_);
+  return true;
+}
+
+bool SimulatedNetwork::SendFromServer(const ByteString& frame) {
+  if (frame.GetLength() < sizeof(struct iphdr)) {
+    return false;
+  }
+  const struct iphdr* ip =
+      reinterpret_cast<const struct iphdr*>(frame.GetConstData());
+  size_t chaddr_offset = (static_cast<size_t>(ip->ihl) << 2) +
+                         sizeof(struct udphdr) + kChaddrOffset;
+  if (frame.GetLength() < chaddr_offset + IFHWADDRLEN) {
+    return false;
+  }
+  if (DropFrame()) {
+    return true;
+  }
+  event_dispatcher_->PostDelayedTask(
+      Bind(&SimulatedNetwork::DeliverToClient,
+           Unretained(this),
+           MakeClientKey(frame.GetConstData() + chaddr_offset),
+           frame),
+      latency_ms_);
+  return true;
+}
+
+void SimulatedNetwork::DeliverToServer(const ByteString& frame) {
+  if (!server_callback_.is_null()) {
+    server_callback_.Run(frame.GetConstData(), frame.GetLength());
+  }
+}
+
+void SimulatedNetwork::DeliverToClient(const std::string& client_key,
+                                       const ByteString& frame) {
+  // The client may have left while the frame was in flight.
+  auto it = clients_.find(client_key);
+  if (it != clients_.end()) {
+    it->second.Run(frame.GetConstData(), frame.GetLength());
+  }
+}
+
+}  // namespace dhcp_client
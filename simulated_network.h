@@ -0,0 +1,94 @@
+//
+// Copyright (C) 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+
+#ifndef DHCP_CLIENT_SIMULATED_NETWORK_H_
+#define DHCP_CLIENT_SIMULATED_NETWORK_H_
+
+#include <net/if.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <unordered_map>
+
+#include <base/callback.h>
+#include <base/macros.h>
+#include <shill/net/byte_string.h>
+
+#include "dhcp_client/dhcpv4.h"
+#include "dhcp_client/event_dispatcher_interface.h"
+
+namespace dhcp_client {
+
+// A broadcast domain joining simulated DHCPV4 clients to one server.
+// Every client frame goes to the server, and server frames are routed
+// to their client by the chaddr of the DHCP message, like the shared
+// socket of PacketDemuxer does. Frames are delivered through the event
+// dispatcher after |latency_ms|, and dropped with |loss_rate| according
+// to a generator seeded at construction.
+class SimulatedNetwork {
+ public:
+  // Called with a frame starting at its IP header.
+  typedef base::Callback<void(const unsigned char* frame, size_t len)>
+      FrameCallback;
+
+  SimulatedNetwork(EventDispatcherInterface* event_dispatcher,
+                   unsigned int seed);
+  ~SimulatedNetwork();
+
+  void set_latency_ms(int64_t latency_ms) { latency_ms_ = latency_ms; }
+  void set_loss_rate(double loss_rate) { loss_rate_ = loss_rate; }
+
+  void SetServer(const FrameCallback& callback);
+  // Attach the client with |hardware_address|, receiving its frames
+  // through |callback|. Returns the sender the client transmits with.
+  DHCPV4::PacketSender AddClient(const shill::ByteString& hardware_address,
+                                 const FrameCallback& callback);
+  void RemoveClient(const shill::ByteString& hardware_address);
+
+  // Send a frame to the server, or from the server to the client
+  // named in the frame.
+  bool SendToServer(const shill::ByteString& frame);
+  bool SendFromServer(const shill::ByteString& frame);
+
+  uint64_t frames_sent() const { return frames_sent_; }
+  uint64_t frames_dropped() const { return frames_dropped_; }
+
+ private:
+  // Whether the next frame is lost.
+  bool DropFrame();
+  void DeliverToServer(const shill::ByteString& frame);
+  void DeliverToClient(const std::string& client_key,
+                       const shill::ByteString& frame);
+
+  EventDispatcherInterface* event_dispatcher_;
+  int64_t latency_ms_;
+  double loss_rate_;
+  std::mt19937 random_engine_;
+  FrameCallback server_callback_;
+  // Clients keyed by hardware address.
+  std::unordered_map<std::string, FrameCallback> clients_;
+  uint64_t frames_sent_;
+  uint64_t frames_dropped_;
+
+  DISALLOW_COPY_AND_ASSIGN(SimulatedNetwork);
+};
+
+}  // namespace dhcp_client
+
+#endif  // DHCP_CLIENT_SIMULATED_NETWORK_H_
@@ -0,0 +1,295 @@
+//
+// Copyright (C) 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+
+#include "dhcp_client/simulated_server.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/ip.h>
+#include <netinet/udp.h>
+
+#include <cstring>
+
+#include <base/logging.h>
+
+#include "dhcp_client/checksum.h"
+#include "dhcp_client/dhcp_message.h"
+#include "dhcp_client/dhcp_options.h"
+#include "dhcp_client/dhcp_options_writer.h"
+
+using shill::ByteString;
+
+namespace dhcp_client {
+
+namespace {
+const uint16_t kDHCPServerPort = 67;
+const uint16_t kDHCPClientPort = 68;
+const uint32_t kSubnetMask = 0xffff0000;
+
+// Layout of the fixed part of a DHCP message.
+const size_t kOpOffset = 0;
+const size_t kHardwareTypeOffset = 1;
+const size_t kHardwareAddressLengthOffset = 2;
+const size_t kTransactionIDOffset = 4;
+const size_t kClientIPAddressOffset = 12;
+const size_t kYourIPAddressOffset = 16;
+const size_t kChaddrOffset = 28;
+const size_t kChaddrLength = 16;
+const size_t kCookieOffset = 236;
+const size_t kOptionsOffset = 240;
+const uint8_t kBootRequest = 1;
+const uint8_t kBootReply = 2;
+const uint8_t kHardwareTypeEthernet = 1;
+const uint8_t kMagicCookie[] = {0x63, 0x82, 0x53, 0x63};
+
+uint32_t ReadUInt32(const unsigned char* data) {
+  uint32_t value;
+  memcpy(&value, data, sizeof(value));
+  return ntohl(value);
+}
+
+void WriteUInt32(unsigned char* data, uint32_t value) {
+  uint32_t value_net = htonl(value);
+  memcpy(data, &value_net, sizeof(value_net));
+}
+
+std::string GetClientKey(const unsigned char* message) {
+  return std::string(reinterpret_cast<const char*>(message + kChaddrOffset),
+                     IFHWADDRLEN);
+}
+}  // namespace
+
+SimulatedServer::SimulatedServer(SimulatedNetwork* network,
+                                 uint32_t server_address,
+                                 uint32_t pool_start,
+                                 uint32_t pool_size,
+                                 uint32_t lease_time)
+    : network_(network),
+      server_address_(server_address),
+      pool_start_(pool_start),
+      pool_size_(pool_size),
+      lease_time_(lease_time),
+      renewal_time_(0),
+      rebinding_time_(0),
+      rapid_commit_(false) {
+}
+
+SimulatedServer::~SimulatedServer() {}
+
+void SimulatedServer::HandleFrame(const unsigned char* frame, size_t len) {
+  if (len < sizeof(struct iphdr)) {
+    return;
+  }
+  const struct iphdr* ip = reinterpret_cast<const struct iphdr*>(frame);
+  size_t header_len =
+      (static_cast<size_t>(ip->ihl) << 2) + sizeof(struct udphdr);
+  if (ip->protocol != IPPROTO_UDP || len < header_len) {
+    return;
+  }
+  const struct udphdr* udp = reinterpret_cast<const struct udphdr*>(
+      frame + header_len - sizeof(struct udphdr));
+  if (udp->uh_dport != htons(kDHCPServerPort)) {
+    return;
+  }
+  Request request;
+  if (!ParseRequest(frame + header_len, len - header_len, &request)) {
+    LOG(ERROR) << "Dropping invalid DHCP message";
+    return;
+  }
+  switch (request.message_type) {
+    case kDHCPMessageTypeDiscover:
+      HandleDiscover(request);
+      break;
+    case kDHCPMessageTypeRequest:
+      HandleRequest(request);
+      break;
+    default:
+      break;
+  }
+}
+
+// static
+bool SimulatedServer::ParseRequest(const unsigned char* message,
+                                   size_t len,
+                                   Request* request) {
+  if (len < kOptionsOffset ||
+      message[kOpOffset] != kBootRequest ||
+      message[kHardwareTypeOffset] != kHardwareTypeEthernet ||
+      message[kHardwareAddressLengthOffset] != IFHWADDRLEN ||
+      memcmp(message + kCookieOffset, kMagicCookie, sizeof(kMagicCookie))) {
+    return false;
+  }
+  memset(request, 0, sizeof(*request));
+  request->message = message;
+  request->client_ip_address = ReadUInt32(message + kClientIPAddressOffset);
+  const unsigned char* option = message + kOptionsOffset;
+  const unsigned char* end = message + len;
+  while (option < end && *option != kDHCPOptionEnd) {
+    if (*option == kDHCPOptionPad) {
+      option++;
+      continue;
+    }
+    if (option + 2 > end || option + 2 + option[1] > end) {
+      return false;
+    }
+    uint8_t code = option[0];
+    uint8_t length = option[1];
+    const unsigned char* value = option + 2;
+    if (code == kDHCPOptionMessageType && length == 1) {
+      request->message_type = value[0];
+    } else if (code == kDHCPOptionRequestedIPAddr && length == 4) {
+      request->requested_ip_address = ReadUInt32(value);
+    } else if (code == kDHCPOptionServerIdentifier && length == 4) {
+      request->server_identifier = ReadUInt32(value);
+    } else if (code == kDHCPOptionRapidCommit) {
+      request->rapid_commit = true;
+    }
+    option = value + length;
+  }
+  return request->message_type != 0;
+}
+
+void SimulatedServer::HandleDiscover(const Request& request) {
+  stats_.discovers++;
+  uint32_t address = GetBinding(request, true);
+  if (address == 0) {
+    return;
+  }
+  if (rapid_commit_ && request.rapid_commit) {
+    SendReply(request, kDHCPMessageTypeAck, address, true);
+  } else {
+    SendReply(request, kDHCPMessageTypeOffer, address, false);
+  }
+}
+
+void SimulatedServer::HandleRequest(const Request& request) {
+  stats_.requests++;
+  // The client picked the offer of another server.
+  if (request.server_identifier != 0 &&
+      request.server_identifier != server_address_) {
+    return;
+  }
+  uint32_t requested_address = request.client_ip_address;
+  if (requested_address != 0) {
+    stats_.renewals++;
+  } else {
+    requested_address = request.requested_ip_address;
+  }
+  uint32_t address = GetBinding(request, false);
+  if (address == 0 || address != requested_address) {
+    SendReply(request, kDHCPMessageTypeNak, 0, false);
+    return;
+  }
+  SendReply(request, kDHCPMessageTypeAck, address, false);
+}
+
+uint32_t SimulatedServer::GetBinding(const Request& request, bool allocate) {
+  std::string client_key = GetClientKey(request.message);
+  auto it = bindings_.find(client_key);
+  if (it != bindings_.end()) {
+    return it->second;
+  }
+  if (!allocate || bindings_.size() >= pool_size_) {
+    return 0;
+  }
+  uint32_t address = pool_start_ + static_cast<uint32_t>(bindings_.size());
+  bindings_[client_key] = address;
+  return address;
+}
+
+void SimulatedServer::SendReply(const Request& request,
+                                uint8_t message_type,
+                                uint32_t address,
+                                bool rapid_commit) {
+  ByteString options;
+  DHCPOptionsWriter* writer = DHCPOptionsWriter::GetInstance();
+  writer->WriteUInt8Option(&options, kDHCPOptionMessageType, message_type);
+  writer->WriteUInt32Option(&options, kDHCPOptionServerIdentifier,
+                            server_address_);
+  if (message_type != kDHCPMessageTypeNak) {
+    writer->WriteUInt32Option(&options, kDHCPOptionSubnetMask, kSubnetMask);
+    writer->WriteUInt32Option(&options, kDHCPOptionLeaseTime, lease_time_);
+    if (renewal_time_ != 0) {
+      writer->WriteUInt32Option(&options, kDHCPOptionRenewalTime,
+                                renewal_time_);
+    }
+    if (rebinding_time_ != 0) {
+      writer->WriteUInt32Option(&options, kDHCPOptionRebindingTime,
+                                rebinding_time_);
+    }
+    if (rapid_commit) {
+      writer->WriteFlagOption(&options, kDHCPOptionRapidCommit);
+    }
+  }
+  writer->WriteEndTag(&options);
+
+  const size_t header_len = sizeof(struct iphdr) + sizeof(struct udphdr);
+  const size_t message_len = kOptionsOffset + options.GetLength();
+  ByteString frame(header_len + message_len);
+  unsigned char* buffer = frame.GetData();
+  unsigned char* message = buffer + header_len;
+  message[kOpOffset] = kBootReply;
+  message[kHardwareTypeOffset] = kHardwareTypeEthernet;
+  message[kHardwareAddressLengthOffset] = IFHWADDRLEN;
+  memcpy(message + kTransactionIDOffset,
+         request.message + kTransactionIDOffset, sizeof(uint32_t));
+  WriteUInt32(message + kYourIPAddressOffset, address);
+  memcpy(message + kChaddrOffset, request.message + kChaddrOffset,
+         kChaddrLength);
+  memcpy(message + kCookieOffset, kMagicCookie, sizeof(kMagicCookie));
+  memcpy(message + kOptionsOffset, options.GetConstData(),
+         options.GetLength());
+
+  // A client owning its address is answered by unicast.
+  uint32_t destination = request.client_ip_address != 0 ?
+      request.client_ip_address : INADDR_BROADCAST;
+  struct iphdr* ip = reinterpret_cast<struct iphdr*>(buffer);
+  struct udphdr* udp = reinterpret_cast<struct udphdr*>(buffer + sizeof(*ip));
+  udp->uh_sport = htons(kDHCPServerPort);
+  udp->uh_dport = htons(kDHCPClientPort);
+  udp->uh_ulen = htons(static_cast<uint16_t>(sizeof(*udp) + message_len));
+  udp->uh_sum = htons(ComputeUDPChecksum(
+      server_address_, destination, reinterpret_cast<const uint8_t*>(udp),
+      sizeof(*udp) + message_len));
+  if (udp->uh_sum == 0) {
+    udp->uh_sum = 0xffff;
+  }
+  ip->version = IPVERSION;
+  ip->ihl = sizeof(*ip) >> 2;
+  ip->ttl = IPDEFTTL;
+  ip->protocol = IPPROTO_UDP;
+  ip->saddr = htonl(server_address_);
+  ip->daddr = htonl(destination);
+  ip->tot_len = htons(static_cast<uint16_t>(header_len + message_len));
+  ip->check = htons(ComputeInternetChecksum(
+      reinterpret_cast<const uint8_t*>(ip), sizeof(*ip)));
+
+  switch (message_type) {
+    case kDHCPMessageTypeOffer:
+      stats_.offers++;
+      break;
+    case kDHCPMessageTypeAck:
+      stats_.acks++;
+      break;
+    case kDHCPMessageTypeNak:
+      stats_.naks++;
+      break;
+  }
+  network_->SendFromServer(frame);
+}
+
+}  // namespace dhcp_client
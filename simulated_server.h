@@ -0,0 +1,124 @@
+//
+// Copyright (C) 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+
+#ifndef DHCP_CLIENT_SIMULATED_SERVER_H_
+#define DHCP_CLIENT_SIMULATED_SERVER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+
+#include <base/macros.h>
+#include <shill/net/byte_string.h>
+
+#include "dhcp_client/simulated_network.h"
+
+namespace dhcp_client {
+
+// A minimal in-process DHCP server for simulations. It hands out
+// addresses from a pool, one per hardware address, and keeps the
+// binding for the life of the server, so a client renewing or
+// rebooting gets its address back. Requests for another address, or
+// from an unknown client, are answered with a Nak.
+class SimulatedServer {
+ public:
+  struct Stats {
+    Stats()
+        : discovers(0),
+          requests(0),
+          renewals(0),
+          offers(0),
+          acks(0),
+          naks(0) {}
+    uint64_t discovers;
+    uint64_t requests;
+    // Requests from a client owning its address, in RENEW or REBIND.
+    uint64_t renewals;
+    uint64_t offers;
+    uint64_t acks;
+    uint64_t naks;
+  };
+
+  // The pool is |pool_size| addresses starting at |pool_start|, all in
+  // host byte order.
+  SimulatedServer(SimulatedNetwork* network,
+                  uint32_t server_address,
+                  uint32_t pool_start,
+                  uint32_t pool_size,
+                  uint32_t lease_time);
+  ~SimulatedServer();
+
+  // Renewal and rebinding times sent with leases, 0 to leave the
+  // options out.
+  void set_renewal_time(uint32_t renewal_time) {
+    renewal_time_ = renewal_time;
+  }
+  void set_rebinding_time(uint32_t rebinding_time) {
+    rebinding_time_ = rebinding_time;
+  }
+  // Answer Discovers carrying Rapid Commit with an Ack.
+  void set_rapid_commit(bool rapid_commit) { rapid_commit_ = rapid_commit; }
+
+  // Handle a frame sent by a client, starting at its IP header.
+  void HandleFrame(const unsigned char* frame, size_t len);
+
+  const Stats& stats() const { return stats_; }
+  size_t binding_count() const { return bindings_.size(); }
+
+ private:
+  // The fields of a client message the server looks at.
+  struct Request {
+    const unsigned char* message;
+    uint8_t message_type;
+    uint32_t client_ip_address;
+    uint32_t requested_ip_address;
+    uint32_t server_identifier;
+    bool rapid_commit;
+  };
+
+  static bool ParseRequest(const unsigned char* message,
+                           size_t len,
+                           Request* request);
+  void HandleDiscover(const Request& request);
+  void HandleRequest(const Request& request);
+  // The address bound to the client of |request|, allocated if needed.
+  // Returns 0 when the pool is exhausted.
+  uint32_t GetBinding(const Request& request, bool allocate);
+  void SendReply(const Request& request,
+                 uint8_t message_type,
+                 uint32_t address,
+                 bool rapid_commit);
+
+  SimulatedNetwork* network_;
+  uint32_t server_address_;
+  uint32_t pool_start_;
+  uint32_t pool_size_;
+  uint32_t lease_time_;
+  uint32_t renewal_time_;
+  uint32_t rebinding_time_;
+  bool rapid_commit_;
+  // Address bound to each hardware address.
+  std::unordered_map<std::string, uint32_t> bindings_;
+  Stats stats_;
+
+  DISALLOW_COPY_AND_ASSIGN(SimulatedServer);
+};
+
+}  // namespace dhcp_client
+
+#endif  // DHCP_CLIENT_SIMULATED_SERVER_H_
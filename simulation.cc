@@ -0,0 +1,114 @@
+//
+// Copyright (C) 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+
+#include "dhcp_client/simulation.h"
+
+#include <net/if.h>
+
+#include <algorithm>
+#include <string>
+
+#include <base/bind.h>
+
+using base::Bind;
+using base::Unretained;
+using shill::ByteString;
+
+namespace dhcp_client {
+
+namespace {
+const uint32_t kServerAddress = 0x0a000001;  // 10.0.0.1
+const uint32_t kPoolStart = 0x0a000100;  // 10.0.1.0
+const char kInterfaceName[] = "sim0";
+const unsigned int kInterfaceIndex = 1;
+
+// A locally administered unicast address for client |index|.
+ByteString MakeHardwareAddress(size_t index) {
+  unsigned char address[IFHWADDRLEN] = {0x02};
+  for (int i = IFHWADDRLEN - 1; i > 0; i--) {
+    address[i] = static_cast<unsigned char>(index);
+    index >>= 8;
+  }
+  return ByteString(address, sizeof(address));
+}
+}  // namespace
+
+Simulation::Simulation(const Parameters& parameters)
+    : parameters_(parameters),
+      random_engine_(parameters.seed),
+      network_(&dispatcher_, random_engine_()),
+      server_(&network_,
+              kServerAddress,
+              kPoolStart,
+              static_cast<uint32_t>(parameters.client_count),
+              parameters.lease_time) {
+  network_.set_latency_ms(parameters_.latency_ms);
+  network_.set_loss_rate(parameters_.loss_rate);
+  network_.SetServer(
+      Bind(&SimulatedServer::HandleFrame, Unretained(&server_)));
+  server_.set_rapid_commit(parameters_.server_rapid_commit);
+
+  clients_.reserve(parameters_.client_count);
+  for (size_t i = 0; i < parameters_.client_count; i++) {
+    ByteString hardware_address = MakeHardwareAddress(i);
+    std::unique_ptr<DHCPV4> client(new DHCPV4(kInterfaceName,
+                                              hardware_address,
+                                              kInterfaceIndex,
+                                              std::string(),
+                                              false,
+                                              false,
+                                              false,
+                                              false,
+                                              parameters_.client_rapid_commit,
+                                              nullptr,
+                                              nullptr,
+                                              &dispatcher_));
+    client->SetRandomSeed(random_engine_());
+    client->set_packet_sender(network_.AddClient(
+        hardware_address,
+        Bind(&DHCPV4::HandleFrame, Unretained(client.get()))));
+    clients_.push_back(std::move(client));
+  }
+}
+
+Simulation::~Simulation() {}
+
+void Simulation::Start() {
+  std::uniform_int_distribution<int64_t> start_time(
+      0, std::max<int64_t>(parameters_.start_spread_ms - 1, 0));
+  for (size_t i = 0; i < clients_.size(); i++) {
+    dispatcher_.PostDelayedTask(
+        Bind(&Simulation::StartClient, Unretained(this), i),
+        start_time(random_engine_));
+  }
+}
+
+size_t Simulation::CountClients(DHCP::State state) const {
+  size_t count = 0;
+  for (const auto& client : clients_) {
+    if (client->state() == state) {
+      count++;
+    }
+  }
+  return count;
+}
+
+void Simulation::StartClient(size_t index) {
+  clients_[index]->Start();
+}
+
+}  // namespace dhcp_client
@@ -0,0 +1,95 @@
+//
+// Copyright (C) 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+
+#ifndef DHCP_CLIENT_SIMULATION_H_
+#define DHCP_CLIENT_SIMULATION_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include <base/macros.h>
+
+#include "dhcp_client/dhcp.h"
+#include "dhcp_client/dhcpv4.h"
+#include "dhcp_client/simulated_event_dispatcher.h"
+#include "dhcp_client/simulated_network.h"
+#include "dhcp_client/simulated_server.h"
+
+namespace dhcp_client {
+
+// Runs many DHCPV4 clients against a SimulatedServer on a virtual
+// clock. Everything random, from transaction ids and retransmission
+// jitter to start times and frame losses, derives from |seed|, so two
+// simulations with the same parameters go through the same events.
+class Simulation {
+ public:
+  struct Parameters {
+    Parameters()
+        : client_count(1000),
+          seed(1),
+          lease_time(3600),
+          latency_ms(1),
+          loss_rate(0),
+          start_spread_ms(1000),
+          client_rapid_commit(false),
+          server_rapid_commit(false) {}
+    size_t client_count;
+    unsigned int seed;
+    // Lease time handed out by the server, in seconds.
+    uint32_t lease_time;
+    int64_t latency_ms;
+    double loss_rate;
+    // Clients start at random times within this window.
+    int64_t start_spread_ms;
+    // Rapid Commit support of the clients and of the server, set apart
+    // to simulate the fallback to the four message exchange.
+    bool client_rapid_commit;
+    bool server_rapid_commit;
+  };
+
+  explicit Simulation(const Parameters& parameters);
+  ~Simulation();
+
+  // Schedule the start of every client.
+  void Start();
+  void RunFor(int64_t duration_ms) { dispatcher_.RunFor(duration_ms); }
+  size_t CountClients(DHCP::State state) const;
+
+  SimulatedEventDispatcher* dispatcher() { return &dispatcher_; }
+  SimulatedNetwork* network() { return &network_; }
+  SimulatedServer* server() { return &server_; }
+
+ private:
+  void StartClient(size_t index);
+
+  Parameters parameters_;
+  std::mt19937 random_engine_;
+  SimulatedEventDispatcher dispatcher_;
+  SimulatedNetwork network_;
+  SimulatedServer server_;
+  // Destroyed first, the clients cancel their timers when stopping.
+  std::vector<std::unique_ptr<DHCPV4>> clients_;
+
+  DISALLOW_COPY_AND_ASSIGN(Simulation);
+};
+
+}  // namespace dhcp_client
+
+#endif  // DHCP_CLIENT_SIMULATION_H_
@@ -0,0 +1,139 @@
+//
+// Copyright (C) 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+
+#include "dhcp_client/simulation.h"
+
+#include <gtest/gtest.h>
+
+namespace dhcp_client {
+
+namespace {
+const int64_t kOneSecondMs = 1000;
+const uint32_t kLeaseTime = 600;
+}  // namespace
+
+class SimulationTest : public testing::Test {
+ protected:
+  Simulation::Parameters MakeParameters(size_t client_count) {
+    Simulation::Parameters parameters;
+    parameters.client_count = client_count;
+    parameters.lease_time = kLeaseTime;
+    parameters.start_spread_ms = 10 * kOneSecondMs;
+    return parameters;
+  }
+};
+
+TEST_F(SimulationTest, AllClientsBind) {
+  Simulation simulation(MakeParameters(1000));
+  simulation.Start();
+  simulation.RunFor(20 * kOneSecondMs);
+  EXPECT_EQ(1000u, simulation.CountClients(DHCP::State::BOUND));
+  const SimulatedServer::Stats& stats = simulation.server()->stats();
+  EXPECT_EQ(1000u, stats.discovers);
+  EXPECT_EQ(1000u, stats.offers);
+  EXPECT_EQ(1000u, stats.requests);
+  EXPECT_EQ(1000u, stats.acks);
+  EXPECT_EQ(0u, stats.naks);
+  EXPECT_EQ(1000u, simulation.server()->binding_count());
+}
+
+TEST_F(SimulationTest, RapidCommit) {
+  Simulation::Parameters parameters = MakeParameters(100);
+  parameters.client_rapid_commit = true;
+  parameters.server_rapid_commit = true;
+  Simulation simulation(parameters);
+  simulation.Start();
+  simulation.RunFor(20 * kOneSecondMs);
+  EXPECT_EQ(100u, simulation.CountClients(DHCP::State::BOUND));
+  EXPECT_EQ(0u, simulation.server()->stats().requests);
+  EXPECT_EQ(100u, simulation.server()->stats().acks);
+}
+
+TEST_F(SimulationTest, RapidCommitFallback) {
+  Simulation::Parameters parameters = MakeParameters(100);
+  parameters.client_rapid_commit = true;
+  Simulation simulation(parameters);
+  simulation.Start();
+  simulation.RunFor(20 * kOneSecondMs);
+  // The server ignores the option, the clients go through the four
+  // message exchange.
+  EXPECT_EQ(100u, simulation.CountClients(DHCP::State::BOUND));
+  const SimulatedServer::Stats& stats = simulation.server()->stats();
+  EXPECT_EQ(100u, stats.offers);
+  EXPECT_EQ(100u, stats.requests);
+  EXPECT_EQ(100u, stats.acks);
+  EXPECT_EQ(0u, stats.naks);
+}
+
+TEST_F(SimulationTest, ClientsRenewAtHalfLease) {
+  Simulation simulation(MakeParameters(100));
+  simulation.Start();
+  // The clients started within 10 seconds, T1 is 300 seconds later.
+  simulation.RunFor(kLeaseTime * kOneSecondMs / 2);
+  EXPECT_EQ(0u, simulation.server()->stats().renewals);
+  simulation.RunFor(20 * kOneSecondMs);
+  EXPECT_EQ(100u, simulation.server()->stats().renewals);
+  EXPECT_EQ(100u, simulation.CountClients(DHCP::State::BOUND));
+  // Every lease is renewed again and nobody falls back to discovery.
+  simulation.RunFor(10 * kLeaseTime * kOneSecondMs);
+  EXPECT_EQ(100u, simulation.CountClients(DHCP::State::BOUND));
+  EXPECT_EQ(100u, simulation.server()->stats().discovers);
+  EXPECT_EQ(0u, simulation.server()->stats().naks);
+}
+
+TEST_F(SimulationTest, RetransmitLostFrames) {
+  Simulation::Parameters parameters = MakeParameters(1000);
+  parameters.loss_rate = 0.2;
+  Simulation simulation(parameters);
+  simulation.Start();
+  simulation.RunFor(kLeaseTime * kOneSecondMs / 2);
+  EXPECT_GT(simulation.network()->frames_dropped(), 0u);
+  EXPECT_GT(simulation.server()->stats().discovers, 1000u);
+  EXPECT_EQ(1000u, simulation.CountClients(DHCP::State::BOUND));
+}
+
+TEST_F(SimulationTest, DeterministicUnderSeed) {
+  Simulation::Parameters parameters = MakeParameters(500);
+  parameters.loss_rate = 0.1;
+  Simulation first(parameters);
+  Simulation second(parameters);
+  first.Start();
+  second.Start();
+  for (int i = 0; i < 20; i++) {
+    first.RunFor(kLeaseTime * kOneSecondMs / 4);
+    second.RunFor(kLeaseTime * kOneSecondMs / 4);
+    const SimulatedServer::Stats& a = first.server()->stats();
+    const SimulatedServer::Stats& b = second.server()->stats();
+    ASSERT_EQ(a.discovers, b.discovers);
+    ASSERT_EQ(a.requests, b.requests);
+    ASSERT_EQ(a.renewals, b.renewals);
+    ASSERT_EQ(a.acks, b.acks);
+    ASSERT_EQ(first.network()->frames_dropped(),
+              second.network()->frames_dropped());
+    ASSERT_EQ(first.CountClients(DHCP::State::BOUND),
+              second.CountClients(DHCP::State::BOUND));
+  }
+  // A different seed goes through different events.
+  parameters.seed++;
+  Simulation third(parameters);
+  third.Start();
+  third.RunFor(20 * kLeaseTime * kOneSecondMs / 4);
+  EXPECT_NE(first.network()->frames_dropped(),
+            third.network()->frames_dropped());
+}
+
+}  // namespace dhcp_client
@@ -0,0 +1,135 @@
+//
+// Copyright (C) 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+
+#include <cinttypes>
+#include <cstdio>
+#include <string>
+
+#include <base/at_exit.h>
+#include <base/command_line.h>
+#include <base/logging.h>
+#include <base/strings/string_number_conversions.h>
+
+#include "dhcp_client/dhcp.h"
+#include "dhcp_client/simulation.h"
+
+using dhcp_client::DHCP;
+using dhcp_client::Simulation;
+
+namespace {
+
+namespace switches {
+
+// Number of simulated clients.
+const char kClients[] = "clients";
+// Seed of the simulation, the same seed replays the same events.
+const char kSeed[] = "seed";
+// Lease time handed out by the server, in seconds.
+const char kLeaseTime[] = "lease_time";
+// One way latency of the simulated network, in milliseconds.
+const char kLatency[] = "latency_ms";
+// Probability for a frame to be lost.
+const char kLossRate[] = "loss_rate";
+// Window the clients start in, in milliseconds.
+const char kStartSpread[] = "start_spread_ms";
+// Simulated time to run for, in seconds.
+const char kDuration[] = "duration";
+// Interval between reports, in seconds.
+const char kReportInterval[] = "report_interval";
+// Use the Rapid Commit exchange.
+const char kRapidCommit[] = "rapid_commit";
+// Support Rapid Commit on one side only.
+const char kClientRapidCommit[] = "client_rapid_commit";
+const char kServerRapidCommit[] = "server_rapid_commit";
+
+}  // namespace switches
+
+const int64_t kMillisecondsPerSecond = 1000;
+
+template <typename T>
+void GetSwitch(const base::CommandLine* cl,
+               const char* name,
+               bool (*convert)(const std::string&, T*),
+               T* value) {
+  if (cl->HasSwitch(name) && !convert(cl->GetSwitchValueASCII(name), value)) {
+    LOG(FATAL) << "Invalid value for --" << name;
+  }
+}
+
+}  // namespace
+
+// Runs the clients against the simulated server and prints, for every
+// report interval, the requests the server received in that interval.
+// Renewal storms show up as peaks of renewals one half of the lease
+// time after the clients started.
+int main(int argc, char* argv[]) {
+  base::AtExitManager exit_manager;
+  base::CommandLine::Init(argc, argv);
+  const base::CommandLine* cl = base::CommandLine::ForCurrentProcess();
+  // Lost frames and retransmissions are expected, not errors.
+  logging::SetMinLogLevel(logging::LOG_FATAL);
+
+  Simulation::Parameters parameters;
+  parameters.client_count = 100000;
+  int64_t duration_seconds = 2 * parameters.lease_time;
+  int64_t report_interval_seconds = 60;
+  GetSwitch(cl, switches::kClients, &base::StringToSizeT,
+            &parameters.client_count);
+  GetSwitch(cl, switches::kSeed, &base::StringToUint, &parameters.seed);
+  GetSwitch(cl, switches::kLeaseTime, &base::StringToUint,
+            &parameters.lease_time);
+  GetSwitch(cl, switches::kLatency, &base::StringToInt64,
+            &parameters.latency_ms);
+  GetSwitch(cl, switches::kLossRate, &base::StringToDouble,
+            &parameters.loss_rate);
+  GetSwitch(cl, switches::kStartSpread, &base::StringToInt64,
+            &parameters.start_spread_ms);
+  GetSwitch(cl, switches::kDuration, &base::StringToInt64,
+            &duration_seconds);
+  GetSwitch(cl, switches::kReportInterval, &base::StringToInt64,
+            &report_interval_seconds);
+  parameters.client_rapid_commit = cl->HasSwitch(switches::kRapidCommit) ||
+      cl->HasSwitch(switches::kClientRapidCommit);
+  parameters.server_rapid_commit = cl->HasSwitch(switches::kRapidCommit) ||
+      cl->HasSwitch(switches::kServerRapidCommit);
+  if (report_interval_seconds <= 0) {
+    LOG(FATAL) << "Invalid value for --" << switches::kReportInterval;
+  }
+
+  Simulation simulation(parameters);
+  simulation.Start();
+  printf("time_s,bound,discovers,requests,renewals,acks,naks,frames_lost\n");
+  dhcp_client::SimulatedServer::Stats last_stats;
+  for (int64_t time_s = report_interval_seconds; time_s <= duration_seconds;
+       time_s += report_interval_seconds) {
+    simulation.RunFor(report_interval_seconds * kMillisecondsPerSecond);
+    const dhcp_client::SimulatedServer::Stats& stats =
+        simulation.server()->stats();
+    printf("%" PRId64 ",%zu,%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64
+           ",%" PRIu64 ",%" PRIu64 "\n",
+           time_s,
+           simulation.CountClients(DHCP::State::BOUND),
+           stats.discovers - last_stats.discovers,
+           stats.requests - last_stats.requests,
+           stats.renewals - last_stats.renewals,
+           stats.acks - last_stats.acks,
+           stats.naks - last_stats.naks,
+           simulation.network()->frames_dropped());
+    last_stats = stats;
+  }
+  return 0;
+}
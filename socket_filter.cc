@@ -0,0 +1,126 @@
+//
+// Copyright (C) 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "dhcp_client/socket_filter.h"
+
+#include <net/ethernet.h>
+#include <net/if.h>
+#include <netinet/in.h>
+#include <netinet/ip.h>
+#include <netinet/udp.h>
+
+#include <cstddef>
+#include <cstring>
+
+namespace dhcp_client {
+
+namespace {
+const uint16_t kDHCPClientPort = 68;
+// Offsets in a DHCP message.
+const uint32_t kTransactionIDOffset = 4;
+const uint32_t kClientHardwareAddressOffset = 28;
+// Accept the whole packet.
+const uint32_t kAcceptLength = 0x0fffffff;
+
+// Socket filter for dhcp packet.
+const sock_filter dhcp_bpf_filter[] = {
+  BPF_STMT(BPF_LD + BPF_B + BPF_ABS, 23 - ETH_HLEN),
+  BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K, IPPROTO_UDP, 0, 6),
+  BPF_STMT(BPF_LD + BPF_H + BPF_ABS, 20 - ETH_HLEN),
+  BPF_JUMP(BPF_JMP + BPF_JSET + BPF_K, 0x1fff, 4, 0),
+  BPF_STMT(BPF_LDX + BPF_B + BPF_MSH, 14 - ETH_HLEN),
+  BPF_STMT(BPF_LD + BPF_H + BPF_IND, 16 - ETH_HLEN),
+  BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K, kDHCPClientPort, 0, 1),
+  BPF_STMT(BPF_RET + BPF_K, kAcceptLength),
+  BPF_STMT(BPF_RET + BPF_K, 0),
+};
+const int dhcp_bpf_filter_len =
+    sizeof(dhcp_bpf_filter) / sizeof(dhcp_bpf_filter[0]);
+
+// Appends a check that the accumulator equals |value|, jumping to the
+// drop instruction otherwise. The jump offset is set by PatchDropJumps.
+void AppendCheckEqual(uint32_t value, std::vector<sock_filter>* program) {
+  program->push_back(BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K, value, 0, 0));
+}
+
+// Points the false branch of every check to the last instruction.
+void PatchDropJumps(std::vector<sock_filter>* program) {
+  size_t drop = program->size() - 1;
+  for (size_t i = 0; i < drop; i++) {
+    sock_filter* instruction = &(*program)[i];
+    if (instruction->code == BPF_JMP + BPF_JEQ + BPF_K) {
+      instruction->jf = static_cast<uint8_t>(drop - i - 1);
+    }
+  }
+}
+}  // namespace
+
+void GetDHCPSocketFilter(sock_fprog* program) {
+  memset(program, 0, sizeof(*program));
+  program->filter = const_cast<sock_filter*>(dhcp_bpf_filter);
+  program->len = dhcp_bpf_filter_len;
+}
+
+bool MakeDHCPClientSocketFilter(const shill::ByteString& hardware_address,
+                                uint32_t transaction_id,
+                                std::vector<sock_filter>* program) {
+  if (hardware_address.GetLength() != IFHWADDRLEN) {
+    return false;
+  }
+  const uint8_t* address = hardware_address.GetConstData();
+  uint32_t address_high = static_cast<uint32_t>(address[0]) << 24 |
+                          static_cast<uint32_t>(address[1]) << 16 |
+                          static_cast<uint32_t>(address[2]) << 8 |
+                          static_cast<uint32_t>(address[3]);
+  uint32_t address_low = static_cast<uint32_t>(address[4]) << 8 |
+                         static_cast<uint32_t>(address[5]);
+  // Offsets of the DHCP fields from the end of the IP header.
+  const uint32_t kDHCPOffset = sizeof(struct udphdr);
+
+  program->clear();
+  // UDP.
+  program->push_back(
+      BPF_STMT(BPF_LD + BPF_B + BPF_ABS, offsetof(struct iphdr, protocol)));
+  AppendCheckEqual(IPPROTO_UDP, program);
+  // Not a fragment.
+  program->push_back(
+      BPF_STMT(BPF_LD + BPF_H + BPF_ABS, offsetof(struct iphdr, frag_off)));
+  program->push_back(BPF_JUMP(BPF_JMP + BPF_JSET + BPF_K, 0x1fff, 0, 1));
+  program->push_back(BPF_STMT(BPF_RET + BPF_K, 0));
+  // X = IP header length.
+  program->push_back(BPF_STMT(BPF_LDX + BPF_B + BPF_MSH, 0));
+  // Destination port.
+  program->push_back(
+      BPF_STMT(BPF_LD + BPF_H + BPF_IND, offsetof(struct udphdr, uh_dport)));
+  AppendCheckEqual(kDHCPClientPort, program);
+  // xid.
+  program->push_back(BPF_STMT(BPF_LD + BPF_W + BPF_IND,
+                              kDHCPOffset + kTransactionIDOffset));
+  AppendCheckEqual(transaction_id, program);
+  // chaddr.
+  program->push_back(BPF_STMT(BPF_LD + BPF_W + BPF_IND,
+                              kDHCPOffset + kClientHardwareAddressOffset));
+  AppendCheckEqual(address_high, program);
+  program->push_back(BPF_STMT(BPF_LD + BPF_H + BPF_IND,
+                              kDHCPOffset + kClientHardwareAddressOffset + 4));
+  AppendCheckEqual(address_low, program);
+  program->push_back(BPF_STMT(BPF_RET + BPF_K, kAcceptLength));
+  program->push_back(BPF_STMT(BPF_RET + BPF_K, 0));
+  PatchDropJumps(program);
+  return true;
+}
+
+}  // namespace dhcp_client
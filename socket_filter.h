@@ -0,0 +1,45 @@
+//
+// Copyright (C) 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef DHCP_CLIENT_SOCKET_FILTER_H_
+#define DHCP_CLIENT_SOCKET_FILTER_H_
+
+#include <linux/filter.h>
+
+#include <cstdint>
+#include <vector>
+
+#include <shill/net/byte_string.h>
+
+namespace dhcp_client {
+
+// Fill |program| with the socket filter for DHCP client packet sockets.
+// It accepts unfragmented UDP datagrams to the DHCP client port.
+// The program is static, |program| does not need to be freed.
+void GetDHCPSocketFilter(sock_fprog* program);
+
+// Build the socket filter for the packet socket of a single client.
+// On top of the checks of the generic filter it only accepts replies
+// with |hardware_address| in chaddr and |transaction_id| as xid, so
+// replies for other hosts and stale transactions are dropped in the
+// kernel. Returns false if |hardware_address| is not an Ethernet address.
+bool MakeDHCPClientSocketFilter(const shill::ByteString& hardware_address,
+                                uint32_t transaction_id,
+                                std::vector<sock_filter>* program);
+
+}  // namespace dhcp_client
+
+#endif  // DHCP_CLIENT_SOCKET_FILTER_H_
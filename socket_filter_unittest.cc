@@ -0,0 +1,190 @@
+//
+// Copyright (C) 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "dhcp_client/socket_filter.h"
+
+#include <netinet/in.h>
+#include <netinet/ip.h>
+#include <netinet/udp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include <shill/net/byte_string.h>
+
+using shill::ByteString;
+
+namespace dhcp_client {
+
+namespace {
+const uint8_t kFakeHardwareAddress[] = {0x02, 0x1a, 0x2b, 0x3c, 0x4d, 0x5e};
+const uint8_t kFakeOtherHardwareAddress[] =
+    {0x02, 0x1a, 0x2b, 0x3c, 0x4d, 0x5f};
+const uint32_t kFakeTransactionID = 0x3a1b2c4d;
+const uint32_t kFakeOtherTransactionID = 0x3a1b2c4e;
+const uint16_t kDHCPServerPort = 67;
+const uint16_t kDHCPClientPort = 68;
+// DHCP fixed fields up to the end of chaddr.
+const size_t kDHCPLength = 44;
+
+struct FrameFields {
+  uint8_t protocol;
+  uint16_t fragment_offset;
+  size_t ip_options_length;
+  uint16_t destination_port;
+  uint32_t transaction_id;
+  const uint8_t* hardware_address;
+};
+
+// Builds a frame as read from a SOCK_DGRAM packet socket.
+std::vector<uint8_t> MakeFrame(const FrameFields& fields) {
+  size_t ip_header_length = sizeof(struct iphdr) + fields.ip_options_length;
+  std::vector<uint8_t> frame(
+      ip_header_length + sizeof(struct udphdr) + kDHCPLength, 0);
+  struct iphdr* ip = reinterpret_cast<struct iphdr*>(frame.data());
+  ip->version = IPVERSION;
+  ip->ihl = static_cast<unsigned int>(ip_header_length >> 2);
+  ip->protocol = fields.protocol;
+  ip->frag_off = htons(fields.fragment_offset);
+  struct udphdr* udp =
+      reinterpret_cast<struct udphdr*>(frame.data() + ip_header_length);
+  udp->uh_sport = htons(kDHCPServerPort);
+  udp->uh_dport = htons(fields.destination_port);
+  uint8_t* dhcp = frame.data() + ip_header_length + sizeof(struct udphdr);
+  uint32_t transaction_id = htonl(fields.transaction_id);
+  memcpy(dhcp + 4, &transaction_id, sizeof(transaction_id));
+  memcpy(dhcp + 28, fields.hardware_address, sizeof(kFakeHardwareAddress));
+  return frame;
+}
+}  // namespace
+
+// The filter is attached to one end of a datagram socket pair, whose
+// packets start at offset 0 like those of a SOCK_DGRAM packet socket.
+class SocketFilterTest : public testing::Test {
+ public:
+  SocketFilterTest()
+      : hardware_address_(kFakeHardwareAddress,
+                          sizeof(kFakeHardwareAddress)) {
+    fields_.protocol = IPPROTO_UDP;
+    fields_.fragment_offset = 0;
+    fields_.ip_options_length = 0;
+    fields_.destination_port = kDHCPClientPort;
+    fields_.transaction_id = kFakeTransactionID;
+    fields_.hardware_address = kFakeHardwareAddress;
+  }
+
+  void SetUp() {
+    ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_DGRAM, 0, sockets_));
+  }
+
+  void TearDown() {
+    close(sockets_[0]);
+    close(sockets_[1]);
+  }
+
+ protected:
+  void AttachClientFilter(uint32_t transaction_id) {
+    std::vector<sock_filter> program;
+    ASSERT_TRUE(MakeDHCPClientSocketFilter(hardware_address_,
+                                           transaction_id,
+                                           &program));
+    sock_fprog pf;
+    pf.filter = program.data();
+    pf.len = static_cast<uint16_t>(program.size());
+    ASSERT_EQ(0, setsockopt(sockets_[1], SOL_SOCKET, SO_ATTACH_FILTER,
+                            &pf, sizeof(pf)));
+  }
+
+  // Returns true if a frame built from |fields_| passes the filter.
+  bool IsAccepted() {
+    std::vector<uint8_t> frame = MakeFrame(fields_);
+    EXPECT_EQ(static_cast<ssize_t>(frame.size()),
+              send(sockets_[0], frame.data(), frame.size(), 0));
+    uint8_t buffer[512];
+    ssize_t len = recv(sockets_[1], buffer, sizeof(buffer), MSG_DONTWAIT);
+    if (len < 0) {
+      return false;
+    }
+    EXPECT_EQ(static_cast<ssize_t>(frame.size()), len);
+    return true;
+  }
+
+  ByteString hardware_address_;
+  FrameFields fields_;
+  int sockets_[2];
+};
+
+TEST_F(SocketFilterTest, AcceptsMatchingReply) {
+  AttachClientFilter(kFakeTransactionID);
+  EXPECT_TRUE(IsAccepted());
+}
+
+TEST_F(SocketFilterTest, AcceptsReplyWithIPOptions) {
+  AttachClientFilter(kFakeTransactionID);
+  fields_.ip_options_length = 8;
+  EXPECT_TRUE(IsAccepted());
+}
+
+TEST_F(SocketFilterTest, DropsForeignTransaction) {
+  AttachClientFilter(kFakeTransactionID);
+  fields_.transaction_id = kFakeOtherTransactionID;
+  EXPECT_FALSE(IsAccepted());
+}
+
+TEST_F(SocketFilterTest, DropsForeignHardwareAddress) {
+  AttachClientFilter(kFakeTransactionID);
+  fields_.hardware_address = kFakeOtherHardwareAddress;
+  EXPECT_FALSE(IsAccepted());
+}
+
+TEST_F(SocketFilterTest, DropsOtherPort) {
+  AttachClientFilter(kFakeTransactionID);
+  fields_.destination_port = kDHCPServerPort;
+  EXPECT_FALSE(IsAccepted());
+}
+
+TEST_F(SocketFilterTest, DropsFragment) {
+  AttachClientFilter(kFakeTransactionID);
+  fields_.fragment_offset = 1;
+  EXPECT_FALSE(IsAccepted());
+}
+
+TEST_F(SocketFilterTest, DropsNonUDP) {
+  AttachClientFilter(kFakeTransactionID);
+  fields_.protocol = IPPROTO_TCP;
+  EXPECT_FALSE(IsAccepted());
+}
+
+TEST_F(SocketFilterTest, ReattachForNewTransaction) {
+  AttachClientFilter(kFakeTransactionID);
+  EXPECT_TRUE(IsAccepted());
+  AttachClientFilter(kFakeOtherTransactionID);
+  EXPECT_FALSE(IsAccepted());
+  fields_.transaction_id = kFakeOtherTransactionID;
+  EXPECT_TRUE(IsAccepted());
+}
+
+TEST_F(SocketFilterTest, RejectsInvalidHardwareAddress) {
+  std::vector<sock_filter> program;
+  EXPECT_FALSE(MakeDHCPClientSocketFilter(ByteString(kFakeHardwareAddress, 4),
+                                          kFakeTransactionID,
+                                          &program));
+}
+
+}  // namespace dhcp_client
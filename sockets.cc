@@ -0,0 +1,63 @@
+//
+// Copyright (C) 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+
+#include "dhcp_client/sockets.h"
+
+#include <sys/mman.h>
+
+namespace dhcp_client {
+
+Sockets::Sockets() {}
+
+Sockets::~Sockets() {}
+
+int Sockets::SetSockOpt(int sockfd,
+                        int level,
+                        int optname,
+                        const void* optval,
+                        socklen_t optlen) const {
+  return setsockopt(sockfd, level, optname, optval, optlen);
+}
+
+int Sockets::RecvMmsg(int sockfd,
+                      struct mmsghdr* msgvec,
+                      unsigned int vlen,
+                      int flags) const {
+  return recvmmsg(sockfd, msgvec, vlen, flags, nullptr);
+}
+
+int Sockets::SendMmsg(int sockfd,
+                      struct mmsghdr* msgvec,
+                      unsigned int vlen,
+                      int flags) const {
+  return sendmmsg(sockfd, msgvec, vlen, flags);
+}
+
+void* Sockets::Mmap(void* addr,
+                    size_t length,
+                    int prot,
+                    int flags,
+                    int fd,
+                    off_t offset) const {
+  return mmap(addr, length, prot, flags, fd, offset);
+}
+
+int Sockets::Munmap(void* addr, size_t length) const {
+  return munmap(addr, length);
+}
+
+}  // namespace dhcp_client
@@ -0,0 +1,69 @@
+//
+// Copyright (C) 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+
+#ifndef DHCP_CLIENT_SOCKETS_H_
+#define DHCP_CLIENT_SOCKETS_H_
+
+#include <sys/socket.h>
+#include <sys/types.h>
+
+#include <cstddef>
+
+#include <base/macros.h>
+#include <shill/net/sockets.h>
+
+namespace dhcp_client {
+
+// shill::Sockets with the batched I/O, socket option and mapping calls
+// used by the receive and send paths, so that they can be mocked as well.
+class Sockets : public shill::Sockets {
+ public:
+  Sockets();
+  ~Sockets() override;
+
+  // setsockopt
+  virtual int SetSockOpt(int sockfd,
+                         int level,
+                         int optname,
+                         const void* optval,
+                         socklen_t optlen) const;
+  // recvmmsg, without a timeout.
+  virtual int RecvMmsg(int sockfd,
+                       struct mmsghdr* msgvec,
+                       unsigned int vlen,
+                       int flags) const;
+  // sendmmsg
+  virtual int SendMmsg(int sockfd,
+                       struct mmsghdr* msgvec,
+                       unsigned int vlen,
+                       int flags) const;
+  // mmap and munmap, for the receive ring of a packet socket.
+  virtual void* Mmap(void* addr,
+                     size_t length,
+                     int prot,
+                     int flags,
+                     int fd,
+                     off_t offset) const;
+  virtual int Munmap(void* addr, size_t length) const;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(Sockets);
+};
+
+}  // namespace dhcp_client
+
+#endif  // DHCP_CLIENT_SOCKETS_H_
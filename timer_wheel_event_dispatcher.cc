@@ -0,0 +1,320 @@
+//
+// Copyright (C) 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "dhcp_client/timer_wheel_event_dispatcher.h"
+
+#include <algorithm>
+#include <utility>
+
+#include <base/bind.h>
+#include <base/logging.h>
+
+namespace dhcp_client {
+
+namespace {
+const int64_t kMicrosecondsPerTick =
+    TimerWheelEventDispatcher::kTickMilliseconds * 1000;
+}  // namespace
+
+const int64_t TimerWheelEventDispatcher::kTickMilliseconds;
+const int TimerWheelEventDispatcher::kLevelBits;
+const int TimerWheelEventDispatcher::kLevels;
+const size_t TimerWheelEventDispatcher::kSlotsPerLevel;
+const size_t TimerWheelEventDispatcher::kExpiredList;
+const int32_t TimerWheelEventDispatcher::kNoTimer;
+
+TimerWheelEventDispatcher::TimerWheelEventDispatcher(
+    std::unique_ptr<EventDispatcherInterface> dispatcher,
+    std::unique_ptr<base::TickClock> clock)
+    : dispatcher_(std::move(dispatcher)),
+      clock_(std::move(clock)),
+      start_time_(clock_->NowTicks()),
+      // Tick 0 is now, it is already over.
+      next_tick_(1),
+      wakeup_tick_(0),
+      free_timers_(kNoTimer),
+      timer_count_(0),
+      slots_(kExpiredList + 1, kNoTimer),
+      weak_ptr_factory_(this) {
+}
+
+TimerWheelEventDispatcher::~TimerWheelEventDispatcher() {}
+
+bool TimerWheelEventDispatcher::PostTask(const base::Closure& task) {
+  return dispatcher_->PostTask(task);
+}
+
+bool TimerWheelEventDispatcher::PostDelayedTask(const base::Closure& task,
+                                                int64_t delay_ms) {
+  return PostCancelableDelayedTask(task, delay_ms) != kInvalidTimerHandle;
+}
+
+TimerHandle TimerWheelEventDispatcher::PostCancelableDelayedTask(
+    const base::Closure& task, int64_t delay_ms) {
+  if (timer_count_ == 0) {
+    // No wakeup walked the wheel while it was idle, skip the idle ticks
+    // so the timer is filed relative to now.
+    next_tick_ = std::max(next_tick_, GetCurrentTick() + 1);
+  }
+  int64_t expiry_us = (clock_->NowTicks() - start_time_).InMicroseconds() +
+      std::max<int64_t>(delay_ms, 0) * 1000;
+  int32_t index = AllocateTimer();
+  Timer* timer = &timers_[index];
+  timer->task = task;
+  // Round up, the task must not run before its delay has elapsed.
+  timer->expiry_tick = static_cast<uint64_t>(
+      (expiry_us + kMicrosecondsPerTick - 1) / kMicrosecondsPerTick);
+  AddTimer(index);
+  // The wheel catches up on the ticks in between when it wakes up, so
+  // the expiry tick is enough here.
+  ScheduleWakeup(timer->expiry_tick);
+  return (static_cast<TimerHandle>(timer->generation) << 32) |
+      static_cast<TimerHandle>(index + 1);
+}
+
+bool TimerWheelEventDispatcher::CancelDelayedTask(TimerHandle handle) {
+  int32_t index = LookUpTimer(handle);
+  if (index == kNoTimer) {
+    return false;
+  }
+  // A wakeup may be left posted for this timer, it will find nothing
+  // to run.
+  UnlinkTimer(index);
+  FreeTimer(index);
+  return true;
+}
+
+base::Time TimerWheelEventDispatcher::Now() {
+  return dispatcher_->Now();
+}
+
+void TimerWheelEventDispatcher::ProcessTimers() {
+  // A task may destroy this object.
+  base::WeakPtr<TimerWheelEventDispatcher> self =
+      weak_ptr_factory_.GetWeakPtr();
+  uint64_t current_tick = GetCurrentTick();
+  while (next_tick_ <= current_tick) {
+    if (timer_count_ == 0) {
+      // Nothing to run or cascade, skip the idle ticks.
+      next_tick_ = current_tick + 1;
+      break;
+    }
+    ProcessTick();
+    if (!self) {
+      return;
+    }
+  }
+  if (wakeup_tick_ < next_tick_) {
+    // The posted wakeup is of no use for the remaining timers.
+    wakeup_tick_ = 0;
+  }
+  ScheduleWakeup(GetNextWakeupTick());
+}
+
+uint64_t TimerWheelEventDispatcher::GetCurrentTick() const {
+  return static_cast<uint64_t>(
+      (clock_->NowTicks() - start_time_).InMicroseconds() /
+      kMicrosecondsPerTick);
+}
+
+int32_t TimerWheelEventDispatcher::AllocateTimer() {
+  int32_t index = free_timers_;
+  if (index == kNoTimer) {
+    index = static_cast<int32_t>(timers_.size());
+    timers_.push_back(Timer());
+    timers_[index].generation = 0;
+  } else {
+    free_timers_ = timers_[index].next;
+  }
+  timers_[index].previous = kNoTimer;
+  timers_[index].next = kNoTimer;
+  timers_[index].slot = kNoTimer;
+  timer_count_++;
+  return index;
+}
+
+void TimerWheelEventDispatcher::FreeTimer(int32_t index) {
+  Timer* timer = &timers_[index];
+  timer->task.Reset();
+  // Invalidate the outstanding handle.
+  timer->generation++;
+  timer->slot = kNoTimer;
+  timer->next = free_timers_;
+  free_timers_ = index;
+  timer_count_--;
+}
+
+int32_t TimerWheelEventDispatcher::LookUpTimer(TimerHandle handle) const {
+  uint64_t position = handle & 0xffffffff;
+  if (position == 0 || position > timers_.size()) {
+    return kNoTimer;
+  }
+  int32_t index = static_cast<int32_t>(position - 1);
+  const Timer& timer = timers_[index];
+  if (timer.slot == kNoTimer ||
+      timer.generation != static_cast<uint32_t>(handle >> 32)) {
+    return kNoTimer;
+  }
+  return index;
+}
+
+void TimerWheelEventDispatcher::LinkTimer(int32_t index, size_t slot) {
+  Timer* timer = &timers_[index];
+  timer->slot = static_cast<int32_t>(slot);
+  timer->previous = kNoTimer;
+  timer->next = slots_[slot];
+  if (timer->next != kNoTimer) {
+    timers_[timer->next].previous = index;
+  }
+  slots_[slot] = index;
+}
+
+void TimerWheelEventDispatcher::UnlinkTimer(int32_t index) {
+  Timer* timer = &timers_[index];
+  if (timer->previous != kNoTimer) {
+    timers_[timer->previous].next = timer->next;
+  } else {
+    slots_[timer->slot] = timer->next;
+  }
+  if (timer->next != kNoTimer) {
+    timers_[timer->next].previous = timer->previous;
+  }
+  timer->previous = kNoTimer;
+  timer->next = kNoTimer;
+}
+
+void TimerWheelEventDispatcher::AddTimer(int32_t index) {
+  Timer* timer = &timers_[index];
+  if (timer->expiry_tick < next_tick_) {
+    timer->expiry_tick = next_tick_;
+  }
+  uint64_t delta = timer->expiry_tick - next_tick_;
+  for (int level = 0; level < kLevels; level++) {
+    int shift = level * kLevelBits;
+    if (delta < (UINT64_C(1) << (shift + kLevelBits))) {
+      size_t slot = (timer->expiry_tick >> shift) & (kSlotsPerLevel - 1);
+      LinkTimer(index, level * kSlotsPerLevel + slot);
+      return;
+    }
+  }
+  // Beyond the range of the wheel, park the timer in the farthest slot.
+  // It is filed again with its real expiry once that slot is reached.
+  int shift = (kLevels - 1) * kLevelBits;
+  uint64_t parked_tick =
+      next_tick_ + (UINT64_C(1) << (shift + kLevelBits)) - 1;
+  size_t slot = (parked_tick >> shift) & (kSlotsPerLevel - 1);
+  LinkTimer(index, (kLevels - 1) * kSlotsPerLevel + slot);
+}
+
+size_t TimerWheelEventDispatcher::Cascade(int level) {
+  size_t index = (next_tick_ >> (level * kLevelBits)) & (kSlotsPerLevel - 1);
+  size_t slot = level * kSlotsPerLevel + index;
+  int32_t timer = slots_[slot];
+  slots_[slot] = kNoTimer;
+  while (timer != kNoTimer) {
+    int32_t next = timers_[timer].next;
+    AddTimer(timer);
+    timer = next;
+  }
+  return index;
+}
+
+void TimerWheelEventDispatcher::ProcessTick() {
+  size_t index = next_tick_ & (kSlotsPerLevel - 1);
+  if (index == 0) {
+    // Level 0 wrapped around, bring down the timers of the next slot of
+    // each upper level that wrapped around as well.
+    for (int level = 1; level < kLevels; level++) {
+      if (Cascade(level) != 0) {
+        break;
+      }
+    }
+  }
+  next_tick_++;
+
+  // Move the expired timers aside, the tasks may add or cancel timers.
+  int32_t timer = slots_[index];
+  slots_[index] = kNoTimer;
+  while (timer != kNoTimer) {
+    int32_t next = timers_[timer].next;
+    LinkTimer(timer, kExpiredList);
+    timer = next;
+  }
+
+  base::WeakPtr<TimerWheelEventDispatcher> self =
+      weak_ptr_factory_.GetWeakPtr();
+  while (slots_[kExpiredList] != kNoTimer) {
+    int32_t expired = slots_[kExpiredList];
+    base::Closure task = timers_[expired].task;
+    UnlinkTimer(expired);
+    FreeTimer(expired);
+    task.Run();
+    if (!self) {
+      return;
+    }
+  }
+}
+
+uint64_t TimerWheelEventDispatcher::GetNextWakeupTick() const {
+  if (timer_count_ == 0) {
+    return 0;
+  }
+  uint64_t wakeup_tick = 0;
+  // Level 0 slots are exact.
+  for (size_t i = 0; i < kSlotsPerLevel; i++) {
+    uint64_t tick = next_tick_ + i;
+    if (slots_[tick & (kSlotsPerLevel - 1)] != kNoTimer) {
+      wakeup_tick = tick;
+      break;
+    }
+  }
+  // The slots of upper levels need a wakeup when they are cascaded.
+  for (int level = 1; level < kLevels; level++) {
+    int shift = level * kLevelBits;
+    uint64_t period = UINT64_C(1) << shift;
+    uint64_t first = (next_tick_ + period - 1) >> shift;
+    for (size_t i = 0; i < kSlotsPerLevel; i++) {
+      size_t slot = (first + i) & (kSlotsPerLevel - 1);
+      if (slots_[level * kSlotsPerLevel + slot] != kNoTimer) {
+        uint64_t tick = (first + i) << shift;
+        if (wakeup_tick == 0 || tick < wakeup_tick) {
+          wakeup_tick = tick;
+        }
+        break;
+      }
+    }
+  }
+  return wakeup_tick;
+}
+
+void TimerWheelEventDispatcher::ScheduleWakeup(uint64_t tick) {
+  if (tick == 0 || (wakeup_tick_ != 0 && wakeup_tick_ <= tick)) {
+    return;
+  }
+  int64_t delay_us = static_cast<int64_t>(tick) * kMicrosecondsPerTick -
+      (clock_->NowTicks() - start_time_).InMicroseconds();
+  int64_t delay_ms = std::max<int64_t>((delay_us + 999) / 1000, 0);
+  if (!dispatcher_->PostDelayedTask(
+          base::Bind(&TimerWheelEventDispatcher::ProcessTimers,
+                     weak_ptr_factory_.GetWeakPtr()),
+          delay_ms)) {
+    LOG(ERROR) << "Failed to schedule timer wakeup";
+    return;
+  }
+  wakeup_tick_ = tick;
+}
+
+}  // namespace dhcp_client
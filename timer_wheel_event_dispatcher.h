@@ -0,0 +1,134 @@
+//
+// Copyright (C) 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef DHCP_CLIENT_TIMER_WHEEL_EVENT_DISPATCHER_H_
+#define DHCP_CLIENT_TIMER_WHEEL_EVENT_DISPATCHER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include <base/callback.h>
+#include <base/macros.h>
+#include <base/memory/weak_ptr.h>
+#include <base/time/tick_clock.h>
+#include <base/time/time.h>
+
+#include "dhcp_client/event_dispatcher_interface.h"
+
+namespace dhcp_client {
+
+// Keeps delayed tasks in a hierarchical timer wheel instead of posting
+// each of them to the underlying dispatcher. Adding and cancelling a
+// timer are O(1), and timers expiring within the same tick run together
+// from a single wakeup of the underlying dispatcher.
+//
+// The wheel has 4 levels of 64 slots. Level 0 holds the timers expiring
+// within the next 64 ticks, and each level above covers 64 times the
+// range of the level below. Timers in an upper level are moved down when
+// the lower level wraps around. Timers beyond the range of the wheel,
+// about 46 hours, are parked in the last slot and re-filed when reached.
+class TimerWheelEventDispatcher : public EventDispatcherInterface {
+ public:
+  // Resolution of the wheel, timers never run early but may run up to
+  // one tick late.
+  static const int64_t kTickMilliseconds = 10;
+
+  // Immediate tasks and wakeups of the wheel go to |dispatcher|.
+  TimerWheelEventDispatcher(
+      std::unique_ptr<EventDispatcherInterface> dispatcher,
+      std::unique_ptr<base::TickClock> clock);
+  ~TimerWheelEventDispatcher() override;
+
+  bool PostTask(const base::Closure& task) override;
+  bool PostDelayedTask(const base::Closure& task,
+                       int64_t delay_ms) override;
+  TimerHandle PostCancelableDelayedTask(const base::Closure& task,
+                                        int64_t delay_ms) override;
+  bool CancelDelayedTask(TimerHandle handle) override;
+  base::Time Now() override;
+
+  // Run the timers that expired, according to the clock. Called when
+  // the wakeup posted to the underlying dispatcher runs.
+  void ProcessTimers();
+
+  size_t timer_count() const { return timer_count_; }
+
+ private:
+  friend class TimerWheelEventDispatcherTest;
+
+  static const int kLevelBits = 6;
+  static const int kLevels = 4;
+  static const size_t kSlotsPerLevel = 1 << kLevelBits;
+  // Slots of all levels, followed by the list of expired timers.
+  static const size_t kExpiredList = kLevels * kSlotsPerLevel;
+  static const int32_t kNoTimer = -1;
+
+  // Timers are kept in a pool and linked by index, the handle of a
+  // timer is its index plus a generation count bumped on reuse.
+  struct Timer {
+    base::Closure task;
+    uint64_t expiry_tick;
+    uint32_t generation;
+    int32_t previous;
+    int32_t next;
+    // Slot the timer is linked in, kNoTimer when free.
+    int32_t slot;
+  };
+
+  uint64_t GetCurrentTick() const;
+  int32_t AllocateTimer();
+  void FreeTimer(int32_t index);
+  int32_t LookUpTimer(TimerHandle handle) const;
+  void LinkTimer(int32_t index, size_t slot);
+  void UnlinkTimer(int32_t index);
+  // File the timer in the slot matching its expiry.
+  void AddTimer(int32_t index);
+  // Re-file the timers of the current slot of |level|. Returns the slot
+  // index.
+  size_t Cascade(int level);
+  // Advance the wheel by one tick, running the timers that expire.
+  void ProcessTick();
+  // First tick at which the wheel has work to do, or 0 if it is empty.
+  // This is the earliest expiry or cascade, so that the catch up after
+  // a wakeup stays short. O(number of slots).
+  uint64_t GetNextWakeupTick() const;
+  // Make sure the underlying dispatcher wakes us up by |tick|.
+  void ScheduleWakeup(uint64_t tick);
+
+  std::unique_ptr<EventDispatcherInterface> dispatcher_;
+  std::unique_ptr<base::TickClock> clock_;
+  base::TimeTicks start_time_;
+  // Next tick to process.
+  uint64_t next_tick_;
+  // Tick of the earliest wakeup posted to |dispatcher_|, 0 if none.
+  uint64_t wakeup_tick_;
+
+  std::vector<Timer> timers_;
+  int32_t free_timers_;
+  size_t timer_count_;
+  // Head of the timer list of every slot.
+  std::vector<int32_t> slots_;
+
+  base::WeakPtrFactory<TimerWheelEventDispatcher> weak_ptr_factory_;
+
+  DISALLOW_COPY_AND_ASSIGN(TimerWheelEventDispatcher);
+};
+
+}  // namespace dhcp_client
+
+#endif  // DHCP_CLIENT_TIMER_WHEEL_EVENT_DISPATCHER_H_
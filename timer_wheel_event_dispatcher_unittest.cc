@@ -0,0 +1,250 @@
+//
+// Copyright (C) 2015 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "dhcp_client/timer_wheel_event_dispatcher.h"
+
+#include <memory>
+#include <random>
+#include <vector>
+
+#include <base/bind.h>
+#include <base/test/simple_test_tick_clock.h>
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include "dhcp_client/mock_event_dispatcher.h"
+
+using base::Bind;
+using base::TimeDelta;
+using base::TimeTicks;
+using base::Unretained;
+using ::testing::_;
+using ::testing::AllOf;
+using ::testing::Gt;
+using ::testing::Le;
+using ::testing::Mock;
+using ::testing::NiceMock;
+using ::testing::Return;
+
+namespace dhcp_client {
+
+namespace {
+const int64_t kOneHourMs = 3600 * 1000;
+}  // namespace
+
+class TimerWheelEventDispatcherTest : public testing::Test {
+ public:
+  TimerWheelEventDispatcherTest()
+      : backing_dispatcher_(new NiceMock<MockEventDispatcher>()),
+        clock_(new base::SimpleTestTickClock()) {
+    AcceptWakeups();
+    // Do not start at the null time.
+    clock_->Advance(TimeDelta::FromSeconds(1));
+    dispatcher_.reset(new TimerWheelEventDispatcher(
+        std::unique_ptr<EventDispatcherInterface>(backing_dispatcher_),
+        std::unique_ptr<base::TickClock>(clock_)));
+  }
+
+  // Records when the task with |id| ran.
+  void OnTimer(size_t id) {
+    run_times_[id] = clock_->NowTicks();
+    run_order_.push_back(id);
+  }
+
+  void CancelTimer(const TimerHandle* handle) {
+    dispatcher_->CancelDelayedTask(*handle);
+  }
+
+ protected:
+  TimerHandle PostTimer(size_t id, int64_t delay_ms) {
+    if (run_times_.size() <= id) {
+      run_times_.resize(id + 1);
+    }
+    return dispatcher_->PostCancelableDelayedTask(
+        Bind(&TimerWheelEventDispatcherTest::OnTimer, Unretained(this), id),
+        delay_ms);
+  }
+
+  // The wakeups are posted, never run: the tests process the timers.
+  void AcceptWakeups() {
+    ON_CALL(*backing_dispatcher_, PostDelayedTask(_, _))
+        .WillByDefault(Return(true));
+  }
+
+  uint64_t next_tick() const { return dispatcher_->next_tick_; }
+
+  void AdvanceMs(int64_t delay_ms) {
+    clock_->Advance(TimeDelta::FromMilliseconds(delay_ms));
+    dispatcher_->ProcessTimers();
+  }
+
+  MockEventDispatcher* backing_dispatcher_;  // Owned by |dispatcher_|.
+  base::SimpleTestTickClock* clock_;  // Owned by |dispatcher_|.
+  std::unique_ptr<TimerWheelEventDispatcher> dispatcher_;
+  std::vector<TimeTicks> run_times_;
+  std::vector<size_t> run_order_;
+};
+
+TEST_F(TimerWheelEventDispatcherTest, RunsWhenDue) {
+  PostTimer(0, 25);
+  AdvanceMs(20);
+  EXPECT_TRUE(run_order_.empty());
+  AdvanceMs(10);
+  ASSERT_EQ(1u, run_order_.size());
+  EXPECT_EQ(0u, dispatcher_->timer_count());
+}
+
+TEST_F(TimerWheelEventDispatcherTest, NeverRunsEarly) {
+  TimeTicks start = clock_->NowTicks();
+  PostTimer(0, 1);
+  PostTimer(1, 10);
+  PostTimer(2, 11);
+  for (int i = 0; i < 7; i++) {
+    AdvanceMs(3);
+  }
+  ASSERT_EQ(3u, run_order_.size());
+  EXPECT_GE((run_times_[0] - start).InMilliseconds(), 1);
+  EXPECT_GE((run_times_[1] - start).InMilliseconds(), 10);
+  EXPECT_GE((run_times_[2] - start).InMilliseconds(), 11);
+}
+
+TEST_F(TimerWheelEventDispatcherTest, CoalescesTimersOfOneTick) {
+  // The wheel asks for a single wakeup for the first tick.
+  EXPECT_CALL(*backing_dispatcher_, PostDelayedTask(_, 40))
+      .WillOnce(Return(true));
+  PostTimer(0, 31);
+  PostTimer(1, 35);
+  PostTimer(2, 40);
+  PostTimer(3, 41);
+  Mock::VerifyAndClearExpectations(backing_dispatcher_);
+  AcceptWakeups();
+  AdvanceMs(40);
+  EXPECT_EQ(3u, run_order_.size());
+}
+
+TEST_F(TimerWheelEventDispatcherTest, Cancel) {
+  TimerHandle handle = PostTimer(0, 100);
+  PostTimer(1, 100);
+  EXPECT_NE(kInvalidTimerHandle, handle);
+  EXPECT_TRUE(dispatcher_->CancelDelayedTask(handle));
+  EXPECT_FALSE(dispatcher_->CancelDelayedTask(handle));
+  EXPECT_EQ(1u, dispatcher_->timer_count());
+  AdvanceMs(100);
+  ASSERT_EQ(1u, run_order_.size());
+  EXPECT_EQ(1u, run_order_[0]);
+}
+
+TEST_F(TimerWheelEventDispatcherTest, CancelAfterRun) {
+  TimerHandle handle = PostTimer(0, 10);
+  AdvanceMs(10);
+  EXPECT_FALSE(dispatcher_->CancelDelayedTask(handle));
+  // The slot is reused with a different handle.
+  TimerHandle other_handle = PostTimer(1, 10);
+  EXPECT_NE(handle, other_handle);
+  EXPECT_FALSE(dispatcher_->CancelDelayedTask(handle));
+  EXPECT_TRUE(dispatcher_->CancelDelayedTask(other_handle));
+}
+
+TEST_F(TimerWheelEventDispatcherTest, TaskCancelsTimerOfSameTick) {
+  TimerHandle handle = kInvalidTimerHandle;
+  dispatcher_->PostDelayedTask(
+      Bind(&TimerWheelEventDispatcherTest::CancelTimer,
+           Unretained(this),
+           &handle),
+      10);
+  handle = PostTimer(0, 10);
+  AdvanceMs(10);
+  EXPECT_EQ(0u, dispatcher_->timer_count());
+  // Only one of the two ran, depending on the order within the tick.
+  EXPECT_LE(run_order_.size(), 1u);
+}
+
+TEST_F(TimerWheelEventDispatcherTest, LongTimers) {
+  // Beyond the range of the wheel.
+  PostTimer(0, 72 * kOneHourMs);
+  PostTimer(1, 12 * kOneHourMs);
+  PostTimer(2, 2 * kOneHourMs);
+  AdvanceMs(2 * kOneHourMs - 1);
+  EXPECT_TRUE(run_order_.empty());
+  AdvanceMs(1);
+  AdvanceMs(12 * kOneHourMs);
+  AdvanceMs(72 * kOneHourMs - 14 * kOneHourMs - 1);
+  EXPECT_EQ((std::vector<size_t>{2, 1}), run_order_);
+  AdvanceMs(1);
+  EXPECT_EQ((std::vector<size_t>{2, 1, 0}), run_order_);
+}
+
+TEST_F(TimerWheelEventDispatcherTest, RandomTimers) {
+  const size_t kTimers = 5000;
+  const int64_t kStepMs = 1000;
+  std::default_random_engine engine(1);
+  std::uniform_int_distribution<int64_t> delay_ms(0, 50 * kOneHourMs);
+  TimeTicks start = clock_->NowTicks();
+  std::vector<int64_t> delays;
+  for (size_t i = 0; i < kTimers; i++) {
+    delays.push_back(delay_ms(engine));
+    PostTimer(i, delays.back());
+  }
+  while (dispatcher_->timer_count() != 0) {
+    AdvanceMs(kStepMs);
+  }
+  ASSERT_EQ(kTimers, run_order_.size());
+  for (size_t i = 0; i < kTimers; i++) {
+    int64_t run_ms = (run_times_[i] - start).InMilliseconds();
+    EXPECT_GE(run_ms, delays[i]);
+    // Run on the first call after the deadline.
+    EXPECT_LT(run_ms, delays[i] + kStepMs);
+  }
+}
+
+TEST_F(TimerWheelEventDispatcherTest, SchedulesWakeupAfterProcessing) {
+  EXPECT_CALL(*backing_dispatcher_, PostDelayedTask(_, _))
+      .WillOnce(Return(true));
+  PostTimer(0, 10);
+  PostTimer(1, 5000);
+  Mock::VerifyAndClearExpectations(backing_dispatcher_);
+  // The next wakeup is at most at the next cascade of the wheel.
+  EXPECT_CALL(*backing_dispatcher_,
+              PostDelayedTask(_, AllOf(Gt(0), Le(4990))))
+      .WillOnce(Return(true));
+  AdvanceMs(10);
+  ASSERT_EQ(1u, run_order_.size());
+}
+
+TEST_F(TimerWheelEventDispatcherTest, RunsOnTimeAfterIdling) {
+  PostTimer(0, 10);
+  AdvanceMs(10);
+  ASSERT_EQ(1u, run_order_.size());
+  // Idle for several rotations of the upper levels, with no wakeup.
+  const int64_t kIdleMs = 10 * kOneHourMs;
+  clock_->Advance(TimeDelta::FromMilliseconds(kIdleMs));
+  // The tick after the current one.
+  uint64_t next = 1 + (10 + kIdleMs) /
+      TimerWheelEventDispatcher::kTickMilliseconds;
+  EXPECT_CALL(*backing_dispatcher_, PostDelayedTask(_, 10))
+      .WillOnce(Return(true));
+  TimeTicks start = clock_->NowTicks();
+  PostTimer(1, 10);
+  Mock::VerifyAndClearExpectations(backing_dispatcher_);
+  // The idle ticks are skipped rather than walked on the next wakeup.
+  EXPECT_EQ(next, next_tick());
+  AdvanceMs(10);
+  ASSERT_EQ(2u, run_order_.size());
+  EXPECT_EQ(10, (run_times_[1] - start).InMilliseconds());
+  EXPECT_EQ(next + 1, next_tick());
+}
+
+}  // namespace dhcp_client